@@ -1,6 +1,7 @@
 #include "Block.h"
 
 CREATE_NODE(Block, BlockData_t) {
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     Block* node = malloc(sizeof(Block));
 
     if (!node) { return NULL; }
@@ -23,6 +24,7 @@ DESTROY_NODE(Block) {
 }
 
 CREATE_LIST(Block) {
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     ListBlock* list = calloc(1, sizeof(ListBlock));
 
     if (!list) { return NULL; }
@@ -34,6 +36,7 @@ DESTROY_LIST(Block) {
     assert(list && *list);
 
     Block* node = (*list)->nodes;
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, (*list)->len);
     while(node) {
         Block* nextNode = node->next;
         
@@ -74,6 +77,7 @@ INSERT_NODES(Block) {
         lastNode = lastNode->next;
         ++count;
     }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count - 1);
 
     if (node->prev) {
         lastNode->next = node->prev->next;
@@ -4,13 +4,33 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "List.h"
+#include "Counters.h"
 #include "Fragment.h"
 
+struct Block_tag;
+
+/**
+ * A past state of a block kept for snapshots: the block had it in versions [validFrom, validTo).
+ * It is never changed, older states follow it.
+ */
+typedef struct BlockState_tag {
+    size_t validFrom;
+    size_t validTo;
+    size_t len;
+    ListFragment* fragments;
+    struct Block_tag* next;
+    struct BlockState_tag* older;
+} BlockState;
+
 typedef struct BlockData_tag {
     size_t len;                 // a length of a string that a block covers
     ListFragment* fragments;    // pointer to fragments of a string
+    size_t version;             // version of the document after the last change of the block
+    _Atomic size_t stateVersion;        // version of the document since the current state (len, fragments, next)
+    BlockState* _Atomic past;           // past states seen by snapshots, the newest first
 } BlockData_t;
 
 // template for list of blocks
@@ -0,0 +1,26 @@
+#include "Clock.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    uint64_t GetMonotonicTime() {
+        static LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+
+        if (!frequency.QuadPart) { QueryPerformanceFrequency(&frequency); }
+        QueryPerformanceCounter(&counter);
+
+        // split to avoid overflow of counter * NS_PER_SEC
+        return (uint64_t)(counter.QuadPart / frequency.QuadPart) * NS_PER_SEC
+            + (uint64_t)(counter.QuadPart % frequency.QuadPart) * NS_PER_SEC / frequency.QuadPart;
+    }
+#else
+    #include <time.h>
+
+    uint64_t GetMonotonicTime() {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+    }
+#endif
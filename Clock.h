@@ -0,0 +1,20 @@
+#pragma once
+#ifndef CLOCK_H_INCLUDED
+#define CLOCK_H_INCLUDED
+
+#include <stdint.h>
+
+// nanoseconds in one microsecond
+#define NS_PER_US 1000ULL
+// nanoseconds in one second
+#define NS_PER_SEC 1000000000ULL
+
+/**
+ * Gets the current value of a monotonic clock.
+ *
+ * OUT:
+ * @return time - nanoseconds since an unspecified starting point
+ */
+uint64_t GetMonotonicTime();
+
+#endif // CLOCK_H_INCLUDED
@@ -0,0 +1,258 @@
+#include "ColumnSelection.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define COLUMN_SPACES 64    // spaces of a padding appended to the text at once
+
+void InitColumnSelection(ColumnSelection* selection, CaretsChanged onChange, void* context) {
+    assert(selection);
+
+    selection->isSelected = 0;
+    selection->anchor = (ModelPos) { NULL, { 0, 0 } };
+    selection->active = selection->anchor;
+    selection->onChange = onChange;
+    selection->context = context;
+}
+
+void BeginColumnSelection(ColumnSelection* selection, ModelPos pos) {
+    assert(selection && pos.block);
+
+    selection->isSelected = 1;
+    selection->anchor = pos;
+    selection->active = pos;
+}
+
+void ClearColumnSelection(ColumnSelection* selection) {
+    assert(selection);
+
+    selection->isSelected = 0;
+}
+
+void GetColumnRect(const ColumnSelection* selection, ColumnRect* rect) {
+    assert(selection && selection->isSelected && rect);
+
+    const ModelPos* top = &(selection->anchor);
+    const ModelPos* bottom = &(selection->active);
+
+    if (top->pos.y > bottom->pos.y) {
+        top = &(selection->active);
+        bottom = &(selection->anchor);
+    }
+
+    rect->block = top->block;
+    rect->y = top->pos.y;
+    rect->lines = bottom->pos.y - top->pos.y + 1;
+    rect->left = MIN(top->pos.x, bottom->pos.x);
+    rect->right = MAX(top->pos.x, bottom->pos.x);
+}
+
+// the selection becomes a column caret
+static void Collapse(ColumnSelection* selection, size_t x) {
+    selection->anchor.pos.x = x;
+    selection->active.pos.x = x;
+}
+
+static void NotifyChars(const ColumnSelection* selection, const Block* block, size_t y, size_t x,
+                        const char* chars, size_t len, size_t oldLen) {
+    if (!selection->onChange) { return; }
+
+    CaretsChange change = { CARETS_CHANGE_CHARS, y, x, chars, len, oldLen, block->data.len, 0 };
+
+    selection->onChange(selection->context, &change);
+}
+
+int CopyColumns(const Document* doc, const ColumnSelection* selection, const char* lineEnd, String* out) {
+    assert(doc && selection && selection->isSelected && lineEnd && out);
+    TRACE_SCOPE("CopyColumns");
+
+    ColumnRect rect;
+    Block* block;
+    size_t count = 0;
+
+    GetColumnRect(selection, &rect);
+    block = rect.block;
+
+    for (size_t i = 0; i < rect.lines; ++i, block = block->next) {
+        if (i && AddString(out, lineEnd) < 0) { return ERR_NOMEM; }
+
+        // a block ending before the rectangle has no chars in it
+        if (block->data.len <= rect.left) { continue; }
+
+        size_t right = MIN(rect.right, block->data.len);
+        size_t x = 0;
+
+        for (Fragment* fragment = block->data.fragments->nodes; x < right; fragment = fragment->next, ++count) {
+            size_t start = MAX(x, rect.left);
+            size_t end = MIN(x + fragment->data.len, right);
+
+            if (start < end && AddChars(out, doc->text->data + fragment->data.pos + start - x, end - start) < 0) {
+                return ERR_NOMEM;
+            }
+            x += fragment->data.len;
+        }
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, rect.lines);
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, count);
+
+    return ERR_SUCCESS;
+}
+
+// appends spaces to the text of a document
+static int AddSpaces(Document* doc, size_t count) {
+    char spaces[COLUMN_SPACES];
+
+    memset(spaces, ' ', sizeof(spaces));
+    while (count) {
+        size_t len = MIN(count, COLUMN_SPACES);
+
+        if (DocAddText(doc, spaces, len)) { return ERR_NOMEM; }
+        count -= len;
+    }
+    return ERR_SUCCESS;
+}
+
+/*
+ * Replaces the columns [left, right) of every block of a rectangle with chars: a short block loses
+ * the chars it has in them, a block ending before left is padded up to it. Every block is edited
+ * once by one pass. The padding of the shortest block followed by the chars is appended to the text
+ * once: a block shows the end of the padding it needs and the chars by one piece, so the text grows
+ * by the chars once instead of once per block.
+ */
+static int ReplaceRect(Document* doc, const ColumnSelection* selection, const ColumnRect* rect,
+                       size_t left, size_t right, const char* chars, size_t len) {
+    Block* block = rect->block;
+    size_t padding = 0;
+    size_t pos = doc->text->len;
+    int errValue = ERR_SUCCESS;
+    size_t i;
+
+    if (len) {
+        for (i = 0; i < rect->lines; ++i, block = block->next) {
+            if (block->data.len < left) { padding = MAX(padding, left - block->data.len); }
+        }
+        COUNTER_ADD(COUNTER_BLOCKS_VISITED, rect->lines);
+
+        if (AddSpaces(doc, padding) || DocAddText(doc, chars, len)) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return ERR_NOMEM;
+        }
+        block = rect->block;
+    }
+
+    for (i = 0; i < rect->lines && !errValue; ++i, block = block->next) {
+        size_t oldLen = block->data.len;
+
+        if (oldLen > left && left < right) {
+            size_t deleted = MIN(right, oldLen) - left;
+
+            errValue = DocDeleteChars(doc, block, rect->y + i, left, deleted);
+            if (errValue) { break; }
+
+            NotifyChars(selection, block, rect->y + i, left, NULL, deleted, oldLen);
+            oldLen = block->data.len;
+        }
+
+        if (!len) { continue; }
+
+        size_t blockPadding = oldLen < left ? left - oldLen : 0;
+        size_t start = pos + padding - blockPadding;
+
+        errValue = DocInsertText(doc, block, rect->y + i, left - blockPadding, start, blockPadding + len);
+        if (!errValue) {
+            NotifyChars(selection, block, rect->y + i, left - blockPadding, doc->text->data + start, blockPadding + len, oldLen);
+        }
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, i);
+
+    return errValue;
+}
+
+int DeleteColumns(Document* doc, ColumnSelection* selection, size_t count, int isBackward) {
+    assert(doc && selection && selection->isSelected);
+    TRACE_SCOPE("DeleteColumns");
+
+    ColumnRect rect;
+    int errValue = ERR_SUCCESS;
+
+    GetColumnRect(selection, &rect);
+
+    // the selected columns are the first deletion, the rest are deletions at the column caret
+    if (rect.left < rect.right && count) {
+        errValue = ReplaceRect(doc, selection, &rect, rect.left, rect.right, NULL, 0);
+        rect.right = rect.left;
+        --count;
+    }
+
+    if (count && !errValue) {
+        if (isBackward) {
+            rect.left -= MIN(count, rect.left);
+            errValue = ReplaceRect(doc, selection, &rect, rect.left, rect.right, NULL, 0);
+        } else {
+            errValue = ReplaceRect(doc, selection, &rect, rect.left, rect.left + count, NULL, 0);
+        }
+    }
+
+    Collapse(selection, rect.left);
+    return errValue;
+}
+
+// tabs of chars are expanded to spaces from a column, returns the count of the expanded chars
+static size_t ExpandTabs(const char* chars, size_t len, size_t column, size_t tabSize, char* expanded) {
+    size_t expandedLen = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (chars[i] != '\t') {
+            expanded[expandedLen++] = chars[i];
+            continue;
+        }
+
+        size_t spaces = tabSize - (column + expandedLen) % tabSize;
+
+        memset(expanded + expandedLen, ' ', spaces);
+        expandedLen += spaces;
+    }
+    return expandedLen;
+}
+
+int InsertColumns(Document* doc, ColumnSelection* selection, const char* chars, size_t len, size_t tabSize) {
+    assert(doc && selection && selection->isSelected && (chars || !len) && tabSize);
+    TRACE_SCOPE("InsertColumns");
+
+    if (!len) { return ERR_SUCCESS; }
+
+    char* expanded = malloc(len * tabSize);
+    if (!expanded) { return ERR_NOMEM; }
+
+    ColumnRect rect;
+
+    GetColumnRect(selection, &rect);
+
+    size_t expandedLen = ExpandTabs(chars, len, rect.left, tabSize, expanded);
+    int errValue = ReplaceRect(doc, selection, &rect, rect.left, rect.right, expanded, expandedLen);
+
+    Collapse(selection, errValue ? rect.left : rect.left + expandedLen);
+    free(expanded);
+    return errValue;
+}
+
+int FillColumns(Document* doc, ColumnSelection* selection, char c) {
+    assert(doc && selection && selection->isSelected);
+    TRACE_SCOPE("FillColumns");
+
+    ColumnRect rect;
+
+    GetColumnRect(selection, &rect);
+    if (rect.left == rect.right) { return ERR_SUCCESS; }
+
+    size_t len = rect.right - rect.left;
+    char* chars = malloc(len);
+    if (!chars) { return ERR_NOMEM; }
+
+    memset(chars, c, len);
+
+    int errValue = ReplaceRect(doc, selection, &rect, rect.left, rect.right, chars, len);
+
+    free(chars);
+    return errValue;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#ifndef COLUMN_SELECTION_H_INCLUDED
+#define COLUMN_SELECTION_H_INCLUDED
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "MultiCaret.h"
+
+/**
+ * Rectangular (column) selection: the same columns of every block between two corners.
+ * The x of a corner may pass the end of its block, so a rectangle keeps its columns over
+ * short lines. Edits of the selection change the chars of the covered blocks only
+ * (no block is split or merged), so the corners stay valid through them. A change of
+ * a block is notified like a change of a caret pass (CARETS_CHANGE_CHARS).
+ */
+typedef struct {
+    int isSelected;             // 0 - no selection
+    ModelPos anchor;            // the corner where the selection began
+    ModelPos active;            // the corner moved by the caret
+    CaretsChanged onChange;     // NULL - changes aren't notified
+    void* context;
+} ColumnSelection;
+
+// the rectangle of a selection
+typedef struct {
+    Block* block;       // the first block
+    size_t y;           // index of the first block
+    size_t lines;       // count of blocks
+    size_t left;        // the first column
+    size_t right;       // the column after the last one (left - no columns, a column caret)
+} ColumnRect;
+
+/**
+ * Inits an empty selection.
+ * IN:
+ * @param selection - pointer to a selection
+ * @param onChange - notification of a change of a block (NULL - no notifications)
+ * @param context - argument of the notification
+ */
+void InitColumnSelection(ColumnSelection* selection, CaretsChanged onChange, void* context);
+
+/**
+ * Begins a selection of no columns at a position, both corners are at it.
+ * IN:
+ * @param selection - pointer to a selection
+ * @param pos - position of the corners
+ */
+void BeginColumnSelection(ColumnSelection* selection, ModelPos pos);
+
+/**
+ * Removes a selection.
+ * IN:
+ * @param selection - pointer to a selection
+ */
+void ClearColumnSelection(ColumnSelection* selection);
+
+/**
+ * Gets the rectangle of a selection.
+ * IN:
+ * @param selection - pointer to a selection (it must be selected)
+ * @param rect - pointer to a rectangle to be filled
+ */
+void GetColumnRect(const ColumnSelection* selection, ColumnRect* rect);
+
+/**
+ * Copies the selected chars: the chars of every block followed by a line end but the last.
+ * A block shorter than the rectangle gives its chars in it only.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param selection - pointer to a selection
+ * @param lineEnd - line end put between blocks
+ * @param out - pointer to a String object with reserved data, the chars are appended to it
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int CopyColumns(const Document* doc, const ColumnSelection* selection, const char* lineEnd, String* out);
+
+/**
+ * Deletes the selected chars (no columns - count chars before or after the column),
+ * the selection becomes a column caret at its first column.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param selection - pointer to a selection
+ * @param count - count of chars deleted at a column caret
+ * @param isBackward - chars before (1) or after (0) a column caret are deleted
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DeleteColumns(Document* doc, ColumnSelection* selection, size_t count, int isBackward);
+
+/**
+ * Replaces the selected chars of every block with chars, the selection becomes a column caret
+ * after them. A block shorter than the first column is padded with spaces up to it. Tabs are
+ * expanded to spaces from the first column.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param selection - pointer to a selection
+ * @param chars - pointer to chars (no line ends)
+ * @param len - count of chars
+ * @param tabSize - a tab is spaces up to the next multiple of it
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int InsertColumns(Document* doc, ColumnSelection* selection, const char* chars, size_t len, size_t tabSize);
+
+/**
+ * Replaces every selected char with a char, blocks shorter than the rectangle are padded
+ * with spaces up to its first column and filled up to its last one. The selection is kept.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param selection - pointer to a selection
+ * @param c - the char
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int FillColumns(Document* doc, ColumnSelection* selection, char c);
+
+#endif // COLUMN_SELECTION_H_INCLUDED
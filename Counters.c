@@ -0,0 +1,146 @@
+#include "Counters.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+typedef struct CountersThread_tag {
+    CounterOp op;                                   // current operation
+    size_t calls[COUNTER_OP_COUNT];                 // count of entered operations
+    size_t counters[COUNTER_OP_COUNT][COUNTER_COUNT];
+} CountersThread;
+
+static const char* opNames[COUNTER_OP_COUNT] = {
+    "other",
+    "load",
+    "cover",
+    "paint",
+    "scroll",
+    "navigate",
+    "edit",
+    "resize",
+    "switch_mode",
+    "search",
+    "replace"
+};
+
+static const char* counterNames[COUNTER_COUNT] = {
+    "blocks_visited",
+    "fragments_visited",
+    "bytes_copied",
+    "allocations",
+    "reallocations",
+    "bytes_reallocated"
+};
+
+static _Atomic(CountersThread*) threads[COUNTERS_MAX_THREADS];
+static atomic_size_t threadsCount;
+static _Thread_local CountersThread* localThread;
+
+static CountersThread* GetLocalThread() {
+    if (localThread) { return localThread; }
+
+    size_t index = atomic_fetch_add(&threadsCount, 1);
+    if (index >= COUNTERS_MAX_THREADS) {
+        atomic_fetch_sub(&threadsCount, 1);
+        return NULL;
+    }
+
+    CountersThread* thread = calloc(1, sizeof(CountersThread));
+    if (!thread) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    atomic_store_explicit(&threads[index], thread, memory_order_release);
+    localThread = thread;
+    return thread;
+}
+
+static size_t GetThreadsCount() {
+    size_t count = atomic_load(&threadsCount);
+    return count > COUNTERS_MAX_THREADS ? COUNTERS_MAX_THREADS : count;
+}
+
+CounterOp CountersEnter(CounterOp op) {
+    assert(op < COUNTER_OP_COUNT);
+
+    CountersThread* thread = GetLocalThread();
+    if (!thread) { return COUNTER_OP_OTHER; }
+
+    CounterOp prevOp = thread->op;
+    if (prevOp != op) {
+        ++thread->calls[op];
+        thread->op = op;
+    }
+
+    return prevOp;
+}
+
+void CountersLeave(const CounterOp* pPrevOp) {
+    assert(pPrevOp);
+
+    if (localThread) { localThread->op = *pPrevOp; }
+}
+
+void CountersAdd(Counter counter, size_t value) {
+    assert(counter < COUNTER_COUNT);
+
+    CountersThread* thread = GetLocalThread();
+    if (thread) { thread->counters[thread->op][counter] += value; }
+}
+
+void CountersExportJSON(FILE* output) {
+    if (!output) { output = stdout; }
+
+    size_t count = GetThreadsCount();
+
+    fprintf(output, "{\n");
+    for (size_t op = 0; op < COUNTER_OP_COUNT; ++op) {
+        size_t calls = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            CountersThread* thread = atomic_load_explicit(&threads[i], memory_order_acquire);
+            if (thread) { calls += thread->calls[op]; }
+        }
+
+        fprintf(output, "    \"%s\": {\"calls\": %zu", opNames[op], calls);
+
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+            size_t value = 0;
+
+            for (size_t i = 0; i < count; ++i) {
+                CountersThread* thread = atomic_load_explicit(&threads[i], memory_order_acquire);
+                if (thread) { value += thread->counters[op][counter]; }
+            }
+
+            fprintf(output, ", \"%s\": %zu", counterNames[counter], value);
+        }
+
+        fprintf(output, "}%s\n", op + 1 < COUNTER_OP_COUNT ? "," : "");
+    }
+    fprintf(output, "}\n");
+}
+
+void CountersReset() {
+    size_t count = GetThreadsCount();
+
+    for (size_t i = 0; i < count; ++i) {
+        CountersThread* thread = atomic_load_explicit(&threads[i], memory_order_acquire);
+
+        if (thread) {
+            memset(thread->calls, 0, sizeof(thread->calls));
+            memset(thread->counters, 0, sizeof(thread->counters));
+        }
+    }
+}
+
+void CountersShutdown() {
+    size_t count = atomic_exchange(&threadsCount, 0);
+    if (count > COUNTERS_MAX_THREADS) { count = COUNTERS_MAX_THREADS; }
+
+    for (size_t i = 0; i < count; ++i) {
+        CountersThread* thread = atomic_exchange(&threads[i], NULL);
+        if (thread) { free(thread); }
+    }
+    localThread = NULL;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef COUNTERS_H_INCLUDED
+#define COUNTERS_H_INCLUDED
+
+#define COUNTERS_ON
+// #define COUNTERS_OFF
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "Error.h"
+
+// upper limit of threads that can update counters
+#define COUNTERS_MAX_THREADS 64
+
+typedef enum {
+    COUNTER_OP_OTHER,           // outside of any listed operation
+    COUNTER_OP_LOAD,            // SetFile
+    COUNTER_OP_COVER,           // CoverDocument
+    COUNTER_OP_PAINT,           // DisplayModel
+    COUNTER_OP_SCROLL,          // Scroll
+    COUNTER_OP_NAVIGATE,        // FindCaret, CaretPageUp, CaretPageDown, CaretGoTo*
+    COUNTER_OP_EDIT,            // CaretAddChar, CaretAddBlock, CaretDeleteChar, CaretDeleteBlock, DocUndo, DocRedo
+    COUNTER_OP_RESIZE,          // UpdateDisplayedModel
+    COUNTER_OP_SWITCH_MODE,     // SwitchMode
+    COUNTER_OP_SEARCH,          // FindLiteral, FindRegex
+    COUNTER_OP_REPLACE,         // ReplaceAll
+    COUNTER_OP_COUNT
+} CounterOp;
+
+typedef enum {
+    COUNTER_BLOCKS_VISITED,     // steps over a list of blocks
+    COUNTER_FRAGMENTS_VISITED,  // steps over a list of fragments
+    COUNTER_BYTES_COPIED,       // bytes copied to a String object
+    COUNTER_ALLOCATIONS,        // calls of malloc/calloc
+    COUNTER_REALLOCATIONS,      // calls of realloc
+    COUNTER_BYTES_REALLOCATED,  // bytes that realloc may move
+    COUNTER_COUNT
+} Counter;
+
+/**
+ * Makes an operation current for the calling thread.
+ * IN:
+ * @param op - operation
+ *
+ * OUT:
+ * @return prevOp - previous current operation
+ */
+CounterOp CountersEnter(CounterOp op);
+
+/**
+ * Restores a previous operation of the calling thread.
+ * IN:
+ * @param pPrevOp - pointer to previous operation (returned by CountersEnter)
+ */
+void CountersLeave(const CounterOp* pPrevOp);
+
+/**
+ * Adds value to a counter of the current operation of the calling thread.
+ * IN:
+ * @param counter - counter
+ * @param value - value to be added
+ */
+void CountersAdd(Counter counter, size_t value);
+
+/**
+ * Prints counters of all threads (merged) per operation in JSON format.
+ * IN:
+ * @param output - pointer to a stream. If it's NULL, then JSON is printed to the stdout
+ */
+void CountersExportJSON(FILE* output);
+
+/**
+ * Fills counters of all threads with zero values.
+ */
+void CountersReset();
+
+/**
+ * Frees counters of all threads. No thread may update counters after it.
+ */
+void CountersShutdown();
+
+#ifdef COUNTERS_ON
+    #ifdef __GNUC__
+        // the operation is current until the end of an enclosing scope
+        #define COUNTERS_SCOPE(op) \
+            CounterOp countersPrevOp __attribute__((cleanup(CountersLeave))) = CountersEnter(op)
+    #else
+        // the previous operation can't be restored at the scope exit: counts go to COUNTER_OP_OTHER
+        #define COUNTERS_SCOPE(op) ((void)0)
+    #endif
+
+    #define COUNTER_ADD(counter, value) CountersAdd(counter, value)
+#else
+    #define COUNTERS_SCOPE(op)          ((void)0)
+    #define COUNTER_ADD(counter, value) ((void)0)
+#endif
+
+#endif // COUNTERS_H_INCLUDED
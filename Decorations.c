@@ -0,0 +1,354 @@
+#include "Decorations.h"
+
+void InitDecorations(Decorations* decorations) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        DecorationLayer* layer = decorations->layers + i;
+
+        // chars inserted at an end of a range are after its mark: the ones typed at its start are in it
+        InitMarkSet(&(layer->marks), MARK_STAY);
+        layer->ends = NULL;
+        layer->size = 0;
+    }
+}
+
+void FreeDecorations(Decorations* decorations) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        FreeMarkSet(&(decorations->layers[i].marks));
+        free(decorations->layers[i].ends);
+    }
+    InitDecorations(decorations);
+}
+
+void ClearDecorations(Decorations* decorations, DecorationLayerId layer) {
+    assert(decorations && layer < DECORATION_LAYERS);
+
+    ClearMarks(&(decorations->layers[layer].marks));
+}
+
+// adds a mark of an end of a range, the ends grow with the nodes of the marks
+static int AddEnd(DecorationLayer* layer, position_t pos, DecorationEnd end, uint32_t* id) {
+    size_t i;
+    int errValue = AddMark(&(layer->marks), pos, &i);
+
+    if (errValue) { return errValue; }
+
+    if (layer->size < layer->marks.size) {
+        DecorationEnd* ends = realloc(layer->ends, layer->marks.size * sizeof(DecorationEnd));
+
+        if (!ends) {
+            RemoveMark(&(layer->marks), i);
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return ERR_NOMEM;
+        }
+        layer->ends = ends;
+        layer->size = layer->marks.size;
+    }
+
+    layer->ends[i] = end;
+    *id = (uint32_t) i;
+    return ERR_SUCCESS;
+}
+
+// adds a range of a block
+static int AddPiece(DecorationLayer* layer, position_t from, size_t end, size_t style) {
+    uint32_t start, finish;
+    int errValue = AddEnd(layer, from, (DecorationEnd) { 0, (uint8_t) style, 0, 0 }, &start);
+
+    if (errValue) { return errValue; }
+
+    errValue = AddEnd(layer, (position_t) { end, from.y }, (DecorationEnd) { start, (uint8_t) style, 1, 0 }, &finish);
+    if (errValue) {
+        RemoveMark(&(layer->marks), start);
+        return errValue;
+    }
+
+    layer->ends[start].other = finish;
+    return ERR_SUCCESS;
+}
+
+int AddDecoration(Decorations* decorations, DecorationLayerId layer, ModelPos from, ModelPos to, size_t style) {
+    assert(decorations && layer < DECORATION_LAYERS && style < DECORATION_STYLES);
+    assert(from.block && to.block);
+
+    if (to.pos.y < from.pos.y || (to.pos.y == from.pos.y && to.pos.x <= from.pos.x)) { return ERR_SUCCESS; }
+
+    Block* block = from.block;
+    position_t pos = from.pos;
+    size_t count = 1;
+
+    // a piece per block
+    for (;; block = block->next, pos = (position_t) { 0, pos.y + 1 }, ++count) {
+        assert(block);
+
+        int isLast = block == to.block;
+        size_t end = isLast ? to.pos.x : block->data.len;
+
+        if (pos.x < end) {
+            int errValue = AddPiece(decorations->layers + layer, pos, end, style);
+
+            if (errValue) {
+                COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+                return errValue;
+            }
+        }
+        if (isLast) { break; }
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+
+    return ERR_SUCCESS;
+}
+
+// the greatest style of the open ranges (DECORATION_STYLES - no open range)
+static size_t GetTopStyle(const int* open) {
+    for (size_t style = DECORATION_STYLES; style--;) {
+        if (open[style] > 0) { return style; }
+    }
+    return DECORATION_STYLES;
+}
+
+DecorationRun* GetDecorationRuns(const Decorations* decorations, DecorationLayerId layer, size_t first, size_t last, size_t* len) {
+    assert(decorations && layer < DECORATION_LAYERS && len);
+
+    const DecorationLayer* decorationLayer = decorations->layers + layer;
+    position_t from = { 0, first };
+    position_t to = { 0, last };
+    size_t count = ListMarks(&(decorationLayer->marks), from, to, NULL, NULL, 0);
+
+    *len = 0;
+    if (!count) { return NULL; }
+
+    size_t* ids = malloc(count * sizeof(size_t));
+    position_t* positions = malloc(count * sizeof(position_t));
+    DecorationRun* runs = malloc(count * sizeof(DecorationRun));
+
+    if (!ids || !positions || !runs) {
+        free(ids);
+        free(positions);
+        free(runs);
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    ListMarks(&(decorationLayer->marks), from, to, ids, positions, count);
+
+    // counts of the open ranges of the styles, no range is open at the start of a block
+    int open[DECORATION_STYLES] = { 0 };
+
+    for (size_t i = 0; i < count; ++i) {
+        const DecorationEnd* end = decorationLayer->ends + ids[i];
+        size_t style = GetTopStyle(open);
+
+        if (i && positions[i].y != positions[i - 1].y) {
+            memset(open, 0, sizeof(open));
+        } else if (i && style < DECORATION_STYLES && positions[i].x > positions[i - 1].x) {
+            DecorationRun* prev = *len ? runs + *len - 1 : NULL;
+
+            // ranges of a style meeting at a position are one run
+            if (prev && prev->y == positions[i].y && prev->end == positions[i - 1].x && prev->style == style) {
+                prev->end = positions[i].x;
+            } else {
+                runs[(*len)++] = (DecorationRun) { positions[i].y, positions[i - 1].x, positions[i].x, style };
+            }
+        }
+        open[end->style] += end->isEnd ? -1 : 1;
+    }
+
+    free(ids);
+    free(positions);
+
+    if (!*len) {
+        free(runs);
+        return NULL;
+    }
+    return runs;
+}
+
+void DecorationsInsertChars(Decorations* decorations, position_t pos, size_t len) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        MarksInsertChars(&(decorations->layers[i].marks), pos, len);
+    }
+}
+
+void DecorationsDeleteChars(Decorations* decorations, position_t pos, size_t len) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        MarksDeleteChars(&(decorations->layers[i].marks), pos, len);
+    }
+}
+
+// cuts a range of a split block by the split: the start at the split moves to the next block
+static int CutRange(DecorationLayer* layer, uint32_t start, position_t startPos, position_t pos) {
+    DecorationEnd end = layer->ends[start];
+    uint32_t finish = end.other;
+    uint32_t newStart;
+    int errValue;
+
+    if (startPos.x == pos.x) {
+        errValue = AddEnd(layer, (position_t) { 0, pos.y + 1 }, end, &newStart);
+        if (errValue) { return errValue; }
+
+        RemoveMark(&(layer->marks), start);
+        layer->ends[finish].other = newStart;
+        return ERR_SUCCESS;
+    }
+
+    uint32_t newFinish;
+
+    errValue = AddEnd(layer, pos, (DecorationEnd) { start, end.style, 1, 0 }, &newFinish);
+    if (errValue) { return errValue; }
+
+    errValue = AddEnd(layer, (position_t) { 0, pos.y + 1 }, (DecorationEnd) { finish, end.style, 0, 0 }, &newStart);
+    if (errValue) {
+        RemoveMark(&(layer->marks), newFinish);
+        return errValue;
+    }
+
+    layer->ends[start].other = newFinish;
+    layer->ends[finish].other = newStart;
+    return ERR_SUCCESS;
+}
+
+// the ranges of the split block whose ends moved to the next block are cut
+static void CutRanges(DecorationLayer* layer, position_t pos) {
+    size_t count = ListMarks(&(layer->marks), (position_t) { 0, pos.y }, (position_t) { 0, pos.y + 1 }, NULL, NULL, 0);
+
+    if (!count) { return; }
+
+    size_t* ids = malloc(count * sizeof(size_t));
+    position_t* positions = malloc(count * sizeof(position_t));
+
+    if (!ids || !positions) {
+        free(ids);
+        free(positions);
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return;
+    }
+
+    ListMarks(&(layer->marks), (position_t) { 0, pos.y }, (position_t) { 0, pos.y + 1 }, ids, positions, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        DecorationEnd* end = layer->ends + ids[i];
+
+        if (end->isEnd) {
+            layer->ends[end->other].flag = 0;
+        } else {
+            end->flag = 1;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        DecorationEnd* end = layer->ends + ids[i];
+
+        if (end->isEnd || !end->flag) { continue; }
+
+        end->flag = 0;
+        if (CutRange(layer, (uint32_t) ids[i], positions[i], pos)) { break; }
+    }
+
+    free(ids);
+    free(positions);
+}
+
+void DecorationsSplitBlock(Decorations* decorations, position_t pos) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        DecorationLayer* layer = decorations->layers + i;
+
+        if (!layer->marks.len) { continue; }
+
+        MarksSplitBlock(&(layer->marks), pos);
+        CutRanges(layer, pos);
+    }
+}
+
+// lists the marks at a position
+static size_t ListMarksAt(const DecorationLayer* layer, position_t pos, size_t** ids) {
+    position_t next = { pos.x + 1, pos.y };
+    size_t count = ListMarks(&(layer->marks), pos, next, NULL, NULL, 0);
+
+    *ids = NULL;
+    if (!count) { return 0; }
+
+    position_t* positions = malloc(count * sizeof(position_t));
+
+    *ids = malloc(count * sizeof(size_t));
+    if (!*ids || !positions) {
+        free(*ids);
+        free(positions);
+        *ids = NULL;
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return 0;
+    }
+
+    ListMarks(&(layer->marks), pos, next, *ids, positions, count);
+    free(positions);
+    return count;
+}
+
+// the ranges of a style ending at the end of a block and starting at the next block are joined (a split is undone)
+static void JoinRanges(DecorationLayer* layer, size_t y, size_t len) {
+    size_t* finishes;
+    size_t* starts = NULL;
+    size_t finishesLen = ListMarksAt(layer, (position_t) { len, y }, &finishes);
+    size_t startsLen = finishesLen ? ListMarksAt(layer, (position_t) { 0, y + 1 }, &starts) : 0;
+
+    for (size_t i = 0; i < finishesLen; ++i) {
+        DecorationEnd* finish = layer->ends + finishes[i];
+
+        if (!finish->isEnd) { continue; }
+
+        for (size_t j = 0; j < startsLen; ++j) {
+            DecorationEnd* start = layer->ends + starts[j];
+
+            // a start is joined once
+            if (start->isEnd || start->style != finish->style || start->flag) { continue; }
+
+            layer->ends[finish->other].other = start->other;
+            layer->ends[start->other].other = finish->other;
+            RemoveMark(&(layer->marks), finishes[i]);
+            RemoveMark(&(layer->marks), starts[j]);
+            start->flag = 1;
+            break;
+        }
+    }
+
+    for (size_t j = 0; j < startsLen; ++j) { layer->ends[starts[j]].flag = 0; }
+
+    free(finishes);
+    free(starts);
+}
+
+void DecorationsMergeBlocks(Decorations* decorations, size_t y, size_t len) {
+    assert(decorations);
+
+    for (size_t i = 0; i < DECORATION_LAYERS; ++i) {
+        DecorationLayer* layer = decorations->layers + i;
+
+        if (!layer->marks.len) { continue; }
+
+        JoinRanges(layer, y, len);
+        MarksMergeBlocks(&(layer->marks), y, len);
+    }
+}
+
+void DecorationsFollowChange(Decorations* decorations, const HistoryChange* change) {
+    assert(decorations && change);
+
+    position_t pos = { change->x, change->y };
+
+    switch (change->op) {
+    case HISTORY_INSERT:    DecorationsInsertChars(decorations, pos, change->len); break;
+    case HISTORY_DELETE:    DecorationsDeleteChars(decorations, pos, change->len); break;
+    case HISTORY_SPLIT:     DecorationsSplitBlock(decorations, pos); break;
+    case HISTORY_MERGE:     DecorationsMergeBlocks(decorations, change->y, change->x); break;
+    default:                break;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef DECORATIONS_H_INCLUDED
+#define DECORATIONS_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Marks.h"
+
+#define DECORATION_STYLES 4     // styles of the ranges (0 .. DECORATION_STYLES - 1), a greater one is shown over a lesser one
+
+typedef enum {
+    DECORATION_RESULTS,     // occurrences found by the find-all search
+    DECORATION_MARKED,      // text marked by the user
+    DECORATION_LAYERS
+} DecorationLayerId;
+
+// an end of a range, kept by the id of its mark
+typedef struct {
+    uint32_t other;         // id of the mark of the other end
+    uint8_t style;
+    uint8_t isEnd;          // 0 - the start of the range
+    uint8_t flag;           // scratch of a pass over the marks of a block
+} DecorationEnd;
+
+typedef struct {
+    MarkSet marks;          // both ends of the ranges
+    DecorationEnd* ends;    // ends by the ids of the marks
+    size_t size;            // capacity of the ends
+} DecorationLayer;
+
+/**
+ * Ranges of the text shown with a style (occurrences, marked text), kept through the edits of
+ * the document in independent layers. A range is kept as a piece per block: both ends of a piece
+ * are marks of the block, so an edit shifts them in O(log n), a split of a block cuts the pieces
+ * crossing the split and a merge joins the pieces meeting at the line end. The pieces of the
+ * displayed blocks are found in O(log n + k), they're merged into styled runs by one pass over
+ * their ends. Marks at a position stay before the inserted chars, so the chars typed at the start
+ * of a range are in it and the ones typed at its end aren't.
+ */
+typedef struct {
+    DecorationLayer layers[DECORATION_LAYERS];
+} Decorations;
+
+// a run of chars of a block shown with a style
+typedef struct {
+    size_t y;           // index of the block
+    size_t start;       // position of the first char in the block
+    size_t end;         // position after the last char
+    size_t style;       // the greatest style of the ranges of the run
+} DecorationRun;
+
+/**
+ * Inits empty layers.
+ * IN:
+ * @param decorations - pointer to decorations
+ */
+void InitDecorations(Decorations* decorations);
+
+/**
+ * Frees the ranges of all layers, the layers become empty.
+ * IN:
+ * @param decorations - pointer to decorations
+ */
+void FreeDecorations(Decorations* decorations);
+
+/**
+ * Removes the ranges of a layer, the memory is kept.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param layer - DecorationLayerId
+ */
+void ClearDecorations(Decorations* decorations, DecorationLayerId layer);
+
+/**
+ * Adds a range to a layer (an empty range isn't added).
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param layer - DecorationLayerId
+ * @param from - position of the first char of the range
+ * @param to - position after the last char of the range (a line end is at x == block->data.len)
+ * @param style - style of the range (< DECORATION_STYLES)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int AddDecoration(Decorations* decorations, DecorationLayerId layer, ModelPos from, ModelPos to, size_t style);
+
+/**
+ * Gets the styled runs of the blocks of a layer.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param layer - DecorationLayerId
+ * @param first - index of the first block
+ * @param last - index of the block after the last one
+ * @param len - pointer to be filled with the count of the runs
+ *
+ * OUT:
+ * @return runs - the disjoint runs sorted by position (to be freed), NULL - no runs or no memory
+ */
+DecorationRun* GetDecorationRuns(const Decorations* decorations, DecorationLayerId layer, size_t first, size_t last, size_t* len);
+
+// edits of the document: the ranges of all layers follow the text
+/**
+ * Chars are inserted into a block.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param pos - position of the inserted chars
+ * @param len - count of chars
+ */
+void DecorationsInsertChars(Decorations* decorations, position_t pos, size_t len);
+
+/**
+ * Chars are deleted from a block, the ranges in them become empty.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param pos - position of the deleted chars
+ * @param len - count of chars
+ */
+void DecorationsDeleteChars(Decorations* decorations, position_t pos, size_t len);
+
+/**
+ * A block is split, a range crossing the split becomes a range of each block.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param pos - position of the split
+ */
+void DecorationsSplitBlock(Decorations* decorations, position_t pos);
+
+/**
+ * The next block is merged into a block, ranges of a style meeting at the line end become one range.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param y - index of the block
+ * @param len - count of chars of the block before the merge
+ */
+void DecorationsMergeBlocks(Decorations* decorations, size_t y, size_t len);
+
+/**
+ * An edit of blocks reported by undo, redo or a replacement (DocChanged): the ranges follow it.
+ * IN:
+ * @param decorations - pointer to decorations
+ * @param change - the edit
+ */
+void DecorationsFollowChange(Decorations* decorations, const HistoryChange* change);
+
+#endif // DECORATIONS_H_INCLUDED
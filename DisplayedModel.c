@@ -4,6 +4,9 @@
 // DISPLAY_STEP
 #define STEP 1
 
+// background of occurrences of the active search
+#define HIGHLIGHT_BK_COLOR RGB(255, 230, 100)
+
 static void InitModelPos(ModelPos* pMP, Block* block) {
     assert(pMP);
 
@@ -12,6 +15,10 @@ static void InitModelPos(ModelPos* pMP, Block* block) {
     pMP->pos.y = 0;
 }
 
+#ifdef CARET_ON
+    static void OnCaretsChange(void* context, const CaretsChange* change);
+#endif
+
 void InitDisplayedModel(DisplayedModel* dm, const TEXTMETRIC* tm) {
     assert(dm);
     assert(tm);
@@ -27,9 +34,22 @@ void InitDisplayedModel(DisplayedModel* dm, const TEXTMETRIC* tm) {
 
     dm->documentArea.chars = 0;
     dm->documentArea.lines = 0;
+    dm->longestBlocks = 0;
 
     dm->wrapModel.isValid = 0;
     dm->wrapModel.lines = 0;
+    dm->highlight = NULL;
+    InitLineIndex(&(dm->lineIndex));
+
+    dm->view.dirty = VIEW_CLEAN;
+    dm->view.scrollX = 0;
+    dm->view.scrollY = 0;
+    dm->view.firstLine = 0;
+    dm->view.lastLine = 0;
+    dm->view.isTimerSet = 0;
+    dm->view.flushTime = 0;
+    dm->edit.depth = 0;
+    dm->edit.isWrapStale = 0;
 
     InitScrollBar(&(dm->scrollBars.horizontal));
     InitScrollBar(&(dm->scrollBars.vertical));
@@ -41,13 +61,40 @@ void InitDisplayedModel(DisplayedModel* dm, const TEXTMETRIC* tm) {
         dm->caret.isHidden.x = 0;
         dm->caret.isHidden.y = 0;
         InitModelPos(&(dm->caret.modelPos), NULL);
+        InitCaretSet(&(dm->carets), &(dm->scrollBars.modelPos), OnCaretsChange, dm);
+        InitColumnSelection(&(dm->columns), OnCaretsChange, dm);
+        InitMarkSet(&(dm->bookmarks), MARK_MOVE);
+        InitDecorations(&(dm->decorations));
+    #endif
+}
+
+void FreeDisplayedModel(DisplayedModel* dm) {
+    assert(dm);
+
+    FreeLineIndex(&(dm->lineIndex));
+
+    #ifdef CARET_ON
+        FreeCaretSet(&(dm->carets));
+        FreeMarkSet(&(dm->bookmarks));
+        FreeDecorations(&(dm->decorations));
     #endif
 }
 
+// marks changed properties of the window, the timer flushes them if no input does
+static void MarkView(HWND hwnd, DisplayedModel* dm, int dirty) {
+    dm->view.dirty |= dirty;
+
+    if (!dm->view.isTimerSet) {
+        SetTimer(hwnd, VIEW_TIMER_ID, VIEW_FRAME_MS, NULL);
+        dm->view.isTimerSet = 1;
+    }
+}
+
 static void PassPrev(ModelPos* modelPos, size_t delta) {
     assert(modelPos);
 
     modelPos->pos.y -= delta;
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, delta);
     for(; delta > 0; --delta) {
         assert(modelPos->block);
         modelPos->block = modelPos->block->prev;
@@ -58,6 +105,7 @@ static void PassNext(ModelPos* modelPos, size_t delta) {
     assert(modelPos);
 
     modelPos->pos.y += delta;
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, delta);
     for(; delta > 0; --delta) {
         assert(modelPos->block);
         modelPos->block = modelPos->block->next;
@@ -77,6 +125,8 @@ static void PassNext(ModelPos* modelPos, size_t delta) {
 static void CountLines(Block* startBlock, const Block* lastBlock, DisplayedModel* dm) {
     assert(startBlock && dm);
 
+    size_t count = 0;
+
     while (startBlock != lastBlock) {
         if (startBlock->data.len > 0) {
             dm->wrapModel.lines += DIV_WITH_ROUND_UP(startBlock->data.len, dm->clientArea.chars);
@@ -84,11 +134,41 @@ static void CountLines(Block* startBlock, const Block* lastBlock, DisplayedModel
             ++dm->wrapModel.lines;
         }
         startBlock = startBlock->next;
+        ++count;
     }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+}
+
+// a block of len chars is added to the document area, returns 1 if it's longer than the longest one
+static int AddBlockLen(DisplayedModel* dm, size_t len) {
+    if (len > dm->documentArea.chars) {
+        dm->documentArea.chars = len;
+        dm->longestBlocks = 1;
+        return 1;
+    }
+    if (len == dm->documentArea.chars) { ++dm->longestBlocks; }
+    return 0;
+}
+
+// a block of len chars is removed from the document area (documentArea.chars stays an upper bound)
+static void RemoveBlockLen(DisplayedModel* dm, size_t len) {
+    if (len == dm->documentArea.chars && dm->longestBlocks) { --dm->longestBlocks; }
+}
+
+static void CountLongestBlocks(DisplayedModel* dm) {
+    size_t count = 0;
+
+    dm->documentArea.chars = 0;
+    dm->longestBlocks = 0;
+    for (Block* block = dm->doc->blocks->nodes; block; block = block->next, ++count) {
+        AddBlockLen(dm, block->data.len);
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
 }
 
 static size_t BuildWrapModel(HWND hwnd, DisplayedModel* dm) {
     assert(dm);
+    TRACE_SCOPE("BuildWrapModel");
     #ifndef NDEBUG // ================================/
         // printf("BuildWrapModel\n");
     #endif
@@ -107,7 +187,7 @@ static size_t BuildWrapModel(HWND hwnd, DisplayedModel* dm) {
             block = dm->caret.modelPos.block;
 
             dm->caret.linePos = dm->wrapModel.lines;
-            dm->caret.linePos += dm->caret.modelPos.pos.x / dm->clientArea.chars;
+            dm->caret.linePos += dm->caret.modelPos.pos.x / dm->clientArea.chars - (dm->caret.clientPos.x == dm->clientArea.chars);
 
             if (!dm->caret.isHidden.y) { CaretHide(hwnd, &(dm->caret.isHidden.y)); }
             dm->caret.clientPos.y = 0;
@@ -125,7 +205,7 @@ static size_t BuildWrapModel(HWND hwnd, DisplayedModel* dm) {
             block = dm->caret.modelPos.block;
 
             dm->caret.linePos = dm->wrapModel.lines;
-            dm->caret.linePos += dm->caret.modelPos.pos.x / dm->clientArea.chars;
+            dm->caret.linePos += dm->caret.modelPos.pos.x / dm->clientArea.chars - (dm->caret.clientPos.x == dm->clientArea.chars);
 
             dm->caret.clientPos.y = dm->caret.linePos - absolutePos;
 
@@ -162,12 +242,15 @@ void CoverDocument(HWND hwnd, DisplayedModel* dm, Document* doc) {
         // printf("Cover document\n");
     #endif // =======================================/
     assert(dm && doc);
+    COUNTERS_SCOPE(COUNTER_OP_COVER);
+    TRACE_SCOPE("CoverDocument");
 
     dm->doc = doc;
     dm->documentArea.lines = doc->blocks->len;
-    dm->documentArea.chars = GetMaxBlockLen(doc->blocks);
+    CountLongestBlocks(dm);
 
     dm->wrapModel.isValid = 0; // TODO: delete
+    InvalidateLineIndex(&(dm->lineIndex));
 
     InitScrollBar(&(dm->scrollBars.horizontal));
     InitScrollBar(&(dm->scrollBars.vertical));
@@ -179,6 +262,8 @@ void CoverDocument(HWND hwnd, DisplayedModel* dm, Document* doc) {
         if (dm->caret.isHidden.x) { CaretShow(hwnd, &(dm->caret.isHidden.x)); }
         if (dm->caret.isHidden.y) { CaretShow(hwnd, &(dm->caret.isHidden.y)); }
         InitModelPos(&(dm->caret.modelPos), doc->blocks->nodes);
+        ClearCarets(&(dm->carets));
+        ClearColumnSelection(&(dm->columns));
     #endif
 
     switch (dm->mode) {
@@ -202,14 +287,27 @@ void CoverDocument(HWND hwnd, DisplayedModel* dm, Document* doc) {
         return;
     }
 
-    SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
-    SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+    MarkView(hwnd, dm, VIEW_HORZ_RANGE | VIEW_VERT_RANGE);
 
     #ifndef NDEBUG // ================================/
         // PrintSBs(dm);
     #endif // =======================================/
 }
 
+void FollowDocChange(void* context, const HistoryChange* change) {
+    assert(context && change);
+
+    #ifdef CARET_ON
+        DisplayedModel* dm = context;
+
+        MarksFollowChange(&(dm->bookmarks), change);
+        DecorationsFollowChange(&(dm->decorations), change);
+    #else
+        (void)context;
+        (void)change;
+    #endif
+}
+
 #ifndef NDEBUG // ======================================= /
     static void PrintPos(const DisplayedModel* dm) {
         assert(dm);
@@ -218,49 +316,392 @@ void CoverDocument(HWND hwnd, DisplayedModel* dm, Document* doc) {
     }
 #endif // ============================================== /
 
-static size_t PrintLine(size_t lineIndex, HDC hdc, const DisplayedModel* dm, Fragment** fragment, size_t displayedChars, size_t delta) {
+// prints chars of a line starting at the position x of the block, highlighted ranges are split into own runs
+static void PrintChars(size_t lineIndex, size_t column, HDC hdc, const DisplayedModel* dm, const char* chars, size_t length,
+                       size_t x, const HighlightRange* ranges, size_t rangesLen) {
+    size_t left = 0;
+    size_t right = rangesLen;
+
+    // the first range ending after x
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+
+        if (ranges[middle].end <= x) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+
+    while (length) {
+        int isHighlighted = left < rangesLen && ranges[left].start <= x;
+        size_t run = length;
+
+        if (isHighlighted) {
+            run = min(run, ranges[left].end - x);
+        } else if (left < rangesLen) {
+            run = min(run, ranges[left].start - x);
+        }
+
+        COLORREF bkColor = isHighlighted ? SetBkColor(hdc, HIGHLIGHT_BK_COLOR) : 0;
+
+        TextOut(hdc,
+            column * dm->charMetric.x,
+            lineIndex * dm->charMetric.y,
+            chars,
+            run);
+
+        if (isHighlighted) { SetBkColor(hdc, bkColor); }
+
+        chars += run;
+        column += run;
+        length -= run;
+        x += run;
+        if (left < rangesLen && x >= ranges[left].end) { ++left; }
+    }
+}
+
+static size_t PrintLine(size_t lineIndex, HDC hdc, const DisplayedModel* dm, Fragment** fragment, size_t displayedChars, size_t delta,
+                        size_t x, const HighlightRange* ranges, size_t rangesLen) {
     assert(dm && fragment && *fragment);
     assert(displayedChars);
 
     size_t length = 0;
+    size_t count = 0;
 
     for (size_t j = 0; j < displayedChars; j += length) {
         if ((*fragment)->data.len - delta <= displayedChars - j) {
             length = (*fragment)->data.len - delta;
 
-            TextOut(hdc,
-                j * dm->charMetric.x,
-                lineIndex * dm->charMetric.y,
+            PrintChars(lineIndex, j, hdc, dm,
                 dm->doc->text->data + (*fragment)->data.pos + delta,
-                length);
+                length, x + j, ranges, rangesLen);
             
             delta = 0;
             *fragment = (*fragment)->next;
+            ++count;
         } else {
             length = displayedChars - j;
 
-            TextOut(hdc,
-                j * dm->charMetric.x,
-                lineIndex * dm->charMetric.y,
+            PrintChars(lineIndex, j, hdc, dm,
                 dm->doc->text->data + (*fragment)->data.pos + delta,
-                length);
+                length, x + j, ranges, rangesLen);
             
             delta += length;
             break;
         }
     }
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, count);
 
     return delta;
 }
 
+#ifdef CARET_ON
+    // draws a caret of the set at a cell of the client area (the caret itself is the system one)
+    static void PaintCaret(HDC hdc, const DisplayedModel* dm, size_t line, size_t column) {
+        PatBlt(hdc, (int) (column * dm->charMetric.x), (int) (line * dm->charMetric.y),
+                1, (int) dm->charMetric.y, BLACKNESS);
+    }
+
+    // draws the carets of the set shown by the client area, they're found from the top block
+    static void PaintCarets(HDC hdc, const DisplayedModel* dm) {
+        const CaretSet* carets = &(dm->carets);
+        const ModelPos* top = &(dm->scrollBars.modelPos);
+        size_t i = FindFirstCaret(carets, top->pos.y);
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT: {
+            size_t left = dm->scrollBars.horizontal.pos;
+
+            for (; i < carets->len && carets->items[i].pos.y < top->pos.y + dm->clientArea.lines; ++i) {
+                size_t x = carets->items[i].pos.x;
+
+                if (i != carets->primary && x >= left && x <= left + dm->clientArea.chars) {
+                    PaintCaret(hdc, dm, carets->items[i].pos.y - top->pos.y, x - left);
+                }
+            }
+            break;
+        }
+
+        case FORMAT_MODE_WRAP: {
+            size_t chars = dm->clientArea.chars;
+            size_t line = 0;    // displayed lines from the top block to the current one
+            size_t y = top->pos.y;
+            size_t count = 0;
+
+            for (Block* block = top->block; block && i < carets->len && line < top->pos.x + dm->clientArea.lines;
+                block = block->next, ++y, ++count) {
+
+                for (; i < carets->len && carets->items[i].pos.y == y; ++i) {
+                    size_t x = carets->items[i].pos.x;
+                    size_t blockLine = x / chars;
+                    size_t column = x % chars;
+
+                    // the end of a full line stays on it
+                    if (x && x == block->data.len && !column) {
+                        --blockLine;
+                        column = chars;
+                    }
+
+                    if (i != carets->primary && line + blockLine >= top->pos.x
+                        && line + blockLine - top->pos.x < dm->clientArea.lines) {
+                        PaintCaret(hdc, dm, line + blockLine - top->pos.x, column);
+                    }
+                }
+                line += block->data.len ? DIV_WITH_ROUND_UP(block->data.len, chars) : 1;
+            }
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    // draws a bar at the left side of a line of the client area
+    static void PaintBookmark(HDC hdc, const DisplayedModel* dm, size_t line) {
+        PatBlt(hdc, 0, (int) (line * dm->charMetric.y), (int) max(dm->charMetric.x / 4, 2), (int) dm->charMetric.y, DSTINVERT);
+    }
+
+    // draws the bookmarks shown by the client area at the first lines of their blocks
+    static void PaintBookmarks(HDC hdc, const DisplayedModel* dm) {
+        const ModelPos* top = &(dm->scrollBars.modelPos);
+        size_t last = min(top->pos.y + dm->clientArea.lines, dm->documentArea.lines);
+        position_t pos;
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            // a block is found once for all its bookmarks
+            for (size_t id = FindNextMark(&(dm->bookmarks), (position_t) { 0, top->pos.y }, &pos);
+                id != MARKS_NONE && pos.y < last; id = FindNextMark(&(dm->bookmarks), (position_t) { 0, pos.y + 1 }, &pos)) {
+                PaintBookmark(hdc, dm, pos.y - top->pos.y);
+            }
+            break;
+
+        case FORMAT_MODE_WRAP: {
+            size_t chars = dm->clientArea.chars;
+            size_t line = 0;    // displayed lines from the top block to the current one
+            size_t y = top->pos.y;
+            size_t count = 0;
+            size_t id = FindNextMark(&(dm->bookmarks), (position_t) { 0, y }, &pos);
+
+            for (Block* block = top->block; block && id != MARKS_NONE && line < top->pos.x + dm->clientArea.lines;
+                block = block->next, ++y, ++count) {
+
+                if (pos.y == y) {
+                    if (line >= top->pos.x) { PaintBookmark(hdc, dm, line - top->pos.x); }
+                    id = FindNextMark(&(dm->bookmarks), (position_t) { 0, y + 1 }, &pos);
+                }
+                line += block->data.len ? DIV_WITH_ROUND_UP(block->data.len, chars) : 1;
+            }
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    // inverts cells of a line of the client area
+    static void PaintCells(HDC hdc, const DisplayedModel* dm, size_t line, size_t column, size_t count) {
+        PatBlt(hdc, (int) (column * dm->charMetric.x), (int) (line * dm->charMetric.y),
+                (int) (count * dm->charMetric.x), (int) dm->charMetric.y, DSTINVERT);
+    }
+
+    // draws the rectangle of the column selection shown by the client area (no columns - a caret on every line)
+    static void PaintColumns(HDC hdc, const DisplayedModel* dm) {
+        const ModelPos* top = &(dm->scrollBars.modelPos);
+        ColumnRect rect;
+
+        GetColumnRect(&(dm->columns), &rect);
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT: {
+            size_t first = max(rect.y, top->pos.y);
+            size_t last = min(rect.y + rect.lines, top->pos.y + dm->clientArea.lines);
+            size_t left = dm->scrollBars.horizontal.pos;
+            size_t right = left + dm->clientArea.chars;
+
+            for (size_t y = first; y < last; ++y) {
+                if (rect.left == rect.right) {
+                    if (rect.left >= left && rect.left <= right) { PaintCaret(hdc, dm, y - top->pos.y, rect.left - left); }
+                } else if (rect.left < right && rect.right > left) {
+                    PaintCells(hdc, dm, y - top->pos.y, max(rect.left, left) - left, min(rect.right, right) - max(rect.left, left));
+                }
+            }
+            break;
+        }
+
+        case FORMAT_MODE_WRAP: {
+            size_t chars = dm->clientArea.chars;
+            size_t line = 0;    // displayed lines from the top block to the current one
+            size_t y = top->pos.y;
+            size_t count = 0;
+
+            for (Block* block = top->block; block && y < rect.y + rect.lines && line < top->pos.x + dm->clientArea.lines;
+                block = block->next, ++y, ++count) {
+
+                size_t blockLines = block->data.len ? DIV_WITH_ROUND_UP(block->data.len, chars) : 1;
+
+                if (y < rect.y) {
+                    line += blockLines;
+                    continue;
+                }
+
+                if (rect.left == rect.right) {
+                    size_t blockLine = rect.left / chars;
+                    size_t column = rect.left % chars;
+
+                    // the end of a full line stays on it
+                    if (rect.left && rect.left == block->data.len && !column) {
+                        --blockLine;
+                        column = chars;
+                    }
+
+                    if (blockLine < blockLines && line + blockLine >= top->pos.x
+                        && line + blockLine - top->pos.x < dm->clientArea.lines) {
+                        PaintCaret(hdc, dm, line + blockLine - top->pos.x, column);
+                    }
+                }
+
+                // the columns of the rectangle are shown by the lines of the block only
+                for (size_t x = rect.left, run; x < rect.right && x / chars < blockLines; x += run) {
+                    size_t blockLine = x / chars;
+                    size_t column = x % chars;
+
+                    run = min(rect.right - x, chars - column);
+                    if (line + blockLine >= top->pos.x && line + blockLine - top->pos.x < dm->clientArea.lines) {
+                        PaintCells(hdc, dm, line + blockLine - top->pos.x, column, run);
+                    }
+                }
+                line += blockLines;
+            }
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    // underlines of the styles of the decorations
+    static const COLORREF decorationColors[DECORATION_STYLES] = {
+        RGB(0, 120, 215), RGB(0, 160, 60), RGB(230, 140, 0), RGB(220, 0, 0)
+    };
+
+    // draws a bar under cells of a line of the client area, the bars of the layers are one above another
+    static void PaintDecoration(HDC hdc, const DisplayedModel* dm, HBRUSH brush, size_t layer, size_t line, size_t column, size_t count) {
+        size_t height = max(dm->charMetric.y / 8, 1);
+        RECT rect;
+
+        rect.left = (LONG) (column * dm->charMetric.x);
+        rect.right = (LONG) ((column + count) * dm->charMetric.x);
+        rect.bottom = (LONG) ((line + 1) * dm->charMetric.y - layer * height);
+        rect.top = rect.bottom - (LONG) height;
+        FillRect(hdc, &rect, brush);
+    }
+
+    // draws the runs of a layer of the decorations, the runs are sorted by position
+    static void PaintDecorationRuns(HDC hdc, const DisplayedModel* dm, const HBRUSH* brushes, size_t layer,
+                                    const DecorationRun* runs, size_t len) {
+        const ModelPos* top = &(dm->scrollBars.modelPos);
+        size_t chars = dm->clientArea.chars;
+        size_t line = 0;    // displayed lines from the top block to the current one
+        size_t y = top->pos.y;
+        size_t count = 0;
+        Block* block = top->block;
+
+        for (size_t i = 0; i < len && block;) {
+            if (runs[i].y != y) {
+                line += (dm->mode == FORMAT_MODE_WRAP && block->data.len) ? DIV_WITH_ROUND_UP(block->data.len, chars) : 1;
+                block = block->next;
+                ++y;
+                ++count;
+                continue;
+            }
+
+            // ranges of blocks replaced by an undo may be after the end
+            size_t start = min(runs[i].start, block->data.len);
+            size_t end = min(runs[i].end, block->data.len);
+            HBRUSH brush = brushes[runs[i].style];
+
+            ++i;
+            if (start == end) { continue; }
+
+            switch (dm->mode) {
+            case FORMAT_MODE_DEFAULT: {
+                size_t left = dm->scrollBars.horizontal.pos;
+                size_t right = left + chars;
+
+                if (start < right && end > left) {
+                    PaintDecoration(hdc, dm, brush, layer, line, max(start, left) - left, min(end, right) - max(start, left));
+                }
+                break;
+            }
+
+            case FORMAT_MODE_WRAP:
+                for (size_t x = start, run; x < end; x += run) {
+                    size_t blockLine = x / chars;
+                    size_t column = x % chars;
+
+                    run = min(end - x, chars - column);
+                    if (line + blockLine >= top->pos.x && line + blockLine - top->pos.x < dm->clientArea.lines) {
+                        PaintDecoration(hdc, dm, brush, layer, line + blockLine - top->pos.x, column, run);
+                    }
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+        COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+    }
+
+    // draws the decorations of the blocks shown by the client area, a layer is found once for all its runs
+    static void PaintDecorations(HDC hdc, const DisplayedModel* dm) {
+        const ModelPos* top = &(dm->scrollBars.modelPos);
+        size_t last = min(top->pos.y + dm->clientArea.lines, dm->documentArea.lines);
+        HBRUSH brushes[DECORATION_STYLES];
+        size_t marks = 0;
+
+        for (size_t layer = 0; layer < DECORATION_LAYERS; ++layer) { marks += dm->decorations.layers[layer].marks.len; }
+        if (!marks) { return; }
+
+        for (size_t style = 0; style < DECORATION_STYLES; ++style) { brushes[style] = CreateSolidBrush(decorationColors[style]); }
+
+        for (size_t layer = 0; layer < DECORATION_LAYERS; ++layer) {
+            size_t len = 0;
+            DecorationRun* runs = dm->decorations.layers[layer].marks.len
+                ? GetDecorationRuns(&(dm->decorations), layer, top->pos.y, last, &len) : NULL;
+
+            if (runs) { PaintDecorationRuns(hdc, dm, brushes, layer, runs, len); }
+            free(runs);
+        }
+
+        for (size_t style = 0; style < DECORATION_STYLES; ++style) { DeleteObject(brushes[style]); }
+    }
+#endif
+
 void DisplayModel(HDC hdc, const DisplayedModel* dm) {
     assert(dm && dm->doc && dm->doc->text);
+    COUNTERS_SCOPE(COUNTER_OP_PAINT);
+    TRACE_SCOPE("DisplayModel");
 
     Block* block = dm->scrollBars.modelPos.block;
     Fragment* fragment;
     size_t displayedLines, displayedChars;
     size_t linesBlock, nextLine;
     size_t delta;
+    size_t fragmentsCount = 0;
+    size_t blocksCount = 0;
+    const HighlightRange* ranges = NULL;
+    size_t rangesLen = 0;
+
+    // blocks of the previous frames which aren't shown any more may be evicted
+    if (dm->highlight) { BeginHighlightFrame(dm->highlight); }
 
     #ifndef NDEBUG // ================================/
         // printf("Display model:\n");
@@ -286,13 +727,17 @@ void DisplayModel(HDC hdc, const DisplayedModel* dm) {
                 while (delta > fragment->data.len) {
                     delta -= fragment->data.len;
                     fragment = fragment->next;
+                    ++fragmentsCount;
                 }
 
-                PrintLine(i, hdc, dm, &fragment, displayedChars, delta);
+                // cached occurrences of the block: only changed or newly shown blocks are searched
+                rangesLen = dm->highlight ? GetBlockHighlight(dm->highlight, block, dm->scrollBars.modelPos.pos.y + i, &ranges) : 0;
+                PrintLine(i, hdc, dm, &fragment, displayedChars, delta, dm->scrollBars.horizontal.pos, ranges, rangesLen);
             }
             
             block = block->next;
         }
+        blocksCount = displayedLines;
         break;
 
     case FORMAT_MODE_WRAP:
@@ -307,10 +752,11 @@ void DisplayModel(HDC hdc, const DisplayedModel* dm) {
         while (delta > fragment->data.len) {
             delta -= fragment->data.len;
             fragment = fragment->next;
+            ++fragmentsCount;
         }
 
         // print
-        for (size_t i = 0; i < displayedLines; nextLine = 0,
+        for (size_t i = 0; i < displayedLines; nextLine = 0, ++blocksCount,
             block = block->next, fragment = block ? block->data.fragments->nodes : NULL) {
 
             // empty line
@@ -321,20 +767,24 @@ void DisplayModel(HDC hdc, const DisplayedModel* dm) {
 
             linesBlock = DIV_WITH_ROUND_UP(block->data.len, dm->clientArea.chars);
             displayedChars = dm->clientArea.chars;
+            rangesLen = dm->highlight ? GetBlockHighlight(dm->highlight, block, dm->scrollBars.modelPos.pos.y + blocksCount, &ranges) : 0;
 
             if (linesBlock - nextLine <= displayedLines - i) {
 
                 for (; nextLine < linesBlock - 1; ++i, ++nextLine) {
-                    delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta);
+                    delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta,
+                                      nextLine * dm->clientArea.chars, ranges, rangesLen);
                 }
 
                 displayedChars = (block->data.len % dm->clientArea.chars) ? (block->data.len % dm->clientArea.chars) : dm->clientArea.chars;
-                delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta);
+                delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta,
+                                  nextLine * dm->clientArea.chars, ranges, rangesLen);
                 
                 ++i;
             } else {
                 for (; i < displayedLines; ++i, ++nextLine) {
-                    delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta);
+                    delta = PrintLine(i, hdc, dm, &fragment, displayedChars, delta,
+                                      nextLine * dm->clientArea.chars, ranges, rangesLen);
                 }
             }
         }
@@ -344,6 +794,15 @@ void DisplayModel(HDC hdc, const DisplayedModel* dm) {
         PrintError(NULL, ERR_PARAM, __FILE__, __LINE__);
         return;
     }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, blocksCount);
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, fragmentsCount);
+
+    #ifdef CARET_ON
+        if (dm->carets.len > 1) { PaintCarets(hdc, dm); }
+        if (dm->columns.isSelected) { PaintColumns(hdc, dm); }
+        PaintDecorations(hdc, dm);
+        if (dm->bookmarks.len) { PaintBookmarks(hdc, dm); }
+    #endif
 }
 
 static void UpdateScrollPos_Back(DisplayedModel* dm, size_t count) {
@@ -351,6 +810,8 @@ static void UpdateScrollPos_Back(DisplayedModel* dm, size_t count) {
 
     switch (dm->mode) {
     case FORMAT_MODE_DEFAULT:
+        COUNTER_ADD(COUNTER_BLOCKS_VISITED, dm->scrollBars.modelPos.pos.y - dm->scrollBars.vertical.pos);
+
         // for remaining
         while (dm->scrollBars.modelPos.pos.y != dm->scrollBars.vertical.pos) {
             dm->scrollBars.modelPos.block = dm->scrollBars.modelPos.block->prev;
@@ -371,6 +832,7 @@ static void UpdateScrollPos_Back(DisplayedModel* dm, size_t count) {
             // prev block
             dm->scrollBars.modelPos.block = dm->scrollBars.modelPos.block->prev;
             --(dm->scrollBars.modelPos.pos.y);
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, 1);
             if (dm->scrollBars.modelPos.block->data.len > 0) {
                 dm->scrollBars.modelPos.pos.x = DIV_WITH_ROUND_UP(dm->scrollBars.modelPos.block->data.len, dm->clientArea.chars) - 1;
             } else {
@@ -394,6 +856,8 @@ static void UpdateScrollPos_Forward(DisplayedModel* dm, size_t count) {
 
     switch (dm->mode) {
     case FORMAT_MODE_DEFAULT:
+        COUNTER_ADD(COUNTER_BLOCKS_VISITED, dm->scrollBars.vertical.pos - dm->scrollBars.modelPos.pos.y);
+
         // for remaining
         while (dm->scrollBars.modelPos.pos.y != dm->scrollBars.vertical.pos) {
             dm->scrollBars.modelPos.block = dm->scrollBars.modelPos.block->next;
@@ -425,6 +889,7 @@ static void UpdateScrollPos_Forward(DisplayedModel* dm, size_t count) {
             // next block
             dm->scrollBars.modelPos.block = block;
             ++dm->scrollBars.modelPos.pos.y;
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, 1);
 
             if (block->data.len > 0) {
                 linesBlock = DIV_WITH_ROUND_UP(block->data.len, dm->clientArea.chars);
@@ -441,6 +906,15 @@ static void UpdateScrollPos_Forward(DisplayedModel* dm, size_t count) {
     }
 }
 
+// finds the position of the vertical scroll-bar through the index of displayed lines
+static int JumpScrollPos(DisplayedModel* dm) {
+    assert(dm);
+
+    size_t chars = dm->mode == FORMAT_MODE_WRAP ? dm->clientArea.chars : 0;
+
+    return FindDisplayedLine(&(dm->lineIndex), dm->doc, chars, dm->scrollBars.vertical.pos, &(dm->scrollBars.modelPos));
+}
+
 static void InitRect(RECT* rectangle, const DisplayedModel* dm) {
     assert(rectangle);
 
@@ -459,6 +933,8 @@ static void InitRect(RECT* rectangle, const DisplayedModel* dm) {
 size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction, RECT* rectangle) {
     assert(dm);
     assert(rectangle);
+    COUNTERS_SCOPE(COUNTER_OP_SCROLL);
+    TRACE_SCOPE("Scroll");
 
     int xScroll = 0;
     int yScroll = 0;
@@ -471,8 +947,9 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
         if (count) {
             dm->scrollBars.vertical.pos -= count;
 
-            UpdateScrollPos_Back(dm, count);
-            SetRelativePos(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+            // a long jump (the thumb) is found by the index, a short one is walked
+            if (count <= LINE_INDEX_STEP || JumpScrollPos(dm)) { UpdateScrollPos_Back(dm, count); }
+            MarkView(hwnd, dm, VIEW_VERT_POS);
 
             yScroll = (int) (count * dm->charMetric.y);
             rectangle->bottom = dm->charMetric.y * min(count, dm->clientArea.lines);
@@ -485,8 +962,8 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
         if (count) {
             dm->scrollBars.vertical.pos += count;
 
-            UpdateScrollPos_Forward(dm, count);
-            SetRelativePos(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+            if (count <= LINE_INDEX_STEP || JumpScrollPos(dm)) { UpdateScrollPos_Forward(dm, count); }
+            MarkView(hwnd, dm, VIEW_VERT_POS);
 
             yScroll = - (int) (count * dm->charMetric.y);
             rectangle->top = dm->charMetric.y * (dm->clientArea.lines - min(count, dm->clientArea.lines));
@@ -501,7 +978,7 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
         if (count) {
             dm->scrollBars.horizontal.pos -= count;
 
-            SetRelativePos(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+            MarkView(hwnd, dm, VIEW_HORZ_POS);
 
             xScroll = (int) (count * dm->charMetric.x);
             rectangle->left = dm->charMetric.x * (dm->clientArea.chars - min(count, dm->clientArea.chars));
@@ -515,7 +992,7 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
         count = min(count, dm->scrollBars.horizontal.maxPos - dm->scrollBars.horizontal.pos);
         if (count) {
             dm->scrollBars.horizontal.pos += count;
-            SetRelativePos(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+            MarkView(hwnd, dm, VIEW_HORZ_POS);
 
             xScroll = - (int) (count * dm->charMetric.x);
             rectangle->right = dm->charMetric.x * min(count, dm->clientArea.chars);
@@ -528,11 +1005,17 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
         return 0;
     }
 
-    ScrollWindow(hwnd, xScroll, yScroll, NULL, NULL);
+    REPLAY_WRITE(REPLAY_OP_SCROLL, dm->scrollBars.modelPos.pos.y, dm->scrollBars.modelPos.pos.x,
+                direction, count, dm->scrollBars.horizontal.pos);
 
-    // Repaint rectangle
-    InvalidateRect(hwnd, rectangle, TRUE);
-    UpdateWindow(hwnd);
+    LATENCY_MODEL_DONE();
+
+    // the shifts of a batch of scrolls are summed, the contents are shifted by the flush
+    if (xScroll || yScroll) {
+        dm->view.scrollX += xScroll;
+        dm->view.scrollY += yScroll;
+        MarkView(hwnd, dm, VIEW_SCROLL);
+    }
 
     #ifndef NDEBUG // ==============================================/
         // PrintPos(dm);
@@ -543,6 +1026,95 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t count, Direction direction,
     return count;
 }
 
+void InvalidateView(HWND hwnd, DisplayedModel* dm) {
+    assert(dm);
+
+    MarkView(hwnd, dm, VIEW_ALL);
+}
+
+void FlushView(HWND hwnd, DisplayedModel* dm) {
+    assert(dm);
+    TRACE_SCOPE("FlushView");
+
+    ViewUpdate* view = &(dm->view);
+    int dirty = view->dirty;
+
+    if (view->isTimerSet) {
+        KillTimer(hwnd, VIEW_TIMER_ID);
+        view->isTimerSet = 0;
+    }
+    view->flushTime = GetMonotonicTime();
+
+    if (!dirty) { return; }
+
+    // cleared before the system calls: a new range of a scroll-bar may resize the window
+    view->dirty = VIEW_CLEAN;
+
+    // scroll-bars
+    if (dirty & VIEW_HORZ_RANGE) {
+        SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+    } else if (dirty & VIEW_HORZ_POS) {
+        SetRelativePos(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+    }
+
+    if (dirty & VIEW_VERT_RANGE) {
+        SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+    } else if (dirty & VIEW_VERT_POS) {
+        SetRelativePos(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+    }
+
+    // contents: damaged lines are shifted by a scroll, so both of them repaint the whole window
+    if (dirty & VIEW_SCROLL) {
+        RECT rectangle;
+
+        InitRect(&rectangle, dm);
+        if ((dirty & (VIEW_ALL | VIEW_LINES)) || abs(view->scrollX) >= rectangle.right
+            || abs(view->scrollY) >= rectangle.bottom) {
+            dirty |= VIEW_ALL;
+        } else {
+            // the uncovered part is added to the update region
+            ScrollWindow(hwnd, view->scrollX, view->scrollY, NULL, NULL);
+        }
+        view->scrollX = 0;
+        view->scrollY = 0;
+    }
+
+    if (dirty & VIEW_ALL) {
+        InvalidateRect(hwnd, NULL, TRUE);
+    } else if (dirty & VIEW_LINES) {
+        RECT rectangle;
+
+        InitRect(&rectangle, dm);
+        rectangle.top = (long) (dm->charMetric.y * view->firstLine);
+        rectangle.bottom = (long) (dm->charMetric.y * view->lastLine);
+        InvalidateRect(hwnd, &rectangle, TRUE);
+    }
+
+    if (dirty & (VIEW_SCROLL | VIEW_LINES | VIEW_ALL)) { UpdateWindow(hwnd); }
+
+    #ifdef CARET_ON
+        if (dirty & VIEW_CARET) { CaretSetPos(dm); }
+    #endif
+}
+
+void UpdateView(HWND hwnd, DisplayedModel* dm) {
+    assert(dm);
+
+    // the next key or click comes with its own changes: one flush covers both of them
+    if (HIWORD(GetQueueStatus(QS_KEY | QS_MOUSEBUTTON))
+        && GetMonotonicTime() - dm->view.flushTime < VIEW_FRAME_MS * 1000 * NS_PER_US) {
+        #ifdef CARET_ON
+            MarkView(hwnd, dm, VIEW_CARET);
+        #endif
+        return;
+    }
+
+    #ifdef CARET_ON
+        dm->view.dirty |= VIEW_CARET;
+    #endif
+    FlushView(hwnd, dm);
+}
+
 static void UpdateHorizontalSB_Default(HWND hwnd, DisplayedModel* dm) {
     assert(dm);
 
@@ -615,6 +1187,7 @@ static void UpdateVerticalSB_Wrap(HWND hwnd, DisplayedModel* dm) {
             // prev block
             dm->scrollBars.modelPos.block = dm->scrollBars.modelPos.block->prev;
             --dm->scrollBars.modelPos.pos.y;
+            COUNTER_ADD(COUNTER_BLOCKS_VISITED, 1);
             if (dm->scrollBars.modelPos.block->data.len > 0) {
                 dm->scrollBars.modelPos.pos.x = DIV_WITH_ROUND_UP(dm->scrollBars.modelPos.block->data.len, dm->clientArea.chars) - 1;
             } else {
@@ -892,67 +1465,112 @@ static void UpdateVerticalSB_Wrap(HWND hwnd, DisplayedModel* dm) {
         ++dm->caret.clientPos.x;
     }
 
-    void CaretPageUp(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+    int CaretMove(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle) {
         assert(dm && rectangle);
-        assert(dm->scrollBars.vertical.pos);
 
-        size_t linePos, delta;
+        switch (direction) {
+        case UP:
+            switch (dm->mode) {
+            case FORMAT_MODE_DEFAULT:
+                if (!dm->caret.modelPos.pos.y) { return 0; }
 
-        switch(dm->mode) {
-        case FORMAT_MODE_DEFAULT:
-            linePos = dm->caret.modelPos.pos.y;
-            break;
+                CaretMoveToTop_Default(hwnd, dm, rectangle);
+                if (dm->caret.modelPos.pos.x > dm->caret.modelPos.block->data.len) {
+                    FindLeftEnd_Default(hwnd, dm, rectangle);
+                }
+                return 1;
 
-        case FORMAT_MODE_WRAP:
-            linePos = dm->caret.linePos;
-            break;
+            case FORMAT_MODE_WRAP:
+                if (!dm->caret.linePos) { return 0; }
 
-        default:
-            return;
-        }
+                CaretMoveToTop_Wrap(hwnd, dm, rectangle);
+                return 1;
 
-        if (dm->clientArea.lines > 1) {
-            delta = min(DECREMENT_OF(dm->clientArea.lines - 1), dm->scrollBars.vertical.pos);
-        } else {
-            delta = 1;
-        }
+            default:
+                return 0;
+            }
 
-        if (dm->caret.modelPos.pos.y > 0) {
-            PassPrev(&(dm->caret.modelPos), delta);
-            Scroll(hwnd, dm, delta, UP, rectangle);
-        }
-    }
+        case DOWN:
+            switch (dm->mode) {
+            case FORMAT_MODE_DEFAULT:
+                if (dm->caret.modelPos.pos.y >= DECREMENT_OF(dm->documentArea.lines)) { return 0; }
 
-    void CaretPageDown(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
-        assert(dm && rectangle);
-        assert(dm->scrollBars.vertical.maxPos - dm->scrollBars.vertical.pos);
+                CaretMoveToBottom_Default(hwnd, dm, rectangle);
+                if (dm->caret.modelPos.pos.x > dm->caret.modelPos.block->data.len) {
+                    FindLeftEnd_Default(hwnd, dm, rectangle);
+                }
+                return 1;
 
-        size_t linePos, delta;
+            case FORMAT_MODE_WRAP:
+                if (dm->caret.linePos >= DECREMENT_OF(dm->wrapModel.lines)) { return 0; }
 
-        switch(dm->mode) {
-        case FORMAT_MODE_DEFAULT:
-            linePos = dm->caret.modelPos.pos.y;
-            break;
+                CaretMoveToBottom_Wrap(hwnd, dm, rectangle);
+                return 1;
 
-        case FORMAT_MODE_WRAP:
-            linePos = dm->caret.linePos;
-            break;
+            default:
+                return 0;
+            }
 
-        default:
-            return;
-        }
+        case LEFT:
+            switch (dm->mode) {
+            case FORMAT_MODE_DEFAULT:
+                if (dm->caret.modelPos.pos.x > 0) {
+                    CaretMoveToLeft_Default(hwnd, dm, rectangle);
+                } else if (dm->caret.modelPos.pos.y > 0) {
+                    CaretMoveToTop_Default(hwnd, dm, rectangle);
+                    FindRightEnd_Default(hwnd, dm, rectangle);
+                } else {
+                    return 0;
+                }
+                return 1;
 
-        if (dm->clientArea.lines > 1) {
-            delta = min(DECREMENT_OF(dm->clientArea.lines - 1),
-                        dm->scrollBars.vertical.maxPos - dm->scrollBars.vertical.pos);
-        } else {
-            delta = 1;
-        }
+            case FORMAT_MODE_WRAP:
+                if (dm->caret.clientPos.x > 0) {
+                    CaretMoveToLeft_Wrap(dm);
+                } else if (dm->caret.linePos > 0) {
+                    CaretMoveToTop_Wrap(hwnd, dm, rectangle);
+                    FindRightEnd_Wrap(dm);
+                } else {
+                    return 0;
+                }
+                return 1;
 
-        if (linePos - dm->caret.clientPos.y + delta <= dm->scrollBars.vertical.maxPos) {
-            PassNext(&(dm->caret.modelPos), delta);
-            Scroll(hwnd, dm, delta, DOWN, rectangle);
-        }
+            default:
+                return 0;
+            }
+
+        case RIGHT:
+            switch (dm->mode) {
+            case FORMAT_MODE_DEFAULT:
+                if (dm->caret.modelPos.pos.x < dm->caret.modelPos.block->data.len) {
+                    CaretMoveToRight_Default(hwnd, dm, rectangle);
+                } else if (dm->caret.modelPos.pos.y < DECREMENT_OF(dm->documentArea.lines)) {
+                    CaretMoveToBottom_Default(hwnd, dm, rectangle);
+                    if (dm->caret.modelPos.pos.x) { FindHome_Default(hwnd, dm, rectangle); }
+                } else {
+                    return 0;
+                }
+                return 1;
+
+            case FORMAT_MODE_WRAP:
+                if (dm->caret.modelPos.pos.x < dm->caret.modelPos.block->data.len
+                    && dm->caret.clientPos.x < dm->clientArea.chars) {
+                    CaretMoveToRight_Wrap(dm);
+                } else if (dm->caret.linePos < DECREMENT_OF(dm->wrapModel.lines)) {
+                    CaretMoveToBottom_Wrap(hwnd, dm, rectangle);
+                    if (dm->caret.clientPos.x) { FindHome_Wrap(dm); }
+                } else {
+                    return 0;
+                }
+                return 1;
+
+            default:
+                return 0;
+            }
+
+        default:
+            return 0;
+        }
     }
 
     void CaretSetPos(DisplayedModel* dm) {
@@ -1026,6 +1644,7 @@ static void UpdateVerticalSB_Wrap(HWND hwnd, DisplayedModel* dm) {
 
     void FindCaret(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
         assert(dm);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
         size_t scrollValue;
 
         if (dm->caret.isHidden.x) {
@@ -1089,357 +1708,1034 @@ static void UpdateVerticalSB_Wrap(HWND hwnd, DisplayedModel* dm) {
         }
     }
 
-    static size_t FindPos(Fragment** fragment, size_t* delta) {
-        assert(fragment && *fragment);
-        assert(delta);
+    // sets the client position of the caret on one axis, a hidden caret is put to the border (see FindCaret)
+    static void SetClientPos(HWND hwnd, int* p_isHidden, size_t modelPos, size_t scrollBarPos, size_t* pClientPos, size_t clientPosMax) {
+        assert(p_isHidden && pClientPos);
 
-        size_t counter = 0;
+        if (modelPos < scrollBarPos) {
+            // caret is over the top/left border
+            *pClientPos = 0;
+            if (!*p_isHidden) { CaretHide(hwnd, p_isHidden); }
 
-        while (*delta > (*fragment)->data.len) {
-            *delta -= (*fragment)->data.len;
-            *fragment = (*fragment)->next;
+        } else if (modelPos > scrollBarPos + clientPosMax) {
+            // caret is over the bottom/right border
+            *pClientPos = clientPosMax;
+            if (!*p_isHidden) { CaretHide(hwnd, p_isHidden); }
 
-            ++counter;
+        } else {
+            *pClientPos = modelPos - scrollBarPos;
+            if (*p_isHidden) { CaretShow(hwnd, p_isHidden); }
         }
+    }
 
-        return counter;
+    // a move of the caret by other means than the set drops the other carets and the column selection
+    static void DropCarets(HWND hwnd, DisplayedModel* dm) {
+        if (dm->carets.len > 1 || dm->columns.isSelected) { MarkView(hwnd, dm, VIEW_ALL); }
+        ClearCarets(&(dm->carets));
+        ClearColumnSelection(&(dm->columns));
     }
 
-    static int SplitFragment(ListFragment* fragments, Fragment* prevFragment, size_t delta) {
-        FragmentData_t fragmentData = { prevFragment->data.len - delta, prevFragment->data.pos + delta };
-        Fragment* newFragment = CreateFragment(prevFragment, &fragmentData);
+    // the chars of a wrapped line (0 - a block is one line), the key of the line index
+    static size_t GetIndexChars(const DisplayedModel* dm) {
+        return dm->mode == FORMAT_MODE_WRAP ? dm->clientArea.chars : 0;
+    }
 
-        if (!newFragment) { return ERR_NOMEM; }
+    static size_t GetDisplayedLines(const DisplayedModel* dm) {
+        return dm->mode == FORMAT_MODE_WRAP ? dm->wrapModel.lines : dm->documentArea.lines;
+    }
 
-        InsertFragments(fragments, newFragment);
-        prevFragment->data.len = delta;
+    // the first position of the scroll-bar showing a position, the current one if it's shown
+    static size_t GetShowingPos(size_t scrollBarPos, size_t maxPos, size_t modelPos, size_t clientPosMax) {
+        if (modelPos >= scrollBarPos && modelPos <= scrollBarPos + clientPosMax) { return scrollBarPos; }
 
-        return ERR_SUCCESS;
+        // in the middle of the client area
+        return min(modelPos - min(modelPos, clientPosMax / 2), maxPos);
     }
 
-    int CaretAddChar(HWND hwnd, DisplayedModel* dm, char c) {
-        assert(dm);
-        
-        ListFragment* fragments = dm->caret.modelPos.block->data.fragments;
-        Fragment* fragment = fragments->nodes;
-        Fragment* newFragment = NULL;
-        FragmentData_t fragmentData = {1, dm->doc->text->len};
+    /*
+     * Moves the caret and the client area in one step: the top line is set directly, the top
+     * block is found by the line index and the whole window is damaged (no ScrollWindow).
+     * clientX - the column of the caret in a wrapped line (FORMAT_MODE_WRAP).
+     */
+    static void JumpTo(HWND hwnd, DisplayedModel* dm, ModelPos modelPos, size_t linePos, size_t clientX,
+                        size_t topLine, RECT* rectangle) {
+        assert(dm && rectangle && modelPos.block);
+        TRACE_SCOPE("JumpTo");
+
+        size_t oldPos = dm->scrollBars.vertical.pos;
+        size_t newPos = min(topLine, dm->scrollBars.vertical.maxPos);
+
+        // the top of the client area
+        if (newPos != oldPos) {
+            dm->scrollBars.vertical.pos = newPos;
+
+            if (JumpScrollPos(dm)) {
+                if (newPos < oldPos) {
+                    UpdateScrollPos_Back(dm, oldPos - newPos);
+                } else {
+                    UpdateScrollPos_Forward(dm, newPos - oldPos);
+                }
+            }
+            MarkView(hwnd, dm, VIEW_VERT_POS);
+        }
 
-        if (AddChar(dm->doc->text, c) < 0) {
-            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-            return ERR_NOMEM;
+        // the caret
+        dm->caret.modelPos = modelPos;
+        dm->caret.linePos = linePos;
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT: {
+            size_t scrollPos = GetShowingPos(dm->scrollBars.horizontal.pos, dm->scrollBars.horizontal.maxPos,
+                                            modelPos.pos.x, DECREMENT_OF(dm->clientArea.chars));
+
+            if (scrollPos != dm->scrollBars.horizontal.pos) {
+                dm->scrollBars.horizontal.pos = scrollPos;
+                MarkView(hwnd, dm, VIEW_HORZ_POS);
+            }
+            SetClientPos(hwnd, &(dm->caret.isHidden.x), modelPos.pos.x, dm->scrollBars.horizontal.pos,
+                        &(dm->caret.clientPos.x), DECREMENT_OF(dm->clientArea.chars));
+            break;
         }
 
-        // find place
-        size_t delta = dm->caret.modelPos.pos.x;
-        FindPos(&fragment, &delta);
+        case FORMAT_MODE_WRAP:
+            dm->caret.clientPos.x = clientX;
+            if (dm->caret.isHidden.x) { CaretShow(hwnd, &(dm->caret.isHidden.x)); }
+            break;
+
+        default:
+            break;
+        }
 
-        // split
-        if (delta && delta < fragment->data.len) {
-            if (SplitFragment(fragments, fragment, delta)) {
-                --dm->doc->text->len;
-                dm->doc->text->data[dm->doc->text->len] = '\0';
+        SetClientPos(hwnd, &(dm->caret.isHidden.y), linePos, dm->scrollBars.vertical.pos,
+                    &(dm->caret.clientPos.y), DECREMENT_OF(dm->clientArea.lines - 1));
 
-                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-                return ERR_NOMEM;
+        REPLAY_WRITE(REPLAY_OP_SCROLL, dm->scrollBars.modelPos.pos.y, dm->scrollBars.modelPos.pos.x,
+                    newPos < oldPos ? UP : DOWN, newPos < oldPos ? oldPos - newPos : newPos - oldPos,
+                    dm->scrollBars.horizontal.pos);
+
+        LATENCY_MODEL_DONE();
+        InitRect(rectangle, dm);
+        MarkView(hwnd, dm, VIEW_ALL);
+    }
+
+    // moves the caret to a position of a block starting at a displayed line and shows it
+    static void JumpToBlockPos(HWND hwnd, DisplayedModel* dm, ModelPos modelPos, size_t blockLine, RECT* rectangle) {
+        assert(dm && rectangle);
+
+        size_t linePos = blockLine;
+        size_t clientX = 0;
+
+        if (dm->mode == FORMAT_MODE_WRAP) {
+            size_t chars = dm->clientArea.chars;
+
+            // the end of a full line stays on it (see FindRightEnd_Wrap)
+            if (modelPos.pos.x && modelPos.pos.x == modelPos.block->data.len && modelPos.pos.x % chars == 0) {
+                clientX = chars;
+                linePos += modelPos.pos.x / chars - 1;
+            } else {
+                clientX = modelPos.pos.x % chars;
+                linePos += modelPos.pos.x / chars;
             }
         }
 
-        // insert
-        if (!fragment->data.len) {
-            ++fragment->data.len;
-            fragment->data.pos = dm->doc->text->len - 1;
-        } else if (delta == fragment->data.len && dm->doc->text->len == (fragment->data.pos + fragment->data.len + 1)) {
-            ++fragment->data.len;
+        size_t topLine = GetShowingPos(dm->scrollBars.vertical.pos, dm->scrollBars.vertical.maxPos,
+                                        linePos, DECREMENT_OF(dm->clientArea.lines - 1));
+
+        JumpTo(hwnd, dm, modelPos, linePos, clientX, topLine, rectangle);
+    }
+
+    void CaretGoTo(HWND hwnd, DisplayedModel* dm, ModelPos modelPos, RECT* rectangle) {
+        assert(dm && rectangle && modelPos.block);
+        assert(modelPos.pos.x <= modelPos.block->data.len);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("CaretGoTo");
+
+        ModelPos blockPos;
+        size_t blockLine;
+
+        if (FindBlockLine(&(dm->lineIndex), dm->doc, GetIndexChars(dm), modelPos.pos.y, &blockPos, &blockLine)) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return;
+        }
+        assert(blockPos.block == modelPos.block);
+
+        DropCarets(hwnd, dm);
+        JumpToBlockPos(hwnd, dm, modelPos, blockLine, rectangle);
+    }
+
+    int CaretGoToLine(HWND hwnd, DisplayedModel* dm, size_t y, size_t x, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("CaretGoToLine");
+
+        ModelPos modelPos;
+        size_t blockLine;
+
+        int errValue = FindBlockLine(&(dm->lineIndex), dm->doc, GetIndexChars(dm), y, &modelPos, &blockLine);
+        if (errValue) { return errValue; }
+
+        modelPos.pos.x = min(x, modelPos.block->data.len);
+        DropCarets(hwnd, dm);
+        JumpToBlockPos(hwnd, dm, modelPos, blockLine, rectangle);
+        return ERR_SUCCESS;
+    }
+
+    int CaretGoToOffset(HWND hwnd, DisplayedModel* dm, size_t offset, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("CaretGoToOffset");
+
+        ModelPos modelPos;
+        size_t blockLine;
+
+        int errValue = FindOffset(&(dm->lineIndex), dm->doc, GetIndexChars(dm), offset, &modelPos, &blockLine);
+        if (errValue) { return errValue; }
+
+        DropCarets(hwnd, dm);
+        JumpToBlockPos(hwnd, dm, modelPos, blockLine, rectangle);
+        return ERR_SUCCESS;
+    }
+
+    void CaretGoToStart(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+
+        ModelPos modelPos = { dm->doc->blocks->nodes, { 0, 0 } };
+
+        DropCarets(hwnd, dm);
+        JumpTo(hwnd, dm, modelPos, 0, 0, 0, rectangle);
+    }
+
+    void CaretGoToEnd(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+
+        Block* last = dm->doc->blocks->last;
+        ModelPos modelPos = { last, { last->data.len, DECREMENT_OF(dm->doc->blocks->len) } };
+        size_t blockLines = 1;
+
+        if (dm->mode == FORMAT_MODE_WRAP && last->data.len) {
+            blockLines = DIV_WITH_ROUND_UP(last->data.len, dm->clientArea.chars);
+        }
+
+        // the start of the last block is counted back from the end of the document
+        DropCarets(hwnd, dm);
+        JumpToBlockPos(hwnd, dm, modelPos, GetDisplayedLines(dm) - blockLines, rectangle);
+    }
+
+    // moves the caret and the top of the client area by lines keeping the column of the caret
+    static int CaretPage(HWND hwnd, DisplayedModel* dm, size_t linePos, size_t topLine, RECT* rectangle) {
+        assert(dm && rectangle);
+
+        ModelPos modelPos;
+        size_t clientX = 0;
+
+        int errValue = FindDisplayedLine(&(dm->lineIndex), dm->doc, GetIndexChars(dm), linePos, &modelPos);
+        if (errValue) { return errValue; }
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            modelPos.pos.x = min(dm->caret.modelPos.pos.x, modelPos.block->data.len);
+            break;
+
+        case FORMAT_MODE_WRAP: {
+            // modelPos.pos.x is the line inside the block
+            size_t start = modelPos.pos.x * dm->clientArea.chars;
+
+            clientX = min(dm->caret.clientPos.x, min(dm->clientArea.chars, modelPos.block->data.len - start));
+            modelPos.pos.x = start + clientX;
+            break;
+        }
+
+        default:
+            return ERR_PARAM;
+        }
+
+        DropCarets(hwnd, dm);
+        JumpTo(hwnd, dm, modelPos, linePos, clientX, topLine, rectangle);
+        return ERR_SUCCESS;
+    }
+
+    // the displayed line of the caret (linePos is kept by the wrap model only)
+    static size_t GetCaretLine(const DisplayedModel* dm) {
+        return dm->mode == FORMAT_MODE_WRAP ? dm->caret.linePos : dm->caret.modelPos.pos.y;
+    }
+
+    // fully shown lines of the client area (the last one is cut)
+    static size_t GetPageLines(const DisplayedModel* dm) {
+        return dm->clientArea.lines > 1 ? DECREMENT_OF(dm->clientArea.lines) : 1;
+    }
+
+    int CaretPageUp(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("CaretPageUp");
+
+        size_t page = GetPageLines(dm);
+        size_t caretLine = GetCaretLine(dm);
+        size_t linePos = caretLine - min(page, caretLine);
+        size_t topLine = dm->scrollBars.vertical.pos - min(page, dm->scrollBars.vertical.pos);
+
+        if (linePos == caretLine && topLine == dm->scrollBars.vertical.pos) { return ERR_SUCCESS; }
+        return CaretPage(hwnd, dm, linePos, topLine, rectangle);
+    }
+
+    int CaretPageDown(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("CaretPageDown");
+
+        size_t page = GetPageLines(dm);
+        size_t caretLine = GetCaretLine(dm);
+        size_t linePos = min(caretLine + page, DECREMENT_OF(GetDisplayedLines(dm)));
+        size_t topLine = min(dm->scrollBars.vertical.pos + page, dm->scrollBars.vertical.maxPos);
+
+        if (linePos == caretLine && topLine == dm->scrollBars.vertical.pos) { return ERR_SUCCESS; }
+        return CaretPage(hwnd, dm, linePos, topLine, rectangle);
+    }
+
+    static size_t GetWrapLines(size_t len, size_t chars) {
+        return len ? DIV_WITH_ROUND_UP(len, chars) : 1;
+    }
+
+    // marks damaged lines [first, last) of the client area
+    static void MarkLines(HWND hwnd, DisplayedModel* dm, size_t first, size_t last) {
+        last = min(last, dm->clientArea.lines);
+        if (first >= last) { return; }
+
+        if (dm->view.dirty & VIEW_LINES) {
+            dm->view.firstLine = min(dm->view.firstLine, first);
+            dm->view.lastLine = max(dm->view.lastLine, last);
         } else {
-            newFragment = CreateFragment(!delta ? NULL : fragment, &fragmentData);
+            dm->view.firstLine = first;
+            dm->view.lastLine = last;
+        }
+        MarkView(hwnd, dm, VIEW_LINES);
+    }
 
-            if (!newFragment) {
-                --dm->doc->text->len;
-                dm->doc->text->data[dm->doc->text->len] = '\0';
+    /*
+     * Marks the lines changed by an edit at the caret: lines of the caret block from the caret line
+     * (blockLen - the longer length of the block before and after the edit), or all lines below it
+     * if lines are added or deleted. The whole window is damaged if the edit scrolled it.
+     */
+    static void MarkEditedLines(HWND hwnd, DisplayedModel* dm, size_t blockLen, int isToBottom,
+                                size_t horizontalPos, size_t verticalPos) {
+        if (dm->caret.isHidden.y || horizontalPos != dm->scrollBars.horizontal.pos
+            || verticalPos != dm->scrollBars.vertical.pos) {
+            MarkView(hwnd, dm, VIEW_ALL);
+            return;
+        }
 
-                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-                return ERR_NOMEM;
-            }
+        size_t lines = 1;
+
+        if (isToBottom) {
+            lines = dm->clientArea.lines;
+        } else if (dm->mode == FORMAT_MODE_WRAP) {
+            size_t blockLinePos = dm->caret.modelPos.pos.x / dm->clientArea.chars
+                                - (dm->caret.clientPos.x == dm->clientArea.chars);
 
-            InsertFragments(fragments, newFragment);
+            lines = GetWrapLines(blockLen, dm->clientArea.chars) - blockLinePos;
         }
+        MarkLines(hwnd, dm, dm->caret.clientPos.y, dm->caret.clientPos.y + lines);
+    }
 
-        // update
-        ++dm->caret.modelPos.block->data.len;
+    // a block of oldLen chars becomes newLen chars long, the horizontal scroll-bar grows with it
+    static void ChangeBlockLen(HWND hwnd, DisplayedModel* dm, size_t oldLen, size_t newLen) {
+        RemoveBlockLen(dm, oldLen);
 
-        if (dm->documentArea.chars < dm->caret.modelPos.block->data.len) {
-            dm->documentArea.chars = dm->caret.modelPos.block->data.len;
+        if (AddBlockLen(dm, newLen) && dm->mode == FORMAT_MODE_DEFAULT) {
+            UpdateHorizontalSB_Default(hwnd, dm);
+            MarkView(hwnd, dm, VIEW_HORZ_RANGE);
+        }
+    }
+
+    // the blocks touched by an edit had oldLines displayed lines, they have newLines now
+    static void UpdateWrapLines(HWND hwnd, DisplayedModel* dm, size_t oldLines, size_t newLines) {
+        if (oldLines == newLines) { return; }
+
+        dm->wrapModel.lines = dm->wrapModel.lines - oldLines + newLines;
+        UpdateVerticalSB_Wrap(hwnd, dm);
+        MarkView(hwnd, dm, VIEW_VERT_RANGE);
+    }
+
+    /*
+     * A split or a merge of the caret block keeps the top line and the caret line if the top
+     * is above the caret block or at its start and the caret is shown, so the next edits and
+     * moves of a transaction may go on before the wrap model is built again.
+     */
+    static int IsWrapKept(const DisplayedModel* dm) {
+        return !dm->caret.isHidden.y
+            && (dm->scrollBars.modelPos.pos.y < dm->caret.modelPos.pos.y
+                || (dm->scrollBars.modelPos.pos.y == dm->caret.modelPos.pos.y && !dm->scrollBars.modelPos.pos.x));
+    }
+
+    static void RebuildWrapModel(HWND hwnd, DisplayedModel* dm) {
+        dm->scrollBars.vertical.pos = BuildWrapModel(hwnd, dm);
+        UpdateVerticalSB_Wrap(hwnd, dm);
+        MarkView(hwnd, dm, VIEW_VERT_RANGE);
+    }
+
+    void BeginEdit(DisplayedModel* dm) {
+        assert(dm);
+
+        ++dm->edit.depth;
+        DocBeginUndoGroup(dm->doc);
+    }
+
+    void EndEdit(HWND hwnd, DisplayedModel* dm) {
+        assert(dm && dm->edit.depth);
+
+        DocEndUndoGroup(dm->doc);
+        if (--dm->edit.depth) { return; }
+
+        TRACE_SCOPE("EndEdit");
+
+        size_t horizontalPos = dm->scrollBars.horizontal.pos;
+        size_t verticalPos = dm->scrollBars.vertical.pos;
+
+        if (dm->edit.isWrapStale) {
+            dm->edit.isWrapStale = 0;
+            RebuildWrapModel(hwnd, dm);
+        }
+
+        // every longest block was shortened
+        if (!dm->longestBlocks) {
+            CountLongestBlocks(dm);
 
             if (dm->mode == FORMAT_MODE_DEFAULT) {
                 UpdateHorizontalSB_Default(hwnd, dm);
-                SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+                MarkView(hwnd, dm, VIEW_HORZ_RANGE);
             }
         }
 
-        if (dm->mode == FORMAT_MODE_WRAP) {
-            size_t linesBlock = 1;
+        if (horizontalPos != dm->scrollBars.horizontal.pos || verticalPos != dm->scrollBars.vertical.pos) {
+            MarkView(hwnd, dm, VIEW_ALL);
+        }
+    }
 
-            if (dm->caret.modelPos.block->data.len != 1) {
-                linesBlock = DIV_WITH_ROUND_UP(dm->caret.modelPos.block->data.len - 1, dm->clientArea.chars);
-            }
+    int CaretAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len) {
+        assert(dm && (chars || !len));
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("CaretAddChars");
 
-            if (linesBlock < DIV_WITH_ROUND_UP(dm->caret.modelPos.block->data.len, dm->clientArea.chars)) {
-                ++dm->wrapModel.lines;
-                UpdateVerticalSB_Wrap(hwnd, dm);
-                SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
-            }
+        Block* block = dm->caret.modelPos.block;
+        size_t horizontalPos = dm->scrollBars.horizontal.pos;
+        size_t verticalPos = dm->scrollBars.vertical.pos;
+        size_t oldLines = 0;
+        size_t newLines = 0;
+
+        if (DocInsertChars(dm->doc, block, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x, chars, len)) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return ERR_NOMEM;
+        }
+        MarksInsertChars(&(dm->bookmarks), dm->caret.modelPos.pos, len);
+        DecorationsInsertChars(&(dm->decorations), dm->caret.modelPos.pos, len);
+        for (size_t i = 0; i < len; ++i) {
+            REPLAY_WRITE(REPLAY_OP_ADD_CHAR, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x + i, 0, (unsigned char)chars[i], 0);
+        }
+
+        // update
+        BeginEdit(dm);
+        ChangeBlockLen(hwnd, dm, block->data.len - len, block->data.len);
+
+        if (dm->mode == FORMAT_MODE_WRAP) {
+            oldLines = GetWrapLines(block->data.len - len, dm->clientArea.chars);
+            newLines = GetWrapLines(block->data.len, dm->clientArea.chars);
+            UpdateWrapLines(hwnd, dm, oldLines, newLines);
         }
+        EndEdit(hwnd, dm);
 
+        MarkEditedLines(hwnd, dm, block->data.len, oldLines != newLines, horizontalPos, verticalPos);
         return ERR_SUCCESS;
     }
 
+    int CaretAddChar(HWND hwnd, DisplayedModel* dm, char c) {
+        return CaretAddChars(hwnd, dm, &c, 1);
+    }
+
     int CaretAddBlock(HWND hwnd, DisplayedModel* dm) {
         assert(dm);
-        int isSplitted = 0;
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("CaretAddBlock");
 
-        ListFragment* fragments = dm->caret.modelPos.block->data.fragments;
-        Fragment* fragment = fragments->nodes;
+        Block* block = dm->caret.modelPos.block;
+        size_t len = block->data.len;
+        size_t horizontalPos = dm->scrollBars.horizontal.pos;
+        size_t verticalPos = dm->scrollBars.vertical.pos;
 
-        ListFragment* newFragments = CreateListFragment();
-        Fragment* newFragment;
-        if (!newFragments) {
+        if (DocSplitBlock(dm->doc, block, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x)) {
             PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
             return ERR_NOMEM;
         }
+        MarksSplitBlock(&(dm->bookmarks), dm->caret.modelPos.pos);
+        DecorationsSplitBlock(&(dm->decorations), dm->caret.modelPos.pos);
+        REPLAY_WRITE(REPLAY_OP_ADD_BLOCK, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x, 0, 0, 0);
 
-        // find place
-        size_t delta = dm->caret.modelPos.pos.x;
-        size_t countPassFragments = FindPos(&fragment, &delta);
-
-        if (delta && delta < fragment->data.len) {
-            // split
-            if (SplitFragment(dm->caret.modelPos.block->data.fragments, fragment, delta)) {
-                DestroyListFragment(&newFragments);
-                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-                return ERR_NOMEM;
-            }
+        // update
+        BeginEdit(dm);
+        ++dm->documentArea.lines;
+        ChangeBlockLen(hwnd, dm, len, block->data.len);
+        AddBlockLen(dm, block->next->data.len);
 
-            newFragment = fragment->next;
-            isSplitted = 1;
-            ++countPassFragments;
-        } else if (delta == fragment->data.len && fragment->next) {
-            newFragment = fragment->next;
-            isSplitted = 1;
-            ++countPassFragments;
-        } else {
-            FragmentData_t fragmentData = { 0, dm->doc->text->len };
-            newFragment = CreateFragment(NULL, &fragmentData);
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            UpdateVerticalSB_Default(hwnd, dm);
+            MarkView(hwnd, dm, VIEW_VERT_RANGE);
+            break;
 
-            if (!newFragment) {
-                DestroyListFragment(&newFragments);
-                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-                return ERR_NOMEM;
+        case FORMAT_MODE_WRAP:
+            if (IsWrapKept(dm)) {
+                UpdateWrapLines(hwnd, dm, GetWrapLines(len, dm->clientArea.chars),
+                                GetWrapLines(block->data.len, dm->clientArea.chars)
+                                + GetWrapLines(block->next->data.len, dm->clientArea.chars));
+                dm->edit.isWrapStale = 1;
+            } else {
+                RebuildWrapModel(hwnd, dm);
             }
+            break;
+        
+        default:
+            break;
         }
+        EndEdit(hwnd, dm);
 
-        // insert
-        Block* block = dm->caret.modelPos.block;
-        BlockData_t blockData = { 0, newFragments };
-        int isChangeLen = block->data.len == dm->documentArea.chars;
-
-        if (isSplitted) {
-            blockData.len = block->data.len - dm->caret.modelPos.pos.x;
-        } else if (!delta) {
-            block = block->prev;
-        }
+        MarkEditedLines(hwnd, dm, 0, 1, horizontalPos, verticalPos);
+        return ERR_SUCCESS;
+    }
 
-        Block* newBlock = CreateBlock(block, &blockData);
+    int CaretDeleteChars(HWND hwnd, DisplayedModel* dm, size_t len) {
+        assert(dm);
+        assert(dm->caret.modelPos.pos.x + len <= dm->caret.modelPos.block->data.len);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("CaretDeleteChars");
 
-        if (!newBlock) {
-            DestroyListFragment(&newFragments);
-            if (!isSplitted) { DestroyFragment(&newFragment); }
+        Block* block = dm->caret.modelPos.block;
+        size_t horizontalPos = dm->scrollBars.horizontal.pos;
+        size_t verticalPos = dm->scrollBars.vertical.pos;
+        size_t oldLines = 0;
+        size_t newLines = 0;
 
+        if (DocDeleteChars(dm->doc, block, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x, len)) {
             PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
             return ERR_NOMEM;
         }
+        MarksDeleteChars(&(dm->bookmarks), dm->caret.modelPos.pos, len);
+        DecorationsDeleteChars(&(dm->decorations), dm->caret.modelPos.pos, len);
+        for (size_t i = 0; i < len; ++i) {
+            REPLAY_WRITE(REPLAY_OP_DELETE_CHAR, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x, 0, 0, 0);
+        }
 
-        if (isSplitted) {
-            newFragment->prev = NULL;
+        // update
+        BeginEdit(dm);
+        ChangeBlockLen(hwnd, dm, block->data.len + len, block->data.len);
 
-            fragment->next = NULL;
-            fragments->len = countPassFragments;
+        if (dm->mode == FORMAT_MODE_WRAP) {
+            oldLines = GetWrapLines(block->data.len + len, dm->clientArea.chars);
+            newLines = GetWrapLines(block->data.len, dm->clientArea.chars);
+            UpdateWrapLines(hwnd, dm, oldLines, newLines);
+        }
+        EndEdit(hwnd, dm);
 
-            block->data.len = dm->caret.modelPos.pos.x;
-        } else if (!delta) {
-            if (dm->caret.modelPos.block == dm->scrollBars.modelPos.block) {
-                switch (dm->mode) {
-                case FORMAT_MODE_DEFAULT:
-                    dm->scrollBars.modelPos.block = newBlock;
-                    break;
+        MarkEditedLines(hwnd, dm, block->data.len + len, oldLines != newLines, horizontalPos, verticalPos);
+        return ERR_SUCCESS;
+    }
 
-                case FORMAT_MODE_WRAP:
-                    if (dm->scrollBars.modelPos.pos.x == 1) {
-                        dm->scrollBars.modelPos.block = newBlock;
-                    }
-                    break;
+    int CaretDeleteChar(HWND hwnd, DisplayedModel* dm) {
+        assert(dm->caret.modelPos.block->data.len);
 
-                default:
-                    break;
-                }
-            }
-            
-            dm->caret.modelPos.block = newBlock;
-        }
+        return CaretDeleteChars(hwnd, dm, 1);
+    }
 
-        InsertFragments(newFragments, newFragment);
-        InsertBlocks(dm->doc->blocks, newBlock);
+    void CaretDeleteBlock(HWND hwnd, DisplayedModel* dm) {
+        assert(dm);
+        assert(dm->caret.modelPos.pos.x == dm->caret.modelPos.block->data.len);
+        assert(dm->caret.modelPos.block->next);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("CaretDeleteBlock");
 
-        // update
-        ++dm->documentArea.lines;
+        Block* block = dm->caret.modelPos.block;
+        size_t len = block->data.len;
+        size_t nextLen = block->next->data.len;
+        size_t horizontalPos = dm->scrollBars.horizontal.pos;
+        size_t verticalPos = dm->scrollBars.vertical.pos;
 
-        if (isChangeLen) {
-            dm->documentArea.chars = GetMaxBlockLen(dm->doc->blocks);
+        if (DocMergeBlocks(dm->doc, block, dm->caret.modelPos.pos.y)) { return; }
+        MarksMergeBlocks(&(dm->bookmarks), dm->caret.modelPos.pos.y, len);
+        DecorationsMergeBlocks(&(dm->decorations), dm->caret.modelPos.pos.y, len);
+        REPLAY_WRITE(REPLAY_OP_DELETE_BLOCK, dm->caret.modelPos.pos.y, dm->caret.modelPos.pos.x, 0, 0, 0);
 
-            if (dm->mode == FORMAT_MODE_DEFAULT) {
-                UpdateHorizontalSB_Default(hwnd, dm);
-                SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
-            }
-        }
+        // update
+        BeginEdit(dm);
+        --dm->documentArea.lines;
+        RemoveBlockLen(dm, nextLen);
+        ChangeBlockLen(hwnd, dm, len, block->data.len);
 
         switch (dm->mode) {
         case FORMAT_MODE_DEFAULT:
             UpdateVerticalSB_Default(hwnd, dm);
-            SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+            MarkView(hwnd, dm, VIEW_VERT_RANGE);
             break;
 
         case FORMAT_MODE_WRAP:
-            dm->scrollBars.vertical.pos = BuildWrapModel(hwnd, dm);
-            UpdateVerticalSB_Wrap(hwnd, dm);
-            SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+            if (IsWrapKept(dm)) {
+                UpdateWrapLines(hwnd, dm, GetWrapLines(len, dm->clientArea.chars) + GetWrapLines(nextLen, dm->clientArea.chars),
+                                GetWrapLines(block->data.len, dm->clientArea.chars));
+                dm->edit.isWrapStale = 1;
+            } else {
+                RebuildWrapModel(hwnd, dm);
+            }
             break;
         
         default:
             break;
         }
+        EndEdit(hwnd, dm);
 
-        return ERR_SUCCESS;
+        MarkEditedLines(hwnd, dm, 0, 1, horizontalPos, verticalPos);
     }
 
-    int CaretDeleteChar(HWND hwnd, DisplayedModel* dm) {
-        assert(dm);
-        assert(dm->caret.modelPos.block->data.len);
+    // a block changed by a pass over the carets of the set: the metrics are kept by the lengths only
+    static void OnCaretsChange(void* context, const CaretsChange* change) {
+        DisplayedModel* dm = context;
+        size_t chars = dm->clientArea.chars;
+        size_t oldLines = 0;
+        size_t newLines = 0;
+
+        switch (change->type) {
+        case CARETS_CHANGE_CHARS:
+            for (size_t i = 0; i < change->len; ++i) {
+                if (change->chars) {
+                    REPLAY_WRITE(REPLAY_OP_ADD_CHAR, change->y, change->x + i, 0, (unsigned char)change->chars[i], 0);
+                } else {
+                    REPLAY_WRITE(REPLAY_OP_DELETE_CHAR, change->y, change->x, 0, 0, 0);
+                }
+            }
+            if (change->chars) {
+                MarksInsertChars(&(dm->bookmarks), (position_t) { change->x, change->y }, change->len);
+                DecorationsInsertChars(&(dm->decorations), (position_t) { change->x, change->y }, change->len);
+            } else {
+                MarksDeleteChars(&(dm->bookmarks), (position_t) { change->x, change->y }, change->len);
+                DecorationsDeleteChars(&(dm->decorations), (position_t) { change->x, change->y }, change->len);
+            }
+            RemoveBlockLen(dm, change->oldLen);
+            AddBlockLen(dm, change->newLen);
 
-        ListFragment* fragments = dm->caret.modelPos.block->data.fragments;
-        Fragment* fragment = fragments->nodes;
+            if (dm->mode == FORMAT_MODE_WRAP) {
+                oldLines = GetWrapLines(change->oldLen, chars);
+                newLines = GetWrapLines(change->newLen, chars);
+            }
+            break;
 
-        // find place
-        size_t delta = dm->caret.modelPos.pos.x;
-        FindPos(&fragment, &delta);
+        case CARETS_CHANGE_SPLIT:
+            REPLAY_WRITE(REPLAY_OP_ADD_BLOCK, change->y, change->x, 0, 0, 0);
+            MarksSplitBlock(&(dm->bookmarks), (position_t) { change->x, change->y });
+            DecorationsSplitBlock(&(dm->decorations), (position_t) { change->x, change->y });
+            ++dm->documentArea.lines;
+            RemoveBlockLen(dm, change->oldLen);
+            AddBlockLen(dm, change->newLen);
+            AddBlockLen(dm, change->nextLen);
+            newLines = 1;   // the top of the client area may be in the block
+            break;
 
-        // split
-        if (delta) {
-            if (delta < fragment->data.len && SplitFragment(fragments, fragment, delta)) {
-                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
-                return ERR_NOMEM;
-            }
+        case CARETS_CHANGE_MERGE:
+            REPLAY_WRITE(REPLAY_OP_DELETE_BLOCK, change->y, change->x, 0, 0, 0);
+            MarksMergeBlocks(&(dm->bookmarks), change->y, change->oldLen);
+            DecorationsMergeBlocks(&(dm->decorations), change->y, change->oldLen);
+            --dm->documentArea.lines;
+            RemoveBlockLen(dm, change->oldLen);
+            RemoveBlockLen(dm, change->nextLen);
+            AddBlockLen(dm, change->newLen);
+            newLines = 1;
+            break;
 
-            assert (fragment->next);
-            fragment = fragment->next;
+        default:
+            break;
         }
 
-        // delete
-        --fragment->data.len;
-        ++fragment->data.pos;
+        // the wrap model is built once after the pass
+        if (dm->mode == FORMAT_MODE_WRAP && oldLines != newLines) { dm->edit.isWrapStale = 1; }
+    }
 
-        if (!fragment->data.len && fragments->len > 1) {
-            DeleteFragment(fragments, fragment);
-        }
+    /*
+     * Puts the caret at a position after a pass or a move of the set or the column selection: the scroll-bars
+     * and the wrap model are updated once for all the changes (lines and longest - the metrics before),
+     * the top of the client area is the anchor kept by the pass. The window is repainted once.
+     */
+    static void ShowModelPos(HWND hwnd, DisplayedModel* dm, ModelPos modelPos, size_t lines, size_t longest, RECT* rectangle) {
+        size_t blockLine = modelPos.pos.y;
 
-        // update
-        --dm->caret.modelPos.block->data.len;
+        dm->caret.modelPos = modelPos;
 
-        if (dm->documentArea.chars == dm->caret.modelPos.block->data.len + 1) {
-            dm->documentArea.chars = GetMaxBlockLen(dm->doc->blocks);
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            if (lines != dm->documentArea.lines || dm->scrollBars.vertical.pos != dm->scrollBars.modelPos.pos.y) {
+                dm->scrollBars.vertical.pos = dm->scrollBars.modelPos.pos.y;
+                UpdateVerticalSB_Default(hwnd, dm);
+                MarkView(hwnd, dm, VIEW_VERT_RANGE);
+            }
 
-            if (dm->mode == FORMAT_MODE_DEFAULT) {
+            if (longest < dm->documentArea.chars) {
                 UpdateHorizontalSB_Default(hwnd, dm);
-                SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
+                MarkView(hwnd, dm, VIEW_HORZ_RANGE);
             }
-        }
+            break;
 
-        if (dm->mode == FORMAT_MODE_WRAP && ((dm->caret.modelPos.block->data.len + 1) > dm->clientArea.chars)) {
-            size_t linesBlock = DIV_WITH_ROUND_UP(dm->caret.modelPos.block->data.len + 1, dm->clientArea.chars);
+        case FORMAT_MODE_WRAP: {
+            ModelPos blockPos;
 
-            if (linesBlock > DIV_WITH_ROUND_UP(dm->caret.modelPos.block->data.len, dm->clientArea.chars)) {
-                --dm->wrapModel.lines;
-                UpdateVerticalSB_Wrap(hwnd, dm);
-                SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+            if (dm->edit.isWrapStale) {
+                dm->edit.isWrapStale = 0;
+                dm->caret.clientPos.x = 0;
+                RebuildWrapModel(hwnd, dm);
             }
+
+            if (FindBlockLine(&(dm->lineIndex), dm->doc, GetIndexChars(dm), modelPos.pos.y, &blockPos, &blockLine)) {
+                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                return;
+            }
+            break;
+        }
+
+        default:
+            break;
         }
 
+        JumpToBlockPos(hwnd, dm, modelPos, blockLine, rectangle);
+    }
+
+    // puts the caret at the primary caret of the set
+    static void ShowCarets(HWND hwnd, DisplayedModel* dm, size_t lines, size_t longest, RECT* rectangle) {
+        ShowModelPos(hwnd, dm, dm->carets.items[dm->carets.primary], lines, longest, rectangle);
+
+        // carets which met became the caret
+        if (dm->carets.len == 1) { ClearCarets(&(dm->carets)); }
+    }
+
+    int MultiCaretAdd(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("MultiCaretAdd");
+
+        CaretSet* carets = &(dm->carets);
+        ModelPos modelPos;
+        Block* block;
+        int errValue;
+
+        ColumnClear(hwnd, dm);
+        if (!carets->len && (errValue = AddCaret(carets, dm->caret.modelPos))) { return errValue; }
+
+        switch (direction) {
+        case UP:
+            modelPos = carets->items[0];
+            block = modelPos.block->prev;
+            --modelPos.pos.y;
+            break;
+
+        case DOWN:
+            modelPos = carets->items[carets->len - 1];
+            block = modelPos.block->next;
+            ++modelPos.pos.y;
+            break;
+
+        default:
+            return ERR_PARAM;
+        }
+
+        if (!block) {
+            if (carets->len == 1) { ClearCarets(carets); }
+            return ERR_SUCCESS;
+        }
+
+        modelPos.block = block;
+        modelPos.pos.x = min(dm->caret.modelPos.pos.x, block->data.len);
+
+        if ((errValue = AddCaret(carets, modelPos))) { return errValue; }
+
+        ShowCarets(hwnd, dm, dm->documentArea.lines, dm->documentArea.chars, rectangle);
         return ERR_SUCCESS;
     }
 
-    void CaretDeleteBlock(HWND hwnd, DisplayedModel* dm) {
+    void MultiCaretClear(HWND hwnd, DisplayedModel* dm) {
         assert(dm);
-        assert(dm->caret.modelPos.pos.x == dm->caret.modelPos.block->data.len);
-        assert(dm->caret.modelPos.block->next);
 
-        Block* block = dm->caret.modelPos.block;
-        Block* nextBlock = block->next;
+        DropCarets(hwnd, dm);
+    }
 
-        ListFragment* fragments = block->data.fragments;
+    // ends a pass over the carets of the set begun by BeginEdit
+    static int EndCaretsEdit(HWND hwnd, DisplayedModel* dm, int errValue, size_t lines, size_t longest, RECT* rectangle) {
+        ShowCarets(hwnd, dm, lines, longest, rectangle);
+        EndEdit(hwnd, dm);
 
-        if (!block->data.len) {
-            if (dm->scrollBars.modelPos.block == block) {
-                dm->scrollBars.modelPos.block = nextBlock;
-            }
-            dm->caret.modelPos.block = nextBlock;
+        if (errValue) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+        return errValue;
+    }
 
-            DeleteBlock(dm->doc->blocks, block);
-        } else if (!nextBlock->data.len) {
-            DeleteBlock(dm->doc->blocks, nextBlock);
-        } else {
-            ListFragment* fragments = block->data.fragments;
-            nextBlock->data.fragments->nodes->prev = fragments->last;
-            InsertFragments(fragments, nextBlock->data.fragments->nodes);
+    int MultiCaretAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len, size_t tabSize, RECT* rectangle) {
+        assert(dm && dm->carets.len && (chars || !len) && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("MultiCaretAddChars");
+
+        size_t lines = dm->documentArea.lines;
+        size_t longest = dm->documentArea.chars;
 
-            nextBlock->data.fragments = NULL;
-            block->data.len += nextBlock->data.len;
+        BeginEdit(dm);
+        int errValue = InsertAtCarets(dm->doc, &(dm->carets), chars, len, tabSize, GetIndexChars(dm));
 
-            DeleteBlock(dm->doc->blocks, nextBlock);
+        return EndCaretsEdit(hwnd, dm, errValue, lines, longest, rectangle);
+    }
 
-            // update horizontal params
-            if (block->data.len > dm->documentArea.chars) {
-                dm->documentArea.chars = GetMaxBlockLen(dm->doc->blocks);
+    int MultiCaretAddBlock(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        assert(dm && dm->carets.len && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("MultiCaretAddBlock");
 
-                if (dm->mode == FORMAT_MODE_DEFAULT) {
-                    UpdateHorizontalSB_Default(hwnd, dm);
-                    SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
-                }
-            }
+        size_t lines = dm->documentArea.lines;
+        size_t longest = dm->documentArea.chars;
+
+        BeginEdit(dm);
+        int errValue = SplitAtCarets(dm->doc, &(dm->carets));
+
+        return EndCaretsEdit(hwnd, dm, errValue, lines, longest, rectangle);
+    }
+
+    int MultiCaretDeleteChars(HWND hwnd, DisplayedModel* dm, size_t count, int isBackward, RECT* rectangle) {
+        assert(dm && dm->carets.len && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("MultiCaretDeleteChars");
+
+        size_t lines = dm->documentArea.lines;
+        size_t longest = dm->documentArea.chars;
+
+        BeginEdit(dm);
+        int errValue = isBackward ? BackspaceAtCarets(dm->doc, &(dm->carets), count)
+                                  : DeleteAtCarets(dm->doc, &(dm->carets), count);
+
+        return EndCaretsEdit(hwnd, dm, errValue, lines, longest, rectangle);
+    }
+
+    void MultiCaretMove(HWND hwnd, DisplayedModel* dm, CaretsMove move, size_t count, RECT* rectangle) {
+        assert(dm && dm->carets.len && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("MultiCaretMove");
+
+        MoveCarets(&(dm->carets), move, count);
+        ShowCarets(hwnd, dm, dm->documentArea.lines, dm->documentArea.chars, rectangle);
+    }
+
+    // puts the caret at the active corner of the column selection (at the end of a short line), the selection is repainted
+    static void ShowColumns(HWND hwnd, DisplayedModel* dm, size_t longest, RECT* rectangle) {
+        ModelPos modelPos = dm->columns.active;
+
+        modelPos.pos.x = min(modelPos.pos.x, modelPos.block->data.len);
+        ShowModelPos(hwnd, dm, modelPos, dm->documentArea.lines, longest, rectangle);
+        MarkView(hwnd, dm, VIEW_ALL);
+    }
+
+    void ColumnSelect(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("ColumnSelect");
+
+        ColumnSelection* columns = &(dm->columns);
+        ModelPos* active = &(columns->active);
+
+        if (!columns->isSelected) {
+            DropCarets(hwnd, dm);
+            BeginColumnSelection(columns, dm->caret.modelPos);
         }
 
-        // update
-        --dm->documentArea.lines;
+        switch (direction) {
+        case UP:
+            if (!active->block->prev) { return; }
+            active->block = active->block->prev;
+            --active->pos.y;
+            break;
 
-        switch (dm->mode) {
-        case FORMAT_MODE_DEFAULT:
-            UpdateVerticalSB_Default(hwnd, dm);
-            SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+        case DOWN:
+            if (!active->block->next) { return; }
+            active->block = active->block->next;
+            ++active->pos.y;
             break;
 
-        case FORMAT_MODE_WRAP:
-            dm->scrollBars.vertical.pos = BuildWrapModel(hwnd, dm);
-            UpdateVerticalSB_Wrap(hwnd, dm);
-            SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+        case LEFT:
+            if (!active->pos.x) { return; }
+            --active->pos.x;
             break;
-        
-        default:
+
+        case RIGHT:
+            // the columns end at the end of the longest line
+            if (active->pos.x >= dm->documentArea.chars) { return; }
+            ++active->pos.x;
             break;
+
+        default:
+            return;
         }
+
+        ShowColumns(hwnd, dm, dm->documentArea.chars, rectangle);
+    }
+
+    void ColumnClear(HWND hwnd, DisplayedModel* dm) {
+        assert(dm);
+
+        if (!dm->columns.isSelected) { return; }
+
+        ClearColumnSelection(&(dm->columns));
+        MarkView(hwnd, dm, VIEW_ALL);
+    }
+
+    int ColumnCopy(const DisplayedModel* dm, const char* lineEnd, String* out) {
+        assert(dm && dm->columns.isSelected);
+
+        return CopyColumns(dm->doc, &(dm->columns), lineEnd, out);
+    }
+
+    // ends an edit of the column selection begun by BeginEdit
+    static int EndColumnsEdit(HWND hwnd, DisplayedModel* dm, int errValue, size_t longest, RECT* rectangle) {
+        ShowColumns(hwnd, dm, longest, rectangle);
+        EndEdit(hwnd, dm);
+
+        if (errValue) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+        return errValue;
+    }
+
+    int ColumnDeleteChars(HWND hwnd, DisplayedModel* dm, size_t count, int isBackward, RECT* rectangle) {
+        assert(dm && dm->columns.isSelected && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("ColumnDeleteChars");
+
+        size_t longest = dm->documentArea.chars;
+
+        BeginEdit(dm);
+        int errValue = DeleteColumns(dm->doc, &(dm->columns), count, isBackward);
+
+        return EndColumnsEdit(hwnd, dm, errValue, longest, rectangle);
+    }
+
+    int ColumnAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len, size_t tabSize, RECT* rectangle) {
+        assert(dm && dm->columns.isSelected && (chars || !len) && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("ColumnAddChars");
+
+        size_t longest = dm->documentArea.chars;
+
+        BeginEdit(dm);
+        int errValue = InsertColumns(dm->doc, &(dm->columns), chars, len, tabSize);
+
+        return EndColumnsEdit(hwnd, dm, errValue, longest, rectangle);
+    }
+
+    int ColumnFill(HWND hwnd, DisplayedModel* dm, char c, RECT* rectangle) {
+        assert(dm && dm->columns.isSelected && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("ColumnFill");
+
+        size_t longest = dm->documentArea.chars;
+
+        BeginEdit(dm);
+        int errValue = FillColumns(dm->doc, &(dm->columns), c);
+
+        return EndColumnsEdit(hwnd, dm, errValue, longest, rectangle);
+    }
+
+    int BookmarkToggle(HWND hwnd, DisplayedModel* dm) {
+        assert(dm);
+
+        size_t y = dm->caret.modelPos.pos.y;
+        position_t pos;
+        size_t id = FindNextMark(&(dm->bookmarks), (position_t) { 0, y }, &pos);
+
+        MarkView(hwnd, dm, VIEW_ALL);
+        if (id == MARKS_NONE || pos.y != y) { return AddMark(&(dm->bookmarks), (position_t) { 0, y }, NULL); }
+
+        // bookmarks of merged blocks meet in a block
+        for (; id != MARKS_NONE && pos.y == y; id = FindNextMark(&(dm->bookmarks), (position_t) { 0, y }, &pos)) {
+            RemoveMark(&(dm->bookmarks), id);
+        }
+        return ERR_SUCCESS;
+    }
+
+    int BookmarkGoToNext(HWND hwnd, DisplayedModel* dm, int isBackward, RECT* rectangle) {
+        assert(dm && rectangle);
+        COUNTERS_SCOPE(COUNTER_OP_NAVIGATE);
+        TRACE_SCOPE("BookmarkGoToNext");
+
+        const MarkSet* bookmarks = &(dm->bookmarks);
+        size_t y = dm->caret.modelPos.pos.y;
+        position_t pos;
+        size_t id;
+
+        // the search goes on from the other end of the document
+        if (isBackward) {
+            id = FindPrevMark(bookmarks, (position_t) { 0, y }, &pos);
+            if (id == MARKS_NONE) { id = FindPrevMark(bookmarks, (position_t) { SIZE_MAX, SIZE_MAX }, &pos); }
+        } else {
+            id = FindNextMark(bookmarks, (position_t) { 0, y + 1 }, &pos);
+            if (id == MARKS_NONE) { id = FindNextMark(bookmarks, (position_t) { 0, 0 }, &pos); }
+        }
+        if (id == MARKS_NONE) { return ERR_PARAM; }
+
+        return CaretGoToLine(hwnd, dm, pos.y, 0, rectangle);
+    }
+
+    int DecorationAdd(HWND hwnd, DisplayedModel* dm, DecorationLayerId layer, ModelPos from, ModelPos to, size_t style) {
+        assert(dm);
+
+        MarkView(hwnd, dm, VIEW_ALL);
+        return AddDecoration(&(dm->decorations), layer, from, to, style);
+    }
+
+    int DecorationMarkColumns(HWND hwnd, DisplayedModel* dm, size_t style) {
+        assert(dm);
+        COUNTERS_SCOPE(COUNTER_OP_EDIT);
+        TRACE_SCOPE("DecorationMarkColumns");
+
+        ColumnRect rect;
+
+        MarkView(hwnd, dm, VIEW_ALL);
+        if (dm->columns.isSelected) { GetColumnRect(&(dm->columns), &rect); }
+
+        if (!dm->columns.isSelected || rect.left == rect.right) {
+            Block* block = dm->caret.modelPos.block;
+            size_t y = dm->caret.modelPos.pos.y;
+
+            return AddDecoration(&(dm->decorations), DECORATION_MARKED, (ModelPos) { block, { 0, y } },
+                                 (ModelPos) { block, { block->data.len, y } }, style);
+        }
+
+        Block* block = rect.block;
+
+        // a block shorter than the rectangle is marked in it only
+        for (size_t i = 0; i < rect.lines; ++i, block = block->next) {
+            ModelPos from = { block, { rect.left, rect.y + i } };
+            ModelPos to = { block, { min(rect.right, block->data.len), rect.y + i } };
+            int errValue = AddDecoration(&(dm->decorations), DECORATION_MARKED, from, to, style);
+
+            if (errValue) {
+                COUNTER_ADD(COUNTER_BLOCKS_VISITED, i);
+                return errValue;
+            }
+        }
+        COUNTER_ADD(COUNTER_BLOCKS_VISITED, rect.lines);
+
+        return ERR_SUCCESS;
+    }
+
+    void DecorationClear(HWND hwnd, DisplayedModel* dm, DecorationLayerId layer) {
+        assert(dm);
+
+        if (!dm->decorations.layers[layer].marks.len) { return; }
+
+        ClearDecorations(&(dm->decorations), layer);
+        MarkView(hwnd, dm, VIEW_ALL);
     }
 #endif
 
 void SwitchMode(HWND hwnd, DisplayedModel* dm, FormatMode mode) {
     // printf("Switch mode\n");
     assert(dm);
+    COUNTERS_SCOPE(COUNTER_OP_SWITCH_MODE);
+    TRACE_SCOPE("SwitchMode");
 
     #ifndef NDEBUG // ====/
         // PrintPos(dm);
@@ -1532,8 +2828,9 @@ void SwitchMode(HWND hwnd, DisplayedModel* dm, FormatMode mode) {
         return;
     }
 
-    SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
-    SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+    MarkView(hwnd, dm, VIEW_HORZ_RANGE | VIEW_VERT_RANGE);
+
+    REPLAY_WRITE(REPLAY_OP_SWITCH_MODE, dm->scrollBars.modelPos.pos.y, dm->scrollBars.modelPos.pos.x, 0, mode, 0);
 
     #ifndef NDEBUG // ====/
         // PrintPos(dm);
@@ -1554,6 +2851,8 @@ static int UpdateParameter(size_t* pOldValue, size_t newValue) {
 void UpdateDisplayedModel(HWND hwnd, DisplayedModel* dm, LPARAM lParam) {
     // printf("UpdateDisplayedModel\n");
     assert(dm);
+    COUNTERS_SCOPE(COUNTER_OP_RESIZE);
+    TRACE_SCOPE("UpdateDisplayedModel");
 
     size_t chars = DIV_WITH_ROUND_UP(LOWORD(lParam), dm->charMetric.x) - (dm->mode == FORMAT_MODE_WRAP);
     size_t lines = DIV_WITH_ROUND_UP(HIWORD(lParam), dm->charMetric.y);
@@ -1598,6 +2897,8 @@ void UpdateDisplayedModel(HWND hwnd, DisplayedModel* dm, LPARAM lParam) {
         return;
     }
 
-    SetRelativeParam(hwnd, &(dm->scrollBars.horizontal), SB_HORZ);
-    SetRelativeParam(hwnd, &(dm->scrollBars.vertical), SB_VERT);
+    MarkView(hwnd, dm, VIEW_HORZ_RANGE | VIEW_VERT_RANGE);
+
+    REPLAY_WRITE(REPLAY_OP_RESIZE, dm->scrollBars.modelPos.pos.y, dm->scrollBars.modelPos.pos.x,
+                0, dm->clientArea.lines, dm->clientArea.chars);
 }
@@ -13,6 +13,17 @@
 #include "Error.h"
 #include "Document.h"
 #include "ScrollBar.h"
+#include "Latency.h"
+#include "Counters.h"
+#include "Trace.h"
+#include "Replay.h"
+#include "Highlight.h"
+#include "LineIndex.h"
+#include "Clock.h"
+#include "MultiCaret.h"
+#include "ColumnSelection.h"
+#include "Marks.h"
+#include "Decorations.h"
 
 #ifdef CARET_ON
     #include "Caret.h"
@@ -20,6 +31,9 @@
 
 #define DECREMENT_OF(elem) (elem - 1)
 
+#define VIEW_FRAME_MS 16        // the view is updated at most once per frame while input is pending
+#define VIEW_TIMER_ID 1         // timer flushing an update which no input flushed
+
 typedef enum {
     FORMAT_MODE_DEFAULT,
     FORMAT_MODE_WRAP
@@ -36,11 +50,6 @@ typedef struct {
     size_t y;
 } metric_t;
 
-typedef struct {
-    size_t x;
-    size_t y;
-} position_t;
-
 typedef struct {
     size_t lines;
     size_t chars;
@@ -51,10 +60,37 @@ typedef struct {
     size_t lines;
 } WrapModel;
 
+typedef enum {
+    VIEW_CLEAN      = 0,
+    VIEW_HORZ_RANGE = 1 << 0,   // range and position of the horizontal scroll-bar
+    VIEW_VERT_RANGE = 1 << 1,   // range and position of the vertical scroll-bar
+    VIEW_HORZ_POS   = 1 << 2,   // position of the horizontal scroll-bar
+    VIEW_VERT_POS   = 1 << 3,   // position of the vertical scroll-bar
+    VIEW_CARET      = 1 << 4,   // position of the caret
+    VIEW_SCROLL     = 1 << 5,   // contents of the client area are shifted by (scrollX, scrollY)
+    VIEW_LINES      = 1 << 6,   // lines [firstLine, lastLine) of the client area are damaged
+    VIEW_ALL        = 1 << 7    // the whole client area is damaged
+} ViewDirty;
+
+/**
+ * Properties of the window changed by the model since the last flush. Edits and scrolls only
+ * mark them, FlushView makes the system calls once: a long batch of edits or scrolls costs
+ * one update of the scroll-bars, one ScrollWindow and one repaint.
+ */
 typedef struct {
-    Block* block;       // pointer to current block (paragraph)
-    position_t pos;     // current position
-} ModelPos;
+    int dirty;              // ViewDirty flags
+    int scrollX;            // shift of the contents (pixels)
+    int scrollY;
+    size_t firstLine;       // damaged lines of the client area
+    size_t lastLine;
+    int isTimerSet;         // the flush timer is set
+    uint64_t flushTime;     // time of the last flush
+} ViewUpdate;
+
+typedef struct {
+    size_t depth;       // count of nested BeginEdit (0 - no transaction)
+    int isWrapStale;    // blocks were split or merged, the last EndEdit builds the wrap model again
+} EditTransaction;
 
 typedef struct {
     metric_t charMetric;    // char metric
@@ -64,7 +100,12 @@ typedef struct {
 
     area_t clientArea;      // dimensions of client area
     area_t documentArea;    // dimensions of document area
+    size_t longestBlocks;   // count of blocks of documentArea.chars length (0 - they are shortened by an edit)
     WrapModel wrapModel;    // lines count for wrap model
+    Highlight* highlight;   // occurrences of the active search (NULL - no search)
+    LineIndex lineIndex;    // checkpoints of displayed lines (long jumps of the vertical scroll-bar)
+    ViewUpdate view;        // changes of the window waiting for a flush
+    EditTransaction edit;   // edit transaction (BeginEdit, EndEdit)
 
     struct {
         ScrollBar horizontal;   // horizontal scroll-bar
@@ -83,6 +124,11 @@ typedef struct {
             ModelPos modelPos;      // position relative to a model
             size_t linePos;         // line position (for wrap model)
         } caret;    // caret
+
+        CaretSet carets;    // carets of multi-caret editing (more than one), the primary one is the caret
+        ColumnSelection columns;    // rectangular selection, its active corner is the caret (not used with the carets)
+        MarkSet bookmarks;          // bookmarked blocks, the marks are at their starts
+        Decorations decorations;    // decorated ranges of the layers (find-all results, marked text)
     #endif
 } DisplayedModel;
 
@@ -97,6 +143,13 @@ typedef struct {
  */
 void InitDisplayedModel(DisplayedModel* dm, const TEXTMETRIC* tm);
 
+/**
+ * Frees memory of a DisplayModel object.
+ * IN:
+ * @param dm - pointer to a DisplayModel object
+ */
+void FreeDisplayedModel(DisplayedModel* dm);
+
 /**
  * Updates DisplayedModel object after resizing window.
  * IN:
@@ -121,6 +174,15 @@ void UpdateDisplayedModel(HWND hwnd, DisplayedModel* dm, LPARAM lParam);
  */
 void CoverDocument(HWND hwnd, DisplayedModel* dm, Document* doc);
 
+/**
+ * Moves the bookmarks and the decorations after an edit of blocks made by undo, redo or
+ * a replacement (DocChanged), the view is covered again after the edits.
+ * IN:
+ * @param context - pointer to a DisplayModel object
+ * @param change - the edit
+ */
+void FollowDocChange(void* context, const HistoryChange* change);
+
 /**
  * Switchs format mode.
  * IN:
@@ -154,6 +216,31 @@ void DisplayModel(HDC hdc, const DisplayedModel* dm);
  */
 size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir, RECT* rectangle);
 
+/**
+ * Marks the whole client area damaged (it's repainted by the next flush).
+ * IN:
+ * @param hwnd - a handle to a window
+ * @param dm - pointer to a DisplayModel object
+ */
+void InvalidateView(HWND hwnd, DisplayedModel* dm);
+
+/**
+ * Flushes the marked changes of the window: scroll-bars, contents, caret.
+ * IN:
+ * @param hwnd - a handle to a window
+ * @param dm - pointer to a DisplayModel object
+ */
+void FlushView(HWND hwnd, DisplayedModel* dm);
+
+/**
+ * Ends handling of an input: the view is flushed now, or later (by the next input or by the timer)
+ * if keys or clicks are pending and the last flush is less than a frame ago.
+ * IN:
+ * @param hwnd - a handle to a window
+ * @param dm - pointer to a DisplayModel object
+ */
+void UpdateView(HWND hwnd, DisplayedModel* dm);
+
 
 // Caret
 #ifdef CARET_ON
@@ -287,9 +374,93 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
     void CaretMoveToRight_Wrap(DisplayedModel* dm);
 
 
-    // TODO: update
-    void CaretPageUp(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
-    void CaretPageDown(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
+    /**
+     * Moves the caret by a cell as the arrow keys do (FORMAT_MODE_DEFAULT and FORMAT_MODE_WRAP):
+     * left and right pass line ends, up and down keep the column if the line is long enough.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param direction - direction of the move (UP, DOWN, LEFT, RIGHT)
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return isMoved - 1 if the caret is moved, 0 at the border of the document
+     */
+    int CaretMove(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle);
+
+
+    /**
+     * Moves the caret and the client area a page up (the fully shown lines) in one step,
+     * the column of the caret is kept if the line is long enough.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int CaretPageUp(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
+
+    /**
+     * Moves the caret and the client area a page down (the fully shown lines) in one step,
+     * the column of the caret is kept if the line is long enough.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int CaretPageDown(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
+
+    /**
+     * Moves the caret to a position of a line (block) found by the line index, the client area
+     * is centered on it if it isn't shown. The window is repainted once.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param y - index of the line (from 0)
+     * @param x - position in the line (a position after its end is its end)
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation (ERR_PARAM - no such line)
+     */
+    int CaretGoToLine(HWND hwnd, DisplayedModel* dm, size_t y, size_t x, RECT* rectangle);
+
+    /**
+     * Moves the caret to a char offset of the document (a line end is one char) found by
+     * the line index, the client area is centered on it if it isn't shown.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param offset - offset from the document start
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation (ERR_PARAM - past the end)
+     */
+    int CaretGoToOffset(HWND hwnd, DisplayedModel* dm, size_t offset, RECT* rectangle);
+
+    /**
+     * Moves the caret and the client area to the document start.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     */
+    void CaretGoToStart(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
+
+    /**
+     * Moves the caret and the client area to the document end.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     */
+    void CaretGoToEnd(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
 
 
     /**
@@ -301,6 +472,17 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
      */
     void FindCaret(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
 
+    /**
+     * Moves the caret to a position of the model, the client area is centered on it if it isn't
+     * shown. The window is repainted once.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param modelPos - new position of the caret (x <= block->data.len)
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     */
+    void CaretGoTo(HWND hwnd, DisplayedModel* dm, ModelPos modelPos, RECT* rectangle);
+
     /**
      * Sets carets on the position on display.
      * IN:
@@ -321,6 +503,26 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
 
 
     // editing
+    /**
+     * Begins an edit transaction, transactions may be nested. Edits inside it keep the metrics read
+     * by caret moves (lines of the document and of the wrap model, a longer longest block) by O(1)
+     * updates of the touched blocks. The last EndEdit builds the wrap model once if blocks were
+     * split or merged and recounts the longest block only if every block of its length was
+     * shortened. An edit outside a transaction is one. Edits of a transaction are undone as one unit.
+     * IN:
+     * @param dm - pointer to a DisplayModel object
+     */
+    void BeginEdit(DisplayedModel* dm);
+
+    /**
+     * Ends an edit transaction: the last one rebuilds the wrap model and recounts the longest block
+     * if it's needed and updates the scroll-bars once.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     */
+    void EndEdit(HWND hwnd, DisplayedModel* dm);
+
     /**
      * Adds char to the text.
      * IN:
@@ -333,6 +535,19 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
      */
     int CaretAddChar(HWND hwnd, DisplayedModel* dm, char c);
 
+    /**
+     * Adds chars to the text at the caret by one edit, the caret stays.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param chars - pointer to chars that should be added (no line ends)
+     * @param len - count of chars
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int CaretAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len);
+
     /**
      * Adds block (paragraph) to the text.
      * IN:
@@ -355,6 +570,18 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
      */
     int CaretDeleteChar(HWND hwnd, DisplayedModel* dm);
 
+    /**
+     * Deletes chars after the caret in its block by one edit.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param len - count of chars (up to the line end)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int CaretDeleteChars(HWND hwnd, DisplayedModel* dm, size_t len);
+
     /**
      * Deletes block (paragraph) from the text.
      * IN:
@@ -362,6 +589,226 @@ size_t Scroll(HWND hwnd, DisplayedModel* dm, size_t scrollValue, Direction dir,
      * @param dm - pointer to a DisplayModel object
      */
     void CaretDeleteBlock(HWND hwnd, DisplayedModel* dm);
+
+
+    // multi-caret editing
+    /**
+     * Adds a caret on the line above the first caret or below the last one at the column of
+     * the caret, the new caret becomes the caret. The caret is the first one of the set if
+     * there's no set. A move of the caret by other means drops the other carets.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param direction - UP or DOWN
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int MultiCaretAdd(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle);
+
+    /**
+     * Drops every caret but the caret.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     */
+    void MultiCaretClear(HWND hwnd, DisplayedModel* dm);
+
+    /**
+     * Adds chars at every caret by one pass over the document, the carets pass them.
+     * The metrics and the scroll-bars are updated once whatever the count of carets is.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param chars - pointer to chars that should be added (no line ends)
+     * @param len - count of chars
+     * @param tabSize - a tab is spaces up to the next multiple of it
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int MultiCaretAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len, size_t tabSize, RECT* rectangle);
+
+    /**
+     * Splits the block at every caret by one pass, the carets go to the new blocks.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int MultiCaretAddBlock(HWND hwnd, DisplayedModel* dm, RECT* rectangle);
+
+    /**
+     * Deletes chars before or after every caret by one pass, a line end is one char.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param count - count of chars deleted by a caret
+     * @param isBackward - 1 - chars before the carets (Backspace), 0 - after them (Delete)
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int MultiCaretDeleteChars(HWND hwnd, DisplayedModel* dm, size_t count, int isBackward, RECT* rectangle);
+
+    /**
+     * Moves every caret by blocks and chars of the model, carets which meet become one.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param move - the move
+     * @param count - count of moves
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     */
+    void MultiCaretMove(HWND hwnd, DisplayedModel* dm, CaretsMove move, size_t count, RECT* rectangle);
+
+    // column selection
+    /**
+     * Moves the active corner of the column selection, the selection begins at the caret if
+     * there's none. The corner keeps its column over short lines, the caret is at it or at
+     * the end of the line. A move of the caret by other means drops the selection.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param direction - direction of the move
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     */
+    void ColumnSelect(HWND hwnd, DisplayedModel* dm, Direction direction, RECT* rectangle);
+
+    /**
+     * Drops the column selection.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     */
+    void ColumnClear(HWND hwnd, DisplayedModel* dm);
+
+    /**
+     * Copies the chars of the column selection, the lines are separated by line ends.
+     * IN:
+     * @param dm - pointer to a DisplayModel object
+     * @param lineEnd - line end put between lines
+     * @param out - pointer to a String object with reserved data, the chars are appended to it
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int ColumnCopy(const DisplayedModel* dm, const char* lineEnd, String* out);
+
+    /**
+     * Deletes the selected columns of every line by one pass (no columns - chars before or after
+     * the column), the selection becomes a column caret.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param count - count of chars deleted at a column caret
+     * @param isBackward - 1 - chars before the column (Backspace), 0 - after it (Delete)
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int ColumnDeleteChars(HWND hwnd, DisplayedModel* dm, size_t count, int isBackward, RECT* rectangle);
+
+    /**
+     * Replaces the selected columns of every line with chars by one pass, the selection becomes
+     * a column caret after them. Short lines are padded with spaces.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param chars - pointer to chars that should be added (no line ends)
+     * @param len - count of chars
+     * @param tabSize - a tab is spaces up to the next multiple of it
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int ColumnAddChars(HWND hwnd, DisplayedModel* dm, const char* chars, size_t len, size_t tabSize, RECT* rectangle);
+
+    /**
+     * Replaces every selected char with a char by one pass, short lines are padded with spaces.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param c - the char
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int ColumnFill(HWND hwnd, DisplayedModel* dm, char c, RECT* rectangle);
+
+    // bookmarks
+    /**
+     * Bookmarks the block of the caret, or removes its bookmark. Bookmarks follow the edits
+     * of the document.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int BookmarkToggle(HWND hwnd, DisplayedModel* dm);
+
+    /**
+     * Moves the caret to the start of the next (previous) bookmarked block after (before) the block
+     * of the caret, the search goes on from the other end of the document.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param isBackward - 1 - the previous bookmark, 0 - the next one
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation (ERR_PARAM - no bookmarks)
+     */
+    int BookmarkGoToNext(HWND hwnd, DisplayedModel* dm, int isBackward, RECT* rectangle);
+
+    // decorations
+    /**
+     * Decorates a range of the document in a layer, the range follows the edits of the document.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param layer - DecorationLayerId
+     * @param from - position of the first char of the range
+     * @param to - position after the last char of the range
+     * @param style - style of the range (< DECORATION_STYLES)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int DecorationAdd(HWND hwnd, DisplayedModel* dm, DecorationLayerId layer, ModelPos from, ModelPos to, size_t style);
+
+    /**
+     * Marks the columns of the column selection in its blocks, or the block of the caret
+     * if no columns are selected.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param style - style of the marked text (< DECORATION_STYLES)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int DecorationMarkColumns(HWND hwnd, DisplayedModel* dm, size_t style);
+
+    /**
+     * Removes the ranges of a layer.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param layer - DecorationLayerId
+     */
+    void DecorationClear(HWND hwnd, DisplayedModel* dm, DecorationLayerId layer);
 #endif
 
 #endif // DISPLAYED_MODEL_H_INCLUDED
@@ -10,9 +10,21 @@ static void SetTitle(Document* doc, char** title) {
     *title = NULL;
 }
 
+// live snapshots may read memory dropped by the document: it is kept for them
+static int HasSnapshots(Document* doc) {
+    if (!doc->snapshots.len) { return 0; }
+
+    CollectSnapshots(&doc->snapshots);
+    return doc->snapshots.len != 0;
+}
+
 static void SetText(Document* doc, String** text) {
     assert(doc && text && *text);
 
+    if (doc->text && HasSnapshots(doc)) {
+        RetireMemory(&doc->snapshots, RETIRED_STRING, doc->text, doc->version + 1);
+        doc->text = NULL;
+    }
     if (doc->text) { DestroyString(&(doc->text)); }
     doc->text = *text;
     *text = NULL;
@@ -21,6 +33,10 @@ static void SetText(Document* doc, String** text) {
 static void SetBlocks(Document* doc, ListBlock** blocks) {
     assert(doc && blocks && *blocks);
 
+    if (doc->blocks && HasSnapshots(doc)) {
+        RetireMemory(&doc->snapshots, RETIRED_BLOCKS, doc->blocks, doc->version + 1);
+        doc->blocks = NULL;
+    }
     if (doc->blocks) { DestroyListBlock(&(doc->blocks)); }
     doc->blocks = *blocks;
     *blocks = NULL;
@@ -86,7 +102,7 @@ static int DocInsertBlock(ListBlock* blocks, size_t blockLen) {
         return ERR_NOMEM;
     }
 
-    BlockData_t blockData = {blockLen, fragments};
+    BlockData_t blockData = {blockLen, fragments, 0};
     if (AddBlockData(blocks, &blockData)) {
         DestroyListFragment(&fragments);
         PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
@@ -98,6 +114,7 @@ static int DocInsertBlock(ListBlock* blocks, size_t blockLen) {
 
 static int ScanFile(FILE* file, ListBlock* blocks, String* text) {
     assert(file && blocks && text);
+    TRACE_SCOPE("ScanFile");
 
     char* buffer = malloc((BASE_STRING_SIZE + 1) * sizeof(char));
 
@@ -143,6 +160,8 @@ static int ScanFile(FILE* file, ListBlock* blocks, String* text) {
 
 int SetFile(Document* doc, char const* filename) {
     assert(doc);
+    COUNTERS_SCOPE(COUNTER_OP_LOAD);
+    TRACE_SCOPE("SetFile");
 
     ListBlock* blocks;
     String* text;
@@ -214,9 +233,17 @@ int SetFile(Document* doc, char const* filename) {
         return ERR_NOMEM;
     }
 
+    // records of the history refer to the old blocks
+    if (doc->history) { ClearHistory(doc->history); }
+
     SetTitle(doc, &title);
     SetText(doc, &text);
     SetBlocks(doc, &blocks);
+
+    // blocks of the file are new to anything that remembers the previous ones
+    ++doc->version;
+    for (Block* block = doc->blocks->nodes; block; block = block->next) { block->data.version = doc->version; }
+
     return ERR_SUCCESS;
 }
 
@@ -238,6 +265,8 @@ void DestroyDocument(Document** ppDoc) {
     assert(ppDoc && *ppDoc);
 
     Document* pDoc = *ppDoc;
+    if (pDoc->history) { DestroyHistory(&(pDoc->history)); }
+    FreeSnapshots(&pDoc->snapshots);
     if (pDoc->title) { free(pDoc->title); }
     if (pDoc->text) { DestroyString(&(pDoc->text)); }
     if (pDoc->blocks) { DestroyListBlock(&(pDoc->blocks)); }
@@ -252,16 +281,16 @@ size_t PrintDocument(FILE* output, Document const* doc) {
 
     if (!output) { output = stdout; }
 
-    for (Block* block = doc->blocks->nodes; block; block = block->next) {
-        for (Fragment* fragment = block->data.fragments->nodes; fragment; fragment = fragment->next) {
-            for (size_t i = 0; i < fragment->data.len; ++i) {
-                fputc(doc->text->data[fragment->data.pos + i], output);
-                ++counter;
-            }
-        }
-        fputc('\n', output);
-        ++counter;
+    DocIterator it;
+    DocSpan span;
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+
+    InitDocIterator(&it, doc, start, DOC_ITER_LINE_ENDS);
+    while (DocNextSpan(&it, &span)) {
+        counter += fwrite(span.ptr, sizeof(char), span.len, output);
     }
+    fputc('\n', output);
+    ++counter;
 
     return counter;
 }
@@ -278,19 +307,19 @@ void PrintDocumentParameters(FILE* output, Document const* doc) {
     
     fprintf(output, "\tText: "); 
     if (doc->text) {
-        fprintf(output, "len = %u, size = %u\n", doc->text->len, doc->text->size);
+        fprintf(output, "len = %zu, size = %zu\n", doc->text->len, doc->text->size);
     } else {
         fprintf(output, "%s\n", null);
     }
 
     fprintf(output, "\tBlocks: "); 
     if (doc->text) {
-        fprintf(output, "len = %u\n", doc->blocks->len);
+        fprintf(output, "len = %zu\n", doc->blocks->len);
 
         Block* block = doc->blocks->nodes;
         for (size_t i = 0; i < doc->blocks->len; ++i) {
-            fprintf(output, "\t\tFragments (%u): ", i);
-            fprintf(output, "%u\n", block->data.fragments->len);
+            fprintf(output, "\t\tFragments (%zu): ", i);
+            fprintf(output, "%zu\n", block->data.fragments->len);
 
             block = block->next;
         }
@@ -303,6 +332,8 @@ size_t GetMaxBlockLen(ListBlock const* blocks) {
     assert(blocks && blocks->nodes);
 
     size_t maxLen = 0;
+
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, blocks->len);
     for (Block* block = blocks->nodes; block; block = block->next) {
         if (maxLen < block->data.len) {
             maxLen = block->data.len;
@@ -310,3 +341,917 @@ size_t GetMaxBlockLen(ListBlock const* blocks) {
     }
     return maxLen;
 }
+
+static size_t FindPos(Fragment** fragment, size_t* delta) {
+    assert(fragment && *fragment);
+    assert(delta);
+
+    size_t counter = 0;
+
+    while (*delta > (*fragment)->data.len) {
+        *delta -= (*fragment)->data.len;
+        *fragment = (*fragment)->next;
+
+        ++counter;
+    }
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, counter);
+
+    return counter;
+}
+
+static int SplitFragment(ListFragment* fragments, Fragment* prevFragment, size_t delta) {
+    FragmentData_t fragmentData = { prevFragment->data.len - delta, prevFragment->data.pos + delta };
+    Fragment* newFragment = CreateFragment(prevFragment, &fragmentData);
+
+    if (!newFragment) { return ERR_NOMEM; }
+
+    InsertFragments(fragments, newFragment);
+    prevFragment->data.len = delta;
+
+    return ERR_SUCCESS;
+}
+
+// keeps the state of a block for live snapshots before the next edit changes it
+static int Touch(Document* doc, Block* block) {
+    if (!doc->snapshots.len) { return ERR_SUCCESS; }
+
+    return PreserveBlock(&doc->snapshots, block, doc->version + 1);
+}
+
+// discards a chain of blocks out of the document
+static void DiscardBlocks(Document* doc, Block* blocks) {
+    int isKept = HasSnapshots(doc);
+
+    while (blocks) {
+        Block* next = blocks->next;
+
+        if (isKept) {
+            RetireMemory(&doc->snapshots, RETIRED_BLOCK, blocks, doc->version + 1);
+        } else {
+            DestroyBlock(&blocks);
+        }
+        blocks = next;
+    }
+}
+
+static void DiscardHistoryBlocks(void* context, Block* nodes) {
+    DiscardBlocks(context, nodes);
+}
+
+// inserts a piece of the text into a block
+static int InsertPiece(Document* doc, Block* block, size_t x, FragmentData_t piece) {
+    if (Touch(doc, block)) { return ERR_NOMEM; }
+
+    ListFragment* fragments = block->data.fragments;
+    Fragment* fragment = fragments->nodes;
+
+    // find place
+    size_t delta = x;
+    FindPos(&fragment, &delta);
+
+    // split
+    if (delta && delta < fragment->data.len) {
+        if (SplitFragment(fragments, fragment, delta)) { return ERR_NOMEM; }
+    }
+
+    // insert
+    if (!fragment->data.len) {
+        fragment->data = piece;
+    } else if (delta == fragment->data.len && piece.pos == fragment->data.pos + fragment->data.len) {
+        fragment->data.len += piece.len;
+    } else {
+        Fragment* newFragment = CreateFragment(!delta ? NULL : fragment, &piece);
+
+        if (!newFragment) { return ERR_NOMEM; }
+
+        InsertFragments(fragments, newFragment);
+    }
+
+    block->data.len += piece.len;
+    block->data.version = ++doc->version;
+
+    return ERR_SUCCESS;
+}
+
+static int InsertPieces(Document* doc, Block* block, size_t x, const FragmentData_t* pieces, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int errValue = InsertPiece(doc, block, x, pieces[i]);
+        if (errValue) { return errValue; }
+
+        x += pieces[i].len;
+    }
+    return ERR_SUCCESS;
+}
+
+// makes a fragment start at x (x < block->data.len), returns it or NULL on error
+static Fragment* CutFragments(Document* doc, Block* block, size_t x) {
+    if (Touch(doc, block)) { return NULL; }
+
+    ListFragment* fragments = block->data.fragments;
+    Fragment* fragment = fragments->nodes;
+
+    // find place
+    size_t delta = x;
+    FindPos(&fragment, &delta);
+
+    // split
+    if (delta) {
+        if (delta < fragment->data.len && SplitFragment(fragments, fragment, delta)) { return NULL; }
+
+        assert (fragment->next);
+        fragment = fragment->next;
+    }
+    return fragment;
+}
+
+// deletes chars from the fragment starting them
+static void RemoveChars(Document* doc, Block* block, Fragment* fragment, size_t len) {
+    ListFragment* fragments = block->data.fragments;
+
+    // delete: whole fragments are dropped, the last one is cut from the front
+    size_t count = 0;
+
+    for (size_t rest = len; rest;) {
+        if (fragment->data.len > rest) {
+            fragment->data.len -= rest;
+            fragment->data.pos += rest;
+            break;
+        }
+
+        Fragment* next = fragment->next;
+
+        rest -= fragment->data.len;
+        fragment->data.pos += fragment->data.len;
+        fragment->data.len = 0;
+
+        if (fragments->len > 1) { DeleteFragment(fragments, fragment); }
+        fragment = next;
+        ++count;
+    }
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, count);
+
+    block->data.len -= len;
+    block->data.version = ++doc->version;
+}
+
+static int DeleteRange(Document* doc, Block* block, size_t x, size_t len) {
+    if (!len) { return ERR_SUCCESS; }
+
+    Fragment* fragment = CutFragments(doc, block, x);
+    if (!fragment) { return ERR_NOMEM; }
+
+    RemoveChars(doc, block, fragment, len);
+    return ERR_SUCCESS;
+}
+
+// a failed record leaves the history behind the document: it is dropped
+static void CheckRecord(Document* doc, int errValue) {
+    if (errValue) {
+        ClearHistory(doc->history);
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+    }
+}
+
+int DocAddText(Document* doc, const char* chars, size_t len) {
+    assert(doc && (chars || !len));
+
+    String* text = doc->text;
+
+    // snapshots read the buffer: it moves instead of realloc
+    if (text->len + len >= text->size && HasSnapshots(doc)) {
+        size_t size = text->size + text->size / 2;
+        if (size < text->len + len + 1) { size = text->len + len + 1; }
+        size = DIV_WITH_ROUND_UP(size, BASE_STRING_SIZE) * BASE_STRING_SIZE;
+
+        COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
+        COUNTER_ADD(COUNTER_BYTES_COPIED, text->len);
+        char* data = malloc(size * sizeof(char));
+        if (!data) { return ERR_NOMEM; }
+
+        memcpy(data, text->data, text->len + 1);
+        RetireMemory(&doc->snapshots, RETIRED_TEXT, text->data, doc->version + 1);
+        text->data = data;
+        text->size = size;
+    }
+
+    return AddChars(text, chars, len) < 0 ? ERR_NOMEM : ERR_SUCCESS;
+}
+
+int DocInsertChars(Document* doc, Block* block, size_t y, size_t x, const char* chars, size_t len) {
+    assert(doc && block && (chars || !len));
+    assert(x <= block->data.len);
+
+    if (!len) { return ERR_SUCCESS; }
+
+    size_t textLen = doc->text->len;
+    FragmentData_t piece = {len, textLen};
+
+    // the chars are appended to the text once and shown by one fragment
+    if (DocAddText(doc, chars, len)) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (InsertPiece(doc, block, x, piece)) {
+        doc->text->len = textLen;
+        doc->text->data[doc->text->len] = '\0';
+
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (doc->history) { CheckRecord(doc, RecordInsert(doc->history, block, y, x, piece)); }
+
+    return ERR_SUCCESS;
+}
+
+int DocInsertText(Document* doc, Block* block, size_t y, size_t x, size_t pos, size_t len) {
+    assert(doc && block);
+    assert(x <= block->data.len && pos + len <= doc->text->len);
+
+    if (!len) { return ERR_SUCCESS; }
+
+    FragmentData_t piece = {len, pos};
+
+    if (InsertPiece(doc, block, x, piece)) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (doc->history) { CheckRecord(doc, RecordInsert(doc->history, block, y, x, piece)); }
+
+    return ERR_SUCCESS;
+}
+
+int DocInsertChar(Document* doc, Block* block, size_t y, size_t x, char c) {
+    return DocInsertChars(doc, block, y, x, &c, 1);
+}
+
+int DocDeleteChars(Document* doc, Block* block, size_t y, size_t x, size_t len) {
+    assert(doc && block);
+    assert(x + len <= block->data.len);
+
+    if (!len) { return ERR_SUCCESS; }
+
+    Fragment* fragment = CutFragments(doc, block, x);
+    if (!fragment) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    // the deleted pieces are recorded before the fragments are dropped
+    if (doc->history) { CheckRecord(doc, RecordDelete(doc->history, block, y, x, fragment, len)); }
+
+    RemoveChars(doc, block, fragment, len);
+    return ERR_SUCCESS;
+}
+
+int DocDeleteChar(Document* doc, Block* block, size_t y, size_t x) {
+    return DocDeleteChars(doc, block, y, x, 1);
+}
+
+// splits a block, the new block is the node if it is given (a block of the history without fragments)
+static int SplitBlock(Document* doc, Block* block, size_t x, Block* node) {
+    int isSplitted = 0;
+
+    if (Touch(doc, block) || (node && Touch(doc, node))) { return ERR_NOMEM; }
+
+    ListFragment* fragments = block->data.fragments;
+    Fragment* fragment = fragments->nodes;
+
+    ListFragment* newFragments = node ? node->data.fragments : CreateListFragment();
+    Fragment* newFragment;
+    if (!newFragments) { return ERR_NOMEM; }
+
+    // find place
+    size_t delta = x;
+    size_t countPassFragments = FindPos(&fragment, &delta);
+
+    if (delta && delta < fragment->data.len) {
+        // split
+        if (SplitFragment(fragments, fragment, delta)) {
+            if (!node) { DestroyListFragment(&newFragments); }
+            return ERR_NOMEM;
+        }
+
+        newFragment = fragment->next;
+        isSplitted = 1;
+        ++countPassFragments;
+    } else if (delta && delta == fragment->data.len && fragment->next) {
+        newFragment = fragment->next;
+        isSplitted = 1;
+        ++countPassFragments;
+    } else {
+        FragmentData_t fragmentData = { 0, doc->text->len };
+        newFragment = CreateFragment(NULL, &fragmentData);
+
+        if (!newFragment) {
+            if (!node) { DestroyListFragment(&newFragments); }
+            return ERR_NOMEM;
+        }
+    }
+
+    // insert
+    BlockData_t blockData = { block->data.len - x, newFragments, ++doc->version };
+    Block* newBlock = node;
+
+    // the node keeps its past states for snapshots, a new block is unseen by them
+    if (newBlock) {
+        newBlock->prev = block;
+        newBlock->next = NULL;
+        newBlock->data.len = blockData.len;
+        newBlock->data.fragments = blockData.fragments;
+        newBlock->data.version = blockData.version;
+    } else if (!(newBlock = CreateBlock(block, &blockData))) {
+        DestroyListFragment(&newFragments);
+        if (!isSplitted) { DestroyFragment(&newFragment); }
+        return ERR_NOMEM;
+    } else {
+        newBlock->data.stateVersion = blockData.version;
+    }
+
+    if (isSplitted) {
+        newFragment->prev = NULL;
+
+        fragment->next = NULL;
+        fragments->len = countPassFragments;
+        fragments->last = fragment;
+    } else if (!x) {
+        // the whole text moves to the new block, the block gets an empty fragment
+        newBlock->data.fragments = fragments;
+        block->data.fragments = newFragments;
+    }
+
+    InsertFragments(newFragments, newFragment);
+    InsertBlocks(doc->blocks, newBlock);
+
+    block->data.len = x;
+    block->data.version = doc->version;
+
+    return ERR_SUCCESS;
+}
+
+int DocSplitBlock(Document* doc, Block* block, size_t y, size_t x) {
+    assert(doc && block);
+    assert(x <= block->data.len);
+
+    if (SplitBlock(doc, block, x, NULL)) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (doc->history) { CheckRecord(doc, RecordSplit(doc->history, block, y, x, block->next)); }
+
+    return ERR_SUCCESS;
+}
+
+// takes blocks first..last out of the list
+static void UnlinkBlocks(ListBlock* blocks, Block* first, Block* last, size_t count) {
+    if (first->prev) {
+        first->prev->next = last->next;
+    } else {
+        blocks->nodes = last->next;
+    }
+
+    if (last->next) {
+        last->next->prev = first->prev;
+    } else {
+        blocks->last = first->prev;
+    }
+
+    first->prev = NULL;
+    last->next = NULL;
+    blocks->len -= count;
+}
+
+/**
+ * Merges a block with the next one. The next block is discarded or, if it is kept (for the history),
+ * it is taken out of the list without fragments and put to *kept.
+ */
+static int MergeBlocks(Document* doc, Block* block, Block** kept) {
+    Block* nextBlock = block->next;
+
+    if (Touch(doc, block) || Touch(doc, nextBlock)) { return ERR_NOMEM; }
+
+    if (!block->data.len) {
+        // the block takes fragments of the next block
+        ListFragment* fragments = block->data.fragments;
+
+        block->data.fragments = nextBlock->data.fragments;
+        nextBlock->data.fragments = fragments;
+        block->data.len = nextBlock->data.len;
+    } else if (nextBlock->data.len) {
+        ListFragment* fragments = block->data.fragments;
+        ListFragment* nextFragments = nextBlock->data.fragments;
+
+        nextFragments->nodes->prev = fragments->last;
+        InsertFragments(fragments, nextFragments->nodes);
+
+        nextFragments->nodes = NULL;
+        nextFragments->last = NULL;
+        nextFragments->len = 0;
+
+        block->data.len += nextBlock->data.len;
+    }
+
+    block->data.version = ++doc->version;
+    UnlinkBlocks(doc->blocks, nextBlock, nextBlock, 1);
+
+    if (!kept) {
+        DiscardBlocks(doc, nextBlock);
+        return ERR_SUCCESS;
+    }
+
+    ListFragment* nextFragments = nextBlock->data.fragments;
+
+    while (nextFragments->nodes) { DeleteFragment(nextFragments, nextFragments->nodes); }
+    nextBlock->data.len = 0;
+
+    *kept = nextBlock;
+    return ERR_SUCCESS;
+}
+
+int DocMergeBlocks(Document* doc, Block* block, size_t y) {
+    assert(doc && block);
+    assert(block->next);
+
+    size_t x = block->data.len;
+    Block* nextBlock = NULL;
+
+    if (MergeBlocks(doc, block, doc->history ? &nextBlock : NULL)) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (nextBlock) {
+        int errValue = RecordMerge(doc->history, block, y, x, nextBlock);
+
+        if (errValue) { DiscardBlocks(doc, nextBlock); }
+        CheckRecord(doc, errValue);
+    }
+    return ERR_SUCCESS;
+}
+
+// puts a chain of blocks into the list in place of count blocks from the first one
+static int SwapBlocks(Document* doc, Block* first, size_t count, Block* chain, size_t chainLen) {
+    Block* prev = first->prev;
+    Block* last = first;
+    Block* chainLast = chain;
+
+    for (size_t i = 1; i < count; ++i) { last = last->next; }
+    for (size_t i = 1; i < chainLen; ++i) { chainLast = chainLast->next; }
+
+    // links of these blocks change
+    if ((prev && Touch(doc, prev)) || Touch(doc, last) || Touch(doc, chainLast)) { return ERR_NOMEM; }
+
+    UnlinkBlocks(doc->blocks, first, last, count);
+
+    chain->prev = prev;
+    InsertBlocks(doc->blocks, chain);
+
+    // the chain is new to anything that remembers the replaced blocks
+    ++doc->version;
+    for (Block* block = chain; chainLen; block = block->next, --chainLen) { block->data.version = doc->version; }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count);
+
+    return ERR_SUCCESS;
+}
+
+int DocReplaceBlocks(Document* doc, Block* first, size_t y, Block* last, Block* chain,
+                     const HistoryChange* changes, size_t changesLen) {
+    assert(doc && first && last && chain && (changes || !changesLen));
+
+    size_t count = 1;
+    size_t chainLen = 1;
+
+    for (Block* block = first; block != last; block = block->next) { ++count; }
+    for (Block* block = chain; block->next; block = block->next) { ++chainLen; }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, count + chainLen);
+
+    if (SwapBlocks(doc, first, count, chain, chainLen)) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (!doc->history) {
+        DiscardBlocks(doc, first);
+        return ERR_SUCCESS;
+    }
+
+    int errValue = RecordReplace(doc->history, chain, y, chainLen, first, count, changes, changesLen);
+
+    if (errValue) { DiscardBlocks(doc, first); }
+    CheckRecord(doc, errValue);
+    return ERR_SUCCESS;
+}
+
+// the replaced blocks and the chain of the record change places
+static int SwapRecord(Document* doc, HistoryRecord* record) {
+    Block* block = record->block;
+    size_t len = record->len;
+
+    if (SwapBlocks(doc, block, len, record->nodes, record->nodesLen)) { return ERR_NOMEM; }
+
+    record->block = record->nodes;
+    record->len = record->nodesLen;
+    record->nodes = block;
+    record->nodesLen = len;
+    return ERR_SUCCESS;
+}
+
+static int UndoRecord(Document* doc, HistoryRecord* record, ModelPos* pos) {
+    int errValue = ERR_SUCCESS;
+
+    switch (record->op) {
+    case HISTORY_INSERT:
+        errValue = DeleteRange(doc, record->block, record->x, record->len);
+        break;
+
+    case HISTORY_DELETE:
+        errValue = InsertPieces(doc, record->block, record->x, record->pieces, record->piecesLen);
+        break;
+
+    case HISTORY_SPLIT:
+        errValue = MergeBlocks(doc, record->block, &record->nodes);
+        break;
+
+    case HISTORY_MERGE:
+        errValue = SplitBlock(doc, record->block, record->x, record->nodes);
+        break;
+
+    case HISTORY_REPLACE:
+        errValue = SwapRecord(doc, record);
+        break;
+    }
+
+    pos->block = record->block;
+    pos->pos.x = record->op == HISTORY_REPLACE ? 0 : record->x;
+    pos->pos.y = record->y;
+    return errValue;
+}
+
+static int RedoRecord(Document* doc, HistoryRecord* record, ModelPos* pos) {
+    int errValue = ERR_SUCCESS;
+
+    pos->block = record->block;
+    pos->pos.x = record->x;
+    pos->pos.y = record->y;
+
+    switch (record->op) {
+    case HISTORY_INSERT:
+        errValue = InsertPieces(doc, record->block, record->x, record->pieces, record->piecesLen);
+        pos->pos.x += record->len;
+        break;
+
+    case HISTORY_DELETE:
+        errValue = DeleteRange(doc, record->block, record->x, record->len);
+        break;
+
+    case HISTORY_SPLIT:
+        errValue = SplitBlock(doc, record->block, record->x, record->nodes);
+        pos->block = record->nodes;
+        pos->pos.x = 0;
+        ++pos->pos.y;
+        break;
+
+    case HISTORY_MERGE:
+        errValue = MergeBlocks(doc, record->block, &record->nodes);
+        break;
+
+    case HISTORY_REPLACE:
+        errValue = SwapRecord(doc, record);
+        pos->block = record->block;
+        pos->pos.x = 0;
+        break;
+    }
+    return errValue;
+}
+
+// reports the edits of blocks of a record: an undone record - the inverse edits in reverse order
+static void ReportRecord(const HistoryRecord* record, int isUndo, DocChanged onChange, void* context) {
+    HistoryChange change = { record->op, record->y, record->x, record->len };
+    const HistoryChange* changes = &change;
+    size_t len = 1;
+
+    if (record->op == HISTORY_REPLACE) {
+        changes = record->changes;
+        len = record->changesLen;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        change = changes[isUndo ? len - 1 - i : i];
+
+        if (isUndo) {
+            switch (change.op) {
+            case HISTORY_INSERT:    change.op = HISTORY_DELETE; break;
+            case HISTORY_DELETE:    change.op = HISTORY_INSERT; break;
+            case HISTORY_SPLIT:     change.op = HISTORY_MERGE; break;
+            case HISTORY_MERGE:     change.op = HISTORY_SPLIT; break;
+            default:                break;
+            }
+        }
+        onChange(context, &change);
+    }
+}
+
+int DocUndo(Document* doc, ModelPos* pos, DocChanged onChange, void* context) {
+    assert(doc && pos);
+    COUNTERS_SCOPE(COUNTER_OP_EDIT);
+    TRACE_SCOPE("DocUndo");
+
+    HistoryRecord* record = doc->history ? PeekUndo(doc->history) : NULL;
+
+    pos->block = NULL;
+    if (!record) { return ERR_SUCCESS; }
+
+    // records of a unit are undone from the last one
+    size_t unit = record->unit;
+
+    do {
+        int errValue = UndoRecord(doc, record, pos);
+
+        PassUndo(doc->history);
+        if (errValue) {
+            CheckRecord(doc, errValue);
+            pos->block = NULL;
+            return errValue;
+        }
+        if (onChange) { ReportRecord(record, 1, onChange, context); }
+    } while ((record = PeekUndo(doc->history)) && record->unit == unit);
+
+    return ERR_SUCCESS;
+}
+
+int DocRedo(Document* doc, ModelPos* pos, DocChanged onChange, void* context) {
+    assert(doc && pos);
+    COUNTERS_SCOPE(COUNTER_OP_EDIT);
+    TRACE_SCOPE("DocRedo");
+
+    HistoryRecord* record = doc->history ? PeekRedo(doc->history) : NULL;
+
+    pos->block = NULL;
+    if (!record) { return ERR_SUCCESS; }
+
+    size_t unit = record->unit;
+
+    do {
+        int errValue = RedoRecord(doc, record, pos);
+
+        PassRedo(doc->history);
+        if (errValue) {
+            CheckRecord(doc, errValue);
+            pos->block = NULL;
+            return errValue;
+        }
+        if (onChange) { ReportRecord(record, 0, onChange, context); }
+    } while ((record = PeekRedo(doc->history)) && record->unit == unit);
+
+    return ERR_SUCCESS;
+}
+
+int SetHistory(Document* doc, size_t cap) {
+    assert(doc);
+
+    if (!cap) {
+        if (doc->history) { DestroyHistory(&doc->history); }
+        return ERR_SUCCESS;
+    }
+
+    if (doc->history) {
+        SetHistoryCap(doc->history, cap);
+        return ERR_SUCCESS;
+    }
+
+    doc->history = CreateHistory(cap, DiscardHistoryBlocks, doc);
+    if (!doc->history) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+    return ERR_SUCCESS;
+}
+
+void DocBeginUndoGroup(Document* doc) {
+    assert(doc);
+
+    if (doc->history) { BeginHistoryGroup(doc->history); }
+}
+
+void DocEndUndoGroup(Document* doc) {
+    assert(doc);
+
+    if (doc->history && doc->history->groupDepth) { EndHistoryGroup(doc->history); }
+}
+
+Snapshot* DocTakeSnapshot(Document* doc) {
+    assert(doc);
+
+    CollectSnapshots(&doc->snapshots);
+
+    Snapshot* snapshot = calloc(1, sizeof(Snapshot));
+
+    if (!snapshot) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    snapshot->version = doc->version;
+    snapshot->text = doc->text->data;
+    snapshot->textLen = doc->text->len;
+    snapshot->blocks = doc->blocks->nodes;
+    snapshot->blocksLen = doc->blocks->len;
+
+    if (AddSnapshot(&doc->snapshots, snapshot)) {
+        free(snapshot);
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+    return snapshot;
+}
+
+Document* CreateSnapshotView(const Snapshot* snapshot, Block** origins) {
+    assert(snapshot && snapshot->blocksLen);
+    TRACE_SCOPE("CreateSnapshotView");
+
+    Document* view = calloc(1, sizeof(Document));
+    String* text = calloc(1, sizeof(String));
+    ListBlock* blocks = calloc(1, sizeof(ListBlock));
+    Block* nodes = calloc(snapshot->blocksLen, sizeof(Block));
+
+    if (!view || !text || !blocks || !nodes) {
+        free(view);
+        free(text);
+        free(blocks);
+        free(nodes);
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    // the chars aren't owned by the view
+    text->data = (char*)snapshot->text;
+    text->len = snapshot->textLen;
+    text->size = snapshot->textLen;
+
+    Block* block = snapshot->blocks;
+
+    for (size_t y = 0; y < snapshot->blocksLen; ++y) {
+        BlockState state;
+
+        GetBlockState(block, snapshot->version, &state);
+        if (origins) { origins[y] = block; }
+
+        nodes[y].prev = y ? &nodes[y - 1] : NULL;
+        nodes[y].next = y + 1 < snapshot->blocksLen ? &nodes[y + 1] : NULL;
+        nodes[y].data.len = state.len;
+        nodes[y].data.fragments = state.fragments;
+        nodes[y].data.version = snapshot->version;
+        block = state.next;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, snapshot->blocksLen);
+
+    blocks->len = snapshot->blocksLen;
+    blocks->nodes = nodes;
+    blocks->last = &nodes[snapshot->blocksLen - 1];
+
+    view->text = text;
+    view->blocks = blocks;
+    view->version = snapshot->version;
+    return view;
+}
+
+void DestroySnapshotView(Document** ppView) {
+    assert(ppView);
+
+    Document* view = *ppView;
+    if (!view) { return; }
+
+    free(view->blocks->nodes);
+    free(view->blocks);
+    free(view->text);
+    free(view);
+
+    *ppView = NULL;
+}
+
+static const char lineEnd[] = "\n";
+
+void InitDocIterator(DocIterator* it, const Document* doc, ModelPos pos, int flags) {
+    assert(it && doc && pos.block);
+    assert(pos.pos.x <= pos.block->data.len);
+
+    size_t x = pos.pos.x;
+    Fragment* fragment = pos.block->data.fragments->nodes;
+    size_t fragmentX = 0;
+
+    // find place: forward starts in the fragment containing x, backward ends in the fragment containing x - 1
+    if (flags & DOC_ITER_BACKWARD) {
+        while (fragment->next && x > fragmentX + fragment->data.len) {
+            fragmentX += fragment->data.len;
+            fragment = fragment->next;
+        }
+    } else {
+        while (fragment && x >= fragmentX + fragment->data.len) {
+            fragmentX += fragment->data.len;
+            fragment = fragment->next;
+        }
+    }
+
+    it->doc = doc;
+    it->flags = flags;
+    it->block = pos.block;
+    it->y = pos.pos.y;
+    it->fragment = fragment;
+    it->fragmentX = fragmentX;
+    it->offset = x - fragmentX;
+    it->isLineEndDone = 0;
+}
+
+static void SetSpan(DocSpan* span, const char* ptr, size_t len, Block* block, size_t y, size_t x, int isLineEnd) {
+    span->ptr = ptr;
+    span->len = len;
+    span->pos.block = block;
+    span->pos.pos.y = y;
+    span->pos.pos.x = x;
+    span->isLineEnd = isLineEnd;
+}
+
+static int NextSpanForward(DocIterator* it, DocSpan* span) {
+    for (;;) {
+        Fragment* fragment = it->fragment;
+
+        if (fragment) {
+            size_t offset = it->offset;
+
+            it->fragment = fragment->next;
+            it->fragmentX += fragment->data.len;
+            it->offset = 0;
+
+            if (offset < fragment->data.len) {
+                SetSpan(span, it->doc->text->data + fragment->data.pos + offset, fragment->data.len - offset,
+                        it->block, it->y, it->fragmentX - fragment->data.len + offset, 0);
+                return 1;
+            }
+            continue;
+        }
+
+        // the block is passed
+        if (!it->block->next) { return 0; }
+
+        if ((it->flags & DOC_ITER_LINE_ENDS) && !it->isLineEndDone) {
+            it->isLineEndDone = 1;
+            SetSpan(span, lineEnd, 1, it->block, it->y, it->block->data.len, 1);
+            return 1;
+        }
+
+        it->block = it->block->next;
+        ++it->y;
+        it->fragment = it->block->data.fragments->nodes;
+        it->fragmentX = 0;
+        it->isLineEndDone = 0;
+    }
+}
+
+static int NextSpanBackward(DocIterator* it, DocSpan* span) {
+    for (;;) {
+        Fragment* fragment = it->fragment;
+
+        if (fragment) {
+            size_t end = it->offset;
+            size_t fragmentX = it->fragmentX;
+
+            it->fragment = fragment->prev;
+            if (it->fragment) {
+                it->fragmentX -= it->fragment->data.len;
+                it->offset = it->fragment->data.len;
+            }
+
+            if (end) {
+                SetSpan(span, it->doc->text->data + fragment->data.pos, end, it->block, it->y, fragmentX, 0);
+                return 1;
+            }
+            continue;
+        }
+
+        // the block is passed
+        Block* prev = it->block->prev;
+        if (!prev) { return 0; }
+
+        if ((it->flags & DOC_ITER_LINE_ENDS) && !it->isLineEndDone) {
+            it->isLineEndDone = 1;
+            SetSpan(span, lineEnd, 1, prev, it->y - 1, prev->data.len, 1);
+            return 1;
+        }
+
+        it->block = prev;
+        --it->y;
+        it->fragment = prev->data.fragments->last;
+        it->fragmentX = prev->data.len - it->fragment->data.len;
+        it->offset = it->fragment->data.len;
+        it->isLineEndDone = 0;
+    }
+}
+
+int DocNextSpan(DocIterator* it, DocSpan* span) {
+    assert(it && span);
+
+    return (it->flags & DOC_ITER_BACKWARD) ? NextSpanBackward(it, span) : NextSpanForward(it, span);
+}
@@ -6,14 +6,32 @@
 #include <assert.h>
 
 #include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
 
 #include "String.h"
 #include "Fragment.h"
 #include "Block.h"
+#include "History.h"
+#include "Snapshot.h"
+
+typedef struct {
+    size_t x;
+    size_t y;
+} position_t;
+
+typedef struct {
+    Block* block;       // pointer to current block (paragraph)
+    position_t pos;     // current position: x - position in the block, y - index of the block
+} ModelPos;
+
 typedef struct Document_tag {
     char* title;                // pointer to a title of file
     String* text;               // pointer to a text (main string)
     ListBlock* blocks;          // pointer to blocks. It stores the structure of the text
+    size_t version;             // count of changes: every edit stamps changed blocks with the new value
+    History* history;           // undo history, NULL - edits aren't recorded
+    SnapshotSet snapshots;      // snapshots read by other threads and memory kept for them
 } Document;
 
 /**
@@ -57,6 +75,293 @@ int SetFile(Document* doc, char const* filename);
  */
 size_t GetMaxBlockLen(ListBlock const* blocks);
 
+
+// editing
+/**
+ * Inserts char to a block.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position in the block (0..block->data.len)
+ * @param c - char that should be inserted
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocInsertChar(Document* doc, Block* block, size_t y, size_t x, char c);
+
+/**
+ * Inserts chars to a block: they are appended to the text once and shown by one fragment.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position in the block (0..block->data.len)
+ * @param chars - pointer to chars that should be inserted (no line ends)
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocInsertChars(Document* doc, Block* block, size_t y, size_t x, const char* chars, size_t len);
+
+/**
+ * Inserts chars of the text of a document to a block: chars appended once by DocAddText()
+ * may be shown by fragments of many blocks.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position in the block (0..block->data.len)
+ * @param pos - position of the first char in the text
+ * @param len - count of chars (pos + len <= doc->text->len, no line ends)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocInsertText(Document* doc, Block* block, size_t y, size_t x, size_t pos, size_t len);
+
+/**
+ * Deletes char from a block.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position of the char in the block (0..block->data.len - 1)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocDeleteChar(Document* doc, Block* block, size_t y, size_t x);
+
+/**
+ * Deletes chars from a block.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position of the first char in the block
+ * @param len - count of chars (x + len <= block->data.len)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocDeleteChars(Document* doc, Block* block, size_t y, size_t x, size_t len);
+
+/**
+ * Splits a block into two blocks. The block keeps the text before the position,
+ * the new block (inserted after it) gets the rest.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document
+ * @param y - index of the block (it is kept by the history)
+ * @param x - position of the split in the block (0..block->data.len)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocSplitBlock(Document* doc, Block* block, size_t y, size_t x);
+
+/**
+ * Merges a block with the next one. The block stays in the list,
+ * the next block is deleted.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param block - pointer to a block of the document (block->next must exist)
+ * @param y - index of the block (it is kept by the history)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocMergeBlocks(Document* doc, Block* block, size_t y);
+
+/**
+ * Replaces blocks of the document with a chain of new blocks. The replaced blocks are
+ * kept by the history (as a whole, so undoing the replacement costs as much as doing it)
+ * or destroyed.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param first - the first replaced block
+ * @param y - index of the first block (it is kept by the history)
+ * @param last - the last replaced block
+ * @param chain - the first new block (the blocks are linked by next, the last next is NULL)
+ * @param changes - edits of blocks making the replacement, one after another (kept by the history
+ *                  to report the replacement when it is undone and redone)
+ * @param changesLen - count of them
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (the chain isn't taken on error)
+ */
+int DocReplaceBlocks(Document* doc, Block* first, size_t y, Block* last, Block* chain,
+                     const HistoryChange* changes, size_t changesLen);
+
+/**
+ * Appends chars to the text of a document. A buffer read by live snapshots isn't reallocated:
+ * the chars move to a new one and the old one is kept for the snapshots.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param chars - pointer to chars
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int DocAddText(Document* doc, const char* chars, size_t len);
+
+
+// snapshots
+/**
+ * Takes a read-only snapshot of the document in O(1). It may be read by any thread while
+ * the document is edited, the reader releases it by ReleaseSnapshot(). Edits after a snapshot
+ * copy the fragments of a block once per snapshot, memory the snapshots read is freed when
+ * they are released. All snapshots must be released before the document is destroyed.
+ * IN:
+ * @param doc - pointer to a Document object
+ *
+ * OUT:
+ * @return snapshot - pointer to a snapshot, NULL on error
+ */
+Snapshot* DocTakeSnapshot(Document* doc);
+
+/**
+ * Creates a read-only document showing a snapshot, so code reading a Document (iterators, searches)
+ * reads the snapshot from any thread. Its blocks are copies of the states of the blocks at the version
+ * allocated at once, they share the fragments of the snapshot. The view must be destroyed
+ * by DestroySnapshotView() before the snapshot is released.
+ * IN:
+ * @param snapshot - pointer to a snapshot
+ * @param origins - pointer to an array of snapshot->blocksLen items to be filled with the blocks of the document
+ *                  by indexes: positions of the view are their positions while the document has the version
+ *                  (NULL - not needed)
+ *
+ * OUT:
+ * @return view - pointer to a Document object, NULL on error
+ */
+Document* CreateSnapshotView(const Snapshot* snapshot, Block** origins);
+
+/**
+ * Destroys a view of a snapshot, the snapshot stays live.
+ * IN:
+ * @param ppView - pointer to pointer to a view
+ *
+ * OUT:
+ * *ppView - filled with NULL value
+ */
+void DestroySnapshotView(Document** ppView);
+
+
+// undo
+/**
+ * Report of an edit of blocks made by undo, redo or a replacement: positions kept out of
+ * the document (marks) follow the edits in the order of the reports.
+ * IN:
+ * @param context - context given with the callback
+ * @param change - the edit
+ */
+typedef void (*DocChanged)(void* context, const HistoryChange* change);
+
+/**
+ * Turns on the undo history, changes its limit or turns it off.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param cap - limit of bytes of the history (HISTORY_DEFAULT_CAP), 0 - no history
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int SetHistory(Document* doc, size_t cap);
+
+/**
+ * Begins a group of edits undone as one unit. Groups may be nested.
+ * IN:
+ * @param doc - pointer to a Document object
+ */
+void DocBeginUndoGroup(Document* doc);
+
+/**
+ * Ends a group of edits.
+ * IN:
+ * @param doc - pointer to a Document object
+ */
+void DocEndUndoGroup(Document* doc);
+
+/**
+ * Undoes the last unit of edits. Blocks may be replaced, so positions kept out of the
+ * document must be found again.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param pos - pointer to a position to be filled with the place of the undone edit
+ *              (pos->block is NULL if nothing is undone)
+ * @param onChange - callback getting the undone edits of blocks, NULL - no reports
+ * @param context - context of onChange
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (the history is dropped on error)
+ */
+int DocUndo(Document* doc, ModelPos* pos, DocChanged onChange, void* context);
+
+/**
+ * Redoes the last undone unit of edits.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param pos - pointer to a position to be filled with the place after the redone edit
+ *              (pos->block is NULL if nothing is redone)
+ * @param onChange - callback getting the redone edits of blocks, NULL - no reports
+ * @param context - context of onChange
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (the history is dropped on error)
+ */
+int DocRedo(Document* doc, ModelPos* pos, DocChanged onChange, void* context);
+
+
+// iteration
+typedef enum {
+    DOC_ITER_FORWARD    = 0,        // spans in document order
+    DOC_ITER_BACKWARD   = 1 << 0,   // spans in reverse document order (chars of a span are in direct order)
+    DOC_ITER_LINE_ENDS  = 1 << 1    // yield a "\n" span between blocks
+} DocIterFlags;
+
+typedef struct {
+    const char* ptr;    // pointer to the first char of the span
+    size_t len;         // length of the span
+    ModelPos pos;       // position of the first char (a line end is at x == block->data.len)
+    int isLineEnd;      // flag of a line end span
+} DocSpan;
+
+typedef struct {
+    const Document* doc;    // pointer to a Document object
+    int flags;              // DocIterFlags
+    Block* block;           // current block
+    size_t y;               // index of the current block
+    Fragment* fragment;     // current fragment (NULL - the block is passed)
+    size_t fragmentX;       // position of the current fragment in the block
+    size_t offset;          // forward: offset to resume from, backward: end of the rest of the fragment
+    int isLineEndDone;      // the line end of the current block is yielded
+} DocIterator;
+
+/**
+ * Inits an iterator over contiguous spans of the text.
+ * IN:
+ * @param it - pointer to an iterator
+ * @param doc - pointer to a Document object
+ * @param pos - start position: the first span starts at it (forward) or ends before it (backward)
+ * @param flags - DocIterFlags
+ */
+void InitDocIterator(DocIterator* it, const Document* doc, ModelPos pos, int flags);
+
+/**
+ * Gets the next span. Empty fragments are skipped.
+ * IN:
+ * @param it - pointer to an iterator
+ * @param span - pointer to a span to be filled
+ *
+ * OUT:
+ * @return isSpan - 1 if the span is filled, 0 at the end (start) of the document
+ */
+int DocNextSpan(DocIterator* it, DocSpan* span);
+
 // for debugging ===============================================
     /**
      * Prints text of document object.
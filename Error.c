@@ -7,6 +7,7 @@ static char* errorMessages[ERR_UNKNOWN + 1] = {
     "error opening file",
     "unexpected end of file while reading",
     "error reading file",
+    "error writing file",
     "not enough memory",
     "parameter is not defined",
     "unknown error"
@@ -11,6 +11,7 @@ typedef enum {
     ERR_OPEN_FILE,
     ERR_EOF,
     ERR_READ,
+    ERR_WRITE,
     ERR_NOMEM,
     ERR_PARAM,
     ERR_UNKNOWN
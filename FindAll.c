@@ -0,0 +1,307 @@
+#include "FindAll.h"
+
+typedef struct {
+    FindAll* findAll;
+    ModelPos from;          // start of the chunk
+    ModelPos to;            // start of the next chunk
+    int isLast;             // the chunk ends at the end of the document (to isn't used)
+    RegexMatch* matches;    // matches starting in the chunk
+    size_t len;
+    size_t size;
+    atomic_int isDone;      // matches are ready
+} FindAllChunk;
+
+struct FindAll_tag {
+    ThreadPool* pool;
+    Snapshot* snapshot;     // the searched version of the document
+    Document* doc;          // view of the snapshot read by workers and the merge
+    Block** blocks;         // blocks of the document at the version by indexes: blocks of taken matches
+    Literal* literal;       // pattern of a literal search (shared by workers, it's read only)
+    Regex** regexes;        // pattern of a regex search: one per worker and one for the merge (the last)
+    size_t regexesCount;
+
+    FindAllChunk* chunks;
+    size_t chunksCount;
+    TaskGroup group;
+    atomic_int isCancelled;
+    FindAllProgress onProgress;
+    void* context;
+
+    // merge
+    size_t chunk;           // current chunk
+    size_t match;           // next match of the current chunk
+    ModelPos from;          // start of the next search (the end of the last taken match)
+    int isSynced;           // matches of the current chunk continue the taken ones
+};
+
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+static int IsEqual(const RegexMatch* a, const RegexMatch* b) {
+    return a->start.pos.y == b->start.pos.y && a->start.pos.x == b->start.pos.x &&
+           a->end.pos.y == b->end.pos.y && a->end.pos.x == b->end.pos.x;
+}
+
+// position where the search continues after a match (an empty match is skipped by a char)
+static int GetNextFrom(const RegexMatch* match, ModelPos* from) {
+    *from = match->end;
+    if (IsBefore(&match->start, &match->end)) { return 1; }
+
+    if (from->pos.x < from->block->data.len) {
+        ++from->pos.x;
+        return 1;
+    }
+    if (!from->block->next) { return 0; }
+
+    from->block = from->block->next;
+    from->pos.x = 0;
+    ++from->pos.y;
+    return 1;
+}
+
+// finds the first match starting in [from, to) with the pattern of a worker
+static int FindInRange(const FindAll* findAll, size_t worker, ModelPos from, const ModelPos* to, RegexMatch* match) {
+    if (findAll->regexes) { return FindRegexInRange(findAll->doc, findAll->regexes[worker], from, to, match); }
+
+    if (!FindLiteralInRange(findAll->doc, findAll->literal, from, to, &match->start)) { return 0; }
+
+    // the occurrence may cross line ends
+    ModelPos end = match->start;
+    end.pos.x += findAll->literal->len;
+
+    while (end.pos.x > end.block->data.len) {
+        end.pos.x -= end.block->data.len + 1;
+        end.block = end.block->next;
+        ++end.pos.y;
+    }
+
+    match->end = end;
+    return 1;
+}
+
+static void SearchChunk(void* arg, size_t worker) {
+    FindAllChunk* chunk = arg;
+    FindAll* findAll = chunk->findAll;
+    const ModelPos* to = chunk->isLast ? NULL : &chunk->to;
+    ModelPos from = chunk->from;
+    RegexMatch match;
+
+    TRACE_SCOPE("SearchChunk");
+
+    while (!atomic_load_explicit(&findAll->isCancelled, memory_order_relaxed) &&
+           FindInRange(findAll, worker, from, to, &match)) {
+        if (chunk->len == chunk->size) {
+            size_t size = chunk->size ? 2 * chunk->size : 64;
+            RegexMatch* matches = realloc(chunk->matches, size * sizeof(RegexMatch));
+
+            if (!matches) {
+                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                break;
+            }
+            chunk->matches = matches;
+            chunk->size = size;
+        }
+
+        chunk->matches[chunk->len++] = match;
+        if (!GetNextFrom(&match, &from) || (to && !IsBefore(&from, to))) { break; }
+    }
+
+    atomic_store_explicit(&chunk->isDone, 1, memory_order_release);
+    if (findAll->onProgress && !atomic_load(&findAll->isCancelled)) { findAll->onProgress(findAll->context); }
+}
+
+// the search reads a snapshot of the document, so the document may be edited while it runs
+static int ViewSnapshot(FindAll* findAll, Document* doc) {
+    // errors of the snapshot and its view are printed by them
+    findAll->snapshot = DocTakeSnapshot(doc);
+    if (!findAll->snapshot) { return ERR_UNKNOWN; }
+
+    findAll->blocks = malloc(findAll->snapshot->blocksLen * sizeof(Block*));
+    if (!findAll->blocks) { return ERR_NOMEM; }
+
+    findAll->doc = CreateSnapshotView(findAll->snapshot, findAll->blocks);
+    if (!findAll->doc) { return ERR_UNKNOWN; }
+
+    findAll->from = (ModelPos){ findAll->doc->blocks->nodes, { 0, 0 } };
+    return ERR_SUCCESS;
+}
+
+// splits blocks into chunks of at least FIND_ALL_CHUNK chars
+static int SplitChunks(FindAll* findAll) {
+    const Document* doc = findAll->doc;
+    size_t size = doc->text->len / FIND_ALL_CHUNK + 1;
+    ModelPos pos = { doc->blocks->nodes, { 0, 0 } };
+    size_t chars = 0;
+
+    findAll->chunks = calloc(size, sizeof(FindAllChunk));
+    if (!findAll->chunks) { return ERR_NOMEM; }
+
+    findAll->chunks[0].from = pos;
+    findAll->chunksCount = 1;
+
+    for (Block* block = doc->blocks->nodes; block->next; block = block->next) {
+        chars += block->data.len + 1;
+        ++pos.pos.y;
+
+        if (chars >= FIND_ALL_CHUNK && findAll->chunksCount < size) {
+            pos.block = block->next;
+            findAll->chunks[findAll->chunksCount - 1].to = pos;
+            findAll->chunks[findAll->chunksCount++].from = pos;
+            chars = 0;
+        }
+    }
+
+    findAll->chunks[findAll->chunksCount - 1].isLast = 1;
+    for (size_t i = 0; i < findAll->chunksCount; ++i) {
+        findAll->chunks[i].findAll = findAll;
+        atomic_init(&findAll->chunks[i].isDone, 0);
+    }
+    return ERR_SUCCESS;
+}
+
+FindAll* StartFindAll(ThreadPool* pool, Document* doc, const char* pattern, size_t len, int flags,
+                      FindAllProgress onProgress, void* context) {
+    assert(pool && doc && pattern && len);
+    TRACE_SCOPE("StartFindAll");
+
+    FindAll* findAll = calloc(1, sizeof(FindAll));
+    if (!findAll) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    findAll->pool = pool;
+    findAll->onProgress = onProgress;
+    findAll->context = context;
+    findAll->isSynced = 1;
+    InitTaskGroup(&findAll->group);
+    atomic_init(&findAll->isCancelled, 0);
+
+    int errValue = ERR_SUCCESS;
+
+    if (flags & FIND_ALL_REGEX) {
+        findAll->regexesCount = ThreadPoolSize(pool) + 1;
+        findAll->regexes = calloc(findAll->regexesCount, sizeof(Regex*));
+
+        if (!findAll->regexes) { errValue = ERR_NOMEM; }
+        // DFA caches aren't shared, so every worker compiles its own copy
+        for (size_t i = 0; !errValue && i < findAll->regexesCount; ++i) {
+            findAll->regexes[i] = CreateRegex(pattern, len, (flags & FIND_ALL_IGNORE_CASE) ? REGEX_IGNORE_CASE : REGEX_MATCH_CASE);
+            if (!findAll->regexes[i]) { errValue = ERR_PARAM; }
+        }
+    } else {
+        findAll->literal = CreateLiteral(pattern, len, (flags & FIND_ALL_IGNORE_CASE) ? SEARCH_IGNORE_CASE : SEARCH_MATCH_CASE);
+        if (!findAll->literal) { errValue = ERR_NOMEM; }
+    }
+
+    if (!errValue) { errValue = ViewSnapshot(findAll, doc); }
+    if (!errValue) { errValue = SplitChunks(findAll); }
+
+    if (errValue) {
+        if (errValue == ERR_NOMEM) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+        DestroyFindAll(&findAll);
+        return NULL;
+    }
+
+    // tasks are taken in the order of submission, so the first chunks are finished first
+    for (size_t i = 0; i < findAll->chunksCount; ++i) {
+        if (ThreadPoolSubmit(pool, &findAll->group, SearchChunk, &findAll->chunks[i])) {
+            DestroyFindAll(&findAll);
+            return NULL;
+        }
+    }
+
+    return findAll;
+}
+
+size_t FindAllTake(FindAll* findAll, RegexMatch* matches, size_t size, int* isFinished) {
+    assert(findAll && matches);
+
+    size_t count = 0;
+
+    while (count < size && findAll->chunk < findAll->chunksCount && !atomic_load(&findAll->isCancelled)) {
+        FindAllChunk* chunk = &findAll->chunks[findAll->chunk];
+        const ModelPos* to = chunk->isLast ? NULL : &chunk->to;
+        RegexMatch match;
+
+        if (!atomic_load_explicit(&chunk->isDone, memory_order_acquire)) { break; }
+
+        if (findAll->isSynced) {
+            if (findAll->match < chunk->len) {
+                matches[count++] = chunk->matches[findAll->match++];
+                if (!GetNextFrom(&matches[count - 1], &findAll->from)) { findAll->chunk = findAll->chunksCount; }
+                continue;
+            }
+        } else if ((!to || IsBefore(&findAll->from, to)) &&
+                   FindInRange(findAll, findAll->regexesCount - 1, findAll->from, to, &match)) {
+            // a match of the previous chunk ends inside the chunk: search from its end
+            // until a match is the same as a match of the chunk
+            while (findAll->match < chunk->len && IsBefore(&chunk->matches[findAll->match].start, &match.start)) {
+                ++findAll->match;
+            }
+
+            if (findAll->match < chunk->len && IsEqual(&chunk->matches[findAll->match], &match)) {
+                findAll->isSynced = 1;
+            } else {
+                matches[count++] = match;
+                if (!GetNextFrom(&match, &findAll->from)) { findAll->chunk = findAll->chunksCount; }
+            }
+            continue;
+        }
+
+        // the next chunk continues the taken matches if the last one doesn't cross its start
+        if (++findAll->chunk < findAll->chunksCount) {
+            findAll->match = 0;
+            findAll->isSynced = !IsBefore(&findAll->chunks[findAll->chunk].from, &findAll->from);
+        }
+    }
+
+    // positions in the view are positions in the document at the version
+    for (size_t i = 0; i < count; ++i) {
+        matches[i].start.block = findAll->blocks[matches[i].start.pos.y];
+        matches[i].end.block = findAll->blocks[matches[i].end.pos.y];
+    }
+
+    if (isFinished) { *isFinished = findAll->chunk >= findAll->chunksCount || atomic_load(&findAll->isCancelled); }
+    return count;
+}
+
+size_t FindAllVersion(const FindAll* findAll) {
+    assert(findAll);
+    return findAll->snapshot->version;
+}
+
+void FindAllWait(FindAll* findAll) {
+    assert(findAll);
+    ThreadPoolWait(findAll->pool, &findAll->group);
+}
+
+void CancelFindAll(FindAll* findAll) {
+    assert(findAll);
+    atomic_store(&findAll->isCancelled, 1);
+}
+
+void DestroyFindAll(FindAll** ppFindAll) {
+    assert(ppFindAll);
+
+    FindAll* findAll = *ppFindAll;
+    if (!findAll) { return; }
+
+    CancelFindAll(findAll);
+    FindAllWait(findAll);
+
+    for (size_t i = 0; i < findAll->chunksCount; ++i) { free(findAll->chunks[i].matches); }
+    free(findAll->chunks);
+
+    for (size_t i = 0; findAll->regexes && i < findAll->regexesCount; ++i) { DestroyRegex(&findAll->regexes[i]); }
+    free(findAll->regexes);
+    DestroyLiteral(&findAll->literal);
+
+    DestroySnapshotView(&findAll->doc);
+    free(findAll->blocks);
+    if (findAll->snapshot) { ReleaseSnapshot(findAll->snapshot); }
+    free(findAll);
+
+    *ppFindAll = NULL;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#ifndef FINDALL_H_INCLUDED
+#define FINDALL_H_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Search.h"
+#include "Regex.h"
+#include "ThreadPool.h"
+
+#define FIND_ALL_CHUNK (256 << 10)  // min size of the text searched by one task (chunks are split between blocks)
+
+typedef enum {
+    FIND_ALL_LITERAL        = 0,
+    FIND_ALL_REGEX          = 1 << 0,
+    FIND_ALL_IGNORE_CASE    = 1 << 1    // ASCII letters only
+} FindAllFlags;
+
+/**
+ * Notification of a finished chunk. It's called by a worker thread.
+ * IN:
+ * @param context - context given to StartFindAll()
+ */
+typedef void (*FindAllProgress)(void* context);
+
+typedef struct FindAll_tag FindAll;
+
+/**
+ * Starts a search of all matches. The blocks are split into chunks which are searched in parallel,
+ * and the results are merged in the order of the document, as if matches were found one by one
+ * starting at the end of the previous match. The search reads a snapshot of the document, so
+ * the document may be edited while it runs; the search must be destroyed before the document.
+ * IN:
+ * @param pool - pointer to a pool running the search
+ * @param doc - pointer to a Document object
+ * @param pattern - pointer to chars of the pattern
+ * @param len - length of the pattern (> 0)
+ * @param flags - FindAllFlags
+ * @param onProgress - notification of a finished chunk (NULL - no notifications)
+ * @param context - argument of the notification
+ *
+ * OUT:
+ * @return findAll - pointer to a search, NULL on error (invalid regular expression or no memory)
+ */
+FindAll* StartFindAll(ThreadPool* pool, Document* doc, const char* pattern, size_t len, int flags,
+                      FindAllProgress onProgress, void* context);
+
+/**
+ * Takes next matches in the order of the document. It doesn't block: only matches of finished chunks are taken.
+ * The matches are positions in the document at the version of the search (FindAllVersion()),
+ * their blocks may be used only while the document has the version.
+ * IN:
+ * @param findAll - pointer to a search
+ * @param matches - pointer to an array to be filled
+ * @param size - size of the array
+ * @param isFinished - pointer to a flag to be filled with 1 if all matches are taken (NULL - not needed)
+ *
+ * OUT:
+ * @return count - count of taken matches
+ */
+size_t FindAllTake(FindAll* findAll, RegexMatch* matches, size_t size, int* isFinished);
+
+/**
+ * Gets the version of the document which is searched.
+ * IN:
+ * @param findAll - pointer to a search
+ *
+ * OUT:
+ * @return version - version of the document when the search is started
+ */
+size_t FindAllVersion(const FindAll* findAll);
+
+/**
+ * Blocks the calling thread until all chunks are searched. It must not be called by workers of the pool.
+ * IN:
+ * @param findAll - pointer to a search
+ */
+void FindAllWait(FindAll* findAll);
+
+/**
+ * Asks workers to stop the search. It doesn't block, chunks which aren't finished are dropped.
+ * IN:
+ * @param findAll - pointer to a search
+ */
+void CancelFindAll(FindAll* findAll);
+
+/**
+ * Cancels a search, waits for its tasks and frees it.
+ * IN:
+ * @param ppFindAll - pointer to pointer to a search
+ *
+ * OUT:
+ * *ppFindAll - filled with NULL value
+ */
+void DestroyFindAll(FindAll** ppFindAll);
+
+#endif // FINDALL_H_INCLUDED
@@ -0,0 +1,423 @@
+#include "FindInFiles.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    #define PATH_SEPARATOR "\\"
+#else
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+    #define PATH_SEPARATOR "/"
+#endif
+
+#define FIND_IN_FILES_WINDOW (1024 * 1024)  // chars searched between checks of cancellation
+
+typedef struct {
+    FindInFiles* search;
+    char* path;
+    FileMatch* matches;     // occurrences in the order of the file
+    size_t len;
+    size_t size;
+    size_t taken;           // count of taken occurrences
+    atomic_int isDone;      // occurrences are ready
+} FileEntry;
+
+struct FindInFiles_tag {
+    ThreadPool* pool;
+    char* dir;
+    Literal* literal;       // shared by workers, it's read only
+    size_t maxMatches;
+    FindInFilesProgress onProgress;
+    void* context;
+
+    TaskGroup group;
+    atomic_int isCancelled;
+
+    // listed by one task before any file is searched
+    FileEntry* files;
+    size_t filesCount;
+    size_t filesSize;
+    atomic_int isListed;
+    atomic_size_t searched;
+
+    size_t first;           // files before it are taken
+};
+
+typedef struct {
+    const char* data;
+    size_t size;
+    #ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+    #else
+        int fd;
+    #endif
+} MappedFile;
+
+static int IsCancelled(FindInFiles* search) {
+    return atomic_load_explicit(&search->isCancelled, memory_order_relaxed);
+}
+
+#ifdef _WIN32
+    static int MapFile(const char* path, MappedFile* mapped) {
+        LARGE_INTEGER size;
+
+        mapped->data = NULL;
+        mapped->mapping = NULL;
+        mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                                   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (mapped->file == INVALID_HANDLE_VALUE) { return ERR_OPEN_FILE; }
+
+        // empty files can't be mapped and have nothing to find
+        if (!GetFileSizeEx(mapped->file, &size) || !size.QuadPart || (uint64_t)size.QuadPart > SIZE_MAX) {
+            CloseHandle(mapped->file);
+            return ERR_READ;
+        }
+        mapped->size = (size_t)size.QuadPart;
+
+        mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapped->mapping) { mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0); }
+
+        if (!mapped->data) {
+            if (mapped->mapping) { CloseHandle(mapped->mapping); }
+            CloseHandle(mapped->file);
+            return ERR_READ;
+        }
+        return ERR_SUCCESS;
+    }
+
+    static void UnmapFile(MappedFile* mapped) {
+        UnmapViewOfFile(mapped->data);
+        CloseHandle(mapped->mapping);
+        CloseHandle(mapped->file);
+    }
+#else
+    static int MapFile(const char* path, MappedFile* mapped) {
+        struct stat info;
+
+        mapped->data = NULL;
+        mapped->fd = open(path, O_RDONLY);
+        if (mapped->fd < 0) { return ERR_OPEN_FILE; }
+
+        // empty files can't be mapped and have nothing to find
+        if (fstat(mapped->fd, &info) || !info.st_size || (uint64_t)info.st_size > SIZE_MAX) {
+            close(mapped->fd);
+            return ERR_READ;
+        }
+        mapped->size = (size_t)info.st_size;
+
+        void* data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, mapped->fd, 0);
+        if (data == MAP_FAILED) {
+            close(mapped->fd);
+            return ERR_READ;
+        }
+
+        madvise(data, mapped->size, MADV_SEQUENTIAL);
+        mapped->data = data;
+        return ERR_SUCCESS;
+    }
+
+    static void UnmapFile(MappedFile* mapped) {
+        munmap((void*)mapped->data, mapped->size);
+        close(mapped->fd);
+    }
+#endif
+
+static int AddMatch(FileEntry* entry, const FileMatch* match) {
+    if (entry->len == entry->size) {
+        size_t size = entry->size ? 2 * entry->size : 16;
+        FileMatch* matches = realloc(entry->matches, size * sizeof(FileMatch));
+
+        if (!matches) { return ERR_NOMEM; }
+        entry->matches = matches;
+        entry->size = size;
+    }
+
+    entry->matches[entry->len++] = *match;
+    return ERR_SUCCESS;
+}
+
+// finds occurrences of the literal in the chars of a file, counting line ends before each of them
+static int SearchChars(FileEntry* entry, const char* data, size_t size) {
+    FindInFiles* search = entry->search;
+    const Literal* literal = search->literal;
+    const char* end = data + size;
+    const char* from = data;
+    const char* counted = data;     // line ends before it are counted
+    const char* lineStart = data;
+    size_t line = 0;
+
+    while (from < end && entry->len < search->maxMatches && !IsCancelled(search)) {
+        // occurrences starting in the window
+        size_t window = (size_t)(end - from);
+        size_t windowLen = window > FIND_IN_FILES_WINDOW + literal->len - 1 ? FIND_IN_FILES_WINDOW + literal->len - 1 : window;
+        const char* hit = FindLiteralInSpan(literal, from, windowLen);
+
+        if (!hit) {
+            from += windowLen < window ? FIND_IN_FILES_WINDOW : window;
+            continue;
+        }
+
+        for (const char* newline; (newline = memchr(counted, '\n', (size_t)(hit - counted))); counted = newline + 1) {
+            ++line;
+            lineStart = newline + 1;
+        }
+        counted = hit;
+
+        FileMatch match = { entry->path, (size_t)(hit - data), line, (size_t)(hit - lineStart) };
+        if (AddMatch(entry, &match)) { return ERR_NOMEM; }
+
+        from = hit + 1;
+    }
+    return ERR_SUCCESS;
+}
+
+static void SearchFile(void* arg, size_t worker) {
+    FileEntry* entry = arg;
+    FindInFiles* search = entry->search;
+    MappedFile mapped;
+    (void)worker;
+
+    TRACE_SCOPE("SearchFile");
+
+    if (!IsCancelled(search) && !MapFile(entry->path, &mapped)) {
+        size_t probe = mapped.size < FIND_IN_FILES_BINARY_PROBE ? mapped.size : FIND_IN_FILES_BINARY_PROBE;
+
+        // binary files are skipped
+        if (!memchr(mapped.data, '\0', probe) && SearchChars(entry, mapped.data, mapped.size)) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        }
+        UnmapFile(&mapped);
+    }
+
+    atomic_fetch_add(&search->searched, 1);
+    atomic_store_explicit(&entry->isDone, 1, memory_order_release);
+    if (search->onProgress && !IsCancelled(search)) { search->onProgress(search->context); }
+}
+
+static int AddFile(FindInFiles* search, const char* dir, const char* name) {
+    if (search->filesCount == search->filesSize) {
+        size_t size = search->filesSize ? 2 * search->filesSize : 256;
+        FileEntry* files = realloc(search->files, size * sizeof(FileEntry));
+
+        if (!files) { return ERR_NOMEM; }
+        search->files = files;
+        search->filesSize = size;
+    }
+
+    char* path = malloc(strlen(dir) + strlen(name) + sizeof(PATH_SEPARATOR));
+    if (!path) { return ERR_NOMEM; }
+
+    strcpy(path, dir);
+    strcat(path, PATH_SEPARATOR);
+    strcat(path, name);
+
+    FileEntry* entry = &search->files[search->filesCount++];
+
+    memset(entry, 0, sizeof(FileEntry));
+    entry->search = search;
+    entry->path = path;
+    atomic_init(&entry->isDone, 0);
+    return ERR_SUCCESS;
+}
+
+// lists regular files of a directory and its subdirectories (depth first)
+static int ListFiles(FindInFiles* search, const char* dir) {
+    int errValue = ERR_SUCCESS;
+
+    #ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        char* mask = malloc(strlen(dir) + 3);
+
+        if (!mask) { return ERR_NOMEM; }
+        strcpy(mask, dir);
+        strcat(mask, "\\*");
+
+        HANDLE find = FindFirstFileA(mask, &data);
+        free(mask);
+        if (find == INVALID_HANDLE_VALUE) { return ERR_SUCCESS; }
+
+        do {
+            const char* name = data.cFileName;
+
+            if (!strcmp(name, ".") || !strcmp(name, "..")) { continue; }
+
+            // reparse points may loop
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) { continue; }
+
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                errValue = AddFile(search, dir, name);
+                continue;
+            }
+
+            char* subdir = malloc(strlen(dir) + strlen(name) + 2);
+            if (!subdir) {
+                errValue = ERR_NOMEM;
+                break;
+            }
+            sprintf(subdir, "%s" PATH_SEPARATOR "%s", dir, name);
+            errValue = ListFiles(search, subdir);
+            free(subdir);
+        } while (!errValue && !IsCancelled(search) && FindNextFileA(find, &data));
+
+        FindClose(find);
+    #else
+        DIR* handle = opendir(dir);
+        struct dirent* item;
+
+        if (!handle) { return ERR_SUCCESS; }
+
+        while (!errValue && !IsCancelled(search) && (item = readdir(handle))) {
+            const char* name = item->d_name;
+            struct stat info;
+
+            if (!strcmp(name, ".") || !strcmp(name, "..")) { continue; }
+
+            char* path = malloc(strlen(dir) + strlen(name) + 2);
+            if (!path) {
+                errValue = ERR_NOMEM;
+                break;
+            }
+            sprintf(path, "%s" PATH_SEPARATOR "%s", dir, name);
+
+            // symbolic links aren't followed: they may loop
+            if (!lstat(path, &info)) {
+                if (S_ISDIR(info.st_mode)) {
+                    errValue = ListFiles(search, path);
+                } else if (S_ISREG(info.st_mode)) {
+                    errValue = AddFile(search, dir, name);
+                }
+            }
+            free(path);
+        }
+
+        closedir(handle);
+    #endif
+
+    return errValue;
+}
+
+// lists the files, then submits a task per file
+static void ListDirectory(void* arg, size_t worker) {
+    FindInFiles* search = arg;
+    (void)worker;
+
+    TRACE_SCOPE("ListDirectory");
+
+    if (ListFiles(search, search->dir)) { PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__); }
+
+    // a file which isn't submitted (on error or after cancellation) has no occurrences
+    for (size_t i = 0; i < search->filesCount; ++i) {
+        if (IsCancelled(search) || ThreadPoolSubmit(search->pool, &search->group, SearchFile, &search->files[i])) {
+            atomic_store_explicit(&search->files[i].isDone, 1, memory_order_release);
+        }
+    }
+
+    atomic_store_explicit(&search->isListed, 1, memory_order_release);
+    if (search->onProgress && !IsCancelled(search)) { search->onProgress(search->context); }
+}
+
+FindInFiles* StartFindInFiles(ThreadPool* pool, const char* dir, const char* pattern, size_t len, int flags,
+                              size_t maxMatches, FindInFilesProgress onProgress, void* context) {
+    assert(pool && dir && pattern && len);
+    TRACE_SCOPE("StartFindInFiles");
+
+    FindInFiles* search = calloc(1, sizeof(FindInFiles));
+    if (!search) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    search->pool = pool;
+    search->maxMatches = maxMatches ? maxMatches : FIND_IN_FILES_MAX_MATCHES;
+    search->onProgress = onProgress;
+    search->context = context;
+    InitTaskGroup(&search->group);
+    atomic_init(&search->isCancelled, 0);
+    atomic_init(&search->isListed, 0);
+    atomic_init(&search->searched, 0);
+
+    search->dir = malloc(strlen(dir) + 1);
+    search->literal = CreateLiteral(pattern, len, flags);
+
+    if (!search->dir || !search->literal) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        DestroyFindInFiles(&search);
+        return NULL;
+    }
+    strcpy(search->dir, dir);
+
+    if (ThreadPoolSubmit(pool, &search->group, ListDirectory, search)) {
+        DestroyFindInFiles(&search);
+        return NULL;
+    }
+    return search;
+}
+
+size_t FindInFilesTake(FindInFiles* search, FileMatch* matches, size_t size, int* isFinished) {
+    assert(search && matches);
+
+    size_t count = 0;
+    int isListed = atomic_load_explicit(&search->isListed, memory_order_acquire);
+
+    for (size_t i = search->first; isListed && i < search->filesCount && count < size; ++i) {
+        FileEntry* entry = &search->files[i];
+
+        if (!atomic_load_explicit(&entry->isDone, memory_order_acquire)) { continue; }
+
+        while (entry->taken < entry->len && count < size) { matches[count++] = entry->matches[entry->taken++]; }
+    }
+
+    // files are taken in any order, the cursor skips the ones taken completely
+    while (isListed && search->first < search->filesCount) {
+        FileEntry* entry = &search->files[search->first];
+
+        if (!atomic_load_explicit(&entry->isDone, memory_order_acquire) || entry->taken < entry->len) { break; }
+        ++search->first;
+    }
+
+    if (isFinished) {
+        *isFinished = (isListed && search->first == search->filesCount) || atomic_load(&search->isCancelled);
+    }
+    return count;
+}
+
+size_t FindInFilesCount(const FindInFiles* search) {
+    assert(search);
+    return atomic_load(&((FindInFiles*)search)->searched);
+}
+
+void FindInFilesWait(FindInFiles* search) {
+    assert(search);
+    ThreadPoolWait(search->pool, &search->group);
+}
+
+void CancelFindInFiles(FindInFiles* search) {
+    assert(search);
+    atomic_store(&search->isCancelled, 1);
+}
+
+void DestroyFindInFiles(FindInFiles** ppSearch) {
+    assert(ppSearch);
+
+    FindInFiles* search = *ppSearch;
+    if (!search) { return; }
+
+    CancelFindInFiles(search);
+    FindInFilesWait(search);
+
+    for (size_t i = 0; i < search->filesCount; ++i) {
+        free(search->files[i].path);
+        free(search->files[i].matches);
+    }
+    free(search->files);
+    free(search->dir);
+    DestroyLiteral(&search->literal);
+    free(search);
+
+    *ppSearch = NULL;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef FINDINFILES_H_INCLUDED
+#define FINDINFILES_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Trace.h"
+
+#include "Search.h"
+#include "ThreadPool.h"
+
+#define FIND_IN_FILES_MAX_MATCHES 1000      // default cap of occurrences of one file
+#define FIND_IN_FILES_BINARY_PROBE 4096     // a file with '\0' in its first chars isn't text
+
+typedef struct {
+    const char* path;   // path of the file (owned by the search)
+    size_t offset;      // offset of the first char of the occurrence in the file
+    size_t line;        // index of the line (a block of the document opened from the file)
+    size_t column;      // position of the occurrence in the line
+} FileMatch;
+
+// called by a worker when a file is searched (the callback must be thread safe)
+typedef void (*FindInFilesProgress)(void* context);
+
+typedef struct FindInFiles_tag FindInFiles;
+
+/**
+ * Starts to search a literal in all files of a directory and its subdirectories.
+ * Files are mapped into memory and searched on the thread pool, one task per file.
+ * Line ends are '\n', so lines and columns are the ones of the file opened as a document.
+ * IN:
+ * @param pool - pointer to a thread pool
+ * @param dir - path of the directory
+ * @param pattern - pointer to chars of the pattern ('\n' matches a line end)
+ * @param len - length of the pattern (> 0)
+ * @param flags - SearchFlags
+ * @param maxMatches - cap of occurrences of one file (0 - FIND_IN_FILES_MAX_MATCHES)
+ * @param onProgress - function called when a file is searched (NULL - not needed)
+ * @param context - argument of the function
+ *
+ * OUT:
+ * @return search - pointer to a running search, NULL on error
+ */
+FindInFiles* StartFindInFiles(ThreadPool* pool, const char* dir, const char* pattern, size_t len, int flags,
+                              size_t maxMatches, FindInFilesProgress onProgress, void* context);
+
+/**
+ * Takes the occurrences of searched files which aren't taken yet. Occurrences of a file come
+ * together and in the order of the file, files come as they are searched.
+ * IN:
+ * @param search - pointer to a search
+ * @param matches - pointer to an array to be filled
+ * @param size - size of the array
+ * @param isFinished - pointer to a flag to be filled: 1 if all occurrences are taken (NULL - not needed)
+ *
+ * OUT:
+ * @return count - count of taken occurrences
+ */
+size_t FindInFilesTake(FindInFiles* search, FileMatch* matches, size_t size, int* isFinished);
+
+/**
+ * Gets the count of searched files.
+ * IN:
+ * @param search - pointer to a search
+ *
+ * OUT:
+ * @return count - count of files whose occurrences are ready
+ */
+size_t FindInFilesCount(const FindInFiles* search);
+
+/**
+ * Waits until all files are searched.
+ * IN:
+ * @param search - pointer to a search
+ */
+void FindInFilesWait(FindInFiles* search);
+
+/**
+ * Stops the search: workers skip the rest of the files.
+ * IN:
+ * @param search - pointer to a search
+ */
+void CancelFindInFiles(FindInFiles* search);
+
+/**
+ * Cancels the search, waits for workers and destroys the search. Paths of taken occurrences become invalid.
+ * IN:
+ * @param ppSearch - pointer to pointer to a search
+ *
+ * OUT:
+ * *ppSearch - filled with NULL value
+ */
+void DestroyFindInFiles(FindInFiles** ppSearch);
+
+#endif // FINDINFILES_H_INCLUDED
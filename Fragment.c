@@ -1,6 +1,7 @@
 #include "Fragment.h"
 
 CREATE_NODE(Fragment, FragmentData_t) {
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     Fragment* node = malloc(sizeof(Fragment));
 
     if (!node) { return NULL; }
@@ -19,6 +20,7 @@ DESTROY_NODE(Fragment) {
 }
 
 CREATE_LIST(Fragment) {
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     ListFragment* list = calloc(1, sizeof(ListFragment));
 
     if (!list) { return NULL; }
@@ -30,6 +32,7 @@ DESTROY_LIST(Fragment) {
     assert(list && *list);
 
     Fragment* node = (*list)->nodes;
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, (*list)->len);
     while(node) {
         Fragment* nextNode = node->next;
         
@@ -70,6 +73,7 @@ INSERT_NODES(Fragment) {
         lastNode = lastNode->next;
         ++count;
     }
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, count - 1);
 
     if (node->prev) {
         lastNode->next = node->prev->next;
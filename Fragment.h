@@ -6,6 +6,7 @@
 #include <assert.h>
 
 #include "List.h"
+#include "Counters.h"
 
 typedef struct FragmentData_tag {
     size_t len;     // a length of a string part
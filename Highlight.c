@@ -0,0 +1,266 @@
+#include "Highlight.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+    const Block* block;         // NULL - empty slot
+    size_t version;             // version of the document when the block was scanned
+    int isScanned;              // ranges are found (0 - a new block or no memory)
+    size_t frame;               // the last frame which showed the block
+    HighlightRange* ranges;
+    size_t len;
+    size_t size;
+} HighlightEntry;
+
+struct Highlight_tag {
+    const Document* doc;
+    char* pattern;              // the pattern as it's given
+    size_t len;
+    int flags;                  // HighlightFlags
+    Literal* literal;           // pattern of a literal search
+    Regex* regex;               // pattern of a regex search
+    size_t follow;              // count of next blocks an occurrence may read (SIZE_MAX - any)
+
+    HighlightEntry* entries;    // open addressing by the block pointer
+    size_t size;                // power of 2
+    size_t count;               // count of used slots
+    size_t frame;
+};
+
+static size_t HashBlock(const Block* block, size_t size) {
+    uint64_t x = (uint64_t)(uintptr_t)block;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x & (size - 1);
+}
+
+static HighlightEntry* FindEntry(HighlightEntry* entries, size_t size, const Block* block) {
+    size_t i = HashBlock(block, size);
+
+    while (entries[i].block && entries[i].block != block) { i = (i + 1) & (size - 1); }
+    return &entries[i];
+}
+
+// a class of the expression has a line end, so a match may continue in the next blocks
+static int CanCrossLines(const Regex* regex) {
+    for (size_t i = 0; i < regex->classesLen; ++i) {
+        if (regex->classes[i].bits['\n' >> 5] & (1u << ('\n' & 31))) { return 1; }
+    }
+    return 0;
+}
+
+static int AddRange(HighlightEntry* entry, size_t start, size_t end) {
+    if (start >= end) { return ERR_SUCCESS; }
+
+    // overlapping occurrences are shown as one range
+    if (entry->len && start <= entry->ranges[entry->len - 1].end) {
+        HighlightRange* last = &entry->ranges[entry->len - 1];
+
+        last->end = MAX(last->end, end);
+        return ERR_SUCCESS;
+    }
+
+    if (entry->len == entry->size) {
+        size_t newSize = entry->size ? 2 * entry->size : 8;
+        HighlightRange* newRanges = realloc(entry->ranges, newSize * sizeof(HighlightRange));
+
+        if (!newRanges) { return ERR_NOMEM; }
+        entry->ranges = newRanges;
+        entry->size = newSize;
+    }
+
+    entry->ranges[entry->len++] = (HighlightRange){ start, end };
+    return ERR_SUCCESS;
+}
+
+// occurrences starting in the block (the position after its line end ends the range)
+static int ScanBlock(Highlight* highlight, Block* block, size_t y, HighlightEntry* entry) {
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("ScanBlock");
+
+    ModelPos from = { block, { 0, y } };
+    ModelPos to = { block->next, { 0, y + 1 } };
+    size_t len = block->data.len;
+
+    entry->len = 0;
+    entry->version = highlight->doc->version;
+
+    if (highlight->regex) {
+        RegexMatch match;
+
+        while (from.pos.x <= len && FindRegexInRange(highlight->doc, highlight->regex, from, to.block ? &to : NULL, &match)) {
+            if (match.start.block != block) { break; }
+
+            int isCrossing = match.end.block != block;
+            size_t end = isCrossing ? len : match.end.pos.x;
+
+            if (AddRange(entry, match.start.pos.x, end)) { return ERR_NOMEM; }
+            if (isCrossing) { break; }
+
+            // an empty match is skipped by a char
+            from.pos.x = end > match.start.pos.x ? end : end + 1;
+        }
+    } else {
+        ModelPos match;
+
+        while (from.pos.x <= len && FindLiteralInRange(highlight->doc, highlight->literal, from, to.block ? &to : NULL, &match)) {
+            if (match.block != block) { break; }
+            if (AddRange(entry, match.pos.x, MIN(match.pos.x + highlight->literal->len, len))) { return ERR_NOMEM; }
+
+            from.pos.x = match.pos.x + 1;
+        }
+    }
+
+    return ERR_SUCCESS;
+}
+
+// the block and the next ones read by its occurrences aren't changed since the scan
+static int IsUpToDate(const Highlight* highlight, const HighlightEntry* entry, const Block* block) {
+    if (highlight->follow == SIZE_MAX) { return entry->version == highlight->doc->version; }
+
+    // a new block reusing the pointer of a deleted one has a newer version
+    for (size_t i = 0; block && i <= highlight->follow; ++i, block = block->next) {
+        if (block->data.version > entry->version) { return 0; }
+    }
+    return 1;
+}
+
+// drops blocks which aren't shown by the current frame and makes room for a new block
+static int EvictEntries(Highlight* highlight) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < highlight->size; ++i) {
+        if (highlight->entries[i].block && highlight->entries[i].frame == highlight->frame) { ++kept; }
+    }
+
+    size_t newSize = highlight->size;
+    while (2 * (kept + 1) > newSize) { newSize *= 2; }
+
+    HighlightEntry* entries = calloc(newSize, sizeof(HighlightEntry));
+    if (!entries) { return ERR_NOMEM; }
+
+    for (size_t i = 0; i < highlight->size; ++i) {
+        HighlightEntry* entry = &highlight->entries[i];
+
+        if (!entry->block) { continue; }
+        if (entry->frame == highlight->frame) {
+            *FindEntry(entries, newSize, entry->block) = *entry;
+        } else {
+            free(entry->ranges);
+        }
+    }
+
+    free(highlight->entries);
+    highlight->entries = entries;
+    highlight->size = newSize;
+    highlight->count = kept;
+    return ERR_SUCCESS;
+}
+
+Highlight* CreateHighlight(const Document* doc, const char* pattern, size_t len, int flags) {
+    assert(doc && pattern && len);
+
+    Highlight* highlight = calloc(1, sizeof(Highlight));
+    if (!highlight) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    highlight->doc = doc;
+    highlight->len = len;
+    highlight->flags = flags;
+    highlight->size = HIGHLIGHT_MIN_BLOCKS;
+    highlight->pattern = malloc(len);
+    highlight->entries = calloc(highlight->size, sizeof(HighlightEntry));
+
+    if (!highlight->pattern || !highlight->entries) {
+        DestroyHighlight(&highlight);
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+    memcpy(highlight->pattern, pattern, len);
+
+    if (flags & HIGHLIGHT_REGEX) {
+        // a syntax error isn't reported: the search reports it
+        highlight->regex = CreateRegex(pattern, len, (flags & HIGHLIGHT_IGNORE_CASE) ? REGEX_IGNORE_CASE : REGEX_MATCH_CASE);
+        if (!highlight->regex) {
+            DestroyHighlight(&highlight);
+            return NULL;
+        }
+        highlight->follow = CanCrossLines(highlight->regex) ? SIZE_MAX : 0;
+    } else {
+        highlight->literal = CreateLiteral(pattern, len, (flags & HIGHLIGHT_IGNORE_CASE) ? SEARCH_IGNORE_CASE : SEARCH_MATCH_CASE);
+        if (!highlight->literal) {
+            DestroyHighlight(&highlight);
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return NULL;
+        }
+
+        // every line end of the pattern reads one more block
+        for (size_t i = 0; i < len; ++i) { highlight->follow += pattern[i] == '\n'; }
+    }
+
+    return highlight;
+}
+
+void DestroyHighlight(Highlight** ppHighlight) {
+    assert(ppHighlight);
+
+    Highlight* highlight = *ppHighlight;
+    if (!highlight) { return; }
+
+    for (size_t i = 0; highlight->entries && i < highlight->size; ++i) { free(highlight->entries[i].ranges); }
+    free(highlight->entries);
+    DestroyLiteral(&highlight->literal);
+    DestroyRegex(&highlight->regex);
+    free(highlight->pattern);
+    free(highlight);
+
+    *ppHighlight = NULL;
+}
+
+int IsHighlightOf(const Highlight* highlight, const char* pattern, size_t len, int flags) {
+    assert(highlight && (pattern || !len));
+
+    return highlight->flags == flags && highlight->len == len && !memcmp(highlight->pattern, pattern, len);
+}
+
+void BeginHighlightFrame(Highlight* highlight) {
+    assert(highlight);
+
+    ++highlight->frame;
+}
+
+size_t GetBlockHighlight(Highlight* highlight, Block* block, size_t y, const HighlightRange** ranges) {
+    assert(highlight && block && ranges);
+
+    HighlightEntry* entry = FindEntry(highlight->entries, highlight->size, block);
+
+    if (!entry->block) {
+        if (4 * (highlight->count + 1) > 3 * highlight->size) {
+            if (EvictEntries(highlight)) {
+                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                return 0;
+            }
+            entry = FindEntry(highlight->entries, highlight->size, block);
+        }
+
+        entry->block = block;
+        ++highlight->count;
+    }
+
+    if (!entry->isScanned || !IsUpToDate(highlight, entry, block)) {
+        entry->isScanned = !ScanBlock(highlight, block, y, entry);
+        if (!entry->isScanned) {
+            entry->len = 0;
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        }
+    }
+
+    entry->frame = highlight->frame;
+    *ranges = entry->ranges;
+    return entry->len;
+}
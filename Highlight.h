@@ -0,0 +1,99 @@
+#pragma once
+#ifndef HIGHLIGHT_H_INCLUDED
+#define HIGHLIGHT_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Search.h"
+#include "Regex.h"
+
+#define HIGHLIGHT_MIN_BLOCKS 64     // initial capacity of the cache (blocks)
+
+typedef enum {
+    HIGHLIGHT_LITERAL       = 0,
+    HIGHLIGHT_REGEX         = 1 << 0,
+    HIGHLIGHT_IGNORE_CASE   = 1 << 1    // ASCII letters only
+} HighlightFlags;
+
+typedef struct {
+    size_t start;       // position of the first highlighted char in the block
+    size_t end;         // position after the last highlighted char (block->data.len - up to the line end)
+} HighlightRange;
+
+/**
+ * Occurrences of the active search in the displayed blocks. Each block keeps the sorted list of
+ * its highlighted ranges tagged with the version of the document when the block was scanned.
+ * The block is scanned again only when it (or a next block read by its occurrences) has a newer
+ * version, so painting and scrolling over scanned blocks don't search. Blocks which aren't shown
+ * by the last frames are evicted when the cache grows.
+ * An occurrence crossing a line end is highlighted in the line where it starts.
+ */
+typedef struct Highlight_tag Highlight;
+
+/**
+ * Creates highlighting of the occurrences of a pattern.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param pattern - pointer to chars of the pattern
+ * @param len - length of the pattern (> 0)
+ * @param flags - HighlightFlags
+ *
+ * OUT:
+ * @return highlight - pointer to a highlight, NULL on error (invalid regex or no memory)
+ */
+Highlight* CreateHighlight(const Document* doc, const char* pattern, size_t len, int flags);
+
+/**
+ * Destroys a highlight.
+ * IN:
+ * @param ppHighlight - pointer to pointer to a highlight
+ *
+ * OUT:
+ * *ppHighlight - filled with NULL value
+ */
+void DestroyHighlight(Highlight** ppHighlight);
+
+/**
+ * Checks that a highlight shows the occurrences of a pattern.
+ * IN:
+ * @param highlight - pointer to a highlight
+ * @param pattern - pointer to chars of the pattern
+ * @param len - length of the pattern
+ * @param flags - HighlightFlags
+ *
+ * OUT:
+ * @return isSame - 1 if the pattern and the flags are the ones of the highlight, 0 otherwise
+ */
+int IsHighlightOf(const Highlight* highlight, const char* pattern, size_t len, int flags);
+
+/**
+ * Starts a new frame: blocks got after it are the shown ones, the others may be evicted.
+ * IN:
+ * @param highlight - pointer to a highlight
+ */
+void BeginHighlightFrame(Highlight* highlight);
+
+/**
+ * Gets the highlighted ranges of a block, the block is scanned if its ranges aren't cached
+ * or are out of date.
+ * IN:
+ * @param highlight - pointer to a highlight
+ * @param block - pointer to a block of the document
+ * @param y - index of the block
+ * @param ranges - pointer to a pointer to be filled with the sorted disjoint ranges
+ *                 (valid until the next frame)
+ *
+ * OUT:
+ * @return count - count of the ranges (0 on error)
+ */
+size_t GetBlockHighlight(Highlight* highlight, Block* block, size_t y, const HighlightRange** ranges);
+
+#endif // HIGHLIGHT_H_INCLUDED
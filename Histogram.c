@@ -0,0 +1,110 @@
+#include "Histogram.h"
+
+#define SUB_BUCKETS (1U << HISTOGRAM_SUB_BITS)
+
+static unsigned GetMostSignificantBit(uint64_t value) {
+    assert(value);
+
+    #ifdef __GNUC__
+        return 63 - __builtin_clzll(value);
+    #else
+        unsigned msb = 0;
+        while (value >>= 1) { ++msb; }
+        return msb;
+    #endif
+}
+
+static size_t GetBucketIndex(uint64_t value) {
+    unsigned shift = 0;
+
+    if (value >= SUB_BUCKETS) {
+        shift = GetMostSignificantBit(value) - HISTOGRAM_SUB_BITS;
+    }
+
+    // [0; 2 * SUB_BUCKETS) are linear, then SUB_BUCKETS per power of two
+    return ((size_t)shift << HISTOGRAM_SUB_BITS) + (size_t)(value >> shift);
+}
+
+static uint64_t GetBucketHighestValue(size_t index) {
+    if (index < 2 * SUB_BUCKETS) { return index; }
+
+    unsigned shift = (unsigned)(index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t mantissa = index - ((size_t)shift << HISTOGRAM_SUB_BITS);
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void InitHistogram(Histogram* hist) {
+    assert(hist);
+
+    atomic_init(&(hist->count), 0);
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        atomic_init(&(hist->buckets[i]), 0);
+    }
+}
+
+void HistogramRecord(Histogram* hist, uint64_t value) {
+    assert(hist);
+
+    size_t index = GetBucketIndex(value);
+    assert(index < HISTOGRAM_BUCKETS);
+
+    // the only writer: plain load and store instead of read-modify-write
+    atomic_store_explicit(&(hist->buckets[index]),
+        atomic_load_explicit(&(hist->buckets[index]), memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&(hist->count),
+        atomic_load_explicit(&(hist->count), memory_order_relaxed) + 1, memory_order_release);
+}
+
+void HistogramMerge(Histogram* dst, const Histogram* src) {
+    assert(dst && src);
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        size_t value = atomic_load_explicit(&(src->buckets[i]), memory_order_relaxed);
+
+        if (value) {
+            atomic_fetch_add_explicit(&(dst->buckets[i]), value, memory_order_relaxed);
+            count += value;
+        }
+    }
+
+    // count is derived from buckets to stay consistent with them
+    atomic_fetch_add_explicit(&(dst->count), count, memory_order_release);
+}
+
+size_t HistogramCount(const Histogram* hist) {
+    assert(hist);
+    return atomic_load_explicit(&(hist->count), memory_order_acquire);
+}
+
+uint64_t HistogramPercentile(const Histogram* hist, double percentile) {
+    assert(hist);
+    assert(percentile >= 0 && percentile <= 100);
+
+    size_t count = 0;
+    size_t total = 0;
+    size_t lastIndex = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        total += atomic_load_explicit(&(hist->buckets[i]), memory_order_relaxed);
+    }
+    if (!total) { return 0; }
+
+    size_t rank = (size_t)(percentile / 100 * total + 0.5);
+    if (!rank) { rank = 1; }
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        size_t value = atomic_load_explicit(&(hist->buckets[i]), memory_order_relaxed);
+
+        if (value) {
+            count += value;
+            lastIndex = i;
+
+            if (count >= rank) { break; }
+        }
+    }
+
+    return GetBucketHighestValue(lastIndex);
+}
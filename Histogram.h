@@ -0,0 +1,72 @@
+#pragma once
+#ifndef HISTOGRAM_H_INCLUDED
+#define HISTOGRAM_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+// count of linear sub-buckets in every power of two (2^5 gives ~3% precision)
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/**
+ * Log-linear (HDR-style) histogram of 64-bit values.
+ * It has only one writer, so recording needs no locks:
+ * counters are atomic only to let other threads read them at any time.
+ */
+typedef struct Histogram_tag {
+    atomic_size_t count;                        // count of recorded values
+    atomic_size_t buckets[HISTOGRAM_BUCKETS];   // counters of values in buckets
+} Histogram;
+
+/**
+ * Inits Histogram object.
+ * IN:
+ * @param hist - pointer to a Histogram object
+ *
+ * OUT:
+ * fills counters with zero values
+ */
+void InitHistogram(Histogram* hist);
+
+/**
+ * Records value to a histogram. Must be called only by an owner of a histogram.
+ * IN:
+ * @param hist - pointer to a Histogram object
+ * @param value - value to be recorded
+ */
+void HistogramRecord(Histogram* hist, uint64_t value);
+
+/**
+ * Adds counters of one histogram to another.
+ * IN:
+ * @param dst - pointer to a Histogram object that will be updated
+ * @param src - pointer to a Histogram object
+ */
+void HistogramMerge(Histogram* dst, const Histogram* src);
+
+/**
+ * Gets count of recorded values.
+ * IN:
+ * @param hist - pointer to a Histogram object
+ *
+ * OUT:
+ * @return count - count of values
+ */
+size_t HistogramCount(const Histogram* hist);
+
+/**
+ * Gets value at a percentile.
+ * IN:
+ * @param hist - pointer to a Histogram object
+ * @param percentile - percentile in range [0; 100]
+ *
+ * OUT:
+ * @return value - highest value equivalent to the value at the percentile
+ *                 (0 if histogram is empty)
+ */
+uint64_t HistogramPercentile(const Histogram* hist, double percentile);
+
+#endif // HISTOGRAM_H_INCLUDED
@@ -0,0 +1,378 @@
+#include "History.h"
+
+// memory of a chain of blocks and their fragments
+static size_t GetChainBytes(const Block* nodes, size_t len) {
+    size_t bytes = 0;
+
+    for (; nodes && len; nodes = nodes->next, --len) {
+        bytes += sizeof(Block);
+        if (nodes->data.fragments) {
+            bytes += sizeof(ListFragment) + nodes->data.fragments->len * sizeof(Fragment);
+        }
+    }
+    return bytes;
+}
+
+static void DiscardChain(History* history, Block* nodes) {
+    if (history->onDiscard) {
+        history->onDiscard(history->context, nodes);
+        return;
+    }
+
+    while (nodes) {
+        Block* next = nodes->next;
+
+        DestroyBlock(&nodes);
+        nodes = next;
+    }
+}
+
+static void FreeRecord(History* history, HistoryRecord* record, int isDone) {
+    switch (record->op) {
+    case HISTORY_SPLIT:
+        if (!isDone) { DiscardChain(history, record->nodes); }
+        break;
+
+    case HISTORY_MERGE:
+        if (isDone) { DiscardChain(history, record->nodes); }
+        break;
+
+    case HISTORY_REPLACE:
+        DiscardChain(history, record->nodes);
+        break;
+
+    default:
+        break;
+    }
+
+    free(record->pieces);
+    free(record->changes);
+    history->bytes -= record->bytes;
+}
+
+History* CreateHistory(size_t cap, HistoryDiscard onDiscard, void* context) {
+    History* history = calloc(1, sizeof(History));
+
+    if (!history) { return NULL; }
+
+    history->cap = cap;
+    history->onDiscard = onDiscard;
+    history->context = context;
+    return history;
+}
+
+void DestroyHistory(History** ppHistory) {
+    assert(ppHistory && *ppHistory);
+
+    ClearHistory(*ppHistory);
+    free((*ppHistory)->records);
+    free(*ppHistory);
+    *ppHistory = NULL;
+}
+
+void ClearHistory(History* history) {
+    assert(history);
+
+    for (size_t i = history->first; i < history->len; ++i) {
+        FreeRecord(history, &history->records[i], i < history->done);
+    }
+
+    history->first = 0;
+    history->done = 0;
+    history->len = 0;
+    history->isGroupUnit = 0;
+}
+
+// drops the undone records: a new record starts another branch of the history
+static void DropUndone(History* history) {
+    for (size_t i = history->done; i < history->len; ++i) {
+        FreeRecord(history, &history->records[i], 0);
+    }
+    history->len = history->done;
+}
+
+// drops the oldest units while the records take more than the cap, the newest unit is kept
+static void FitCap(History* history) {
+    while (history->bytes > history->cap && history->first < history->done
+           && history->records[history->first].unit != history->records[history->done - 1].unit) {
+        size_t unit = history->records[history->first].unit;
+
+        while (history->first < history->done && history->records[history->first].unit == unit) {
+            FreeRecord(history, &history->records[history->first], 1);
+            ++history->first;
+        }
+    }
+}
+
+void SetHistoryCap(History* history, size_t cap) {
+    assert(history);
+
+    history->cap = cap;
+    FitCap(history);
+}
+
+void BeginHistoryGroup(History* history) {
+    assert(history);
+
+    if (!history->groupDepth++) { history->isGroupUnit = 0; }
+}
+
+void EndHistoryGroup(History* history) {
+    assert(history && history->groupDepth);
+
+    --history->groupDepth;
+}
+
+static HistoryRecord* GetLastRecord(History* history) {
+    return history->done > history->first ? &history->records[history->done - 1] : NULL;
+}
+
+// the edit continues the last record: typing or deleting a run of chars at one place
+static int IsContinued(History* history, HistoryOp op, const Block* block, size_t x, size_t len) {
+    const HistoryRecord* last = GetLastRecord(history);
+
+    if (!last || history->isSealed || last->op != op || last->block != block) { return 0; }
+    if (history->groupDepth && history->isGroupUnit && last->unit != history->unit) { return 0; }
+
+    switch (op) {
+    case HISTORY_INSERT:    return x == last->x + last->len;
+    case HISTORY_DELETE:    return x == last->x || x + len == last->x;
+    default:                return 0;
+    }
+}
+
+static int ReserveRecord(History* history) {
+    if (history->len < history->size) { return ERR_SUCCESS; }
+
+    // dropped records leave room at the front
+    if (history->first) {
+        memmove(history->records, history->records + history->first, (history->len - history->first) * sizeof(HistoryRecord));
+        history->done -= history->first;
+        history->len -= history->first;
+        history->first = 0;
+        return ERR_SUCCESS;
+    }
+
+    size_t size = history->size ? 2 * history->size : HISTORY_MIN_RECORDS;
+    HistoryRecord* records = realloc(history->records, size * sizeof(HistoryRecord));
+
+    if (!records) { return ERR_NOMEM; }
+
+    history->bytes += (size - history->size) * sizeof(HistoryRecord);
+    history->records = records;
+    history->size = size;
+    return ERR_SUCCESS;
+}
+
+/**
+ * Starts a record of an edit, a continued edit gets the last record. The undone records are
+ * dropped. Returns NULL on error.
+ */
+static HistoryRecord* AddRecord(History* history, HistoryOp op, Block* block, size_t y, size_t x, size_t len, int isContinued) {
+    DropUndone(history);
+
+    // the group joins the continued unit
+    if (isContinued) {
+        if (history->groupDepth) { history->isGroupUnit = 1; }
+        return GetLastRecord(history);
+    }
+
+    if (ReserveRecord(history)) { return NULL; }
+
+    // a group gets one unit
+    if (!history->groupDepth || !history->isGroupUnit) { ++history->unit; }
+    if (history->groupDepth) { history->isGroupUnit = 1; }
+    history->isSealed = 0;
+
+    HistoryRecord* record = &history->records[history->len++];
+
+    memset(record, 0, sizeof(HistoryRecord));
+    record->op = op;
+    record->unit = history->unit;
+    record->block = block;
+    record->y = y;
+    record->x = x;
+    record->len = len;
+
+    history->done = history->len;
+    return record;
+}
+
+static int ReservePieces(History* history, HistoryRecord* record, size_t count) {
+    if (record->piecesLen + count <= record->piecesSize) { return ERR_SUCCESS; }
+
+    size_t size = record->piecesSize ? 2 * record->piecesSize : 1;
+
+    while (size < record->piecesLen + count) { size *= 2; }
+
+    FragmentData_t* pieces = realloc(record->pieces, size * sizeof(FragmentData_t));
+    if (!pieces) { return ERR_NOMEM; }
+
+    size_t bytes = (size - record->piecesSize) * sizeof(FragmentData_t);
+
+    record->pieces = pieces;
+    record->piecesSize = size;
+    record->bytes += bytes;
+    history->bytes += bytes;
+    return ERR_SUCCESS;
+}
+
+// a piece of the text continuing the last piece of the record extends it
+static int AppendPiece(History* history, HistoryRecord* record, FragmentData_t piece) {
+    if (record->piecesLen) {
+        FragmentData_t* last = &record->pieces[record->piecesLen - 1];
+
+        if (last->pos + last->len == piece.pos) {
+            last->len += piece.len;
+            return ERR_SUCCESS;
+        }
+    }
+
+    if (ReservePieces(history, record, 1)) { return ERR_NOMEM; }
+
+    record->pieces[record->piecesLen++] = piece;
+    return ERR_SUCCESS;
+}
+
+int RecordInsert(History* history, Block* block, size_t y, size_t x, FragmentData_t piece) {
+    assert(history && block);
+
+    int isContinued = IsContinued(history, HISTORY_INSERT, block, x, piece.len);
+    HistoryRecord* record = AddRecord(history, HISTORY_INSERT, block, y, x, 0, isContinued);
+
+    if (!record) { return ERR_NOMEM; }
+
+    record->len += piece.len;
+    if (AppendPiece(history, record, piece)) { return ERR_NOMEM; }
+
+    FitCap(history);
+    return ERR_SUCCESS;
+}
+
+int RecordDelete(History* history, Block* block, size_t y, size_t x, const Fragment* fragment, size_t len) {
+    assert(history && block && fragment);
+
+    int isContinued = IsContinued(history, HISTORY_DELETE, block, x, len);
+    HistoryRecord* record = AddRecord(history, HISTORY_DELETE, block, y, x, 0, isContinued);
+
+    if (!record) { return ERR_NOMEM; }
+
+    // Backspace deletes chars before the recorded ones: they are put in front
+    size_t count = 0;
+    size_t rest = len;
+    int isFront = isContinued && x + len == record->x;
+
+    for (const Fragment* node = fragment; rest; node = node->next) {
+        if (node->data.len) { ++count; }
+        rest -= node->data.len < rest ? node->data.len : rest;
+    }
+    if (ReservePieces(history, record, count)) { return ERR_NOMEM; }
+
+    size_t at = isFront ? 0 : record->piecesLen;
+
+    if (isFront) {
+        memmove(record->pieces + count, record->pieces, record->piecesLen * sizeof(FragmentData_t));
+        record->x = x;
+    }
+
+    rest = len;
+    for (const Fragment* node = fragment; rest; node = node->next) {
+        size_t pieceLen = node->data.len < rest ? node->data.len : rest;
+
+        if (pieceLen) { record->pieces[at++] = (FragmentData_t){ pieceLen, node->data.pos }; }
+        rest -= pieceLen;
+    }
+    record->piecesLen += count;
+    record->len += len;
+
+    // pieces meeting at the joint of two deletions are one piece of the text
+    size_t joint = isFront ? count : record->piecesLen - count;
+    if (joint && joint < record->piecesLen) {
+        FragmentData_t* before = &record->pieces[joint - 1];
+
+        if (before->pos + before->len == before[1].pos) {
+            before->len += before[1].len;
+            memmove(before + 1, before + 2, (record->piecesLen - joint - 1) * sizeof(FragmentData_t));
+            --record->piecesLen;
+        }
+    }
+
+    FitCap(history);
+    return ERR_SUCCESS;
+}
+
+// a record of blocks out of the document, it takes the changes
+static int RecordNodes(History* history, HistoryOp op, Block* block, size_t y, size_t x, size_t len, Block* nodes, size_t nodesLen,
+                       HistoryChange* changes, size_t changesLen) {
+    HistoryRecord* record = AddRecord(history, op, block, y, x, len, 0);
+
+    if (!record) { return ERR_NOMEM; }
+
+    record->nodes = nodes;
+    record->nodesLen = nodesLen;
+    record->changes = changes;
+    record->changesLen = changesLen;
+    record->bytes = sizeof(HistoryRecord) + GetChainBytes(nodes, nodesLen) + changesLen * sizeof(HistoryChange);
+    if (op == HISTORY_REPLACE) { record->bytes += GetChainBytes(block, len); }
+    history->bytes += record->bytes;
+
+    FitCap(history);
+    return ERR_SUCCESS;
+}
+
+int RecordSplit(History* history, Block* block, size_t y, size_t x, Block* newBlock) {
+    assert(history && block && newBlock);
+
+    return RecordNodes(history, HISTORY_SPLIT, block, y, x, 0, newBlock, 1, NULL, 0);
+}
+
+int RecordMerge(History* history, Block* block, size_t y, size_t x, Block* nextBlock) {
+    assert(history && block && nextBlock);
+
+    return RecordNodes(history, HISTORY_MERGE, block, y, x, 0, nextBlock, 1, NULL, 0);
+}
+
+int RecordReplace(History* history, Block* first, size_t y, size_t len, Block* nodes, size_t nodesLen,
+                  const HistoryChange* changes, size_t changesLen) {
+    assert(history && first && nodes && (changes || !changesLen));
+
+    HistoryChange* copy = NULL;
+
+    if (changesLen) {
+        copy = malloc(changesLen * sizeof(HistoryChange));
+        if (!copy) { return ERR_NOMEM; }
+        memcpy(copy, changes, changesLen * sizeof(HistoryChange));
+    }
+
+    if (RecordNodes(history, HISTORY_REPLACE, first, y, 0, len, nodes, nodesLen, copy, changesLen)) {
+        free(copy);
+        return ERR_NOMEM;
+    }
+    return ERR_SUCCESS;
+}
+
+HistoryRecord* PeekUndo(History* history) {
+    assert(history);
+
+    return GetLastRecord(history);
+}
+
+HistoryRecord* PeekRedo(History* history) {
+    assert(history);
+
+    return history->done < history->len ? &history->records[history->done] : NULL;
+}
+
+void PassUndo(History* history) {
+    assert(history && history->done > history->first);
+
+    --history->done;
+    history->isSealed = 1;
+}
+
+void PassRedo(History* history) {
+    assert(history && history->done < history->len);
+
+    ++history->done;
+    history->isSealed = 1;
+}
@@ -0,0 +1,250 @@
+#pragma once
+#ifndef HISTORY_H_INCLUDED
+#define HISTORY_H_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+
+#include "Fragment.h"
+#include "Block.h"
+
+#define HISTORY_DEFAULT_CAP ((size_t)64 << 20)  // bytes of records kept by default
+#define HISTORY_MIN_RECORDS 64                  // initial capacity of the records
+
+typedef enum {
+    HISTORY_INSERT,     // pieces of the text inserted into the block at x
+    HISTORY_DELETE,     // pieces of the text deleted from the block at x
+    HISTORY_SPLIT,      // the block split at x, nodes - the new block
+    HISTORY_MERGE,      // nodes (the next block) merged into the block of x chars
+    HISTORY_REPLACE     // len blocks from the block replaced nodesLen blocks of nodes
+} HistoryOp;
+
+// an edit of blocks: a record of an edit is one, a replacement is a list of them
+typedef struct {
+    HistoryOp op;   // INSERT, DELETE, SPLIT or MERGE
+    size_t y;       // index of the block
+    size_t x;       // position in the block (MERGE - length of the block before the merge)
+    size_t len;     // INSERT, DELETE - count of chars
+} HistoryChange;
+
+/**
+ * Disposal of a chain of blocks dropped by the history (instead of destroying them).
+ * IN:
+ * @param context - context given to CreateHistory()
+ * @param nodes - chain of blocks out of the document
+ */
+typedef void (*HistoryDiscard)(void* context, Block* nodes);
+
+/**
+ * A structural delta of one edit. It refers to chars of the text of the document (the text is
+ * append-only) and to block nodes, it never copies chars. A record is undone and redone in
+ * the state of the document it was made in, so its block and its positions stay valid:
+ * nodes out of the document are owned by the record (SPLIT - undone, MERGE - done,
+ * REPLACE - always, the other side of the replacement).
+ */
+typedef struct {
+    HistoryOp op;
+    size_t unit;                // records of a unit are undone and redone together
+    Block* block;               // the edited block (REPLACE - the first block in the document)
+    size_t y;                   // index of the block
+    size_t x;                   // position in the block (MERGE - length of the block before the merge)
+    size_t len;                 // INSERT, DELETE - count of chars, REPLACE - count of blocks in the document
+    FragmentData_t* pieces;     // INSERT, DELETE - pieces of the text in document order
+    size_t piecesLen;
+    size_t piecesSize;
+    Block* nodes;               // SPLIT, MERGE, REPLACE - chain of blocks out of the document
+    size_t nodesLen;
+    HistoryChange* changes;     // REPLACE - edits of blocks making the replacement, one after another
+    size_t changesLen;
+    size_t bytes;               // memory of the record (nodes and fragments of REPLACE too)
+} HistoryRecord;
+
+/**
+ * Undo history of a document: records [first, done) are done, [done, len) are undone.
+ * A new record drops the undone ones. Typing and deleting a run of chars at one place
+ * continue the last record, so a run costs O(1) memory; records of a group (BeginHistoryGroup)
+ * join one unit. The oldest units are dropped while the records take more than the cap
+ * (the newest unit is kept anyway).
+ */
+typedef struct {
+    HistoryRecord* records;
+    size_t first;       // the oldest kept record
+    size_t done;
+    size_t len;
+    size_t size;
+    size_t unit;        // the last unit
+    size_t cap;         // limit of bytes
+    size_t bytes;       // bytes of the kept records
+    size_t groupDepth;  // count of nested BeginHistoryGroup
+    int isGroupUnit;    // the group has got its unit
+    int isSealed;       // the next record starts a new unit (after undo and redo)
+    HistoryDiscard onDiscard;   // NULL - dropped blocks are destroyed
+    void* context;
+} History;
+
+/**
+ * Creates an empty history.
+ * IN:
+ * @param cap - limit of bytes of the records
+ * @param onDiscard - disposal of dropped blocks, NULL - they are destroyed
+ * @param context - context of onDiscard
+ *
+ * OUT:
+ * @return history - pointer to a history, NULL on error
+ */
+History* CreateHistory(size_t cap, HistoryDiscard onDiscard, void* context);
+
+/**
+ * Destroys a history and discards the blocks owned by its records.
+ * IN:
+ * @param ppHistory - pointer to pointer to a history
+ *
+ * OUT:
+ * *ppHistory - filled with NULL value
+ */
+void DestroyHistory(History** ppHistory);
+
+/**
+ * Drops all records (the document is replaced or a record failed).
+ * IN:
+ * @param history - pointer to a history
+ */
+void ClearHistory(History* history);
+
+/**
+ * Sets the limit of bytes of the records, the oldest units are dropped to fit it.
+ * IN:
+ * @param history - pointer to a history
+ * @param cap - limit of bytes
+ */
+void SetHistoryCap(History* history, size_t cap);
+
+/**
+ * Begins a group: records up to the matching EndHistoryGroup join one unit (the first of them
+ * may continue the last unit). Groups may be nested.
+ * IN:
+ * @param history - pointer to a history
+ */
+void BeginHistoryGroup(History* history);
+
+/**
+ * Ends a group.
+ * IN:
+ * @param history - pointer to a history
+ */
+void EndHistoryGroup(History* history);
+
+/**
+ * Records chars inserted into a block: they are one piece of the text.
+ * IN:
+ * @param history - pointer to a history
+ * @param block - pointer to the block
+ * @param y - index of the block
+ * @param x - position of the chars in the block
+ * @param piece - the chars in the text
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int RecordInsert(History* history, Block* block, size_t y, size_t x, FragmentData_t piece);
+
+/**
+ * Records chars to be deleted from a block.
+ * IN:
+ * @param history - pointer to a history
+ * @param block - pointer to the block
+ * @param y - index of the block
+ * @param x - position of the first char in the block
+ * @param fragment - the fragment starting at x
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int RecordDelete(History* history, Block* block, size_t y, size_t x, const Fragment* fragment, size_t len);
+
+/**
+ * Records a split of a block.
+ * IN:
+ * @param history - pointer to a history
+ * @param block - pointer to the block
+ * @param y - index of the block
+ * @param x - position of the split
+ * @param newBlock - the block made by the split
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int RecordSplit(History* history, Block* block, size_t y, size_t x, Block* newBlock);
+
+/**
+ * Records a merge of a block with the next one, the record owns the next block.
+ * IN:
+ * @param history - pointer to a history
+ * @param block - pointer to the block
+ * @param y - index of the block
+ * @param x - length of the block before the merge
+ * @param nextBlock - the next block out of the document (it has no fragments)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int RecordMerge(History* history, Block* block, size_t y, size_t x, Block* nextBlock);
+
+/**
+ * Records a replacement of blocks, the record owns the replaced ones.
+ * IN:
+ * @param history - pointer to a history
+ * @param first - the first new block in the document
+ * @param y - index of the first block
+ * @param len - count of the new blocks
+ * @param nodes - chain of the replaced blocks out of the document
+ * @param nodesLen - count of them
+ * @param changes - edits of blocks making the replacement (they are copied)
+ * @param changesLen - count of them
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int RecordReplace(History* history, Block* first, size_t y, size_t len, Block* nodes, size_t nodesLen,
+                  const HistoryChange* changes, size_t changesLen);
+
+/**
+ * Gets the record to be undone next.
+ * IN:
+ * @param history - pointer to a history
+ *
+ * OUT:
+ * @return record - pointer to the record, NULL if nothing is done
+ */
+HistoryRecord* PeekUndo(History* history);
+
+/**
+ * Gets the record to be redone next.
+ * IN:
+ * @param history - pointer to a history
+ *
+ * OUT:
+ * @return record - pointer to the record, NULL if nothing is undone
+ */
+HistoryRecord* PeekRedo(History* history);
+
+/**
+ * Marks the record of PeekUndo undone.
+ * IN:
+ * @param history - pointer to a history
+ */
+void PassUndo(History* history);
+
+/**
+ * Marks the record of PeekRedo done.
+ * IN:
+ * @param history - pointer to a history
+ */
+void PassRedo(History* history);
+
+#endif // HISTORY_H_INCLUDED
@@ -0,0 +1,250 @@
+#include "IncrementalSearch.h"
+
+// old occurrences of one block
+typedef struct {
+    const Block* block;
+    size_t start;       // index of the first occurrence
+    size_t len;         // count of occurrences
+} HitRun;
+
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+static int CompareRuns(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)((const HitRun*)a)->block;
+    uintptr_t y = (uintptr_t)((const HitRun*)b)->block;
+    return (x > y) - (x < y);
+}
+
+static int AddHit(ModelPos** hits, size_t* len, size_t* size, ModelPos pos) {
+    if (*len == *size) {
+        size_t newSize = *size ? 2 * *size : 64;
+        ModelPos* newHits = realloc(*hits, newSize * sizeof(ModelPos));
+
+        if (!newHits) { return ERR_NOMEM; }
+        *hits = newHits;
+        *size = newSize;
+    }
+
+    (*hits)[(*len)++] = pos;
+    return ERR_SUCCESS;
+}
+
+// the next char of the document, 0 at the end
+static int NextPos(ModelPos* pos) {
+    if (pos->pos.x < pos->block->data.len) {
+        ++pos->pos.x;
+        return 1;
+    }
+    if (!pos->block->next) { return 0; }
+
+    pos->block = pos->block->next;
+    pos->pos.x = 0;
+    ++pos->pos.y;
+    return 1;
+}
+
+// the position count chars before the start of a block (or the start of the document)
+static ModelPos GoBack(Block* block, size_t y, size_t count) {
+    ModelPos pos = { block, { 0, y } };
+
+    while (count && pos.block->prev) {
+        Block* prev = pos.block->prev;
+
+        pos.block = prev;
+        --pos.pos.y;
+
+        // chars of the block with its line end
+        if (count <= prev->data.len + 1) {
+            pos.pos.x = prev->data.len + 1 - count;
+            break;
+        }
+        count -= prev->data.len + 1;
+    }
+
+    return pos;
+}
+
+// appends all occurrences starting in [from, to)
+static int ScanRange(const Document* doc, const Literal* literal, ModelPos from, const ModelPos* to,
+                     ModelPos** hits, size_t* len, size_t* size) {
+    ModelPos match;
+
+    while (FindLiteralInRange(doc, literal, from, to, &match)) {
+        if (AddHit(hits, len, size, match)) { return ERR_NOMEM; }
+
+        from = match;
+        if (!NextPos(&from) || (to && !IsBefore(&from, to))) { break; }
+    }
+
+    return ERR_SUCCESS;
+}
+
+// keeps the old occurrences which are still occurrences
+static void NarrowHits(IncrementalSearch* search, const Literal* literal) {
+    size_t len = 0;
+
+    for (size_t i = 0; i < search->len; ++i) {
+        if (IsLiteralAt(search->doc, literal, search->hits[i])) { search->hits[len++] = search->hits[i]; }
+    }
+    search->len = len;
+}
+
+// checks the old occurrences of unchanged blocks and scans changed blocks
+static int RescanChanged(IncrementalSearch* search, const Literal* literal) {
+    const Document* doc = search->doc;
+    ModelPos* hits = NULL;
+    size_t len = 0;
+    size_t size = 0;
+    HitRun* runs = NULL;
+    size_t runsLen = 0;
+
+    // old occurrences are grouped by blocks: blocks may be deleted, so their pointers are only compared
+    if (search->len) {
+        runs = malloc(search->len * sizeof(HitRun));
+        if (!runs) { return ERR_NOMEM; }
+
+        for (size_t i = 0; i < search->len; ++i) {
+            if (runsLen && runs[runsLen - 1].block == search->hits[i].block) {
+                ++runs[runsLen - 1].len;
+            } else {
+                runs[runsLen++] = (HitRun){ search->hits[i].block, i, 1 };
+            }
+        }
+        qsort(runs, runsLen, sizeof(HitRun), CompareRuns);
+    }
+
+    int errValue = ERR_SUCCESS;
+    Block* block = doc->blocks->nodes;
+    size_t y = 0;
+
+    while (block && !errValue) {
+        if (block->data.version > search->version) {
+            // changed blocks and the tail of the previous text, where an occurrence crossing them may start
+            Block* end = block;
+            size_t endY = y;
+
+            while (end && end->data.version > search->version) {
+                end = end->next;
+                ++endY;
+            }
+
+            ModelPos from = GoBack(block, y, literal->len - 1);
+            ModelPos to = { end, { 0, endY } };
+
+            while (len && !IsBefore(&hits[len - 1], &from)) { --len; }
+            errValue = ScanRange(doc, literal, from, end ? &to : NULL, &hits, &len, &size);
+
+            block = end;
+            y = endY;
+            continue;
+        }
+
+        // an unchanged block existed at the previous query, so its pointer isn't reused
+        HitRun key = { block, 0, 0 };
+        const HitRun* run = runsLen ? bsearch(&key, runs, runsLen, sizeof(HitRun), CompareRuns) : NULL;
+
+        for (size_t i = 0; run && i < run->len && !errValue; ++i) {
+            ModelPos pos = { block, { search->hits[run->start + i].pos.x, y } };
+
+            // the occurrence may cross a changed block
+            if (IsLiteralAt(doc, literal, pos)) { errValue = AddHit(&hits, &len, &size, pos); }
+        }
+
+        block = block->next;
+        ++y;
+    }
+
+    free(runs);
+    if (errValue) {
+        free(hits);
+        return errValue;
+    }
+
+    free(search->hits);
+    search->hits = hits;
+    search->len = len;
+    search->size = size;
+    return ERR_SUCCESS;
+}
+
+static int ScanAll(IncrementalSearch* search, const Literal* literal) {
+    ModelPos from = { search->doc->blocks->nodes, { 0, 0 } };
+
+    search->len = 0;
+    return ScanRange(search->doc, literal, from, NULL, &search->hits, &search->len, &search->size);
+}
+
+IncrementalSearch* CreateIncrementalSearch(const Document* doc) {
+    assert(doc);
+
+    IncrementalSearch* search = calloc(1, sizeof(IncrementalSearch));
+    if (!search) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    search->doc = doc;
+    return search;
+}
+
+void DestroyIncrementalSearch(IncrementalSearch** ppSearch) {
+    assert(ppSearch);
+
+    IncrementalSearch* search = *ppSearch;
+    if (!search) { return; }
+
+    DestroyLiteral(&search->literal);
+    free(search->hits);
+    free(search);
+
+    *ppSearch = NULL;
+}
+
+int UpdateIncrementalSearch(IncrementalSearch* search, const char* query, size_t len, int flags) {
+    assert(search && (query || !len));
+    TRACE_SCOPE("UpdateIncrementalSearch");
+
+    if (!len) {
+        DestroyLiteral(&search->literal);
+        search->len = 0;
+        return ERR_SUCCESS;
+    }
+
+    Literal* literal = CreateLiteral(query, len, flags);
+    if (!literal) {
+        DestroyLiteral(&search->literal);
+        search->len = 0;
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    // occurrences of an extended query are occurrences of the previous one
+    const Literal* prev = search->literal;
+    int isExtension = prev && prev->flags == literal->flags && prev->len <= literal->len
+                   && !memcmp(prev->pattern, literal->pattern, prev->len);
+    int errValue;
+
+    if (!isExtension) {
+        errValue = ScanAll(search, literal);
+    } else if (search->version == search->doc->version) {
+        NarrowHits(search, literal);
+        errValue = ERR_SUCCESS;
+    } else {
+        errValue = RescanChanged(search, literal);
+    }
+
+    DestroyLiteral(&search->literal);
+    search->version = search->doc->version;
+
+    if (errValue) {
+        DestroyLiteral(&literal);
+        search->len = 0;
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+        return errValue;
+    }
+
+    search->literal = literal;
+    return ERR_SUCCESS;
+}
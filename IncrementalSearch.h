@@ -0,0 +1,60 @@
+#pragma once
+#ifndef INCREMENTALSEARCH_H_INCLUDED
+#define INCREMENTALSEARCH_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Search.h"
+
+typedef struct {
+    const Document* doc;    // pointer to the searched document
+    Literal* literal;       // the last query (NULL - no query)
+    ModelPos* hits;         // all occurrences of the query in the order of the document (they may overlap)
+    size_t len;             // count of occurrences
+    size_t size;            // size of the array
+    size_t version;         // version of the document when the occurrences were found
+} IncrementalSearch;
+
+/**
+ * Creates a search-as-you-type session of a document.
+ * IN:
+ * @param doc - pointer to a Document object
+ *
+ * OUT:
+ * @return search - pointer to a session, NULL on error
+ */
+IncrementalSearch* CreateIncrementalSearch(const Document* doc);
+
+/**
+ * Destroys a search-as-you-type session.
+ * IN:
+ * @param ppSearch - pointer to pointer to a session
+ *
+ * OUT:
+ * *ppSearch - filled with NULL value
+ */
+void DestroyIncrementalSearch(IncrementalSearch** ppSearch);
+
+/**
+ * Finds all occurrences of a new query. When the query extends the previous one, only the previous
+ * occurrences are checked, and blocks changed since the previous query (blocks with a newer version)
+ * are scanned again. Other queries scan the whole document.
+ * IN:
+ * @param search - pointer to a session
+ * @param query - pointer to chars of the query ('\n' matches a line end)
+ * @param len - length of the query (0 - no query, no occurrences)
+ * @param flags - SearchFlags
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (on error the session has no query)
+ */
+int UpdateIncrementalSearch(IncrementalSearch* search, const char* query, size_t len, int flags);
+
+#endif // INCREMENTALSEARCH_H_INCLUDED
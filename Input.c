@@ -0,0 +1,338 @@
+#include "Input.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static int IsTypedChar(char c) {
+    return c == '\t' || ((unsigned char)c >= ' ' && c != 0x7f);
+}
+
+void InitInputBatch(InputBatch* batch) {
+    assert(batch);
+
+    batch->op = INPUT_OP_NONE;
+    batch->direction = UP;
+    batch->count = 0;
+    batch->len = 0;
+}
+
+int AddInputChar(InputBatch* batch, char c, size_t repeat) {
+    assert(batch);
+
+    if (!repeat) { repeat = 1; }    // a message posted by the window itself
+
+    if (c == '\b') {
+        if (batch->op != INPUT_OP_NONE && batch->op != INPUT_OP_BACKSPACE) { return 0; }
+
+        batch->op = INPUT_OP_BACKSPACE;
+        batch->count += repeat;
+        return 1;
+    }
+
+    if (!IsTypedChar(c)) { return 0; }
+    if (batch->op != INPUT_OP_NONE && batch->op != INPUT_OP_TYPE) { return 0; }
+    if (batch->len + repeat > INPUT_BATCH_CHARS) { return 0; }
+
+    batch->op = INPUT_OP_TYPE;
+    for (size_t i = 0; i < repeat; ++i) { batch->chars[batch->len++] = c; }
+    return 1;
+}
+
+int AddInputKey(InputBatch* batch, WPARAM key, size_t repeat) {
+    assert(batch);
+
+    Direction direction;
+
+    if (!repeat) { repeat = 1; }    // a message posted by the window itself
+
+    switch (key) {
+    case VK_DELETE:
+        if (batch->op != INPUT_OP_NONE && batch->op != INPUT_OP_DELETE) { return 0; }
+
+        batch->op = INPUT_OP_DELETE;
+        batch->count += repeat;
+        return 1;
+
+    case VK_UP:     direction = UP;     break;
+    case VK_DOWN:   direction = DOWN;   break;
+    case VK_LEFT:   direction = LEFT;   break;
+    case VK_RIGHT:  direction = RIGHT;  break;
+
+    default:
+        return 0;
+    }
+
+    // a shifted arrow key selects columns
+    if (GetKeyState(VK_SHIFT) < 0) { return 0; }
+    if (batch->op != INPUT_OP_NONE && (batch->op != INPUT_OP_MOVE || batch->direction != direction)) { return 0; }
+
+    batch->op = INPUT_OP_MOVE;
+    batch->direction = direction;
+    batch->count += repeat;
+    return 1;
+}
+
+// a key-down which only produces a char batched by AddInputChar (the window handles no shortcut of it):
+// Escape and Enter produce chars too, but their key-downs go to the window
+static int IsCharKey(WPARAM key) {
+    if (GetKeyState(VK_CONTROL) < 0 || GetKeyState(VK_MENU) < 0) { return 0; }
+
+    UINT c = MapVirtualKey((UINT) key, MAPVK_VK_TO_CHAR);
+
+    // the high bit marks a dead key
+    return c == '\b' || (c <= 0xFF && IsTypedChar((char) c));
+}
+
+void DrainInput(HWND hwnd, InputBatch* batch) {
+    assert(batch);
+    TRACE_SCOPE("DrainInput");
+
+    MSG msg;
+
+    // the first message of the queue is taken only, so the order of other messages is kept
+    while (PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE) && msg.hwnd == hwnd) {
+        size_t repeat = LOWORD(msg.lParam);
+        int isTaken;
+
+        switch (msg.message) {
+        case WM_CHAR:
+            isTaken = AddInputChar(batch, (char) msg.wParam, repeat);
+            break;
+
+        case WM_KEYDOWN:
+            // a key-down of a typed char is translated here: its WM_CHAR comes next
+            isTaken = AddInputKey(batch, msg.wParam, repeat) || msg.wParam == VK_SHIFT || IsCharKey(msg.wParam);
+            break;
+
+        case WM_KEYUP:
+            isTaken = 1;
+            break;
+
+        default:
+            isTaken = 0;
+            break;
+        }
+
+        if (!isTaken) { break; }
+
+        PeekMessage(&msg, hwnd, msg.message, msg.message, PM_REMOVE);
+        if (msg.message == WM_KEYDOWN) { TranslateMessage(&msg); }
+    }
+}
+
+#ifdef CARET_ON
+    // the caret passes a typed char (the caret may stay at the end of a full wrapped line)
+    static void PassTypedChar(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            CaretMove(hwnd, dm, RIGHT, rectangle);
+            break;
+
+        case FORMAT_MODE_WRAP:
+            if (dm->caret.modelPos.pos.x < dm->caret.modelPos.block->data.len
+                && dm->caret.clientPos.x < dm->clientArea.chars) {
+                CaretMoveToRight_Wrap(dm);
+            } else if (dm->caret.linePos < DECREMENT_OF(dm->wrapModel.lines)) {
+                CaretMoveToBottom_Wrap(hwnd, dm, rectangle);
+                if (dm->caret.clientPos.x) { FindHome_Wrap(dm); }
+                CaretMoveToRight_Wrap(dm);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    static int ApplyType(HWND hwnd, DisplayedModel* dm, const InputBatch* batch, RECT* rectangle) {
+        char chars[INPUT_BATCH_CHARS * INPUT_TAB_SIZE];
+        size_t len = 0;
+        size_t column;
+
+        switch (dm->mode) {
+        case FORMAT_MODE_DEFAULT:
+            column = dm->caret.modelPos.pos.x;
+            break;
+
+        case FORMAT_MODE_WRAP:
+            column = dm->caret.clientPos.x % dm->clientArea.chars;
+            break;
+
+        default:
+            return ERR_PARAM;
+        }
+
+        // tabs are expanded to spaces from the column of the caret
+        for (size_t i = 0; i < batch->len; ++i) {
+            if (batch->chars[i] != '\t') {
+                chars[len++] = batch->chars[i];
+                continue;
+            }
+
+            size_t tabColumn = column + len;
+            size_t spaces;
+
+            if (dm->mode == FORMAT_MODE_WRAP) {
+                tabColumn %= dm->clientArea.chars;
+                spaces = MIN(INPUT_TAB_SIZE - tabColumn % INPUT_TAB_SIZE, dm->clientArea.chars - tabColumn);
+            } else {
+                spaces = INPUT_TAB_SIZE - tabColumn % INPUT_TAB_SIZE;
+            }
+            for (; spaces; --spaces) { chars[len++] = ' '; }
+        }
+
+        int errValue = CaretAddChars(hwnd, dm, chars, len);
+        if (errValue) { return errValue; }
+
+        for (size_t i = 0; i < len; ++i) { PassTypedChar(hwnd, dm, rectangle); }
+        return ERR_SUCCESS;
+    }
+
+    // the end of a full wrapped line before a joined line end becomes the start of the next line
+    static void DeleteLineEnd(HWND hwnd, DisplayedModel* dm, RECT* rectangle) {
+        CaretDeleteBlock(hwnd, dm);
+
+        if (dm->mode == FORMAT_MODE_WRAP && dm->caret.clientPos.x == dm->clientArea.chars
+            && dm->caret.modelPos.pos.x < dm->caret.modelPos.block->data.len) {
+            CaretMoveToBottom_Wrap(hwnd, dm, rectangle);
+            FindHome_Wrap(dm);
+        }
+    }
+
+    static int ApplyBackspace(HWND hwnd, DisplayedModel* dm, size_t count, RECT* rectangle) {
+        size_t pending = 0;     // chars passed by the caret in its block, they are deleted by one edit
+        int errValue;
+
+        for (; count && (dm->caret.modelPos.pos.y || dm->caret.modelPos.pos.x); --count) {
+            if (dm->caret.modelPos.pos.x) {
+                // the start of a wrapped line is the end of the previous one: a move doesn't pass a char
+                if (dm->mode == FORMAT_MODE_WRAP && !dm->caret.clientPos.x) { CaretMove(hwnd, dm, LEFT, rectangle); }
+
+                CaretMove(hwnd, dm, LEFT, rectangle);
+                ++pending;
+                continue;
+            }
+
+            if (pending) {
+                if ((errValue = CaretDeleteChars(hwnd, dm, pending))) { return errValue; }
+                pending = 0;
+            }
+
+            // the line end before the caret
+            CaretMove(hwnd, dm, LEFT, rectangle);
+            DeleteLineEnd(hwnd, dm, rectangle);
+        }
+
+        return pending ? CaretDeleteChars(hwnd, dm, pending) : ERR_SUCCESS;
+    }
+
+    static int ApplyDelete(HWND hwnd, DisplayedModel* dm, size_t count, RECT* rectangle) {
+        while (count) {
+            Block* block = dm->caret.modelPos.block;
+
+            if (dm->caret.modelPos.pos.x < block->data.len) {
+                size_t len = MIN(count, block->data.len - dm->caret.modelPos.pos.x);
+
+                int errValue = CaretDeleteChars(hwnd, dm, len);
+                if (errValue) { return errValue; }
+                count -= len;
+            } else if (block->next) {
+                DeleteLineEnd(hwnd, dm, rectangle);
+                --count;
+            } else {
+                break;
+            }
+        }
+
+        return ERR_SUCCESS;
+    }
+
+    // every caret of multi-caret editing gets the batch by one pass over the document
+    static int ApplyCaretsBatch(HWND hwnd, DisplayedModel* dm, const InputBatch* batch, RECT* rectangle) {
+        switch (batch->op) {
+        case INPUT_OP_TYPE:
+            return MultiCaretAddChars(hwnd, dm, batch->chars, batch->len, INPUT_TAB_SIZE, rectangle);
+
+        case INPUT_OP_BACKSPACE:
+            return MultiCaretDeleteChars(hwnd, dm, batch->count, 1, rectangle);
+
+        case INPUT_OP_DELETE:
+            return MultiCaretDeleteChars(hwnd, dm, batch->count, 0, rectangle);
+
+        case INPUT_OP_MOVE:
+            // the first moves of the set are in the order of Direction
+            MultiCaretMove(hwnd, dm, (CaretsMove) batch->direction, batch->count, rectangle);
+            return ERR_SUCCESS;
+
+        default:
+            return ERR_SUCCESS;
+        }
+    }
+
+    // the column selection gets an edit of the batch by one pass over its lines
+    static int ApplyColumnsBatch(HWND hwnd, DisplayedModel* dm, const InputBatch* batch, RECT* rectangle) {
+        switch (batch->op) {
+        case INPUT_OP_TYPE:
+            return ColumnAddChars(hwnd, dm, batch->chars, batch->len, INPUT_TAB_SIZE, rectangle);
+
+        case INPUT_OP_BACKSPACE:
+            return ColumnDeleteChars(hwnd, dm, batch->count, 1, rectangle);
+
+        case INPUT_OP_DELETE:
+            return ColumnDeleteChars(hwnd, dm, batch->count, 0, rectangle);
+
+        default:
+            return ERR_SUCCESS;
+        }
+    }
+
+    int ApplyInputBatch(HWND hwnd, DisplayedModel* dm, InputBatch* batch, RECT* rectangle) {
+        assert(dm && batch && rectangle);
+        TRACE_SCOPE("ApplyInputBatch");
+
+        int errValue = ERR_SUCCESS;
+
+        if (dm->carets.len > 1) {
+            errValue = ApplyCaretsBatch(hwnd, dm, batch, rectangle);
+            InitInputBatch(batch);
+            return errValue;
+        }
+
+        if (dm->columns.isSelected) {
+            // a move leaves the selection from the caret at its active corner
+            if (batch->op != INPUT_OP_MOVE) {
+                errValue = ApplyColumnsBatch(hwnd, dm, batch, rectangle);
+                InitInputBatch(batch);
+                return errValue;
+            }
+            ColumnClear(hwnd, dm);
+        }
+
+        // the longest line is recounted once after a run of deletions
+        BeginEdit(dm);
+        switch (batch->op) {
+        case INPUT_OP_TYPE:
+            errValue = ApplyType(hwnd, dm, batch, rectangle);
+            break;
+
+        case INPUT_OP_BACKSPACE:
+            errValue = ApplyBackspace(hwnd, dm, batch->count, rectangle);
+            break;
+
+        case INPUT_OP_DELETE:
+            errValue = ApplyDelete(hwnd, dm, batch->count, rectangle);
+            break;
+
+        case INPUT_OP_MOVE:
+            for (size_t i = 0; i < batch->count && CaretMove(hwnd, dm, batch->direction, rectangle); ++i) {}
+            break;
+
+        default:
+            break;
+        }
+        EndEdit(hwnd, dm);
+
+        InitInputBatch(batch);
+
+        return errValue;
+    }
+#endif
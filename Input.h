@@ -0,0 +1,97 @@
+#pragma once
+#ifndef INPUT_H_INCLUDED
+#define INPUT_H_INCLUDED
+
+#include <windows.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "DisplayedModel.h"
+
+#define INPUT_BATCH_CHARS 256   // typed chars of a batch (a tab is expanded when the batch is applied)
+#define INPUT_TAB_SIZE 8        // a tab is spaces up to the next multiple of it
+
+typedef enum {
+    INPUT_OP_NONE,          // empty batch
+    INPUT_OP_TYPE,          // chars typed at the caret
+    INPUT_OP_BACKSPACE,     // chars deleted before the caret
+    INPUT_OP_DELETE,        // chars deleted after the caret
+    INPUT_OP_MOVE           // moves of the caret by an arrow key
+} InputOp;
+
+/**
+ * Key events of one kind merged into one model operation: a run of typed chars is inserted
+ * by one edit, a run of Backspace or Delete deletes the chars of a line by one edit,
+ * a run of arrow keys moves the caret without painting between the moves.
+ * The view is updated once after the batch.
+ */
+typedef struct {
+    InputOp op;
+    Direction direction;            // direction of INPUT_OP_MOVE
+    size_t count;                   // count of deleted chars or moves
+    char chars[INPUT_BATCH_CHARS];  // typed chars (INPUT_OP_TYPE)
+    size_t len;
+} InputBatch;
+
+/**
+ * Inits an empty batch.
+ * IN:
+ * @param batch - pointer to a batch
+ */
+void InitInputBatch(InputBatch* batch);
+
+/**
+ * Adds a char of WM_CHAR to a batch: printable chars, tabs and backspaces are batched.
+ * IN:
+ * @param batch - pointer to a batch
+ * @param c - the char
+ * @param repeat - repeat count of the message
+ *
+ * OUT:
+ * @return isAdded - 1 if the char continues the batch, 0 if it must be handled after the batch
+ */
+int AddInputChar(InputBatch* batch, char c, size_t repeat);
+
+/**
+ * Adds a key of WM_KEYDOWN to a batch: arrow keys (not shifted) and Delete are batched.
+ * IN:
+ * @param batch - pointer to a batch
+ * @param key - virtual-key code
+ * @param repeat - repeat count of the message
+ *
+ * OUT:
+ * @return isAdded - 1 if the key continues the batch, 0 if it must be handled after the batch
+ */
+int AddInputKey(InputBatch* batch, WPARAM key, size_t repeat);
+
+/**
+ * Merges the pending key messages of the queue which continue a batch. Other messages stay
+ * in the queue in their order; key-ups and key-downs producing batched chars are consumed.
+ * IN:
+ * @param hwnd - a handle to a window
+ * @param batch - pointer to a batch
+ */
+void DrainInput(HWND hwnd, InputBatch* batch);
+
+#ifdef CARET_ON
+    /**
+     * Applies a batch to the model by one edit transaction: its edits and scrolls only mark
+     * the view, so the caller updates it once (UpdateView). Carets of multi-caret editing get
+     * the batch by one pass over the document, a column selection gets its edits by one pass
+     * over its lines (a move clears it). The batch becomes empty.
+     * IN:
+     * @param hwnd - a handle to a window
+     * @param dm - pointer to a DisplayModel object
+     * @param batch - pointer to a batch
+     * @param rectangle - pointer to rectangle (will be invalidate)
+     *
+     * OUT:
+     * @return errValue - value indicating the success of the operation
+     */
+    int ApplyInputBatch(HWND hwnd, DisplayedModel* dm, InputBatch* batch, RECT* rectangle);
+#endif
+
+#endif // INPUT_H_INCLUDED
@@ -0,0 +1,160 @@
+#include "Latency.h"
+
+#include <stdlib.h>
+
+#include "Clock.h"
+
+typedef struct LatencyThread_tag {
+    Histogram histograms[LATENCY_OP_COUNT][LATENCY_STAGE_COUNT];
+
+    struct {
+        size_t depth;       // nesting depth of input handling
+        int isActive;       // flag of the input that waits for paint
+        LatencyOp op;       // operation type of the input
+        uint64_t input;     // time of input arrival
+        uint64_t model;     // time of model mutation completion (0 if there was not)
+    } pending;              // current input of a thread
+} LatencyThread;
+
+static const char* opNames[LATENCY_OP_COUNT] = {
+    "char",
+    "keydown",
+    "scroll",
+    "command",
+    "resize"
+};
+
+static const char* stageNames[LATENCY_STAGE_COUNT] = {
+    "model",
+    "paint"
+};
+
+static _Atomic(LatencyThread*) threads[LATENCY_MAX_THREADS];
+static atomic_size_t threadsCount;
+static _Thread_local LatencyThread* localThread;
+
+static LatencyThread* GetLocalThread() {
+    if (localThread) { return localThread; }
+
+    size_t index = atomic_fetch_add(&threadsCount, 1);
+    if (index >= LATENCY_MAX_THREADS) {
+        atomic_fetch_sub(&threadsCount, 1);
+        return NULL;
+    }
+
+    LatencyThread* thread = calloc(1, sizeof(LatencyThread));
+    if (!thread) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    for (size_t op = 0; op < LATENCY_OP_COUNT; ++op) {
+        for (size_t stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+            InitHistogram(&(thread->histograms[op][stage]));
+        }
+    }
+
+    atomic_store_explicit(&threads[index], thread, memory_order_release);
+    localThread = thread;
+    return thread;
+}
+
+void LatencyInput(LatencyOp op) {
+    assert(op < LATENCY_OP_COUNT);
+
+    LatencyThread* thread = GetLocalThread();
+    if (!thread) { return; }
+
+    if (!thread->pending.depth++ && !thread->pending.isActive) {
+        thread->pending.isActive = 1;
+        thread->pending.op = op;
+        thread->pending.input = GetMonotonicTime();
+        thread->pending.model = 0;
+    }
+}
+
+void LatencyModelDone() {
+    LatencyThread* thread = localThread;
+
+    if (thread && thread->pending.isActive) {
+        thread->pending.model = GetMonotonicTime();
+    }
+}
+
+void LatencyPaintDone() {
+    LatencyThread* thread = localThread;
+
+    if (!thread || !thread->pending.isActive) { return; }
+
+    uint64_t now = GetMonotonicTime();
+    Histogram* histograms = thread->histograms[thread->pending.op];
+
+    if (thread->pending.model) {
+        HistogramRecord(&histograms[LATENCY_STAGE_MODEL], thread->pending.model - thread->pending.input);
+    }
+    HistogramRecord(&histograms[LATENCY_STAGE_PAINT], now - thread->pending.input);
+
+    thread->pending.isActive = 0;
+}
+
+void LatencyInputDone(int isPaintPending) {
+    LatencyThread* thread = localThread;
+
+    if (!thread || !thread->pending.depth) { return; }
+
+    if (!--thread->pending.depth && !isPaintPending) {
+        // nothing to repaint: the input is visible already
+        LatencyPaintDone();
+    }
+}
+
+int LatencyDump(FILE* output) {
+    Histogram* merged = malloc(sizeof(Histogram));
+
+    if (!merged) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (!output) { output = stdout; }
+
+    size_t count = atomic_load(&threadsCount);
+    if (count > LATENCY_MAX_THREADS) { count = LATENCY_MAX_THREADS; }
+
+    fprintf(output, "%-8s %-6s %10s %12s %12s %12s %12s\n",
+        "op", "stage", "count", "p50, us", "p99, us", "p999, us", "max, us");
+
+    for (size_t op = 0; op < LATENCY_OP_COUNT; ++op) {
+        for (size_t stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+            InitHistogram(merged);
+
+            for (size_t i = 0; i < count; ++i) {
+                LatencyThread* thread = atomic_load_explicit(&threads[i], memory_order_acquire);
+                if (thread) { HistogramMerge(merged, &(thread->histograms[op][stage])); }
+            }
+
+            if (!HistogramCount(merged)) { continue; }
+
+            fprintf(output, "%-8s %-6s %10zu %12.1f %12.1f %12.1f %12.1f\n",
+                opNames[op], stageNames[stage], HistogramCount(merged),
+                (double)HistogramPercentile(merged, 50) / NS_PER_US,
+                (double)HistogramPercentile(merged, 99) / NS_PER_US,
+                (double)HistogramPercentile(merged, 99.9) / NS_PER_US,
+                (double)HistogramPercentile(merged, 100) / NS_PER_US);
+        }
+    }
+
+    free(merged);
+    return ERR_SUCCESS;
+}
+
+void LatencyShutdown() {
+    size_t count = atomic_exchange(&threadsCount, 0);
+    if (count > LATENCY_MAX_THREADS) { count = LATENCY_MAX_THREADS; }
+
+    for (size_t i = 0; i < count; ++i) {
+        LatencyThread* thread = atomic_exchange(&threads[i], NULL);
+        if (thread) { free(thread); }
+    }
+    localThread = NULL;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef LATENCY_H_INCLUDED
+#define LATENCY_H_INCLUDED
+
+#define LATENCY_ON
+// #define LATENCY_OFF
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Error.h"
+#include "Histogram.h"
+
+// upper limit of threads that can record latencies
+#define LATENCY_MAX_THREADS 64
+
+typedef enum {
+    LATENCY_OP_CHAR,        // WM_CHAR
+    LATENCY_OP_KEYDOWN,     // WM_KEYDOWN
+    LATENCY_OP_SCROLL,      // WM_HSCROLL, WM_VSCROLL
+    LATENCY_OP_COMMAND,     // WM_COMMAND
+    LATENCY_OP_RESIZE,      // WM_SIZE
+    LATENCY_OP_COUNT
+} LatencyOp;
+
+typedef enum {
+    LATENCY_STAGE_MODEL,    // from input arrival to model mutation completion
+    LATENCY_STAGE_PAINT,    // from input arrival to paint completion
+    LATENCY_STAGE_COUNT
+} LatencyStage;
+
+/**
+ * Marks input arrival. Nested inputs (e.g. sent by SendMessage) belong to the outer one.
+ * IN:
+ * @param op - operation type of the input
+ */
+void LatencyInput(LatencyOp op);
+
+/**
+ * Marks model mutation completion for the current input.
+ */
+void LatencyModelDone();
+
+/**
+ * Marks paint completion. Records latencies of the current input.
+ */
+void LatencyPaintDone();
+
+/**
+ * Marks the end of input handling.
+ * IN:
+ * @param isPaintPending - flag of a paint that is still expected for the input.
+ *                         If it's false, then the current input is completed now.
+ */
+void LatencyInputDone(int isPaintPending);
+
+/**
+ * Prints p50/p99/p999 of latencies per operation type (all threads are merged).
+ * IN:
+ * @param output - pointer to a stream. If it's NULL, then the table is printed to the stdout
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int LatencyDump(FILE* output);
+
+/**
+ * Frees histograms of all threads. No thread may record latencies after it.
+ */
+void LatencyShutdown();
+
+#ifdef LATENCY_ON
+    #define LATENCY_INPUT(op)                   LatencyInput(op)
+    #define LATENCY_MODEL_DONE()                LatencyModelDone()
+    #define LATENCY_PAINT_DONE()                LatencyPaintDone()
+    #define LATENCY_INPUT_DONE(isPaintPending)  LatencyInputDone(isPaintPending)
+#else
+    #define LATENCY_INPUT(op)                   ((void)0)
+    #define LATENCY_MODEL_DONE()                ((void)0)
+    #define LATENCY_PAINT_DONE()                ((void)0)
+    #define LATENCY_INPUT_DONE(isPaintPending)  ((void)0)
+#endif
+
+#endif // LATENCY_H_INCLUDED
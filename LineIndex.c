@@ -0,0 +1,189 @@
+#include "LineIndex.h"
+
+typedef enum {
+    LINE_KEY_LINE,      // displayed line
+    LINE_KEY_BLOCK,     // index of a block
+    LINE_KEY_OFFSET     // char offset
+} LineKey;
+
+static size_t GetBlockLines(const Block* block, size_t chars) {
+    if (!chars || !block->data.len) { return 1; }
+    return DIV_WITH_ROUND_UP(block->data.len, chars);
+}
+
+static int BuildLineIndex(LineIndex* index, const Document* doc, size_t chars) {
+    TRACE_SCOPE("BuildLineIndex");
+
+    size_t len = DIV_WITH_ROUND_UP(doc->blocks->len, LINE_INDEX_STEP);
+
+    if (len > index->size) {
+        LineCheckpoint* checkpoints = realloc(index->checkpoints, len * sizeof(LineCheckpoint));
+
+        if (!checkpoints) {
+            InvalidateLineIndex(index);
+            return ERR_NOMEM;
+        }
+        index->checkpoints = checkpoints;
+        index->size = len;
+    }
+
+    size_t y = 0;
+    size_t line = 0;
+    size_t offset = 0;
+
+    index->len = 0;
+    for (Block* block = doc->blocks->nodes; block; block = block->next, ++y) {
+        if (y % LINE_INDEX_STEP == 0) { index->checkpoints[index->len++] = (LineCheckpoint){ block, y, line, offset }; }
+        line += GetBlockLines(block, chars);
+        offset += block->data.len + 1;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, y);
+
+    index->doc = doc;
+    index->version = doc->version;
+    index->chars = chars;
+    index->lines = line;
+    index->length = offset ? offset - 1 : 0;
+    return ERR_SUCCESS;
+}
+
+void InitLineIndex(LineIndex* index) {
+    assert(index);
+
+    index->doc = NULL;
+    index->version = 0;
+    index->chars = 0;
+    index->lines = 0;
+    index->length = 0;
+    index->checkpoints = NULL;
+    index->len = 0;
+    index->size = 0;
+}
+
+void FreeLineIndex(LineIndex* index) {
+    assert(index);
+
+    free(index->checkpoints);
+    InitLineIndex(index);
+}
+
+void InvalidateLineIndex(LineIndex* index) {
+    assert(index);
+
+    index->doc = NULL;
+    index->len = 0;
+}
+
+static int UpdateLineIndex(LineIndex* index, const Document* doc, size_t chars) {
+    if (index->doc != doc || index->version != doc->version || index->chars != chars) {
+        return BuildLineIndex(index, doc, chars);
+    }
+    return ERR_SUCCESS;
+}
+
+static size_t GetKey(const LineCheckpoint* checkpoint, LineKey key) {
+    switch (key) {
+    case LINE_KEY_LINE:     return checkpoint->line;
+    case LINE_KEY_BLOCK:    return checkpoint->y;
+    default:                return checkpoint->offset;
+    }
+}
+
+// the last checkpoint at or before the value
+static const LineCheckpoint* FindCheckpoint(const LineIndex* index, LineKey key, size_t value) {
+    size_t left = 0;
+    size_t right = index->len;
+
+    while (right - left > 1) {
+        size_t middle = left + (right - left) / 2;
+
+        if (GetKey(&index->checkpoints[middle], key) <= value) {
+            left = middle;
+        } else {
+            right = middle;
+        }
+    }
+    return &index->checkpoints[left];
+}
+
+int FindDisplayedLine(LineIndex* index, const Document* doc, size_t chars, size_t line, ModelPos* pos) {
+    assert(index && doc && pos);
+
+    int errValue = UpdateLineIndex(index, doc, chars);
+    if (errValue) { return errValue; }
+
+    if (line >= index->lines) { return ERR_PARAM; }
+
+    const LineCheckpoint* checkpoint = FindCheckpoint(index, LINE_KEY_LINE, line);
+    Block* block = checkpoint->block;
+    size_t y = checkpoint->y;
+    size_t blockLine = checkpoint->line;
+    size_t lines;
+
+    while (line >= blockLine + (lines = GetBlockLines(block, chars))) {
+        blockLine += lines;
+        block = block->next;
+        ++y;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, y - checkpoint->y);
+
+    pos->block = block;
+    pos->pos.y = y;
+    pos->pos.x = line - blockLine;
+    return ERR_SUCCESS;
+}
+
+int FindBlockLine(LineIndex* index, const Document* doc, size_t chars, size_t y, ModelPos* pos, size_t* line) {
+    assert(index && doc && pos && line);
+
+    int errValue = UpdateLineIndex(index, doc, chars);
+    if (errValue) { return errValue; }
+
+    if (y >= doc->blocks->len) { return ERR_PARAM; }
+
+    const LineCheckpoint* checkpoint = FindCheckpoint(index, LINE_KEY_BLOCK, y);
+    Block* block = checkpoint->block;
+    size_t blockLine = checkpoint->line;
+
+    for (size_t i = checkpoint->y; i < y; ++i) {
+        blockLine += GetBlockLines(block, chars);
+        block = block->next;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, y - checkpoint->y);
+
+    pos->block = block;
+    pos->pos.y = y;
+    pos->pos.x = 0;
+    *line = blockLine;
+    return ERR_SUCCESS;
+}
+
+int FindOffset(LineIndex* index, const Document* doc, size_t chars, size_t offset, ModelPos* pos, size_t* line) {
+    assert(index && doc && pos && line);
+
+    int errValue = UpdateLineIndex(index, doc, chars);
+    if (errValue) { return errValue; }
+
+    if (!index->len || offset > index->length) { return ERR_PARAM; }
+
+    const LineCheckpoint* checkpoint = FindCheckpoint(index, LINE_KEY_OFFSET, offset);
+    Block* block = checkpoint->block;
+    size_t y = checkpoint->y;
+    size_t blockLine = checkpoint->line;
+    size_t blockOffset = checkpoint->offset;
+
+    // the line end belongs to its block
+    while (offset > blockOffset + block->data.len) {
+        blockOffset += block->data.len + 1;
+        blockLine += GetBlockLines(block, chars);
+        block = block->next;
+        ++y;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, y - checkpoint->y);
+
+    pos->block = block;
+    pos->pos.y = y;
+    pos->pos.x = offset - blockOffset;
+    *line = blockLine;
+    return ERR_SUCCESS;
+}
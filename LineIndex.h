@@ -0,0 +1,108 @@
+#pragma once
+#ifndef LINEINDEX_H_INCLUDED
+#define LINEINDEX_H_INCLUDED
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+
+#define LINE_INDEX_STEP 256     // blocks between checkpoints: a lookup walks at most so many blocks
+
+typedef struct {
+    Block* block;       // pointer to the block
+    size_t y;           // index of the block
+    size_t line;        // count of displayed lines before the block
+    size_t offset;      // count of chars before the block (a line end is one char)
+} LineCheckpoint;
+
+/**
+ * Checkpoints of every LINE_INDEX_STEP-th block of a document, so a displayed line, a block
+ * or a char offset is found by a binary search and a short walk instead of a walk from the
+ * current position.
+ * The index belongs to a version of the document: it's rebuilt by the first lookup after an edit.
+ */
+typedef struct {
+    const Document* doc;        // indexed document (NULL - not built)
+    size_t version;             // version of the document when the index was built
+    size_t chars;               // chars of a wrapped line (0 - a block is one line)
+    size_t lines;               // count of displayed lines of the document
+    size_t length;              // count of chars of the document (a line end is one char)
+    LineCheckpoint* checkpoints;
+    size_t len;
+    size_t size;
+} LineIndex;
+
+/**
+ * Inits an empty index.
+ * IN:
+ * @param index - pointer to an index
+ */
+void InitLineIndex(LineIndex* index);
+
+/**
+ * Frees checkpoints of an index, the index becomes empty.
+ * IN:
+ * @param index - pointer to an index
+ */
+void FreeLineIndex(LineIndex* index);
+
+/**
+ * Marks an index out of date (another document or the same pointer reused by a new document).
+ * IN:
+ * @param index - pointer to an index
+ */
+void InvalidateLineIndex(LineIndex* index);
+
+/**
+ * Finds the block showing a displayed line, the index is rebuilt if it's out of date.
+ * IN:
+ * @param index - pointer to an index
+ * @param doc - pointer to a Document object
+ * @param chars - chars of a wrapped line (0 - a block is one line)
+ * @param line - index of the displayed line
+ * @param pos - pointer to a position to be filled: the block, its index (y) and
+ *              the line inside the block (x, 0 if chars is 0)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (ERR_PARAM - no such line)
+ */
+int FindDisplayedLine(LineIndex* index, const Document* doc, size_t chars, size_t line, ModelPos* pos);
+
+/**
+ * Finds a block by its index, the index is rebuilt if it's out of date.
+ * IN:
+ * @param index - pointer to an index
+ * @param doc - pointer to a Document object
+ * @param chars - chars of a wrapped line (0 - a block is one line)
+ * @param y - index of the block
+ * @param pos - pointer to a position to be filled: the block, its index (y) and x = 0
+ * @param line - pointer to be filled with the displayed line of the block start
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (ERR_PARAM - no such block)
+ */
+int FindBlockLine(LineIndex* index, const Document* doc, size_t chars, size_t y, ModelPos* pos, size_t* line);
+
+/**
+ * Finds the position of a char offset of the document (a line end is one char),
+ * the index is rebuilt if it's out of date.
+ * IN:
+ * @param index - pointer to an index
+ * @param doc - pointer to a Document object
+ * @param chars - chars of a wrapped line (0 - a block is one line)
+ * @param offset - offset from the document start (the document length - its end)
+ * @param pos - pointer to a position to be filled: the block, its index (y) and
+ *              the position in the block (x, the block length - its line end)
+ * @param line - pointer to be filled with the displayed line of the block start
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (ERR_PARAM - past the end)
+ */
+int FindOffset(LineIndex* index, const Document* doc, size_t chars, size_t offset, ModelPos* pos, size_t* line);
+
+#endif // LINEINDEX_H_INCLUDED
@@ -0,0 +1,368 @@
+#include "Marks.h"
+
+#define MARKS_NIL UINT32_MAX    // no node
+
+static const position_t MARKS_END = { SIZE_MAX, SIZE_MAX };    // after every mark
+
+void InitMarkSet(MarkSet* set, MarkGravity gravity) {
+    assert(set);
+
+    set->nodes = NULL;
+    set->used = 0;
+    set->size = 0;
+    set->len = 0;
+    set->root = MARKS_NIL;
+    set->removed = MARKS_NIL;
+    set->seed = 2463534242u;
+    set->gravity = gravity;
+}
+
+void FreeMarkSet(MarkSet* set) {
+    assert(set);
+
+    free(set->nodes);
+    InitMarkSet(set, set->gravity);
+}
+
+void ClearMarks(MarkSet* set) {
+    assert(set);
+
+    set->used = 0;
+    set->len = 0;
+    set->root = MARKS_NIL;
+    set->removed = MARKS_NIL;
+}
+
+static int IsBefore(position_t a, position_t b) {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+static position_t ShiftPos(position_t pos, const MarkShift* shift) {
+    pos.y += shift->dy;
+    pos.x = shift->isSet ? shift->dx : pos.x + shift->dx;
+    return pos;
+}
+
+// a shift is followed by the next one
+static void AddShift(MarkShift* shift, const MarkShift* next) {
+    shift->dy += next->dy;
+    if (next->isSet) {
+        shift->isSet = 1;
+        shift->dx = next->dx;
+    } else {
+        shift->dx += next->dx;
+    }
+}
+
+// shifts a subtree: the root at once, its children by the pending shift
+static void ShiftNode(MarkSet* set, uint32_t i, const MarkShift* shift) {
+    if (i == MARKS_NIL) { return; }
+
+    set->nodes[i].pos = ShiftPos(set->nodes[i].pos, shift);
+    AddShift(&(set->nodes[i].shift), shift);
+}
+
+static void PushShift(MarkSet* set, uint32_t i) {
+    MarkNode* node = set->nodes + i;
+
+    if (!node->shift.dy && !node->shift.dx && !node->shift.isSet) { return; }
+
+    ShiftNode(set, node->left, &(node->shift));
+    ShiftNode(set, node->right, &(node->shift));
+    node->shift = (MarkShift) { 0, 0, 0 };
+}
+
+static void SetParent(MarkSet* set, uint32_t i, uint32_t parent) {
+    if (i != MARKS_NIL) { set->nodes[i].parent = parent; }
+}
+
+// splits a subtree to the marks before a position and the rest
+static void Split(MarkSet* set, uint32_t i, position_t pos, uint32_t* before, uint32_t* rest) {
+    if (i == MARKS_NIL) {
+        *before = MARKS_NIL;
+        *rest = MARKS_NIL;
+        return;
+    }
+
+    MarkNode* node = set->nodes + i;
+
+    PushShift(set, i);
+    if (IsBefore(node->pos, pos)) {
+        Split(set, node->right, pos, &(node->right), rest);
+        SetParent(set, node->right, i);
+        *before = i;
+    } else {
+        Split(set, node->left, pos, before, &(node->left));
+        SetParent(set, node->left, i);
+        *rest = i;
+    }
+}
+
+// joins subtrees, the marks of the first one are before the marks of the second one
+static uint32_t Join(MarkSet* set, uint32_t first, uint32_t second) {
+    if (first == MARKS_NIL) { return second; }
+    if (second == MARKS_NIL) { return first; }
+
+    if (set->nodes[first].priority > set->nodes[second].priority) {
+        PushShift(set, first);
+        set->nodes[first].right = Join(set, set->nodes[first].right, second);
+        SetParent(set, set->nodes[first].right, first);
+        return first;
+    }
+
+    PushShift(set, second);
+    set->nodes[second].left = Join(set, first, set->nodes[second].left);
+    SetParent(set, set->nodes[second].left, second);
+    return second;
+}
+
+static void SetRoot(MarkSet* set, uint32_t root) {
+    set->root = root;
+    SetParent(set, root, MARKS_NIL);
+}
+
+// shifts the marks of [from, to)
+static void ShiftRange(MarkSet* set, position_t from, position_t to, size_t dy, size_t dx, int isSet) {
+    MarkShift shift = { dy, dx, isSet };
+    uint32_t before, range, after;
+
+    Split(set, set->root, from, &before, &range);
+    Split(set, range, to, &range, &after);
+    ShiftNode(set, range, &shift);
+    SetRoot(set, Join(set, Join(set, before, range), after));
+}
+
+static uint32_t NextPriority(MarkSet* set) {
+    set->seed ^= set->seed << 13;
+    set->seed ^= set->seed >> 17;
+    set->seed ^= set->seed << 5;
+    return set->seed;
+}
+
+int AddMark(MarkSet* set, position_t pos, size_t* id) {
+    assert(set);
+
+    uint32_t i = set->removed;
+
+    if (i != MARKS_NIL) {
+        set->removed = set->nodes[i].right;
+    } else {
+        if (set->used == set->size) {
+            size_t size = set->size ? set->size * 2 : MARKS_MIN_NODES;
+            MarkNode* nodes = size < MARKS_NIL ? realloc(set->nodes, size * sizeof(MarkNode)) : NULL;
+
+            if (!nodes) {
+                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                return ERR_NOMEM;
+            }
+            set->nodes = nodes;
+            set->size = size;
+        }
+        i = (uint32_t) set->used++;
+    }
+
+    MarkNode* node = set->nodes + i;
+    uint32_t before, after;
+
+    node->pos = pos;
+    node->shift = (MarkShift) { 0, 0, 0 };
+    node->left = MARKS_NIL;
+    node->right = MARKS_NIL;
+    node->priority = NextPriority(set);
+
+    // after the marks at the same position
+    Split(set, set->root, (position_t) { pos.x + 1, pos.y }, &before, &after);
+    SetRoot(set, Join(set, Join(set, before, i), after));
+    ++set->len;
+
+    if (id) { *id = i; }
+    return ERR_SUCCESS;
+}
+
+// the shifts of the ancestors of a node are applied to it
+static void PushPath(MarkSet* set, uint32_t i) {
+    uint32_t parent = set->nodes[i].parent;
+
+    if (parent == MARKS_NIL) { return; }
+
+    PushPath(set, parent);
+    PushShift(set, parent);
+}
+
+void RemoveMark(MarkSet* set, size_t id) {
+    assert(set && id < set->used);
+
+    uint32_t i = (uint32_t) id;
+
+    PushPath(set, i);
+    PushShift(set, i);
+
+    MarkNode* node = set->nodes + i;
+    uint32_t parent = node->parent;
+    uint32_t child = Join(set, node->left, node->right);
+
+    SetParent(set, child, parent);
+    if (parent == MARKS_NIL) {
+        set->root = child;
+    } else if (set->nodes[parent].left == i) {
+        set->nodes[parent].left = child;
+    } else {
+        set->nodes[parent].right = child;
+    }
+
+    node->right = set->removed;
+    set->removed = i;
+    --set->len;
+}
+
+position_t GetMark(const MarkSet* set, size_t id) {
+    assert(set && id < set->used);
+
+    position_t pos = set->nodes[id].pos;
+
+    // the shift of the nearest ancestor is the earliest one
+    for (uint32_t i = set->nodes[id].parent; i != MARKS_NIL; i = set->nodes[i].parent) {
+        pos = ShiftPos(pos, &(set->nodes[i].shift));
+    }
+    return pos;
+}
+
+/*
+ * Finds the first mark at a position or after it (isNext), or the last mark before it.
+ * The nodes aren't changed: the shifts of the ancestors are gathered on the way down.
+ */
+static size_t FindMark(const MarkSet* set, position_t pos, int isNext, position_t* markPos) {
+    MarkShift shift = { 0, 0, 0 };
+    uint32_t found = MARKS_NIL;
+    position_t foundPos = { 0, 0 };
+
+    for (uint32_t i = set->root; i != MARKS_NIL;) {
+        const MarkNode* node = set->nodes + i;
+        position_t nodePos = ShiftPos(node->pos, &shift);
+        int isBefore = IsBefore(nodePos, pos);
+
+        if (isBefore != isNext) {
+            found = i;
+            foundPos = nodePos;
+        }
+
+        // the shift of the node comes before the shifts of its ancestors
+        MarkShift childShift = node->shift;
+
+        AddShift(&childShift, &shift);
+        shift = childShift;
+        i = isBefore ? node->right : node->left;
+    }
+
+    if (found == MARKS_NIL) { return MARKS_NONE; }
+    if (markPos) { *markPos = foundPos; }
+    return found;
+}
+
+size_t FindNextMark(const MarkSet* set, position_t pos, position_t* markPos) {
+    assert(set);
+
+    return FindMark(set, pos, 1, markPos);
+}
+
+size_t FindPrevMark(const MarkSet* set, position_t pos, position_t* markPos) {
+    assert(set);
+
+    return FindMark(set, pos, 0, markPos);
+}
+
+typedef struct {
+    position_t from;
+    position_t to;
+    size_t* ids;
+    position_t* positions;
+    size_t size;
+    size_t count;
+} MarkList;
+
+// lists the marks of a subtree in the range, the subtrees out of it aren't visited
+static void ListNode(const MarkSet* set, uint32_t i, const MarkShift* shift, MarkList* list) {
+    if (i == MARKS_NIL) { return; }
+
+    const MarkNode* node = set->nodes + i;
+    position_t nodePos = ShiftPos(node->pos, shift);
+    MarkShift childShift = node->shift;
+
+    int isAtFrom = !IsBefore(nodePos, list->from);
+    int isBeforeTo = IsBefore(nodePos, list->to);
+
+    AddShift(&childShift, shift);
+
+    if (isAtFrom) { ListNode(set, node->left, &childShift, list); }
+    if (isAtFrom && isBeforeTo) {
+        if (list->count < list->size) {
+            list->ids[list->count] = i;
+            list->positions[list->count] = nodePos;
+        }
+        ++list->count;
+    }
+    if (isBeforeTo) { ListNode(set, node->right, &childShift, list); }
+}
+
+size_t ListMarks(const MarkSet* set, position_t from, position_t to, size_t* ids, position_t* positions, size_t size) {
+    assert(set && (!size || (ids && positions)));
+
+    MarkList list = { from, to, ids, positions, size, 0 };
+    MarkShift shift = { 0, 0, 0 };
+
+    ListNode(set, set->root, &shift, &list);
+    return list.count;
+}
+
+void MarksInsertChars(MarkSet* set, position_t pos, size_t len) {
+    assert(set);
+
+    if (!set->len || !len) { return; }
+
+    if (set->gravity == MARK_STAY) { ++pos.x; }
+    ShiftRange(set, pos, (position_t) { 0, pos.y + 1 }, 0, len, 0);
+}
+
+void MarksDeleteChars(MarkSet* set, position_t pos, size_t len) {
+    assert(set);
+
+    if (!set->len || !len) { return; }
+
+    ShiftRange(set, pos, (position_t) { pos.x + len, pos.y }, 0, pos.x, 1);
+    ShiftRange(set, (position_t) { pos.x + len, pos.y }, (position_t) { 0, pos.y + 1 }, 0, -len, 0);
+}
+
+void MarksSplitBlock(MarkSet* set, position_t pos) {
+    assert(set);
+
+    if (!set->len) { return; }
+
+    position_t from = pos;
+
+    if (set->gravity == MARK_STAY) { ++from.x; }
+    ShiftRange(set, (position_t) { 0, pos.y + 1 }, MARKS_END, 1, 0, 0);
+    ShiftRange(set, from, (position_t) { 0, pos.y + 1 }, 1, -pos.x, 0);
+}
+
+void MarksMergeBlocks(MarkSet* set, size_t y, size_t len) {
+    assert(set);
+
+    if (!set->len) { return; }
+
+    ShiftRange(set, (position_t) { 0, y + 1 }, (position_t) { 0, y + 2 }, -1, len, 0);
+    ShiftRange(set, (position_t) { 0, y + 2 }, MARKS_END, -1, 0, 0);
+}
+
+void MarksFollowChange(MarkSet* set, const HistoryChange* change) {
+    assert(set && change);
+
+    position_t pos = { change->x, change->y };
+
+    switch (change->op) {
+    case HISTORY_INSERT:    MarksInsertChars(set, pos, change->len); break;
+    case HISTORY_DELETE:    MarksDeleteChars(set, pos, change->len); break;
+    case HISTORY_SPLIT:     MarksSplitBlock(set, pos); break;
+    case HISTORY_MERGE:     MarksMergeBlocks(set, change->y, change->x); break;
+    default:                break;
+    }
+}
@@ -0,0 +1,197 @@
+#pragma once
+#ifndef MARKS_H_INCLUDED
+#define MARKS_H_INCLUDED
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+
+#define MARKS_MIN_NODES 64          // initial capacity of a mark set
+#define MARKS_NONE ((size_t) -1)    // no mark
+
+typedef enum {
+    MARK_STAY,      // chars inserted (a block split) at a mark are after it
+    MARK_MOVE       // chars inserted (a block split) at a mark are before it
+} MarkGravity;
+
+// a pending shift of the marks of a subtree: y += dy, x = isSet ? dx : x + dx (modulo SIZE_MAX + 1)
+typedef struct {
+    size_t dy;
+    size_t dx;
+    int isSet;
+} MarkShift;
+
+typedef struct {
+    position_t pos;         // position of the mark, the shifts of its ancestors aren't applied yet
+    MarkShift shift;        // shift of the children not applied yet
+    uint32_t left;          // 32-bit links keep a node small for millions of marks
+    uint32_t right;         // a removed node - the next removed node
+    uint32_t parent;
+    uint32_t priority;      // the parent has a greater one
+} MarkNode;
+
+/**
+ * Marks attached to positions of a document, kept through its edits. They're ordered by
+ * their positions in a treap whose subtrees carry pending shifts: an edit of a block shifts
+ * the marks after it in the block (dx) and the marks of the following blocks (dy) by splitting
+ * the treap around them, shifting the subtree root and joining it again, so an edit costs
+ * O(log n) for any count of marks. A mark is found by its position or by its id (the node).
+ */
+typedef struct {
+    MarkNode* nodes;
+    size_t used;            // count of nodes taken from the array
+    size_t size;            // capacity of the array
+    size_t len;             // count of marks
+    uint32_t root;
+    uint32_t removed;       // the first removed node
+    uint32_t seed;          // state of the priorities
+    MarkGravity gravity;
+} MarkSet;
+
+/**
+ * Inits an empty mark set.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param gravity - side of the chars inserted at a mark
+ */
+void InitMarkSet(MarkSet* set, MarkGravity gravity);
+
+/**
+ * Frees the marks of a set, the set becomes empty.
+ * IN:
+ * @param set - pointer to a mark set
+ */
+void FreeMarkSet(MarkSet* set);
+
+/**
+ * Removes all marks of a set (their ids become invalid), the memory is kept.
+ * IN:
+ * @param set - pointer to a mark set
+ */
+void ClearMarks(MarkSet* set);
+
+/**
+ * Adds a mark, it's after the marks at the same position.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - position of the mark (x - position in the block, y - index of the block)
+ * @param id - pointer to be filled with the id of the mark (may be NULL)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int AddMark(MarkSet* set, position_t pos, size_t* id);
+
+/**
+ * Removes a mark, its id may be given to a new mark.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param id - id of the mark
+ */
+void RemoveMark(MarkSet* set, size_t id);
+
+/**
+ * Gets the position of a mark.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param id - id of the mark
+ *
+ * OUT:
+ * @return pos - position of the mark
+ */
+position_t GetMark(const MarkSet* set, size_t id);
+
+/**
+ * Finds the first mark at a position or after it.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - the position
+ * @param markPos - pointer to be filled with the position of the mark (may be NULL)
+ *
+ * OUT:
+ * @return id - id of the mark (MARKS_NONE - no mark)
+ */
+size_t FindNextMark(const MarkSet* set, position_t pos, position_t* markPos);
+
+/**
+ * Finds the last mark before a position.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - the position
+ * @param markPos - pointer to be filled with the position of the mark (may be NULL)
+ *
+ * OUT:
+ * @return id - id of the mark (MARKS_NONE - no mark)
+ */
+size_t FindPrevMark(const MarkSet* set, position_t pos, position_t* markPos);
+
+/**
+ * Lists the marks of a range in their order, a walk of the range costs O(log n + count).
+ * IN:
+ * @param set - pointer to a mark set
+ * @param from - the first position of the range
+ * @param to - the position after the range
+ * @param ids - pointer to an array to be filled with the ids of the marks (may be NULL if size is 0)
+ * @param positions - pointer to an array to be filled with the positions of the marks (may be NULL if size is 0)
+ * @param size - size of the arrays
+ *
+ * OUT:
+ * @return count - count of the marks of the range (only the first size ones are listed)
+ */
+size_t ListMarks(const MarkSet* set, position_t from, position_t to, size_t* ids, position_t* positions, size_t size);
+
+// edits of the document: the marks follow the text
+/**
+ * Chars are inserted into a block: the marks after them in the block move by len.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - position of the inserted chars
+ * @param len - count of chars
+ */
+void MarksInsertChars(MarkSet* set, position_t pos, size_t len);
+
+/**
+ * Chars are deleted from a block: the marks in them move to their position,
+ * the marks after them in the block move back by len.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - position of the deleted chars
+ * @param len - count of chars
+ */
+void MarksDeleteChars(MarkSet* set, position_t pos, size_t len);
+
+/**
+ * A block is split: the marks after the split move to the new block,
+ * the marks of the following blocks move down by one block.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param pos - position of the split
+ */
+void MarksSplitBlock(MarkSet* set, position_t pos);
+
+/**
+ * The next block is merged into a block: its marks move to the end of the block,
+ * the marks of the following blocks move up by one block.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param y - index of the block
+ * @param len - count of chars of the block before the merge
+ */
+void MarksMergeBlocks(MarkSet* set, size_t y, size_t len);
+
+/**
+ * An edit of blocks reported by undo, redo or a replacement (DocChanged): the marks follow it.
+ * IN:
+ * @param set - pointer to a mark set
+ * @param change - the edit
+ */
+void MarksFollowChange(MarkSet* set, const HistoryChange* change);
+
+#endif // MARKS_H_INCLUDED
@@ -6,4 +6,36 @@
 
 #define IDM_FORMAT_WRAP   100
 
+#define IDM_DEBUG_LATENCY   200
+#define IDM_DEBUG_COUNTERS  210
+#define IDM_DEBUG_TRACE     220
+#define IDM_DEBUG_REPLAY    230
+
+#define IDM_SEARCH_FIND     300
+#define IDM_SEARCH_NEXT     310
+#define IDM_SEARCH_PREV     320
+#define IDM_SEARCH_REGEX    330
+#define IDM_SEARCH_FIND_ALL 340
+#define IDM_SEARCH_REPLACE  350
+#define IDM_SEARCH_FIND_IN_FILES    360
+#define IDM_SEARCH_NEXT_RESULT      370
+#define IDM_SEARCH_GO_TO            380
+
+#define IDD_GO_TO           400
+#define IDC_GO_TO_VALUE     410
+#define IDC_GO_TO_LINE      420
+#define IDC_GO_TO_OFFSET    430
+
+#define IDM_EDIT_UNDO       500
+#define IDM_EDIT_REDO       510
+#define IDM_EDIT_CUT        520
+#define IDM_EDIT_COPY       530
+#define IDM_EDIT_BLANK      540
+#define IDM_EDIT_MARK       550
+#define IDM_EDIT_CLEAR_MARKS    560
+
+#define IDM_BOOKMARK_TOGGLE 600
+#define IDM_BOOKMARK_NEXT   610
+#define IDM_BOOKMARK_PREV   620
+
 #endif // MENU_H_INCLUDED
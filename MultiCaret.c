@@ -0,0 +1,525 @@
+#include "MultiCaret.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Fix-ups of a pass for the carets which aren't passed yet. Carets of one block are passed
+ * in a row: the edits of the passed ones shift the positions in the block by dx and may move
+ * the rest of the block to another block (a split or a merge). Edits of blocks before
+ * a caret shift its block index by dy.
+ */
+typedef struct {
+    Block* from;        // the block of the carets being passed, as it was before the pass (NULL - none)
+    Block* to;          // the block showing the rest of it now
+    size_t toY;         // index of that block
+    ptrdiff_t dx;       // shift of the positions of the carets being passed
+    ptrdiff_t dy;       // shift of the indices of other blocks
+    int isAnchorDone;   // the anchor is at its place after the pass
+} CaretsPass;
+
+static int Reserve(void** data, size_t* size, size_t len, size_t itemSize) {
+    if (len < *size) { return ERR_SUCCESS; }
+
+    size_t newSize = *size ? 2 * *size : CARETS_MIN_ITEMS;
+    void* newData = realloc(*data, newSize * itemSize);
+
+    if (!newData) { return ERR_NOMEM; }
+    *data = newData;
+    *size = newSize;
+    return ERR_SUCCESS;
+}
+
+void InitCaretSet(CaretSet* set, ModelPos* anchor, CaretsChanged onChange, void* context) {
+    assert(set);
+
+    set->items = NULL;
+    set->len = 0;
+    set->size = 0;
+    set->primary = 0;
+    set->anchor = anchor;
+    set->onChange = onChange;
+    set->context = context;
+}
+
+void FreeCaretSet(CaretSet* set) {
+    assert(set);
+
+    free(set->items);
+    set->items = NULL;
+    set->len = 0;
+    set->size = 0;
+    set->primary = 0;
+}
+
+void ClearCarets(CaretSet* set) {
+    assert(set);
+
+    set->len = 0;
+    set->primary = 0;
+}
+
+static int ComparePos(const ModelPos* a, const ModelPos* b) {
+    if (a->pos.y != b->pos.y) { return a->pos.y < b->pos.y ? -1 : 1; }
+    if (a->pos.x != b->pos.x) { return a->pos.x < b->pos.x ? -1 : 1; }
+    return 0;
+}
+
+// the first caret which isn't before a position
+static size_t LowerBound(const CaretSet* set, const ModelPos* pos) {
+    size_t left = 0;
+    size_t right = set->len;
+
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+
+        if (ComparePos(&(set->items[middle]), pos) < 0) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+    return left;
+}
+
+int AddCaret(CaretSet* set, ModelPos pos) {
+    assert(set && pos.block);
+
+    size_t i = LowerBound(set, &pos);
+
+    if (i < set->len && !ComparePos(&(set->items[i]), &pos)) {
+        set->primary = i;
+        return ERR_SUCCESS;
+    }
+
+    if (Reserve((void**)&set->items, &set->size, set->len, sizeof(ModelPos))) { return ERR_NOMEM; }
+
+    memmove(set->items + i + 1, set->items + i, (set->len - i) * sizeof(ModelPos));
+    set->items[i] = pos;
+    ++set->len;
+    set->primary = i;
+    return ERR_SUCCESS;
+}
+
+size_t FindFirstCaret(const CaretSet* set, size_t y) {
+    assert(set);
+
+    ModelPos pos = { NULL, { 0, y } };
+
+    return LowerBound(set, &pos);
+}
+
+// carets which met become one, the primary caret is kept
+static void MergeEqualCarets(CaretSet* set) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < set->len; ++i) {
+        if (kept && !ComparePos(&(set->items[kept - 1]), &(set->items[i]))) {
+            if (set->primary == i) { set->primary = kept - 1; }
+            continue;
+        }
+
+        if (set->primary == i) { set->primary = kept; }
+        set->items[kept++] = set->items[i];
+    }
+    set->len = kept;
+}
+
+static void Notify(const CaretSet* set, const CaretsChange* change) {
+    if (set->onChange) { set->onChange(set->context, change); }
+}
+
+static void InitPass(CaretsPass* pass) {
+    pass->from = NULL;
+    pass->to = NULL;
+    pass->toY = 0;
+    pass->dx = 0;
+    pass->dy = 0;
+    pass->isAnchorDone = 0;
+}
+
+// the current position of a caret which isn't passed yet
+static ModelPos MapCaret(const CaretsPass* pass, ModelPos pos) {
+    if (pos.block == pass->from) {
+        pos.block = pass->to;
+        pos.pos.y = pass->toY;
+        pos.pos.x += pass->dx;
+    } else {
+        pos.pos.y += pass->dy;
+    }
+    return pos;
+}
+
+// the caret gets its current position, its block becomes the one being passed
+static void BeginCaret(CaretSet* set, CaretsPass* pass, size_t i) {
+    ModelPos* caret = &(set->items[i]);
+    ModelPos* anchor = set->anchor;
+
+    // the blocks before the anchor are passed
+    if (anchor && !pass->isAnchorDone && caret->pos.y >= anchor->pos.y) {
+        anchor->pos.y += pass->dy;
+        pass->isAnchorDone = 1;
+    }
+
+    if (caret->block != pass->from) {
+        pass->from = caret->block;
+        pass->to = caret->block;
+        pass->toY = caret->pos.y + pass->dy;
+        pass->dx = 0;
+    }
+    *caret = MapCaret(pass, *caret);
+}
+
+// the carets from i aren't passed (an error stopped the pass) but get their current positions
+static void EndPass(CaretSet* set, CaretsPass* pass, size_t i) {
+    for (; i < set->len; ++i) { set->items[i] = MapCaret(pass, set->items[i]); }
+
+    if (set->anchor && !pass->isAnchorDone) { set->anchor->pos.y += pass->dy; }
+
+    MergeEqualCarets(set);
+}
+
+// a removed block is merged into a block: the anchor at it goes to the start of the block
+static void MoveAnchor(CaretSet* set, CaretsPass* pass, const Block* removed, Block* block, size_t y) {
+    if (!set->anchor || set->anchor->block != removed) { return; }
+
+    set->anchor->block = block;
+    set->anchor->pos.x = 0;
+    set->anchor->pos.y = y;
+    pass->isAnchorDone = 1;
+}
+
+static void NotifyChars(const CaretSet* set, const ModelPos* caret, const char* chars, size_t len, size_t oldLen) {
+    CaretsChange change = { CARETS_CHANGE_CHARS, caret->pos.y, caret->pos.x, chars, len,
+                            oldLen, caret->block->data.len, 0 };
+
+    Notify(set, &change);
+}
+
+// tabs of chars are expanded to spaces from a column, returns the count of the expanded chars
+static size_t ExpandTabs(const char* chars, size_t len, size_t column, size_t tabSize, size_t lineChars, char* expanded) {
+    size_t expandedLen = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (chars[i] != '\t') {
+            expanded[expandedLen++] = chars[i];
+            continue;
+        }
+
+        size_t tabColumn = column + expandedLen;
+        size_t spaces;
+
+        if (lineChars) {
+            tabColumn %= lineChars;
+            spaces = MIN(tabSize - tabColumn % tabSize, lineChars - tabColumn);
+        } else {
+            spaces = tabSize - tabColumn % tabSize;
+        }
+        memset(expanded + expandedLen, ' ', spaces);
+        expandedLen += spaces;
+    }
+
+    return expandedLen;
+}
+
+int InsertAtCarets(Document* doc, CaretSet* set, const char* chars, size_t len, size_t tabSize, size_t lineChars) {
+    assert(doc && set && (chars || !len) && tabSize);
+    TRACE_SCOPE("InsertAtCarets");
+
+    if (!len || !set->len) { return ERR_SUCCESS; }
+
+    char* expanded = malloc(len * tabSize);
+    if (!expanded) { return ERR_NOMEM; }
+
+    CaretsPass pass;
+    int errValue = ERR_SUCCESS;
+    size_t i;
+
+    InitPass(&pass);
+    for (i = 0; i < set->len && !errValue; ++i) {
+        BeginCaret(set, &pass, i);
+
+        ModelPos* caret = &(set->items[i]);
+        size_t column = lineChars ? caret->pos.x % lineChars : caret->pos.x;
+        size_t expandedLen = ExpandTabs(chars, len, column, tabSize, lineChars, expanded);
+
+        errValue = DocInsertChars(doc, caret->block, caret->pos.y, caret->pos.x, expanded, expandedLen);
+        if (errValue) { continue; }
+
+        NotifyChars(set, caret, expanded, expandedLen, caret->block->data.len - expandedLen);
+        caret->pos.x += expandedLen;
+        pass.dx += expandedLen;
+    }
+    EndPass(set, &pass, i);
+
+    free(expanded);
+    return errValue;
+}
+
+int SplitAtCarets(Document* doc, CaretSet* set) {
+    assert(doc && set);
+    TRACE_SCOPE("SplitAtCarets");
+
+    CaretsPass pass;
+    int errValue = ERR_SUCCESS;
+    size_t i;
+
+    InitPass(&pass);
+    for (i = 0; i < set->len && !errValue; ++i) {
+        BeginCaret(set, &pass, i);
+
+        ModelPos* caret = &(set->items[i]);
+        Block* block = caret->block;
+        size_t len = block->data.len;
+
+        errValue = DocSplitBlock(doc, block, caret->pos.y, caret->pos.x);
+        if (errValue) { continue; }
+
+        CaretsChange change = { CARETS_CHANGE_SPLIT, caret->pos.y, caret->pos.x, NULL, 0,
+                                len, block->data.len, block->next->data.len };
+        Notify(set, &change);
+
+        // the rest of the block is in the new block
+        pass.to = block->next;
+        ++pass.toY;
+        pass.dx -= caret->pos.x;
+        ++pass.dy;
+
+        caret->block = block->next;
+        caret->pos.x = 0;
+        ++caret->pos.y;
+    }
+    EndPass(set, &pass, i);
+
+    return errValue;
+}
+
+static int BackspaceAtCaret(Document* doc, CaretSet* set, CaretsPass* pass, size_t i, size_t count) {
+    ModelPos* caret = &(set->items[i]);
+    const ModelPos* prev = i ? &(set->items[i - 1]) : NULL;
+    int errValue;
+
+    while (count) {
+        Block* block = caret->block;
+        int isPrevHere = prev && prev->block == block;
+        size_t start = isPrevHere ? prev->pos.x : 0;
+
+        if (caret->pos.x > start) {
+            size_t len = MIN(count, caret->pos.x - start);
+
+            errValue = DocDeleteChars(doc, block, caret->pos.y, caret->pos.x - len, len);
+            if (errValue) { return errValue; }
+
+            caret->pos.x -= len;
+            NotifyChars(set, caret, NULL, len, block->data.len + len);
+            pass->dx -= len;
+            count -= len;
+            continue;
+        }
+
+        if (isPrevHere || !block->prev) { break; }
+
+        // the line end before the caret
+        Block* prevBlock = block->prev;
+        size_t prevLen = prevBlock->data.len;
+        size_t len = block->data.len;
+
+        errValue = DocMergeBlocks(doc, prevBlock, caret->pos.y - 1);
+        if (errValue) { return errValue; }
+
+        caret->block = prevBlock;
+        caret->pos.x = prevLen;
+        --caret->pos.y;
+
+        CaretsChange change = { CARETS_CHANGE_MERGE, caret->pos.y, prevLen, NULL, 0,
+                                prevLen, prevBlock->data.len, len };
+        Notify(set, &change);
+        MoveAnchor(set, pass, block, prevBlock, caret->pos.y);
+
+        pass->to = prevBlock;
+        --pass->toY;
+        pass->dx += prevLen;
+        --pass->dy;
+        --count;
+    }
+
+    return ERR_SUCCESS;
+}
+
+int BackspaceAtCarets(Document* doc, CaretSet* set, size_t count) {
+    assert(doc && set);
+    TRACE_SCOPE("BackspaceAtCarets");
+
+    CaretsPass pass;
+    int errValue = ERR_SUCCESS;
+    size_t i;
+
+    InitPass(&pass);
+    for (i = 0; i < set->len && !errValue; ++i) {
+        BeginCaret(set, &pass, i);
+        errValue = BackspaceAtCaret(doc, set, &pass, i, count);
+    }
+    EndPass(set, &pass, i);
+
+    return errValue;
+}
+
+static int DeleteAtCaret(Document* doc, CaretSet* set, CaretsPass* pass, size_t i, size_t count) {
+    ModelPos* caret = &(set->items[i]);
+    int errValue;
+
+    while (count) {
+        Block* block = caret->block;
+        size_t end = block->data.len;
+        int isNextHere = 0;
+
+        if (i + 1 < set->len) {
+            ModelPos next = MapCaret(pass, set->items[i + 1]);
+
+            if (next.block == block) {
+                end = next.pos.x;
+                isNextHere = 1;
+            }
+        }
+
+        if (caret->pos.x < end) {
+            size_t len = MIN(count, end - caret->pos.x);
+
+            errValue = DocDeleteChars(doc, block, caret->pos.y, caret->pos.x, len);
+            if (errValue) { return errValue; }
+
+            NotifyChars(set, caret, NULL, len, block->data.len + len);
+            pass->dx -= len;
+            count -= len;
+            continue;
+        }
+
+        if (isNextHere || !block->next) { break; }
+
+        // the line end after the caret: the carets of the next block are passed next
+        Block* next = block->next;
+        size_t len = block->data.len;
+        size_t nextLen = next->data.len;
+
+        errValue = DocMergeBlocks(doc, block, caret->pos.y);
+        if (errValue) { return errValue; }
+
+        CaretsChange change = { CARETS_CHANGE_MERGE, caret->pos.y, len, NULL, 0,
+                                len, block->data.len, nextLen };
+        Notify(set, &change);
+        MoveAnchor(set, pass, next, block, caret->pos.y);
+
+        pass->from = next;
+        pass->to = block;
+        pass->toY = caret->pos.y;
+        pass->dx = len;
+        --pass->dy;
+        --count;
+    }
+
+    return ERR_SUCCESS;
+}
+
+int DeleteAtCarets(Document* doc, CaretSet* set, size_t count) {
+    assert(doc && set);
+    TRACE_SCOPE("DeleteAtCarets");
+
+    CaretsPass pass;
+    int errValue = ERR_SUCCESS;
+    size_t i;
+
+    InitPass(&pass);
+    for (i = 0; i < set->len && !errValue; ++i) {
+        BeginCaret(set, &pass, i);
+        errValue = DeleteAtCaret(doc, set, &pass, i, count);
+    }
+    EndPass(set, &pass, i);
+
+    return errValue;
+}
+
+// returns 1 if the caret is moved
+static int MoveCaret(ModelPos* caret, CaretsMove move) {
+    Block* block = caret->block;
+    int isMoved;
+
+    switch (move) {
+    case CARETS_UP:
+        if (!block->prev) { return 0; }
+
+        caret->block = block->prev;
+        caret->pos.x = MIN(caret->pos.x, caret->block->data.len);
+        --caret->pos.y;
+        return 1;
+
+    case CARETS_DOWN:
+        if (!block->next) { return 0; }
+
+        caret->block = block->next;
+        caret->pos.x = MIN(caret->pos.x, caret->block->data.len);
+        ++caret->pos.y;
+        return 1;
+
+    case CARETS_LEFT:
+        if (caret->pos.x) {
+            --caret->pos.x;
+        } else if (block->prev) {
+            caret->block = block->prev;
+            caret->pos.x = caret->block->data.len;
+            --caret->pos.y;
+        } else {
+            return 0;
+        }
+        return 1;
+
+    case CARETS_RIGHT:
+        if (caret->pos.x < block->data.len) {
+            ++caret->pos.x;
+        } else if (block->next) {
+            caret->block = block->next;
+            caret->pos.x = 0;
+            ++caret->pos.y;
+        } else {
+            return 0;
+        }
+        return 1;
+
+    case CARETS_HOME:
+        isMoved = caret->pos.x != 0;
+        caret->pos.x = 0;
+        return isMoved;
+
+    case CARETS_END:
+        isMoved = caret->pos.x != block->data.len;
+        caret->pos.x = block->data.len;
+        return isMoved;
+
+    default:
+        return 0;
+    }
+}
+
+static int CompareCarets(const void* a, const void* b) {
+    return ComparePos(a, b);
+}
+
+void MoveCarets(CaretSet* set, CaretsMove move, size_t count) {
+    assert(set);
+    TRACE_SCOPE("MoveCarets");
+
+    int isSorted = 1;
+
+    for (size_t i = 0; i < set->len; ++i) {
+        for (size_t j = 0; j < count && MoveCaret(&(set->items[i]), move); ++j) {}
+
+        if (i && ComparePos(&(set->items[i - 1]), &(set->items[i])) > 0) { isSorted = 0; }
+    }
+
+    // a caret stopped at the first or the last block may be passed by a caret of the next one
+    if (!isSorted) {
+        ModelPos primary = set->items[set->primary];
+
+        qsort(set->items, set->len, sizeof(ModelPos), CompareCarets);
+        set->primary = LowerBound(set, &primary);
+    }
+    MergeEqualCarets(set);
+}
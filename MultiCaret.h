@@ -0,0 +1,182 @@
+#pragma once
+#ifndef MULTI_CARET_H_INCLUDED
+#define MULTI_CARET_H_INCLUDED
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+
+#define CARETS_MIN_ITEMS 8      // initial capacity of a caret set
+
+typedef enum {
+    CARETS_CHANGE_CHARS,    // chars inserted into the block at x (chars) or deleted at x (chars - NULL)
+    CARETS_CHANGE_SPLIT,    // the block split at x
+    CARETS_CHANGE_MERGE     // the next block merged into the block of x chars
+} CaretsChangeType;
+
+// a change of one block made by a pass over the carets
+typedef struct {
+    CaretsChangeType type;
+    size_t y;               // index of the block when it's changed
+    size_t x;               // position of the change in the block
+    const char* chars;      // CHARS - inserted chars, NULL - chars are deleted
+    size_t len;             // CHARS - count of chars
+    size_t oldLen;          // length of the block before the change
+    size_t newLen;          // length of the block after the change
+    size_t nextLen;         // SPLIT - length of the new block, MERGE - length of the merged block
+} CaretsChange;
+
+/**
+ * Notification of a change made by a pass: the owner of the carets updates its metrics by
+ * the lengths of the change only, so a pass costs O(1) per caret besides the edit itself.
+ * IN:
+ * @param context - context given to InitCaretSet()
+ * @param change - pointer to the change
+ */
+typedef void (*CaretsChanged)(void* context, const CaretsChange* change);
+
+// the order of the first moves is the order of Direction of the displayed model
+typedef enum {
+    CARETS_UP,
+    CARETS_LEFT,
+    CARETS_RIGHT,
+    CARETS_DOWN,
+    CARETS_HOME,            // the start of the block
+    CARETS_END              // the end of the block
+} CaretsMove;
+
+/**
+ * Carets of multi-caret editing. They're kept in document order without equal positions,
+ * so an edit is applied to all of them by one pass from the first to the last: a caret is
+ * edited in its current block, and the positions of the following carets are fixed up by
+ * the shift of their block (dx) and of the block indices (dy) instead of being searched again.
+ * Carets which meet after an edit become one.
+ */
+typedef struct {
+    ModelPos* items;
+    size_t len;
+    size_t size;
+    size_t primary;             // index of the caret shown by the window
+    ModelPos* anchor;           // start of a block kept by the passes (the top of a view), may be NULL
+    CaretsChanged onChange;     // NULL - changes aren't notified
+    void* context;
+} CaretSet;
+
+/**
+ * Inits an empty caret set.
+ * IN:
+ * @param set - pointer to a caret set
+ * @param anchor - pointer to a position at the start of a block: it stays at its block,
+ *                 a merge of the block into the previous one moves it to the previous block (NULL - none)
+ * @param onChange - notification of a change of a block (NULL - no notifications)
+ * @param context - argument of the notification
+ */
+void InitCaretSet(CaretSet* set, ModelPos* anchor, CaretsChanged onChange, void* context);
+
+/**
+ * Frees carets of a set, the set becomes empty.
+ * IN:
+ * @param set - pointer to a caret set
+ */
+void FreeCaretSet(CaretSet* set);
+
+/**
+ * Removes all carets of a set (the memory is kept).
+ * IN:
+ * @param set - pointer to a caret set
+ */
+void ClearCarets(CaretSet* set);
+
+/**
+ * Adds a caret to a set, it becomes the primary one (an equal caret isn't added twice).
+ * IN:
+ * @param set - pointer to a caret set
+ * @param pos - position of the caret
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int AddCaret(CaretSet* set, ModelPos pos);
+
+/**
+ * Finds the first caret at a block or after it.
+ * IN:
+ * @param set - pointer to a caret set
+ * @param y - index of the block
+ *
+ * OUT:
+ * @return index - index of the caret (set->len - no such caret)
+ */
+size_t FindFirstCaret(const CaretSet* set, size_t y);
+
+/**
+ * Inserts chars at every caret, the carets pass them. Tabs are expanded to spaces
+ * from the column of each caret.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param set - pointer to a caret set
+ * @param chars - pointer to chars (no line ends)
+ * @param len - count of chars
+ * @param tabSize - a tab is spaces up to the next multiple of it
+ * @param lineChars - chars of a wrapped line: a tab doesn't pass its end (0 - lines aren't wrapped)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (carets stay valid on error)
+ */
+int InsertAtCarets(Document* doc, CaretSet* set, const char* chars, size_t len, size_t tabSize, size_t lineChars);
+
+/**
+ * Splits the block at every caret, the carets go to the starts of the new blocks.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param set - pointer to a caret set
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (carets stay valid on error)
+ */
+int SplitAtCarets(Document* doc, CaretSet* set);
+
+/**
+ * Deletes chars before every caret, a line end is one char. A caret doesn't delete
+ * chars before the previous caret, they meet instead.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param set - pointer to a caret set
+ * @param count - count of chars deleted by a caret
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (carets stay valid on error)
+ */
+int BackspaceAtCarets(Document* doc, CaretSet* set, size_t count);
+
+/**
+ * Deletes chars after every caret, a line end is one char. A caret doesn't delete
+ * chars after the next caret, they meet instead.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param set - pointer to a caret set
+ * @param count - count of chars deleted by a caret
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (carets stay valid on error)
+ */
+int DeleteAtCarets(Document* doc, CaretSet* set, size_t count);
+
+/**
+ * Moves every caret in the model: left and right pass line ends, up and down keep the column
+ * if the block is long enough.
+ * IN:
+ * @param set - pointer to a caret set
+ * @param move - the move
+ * @param count - count of moves
+ */
+void MoveCarets(CaretSet* set, CaretsMove move, size_t count);
+
+#endif // MULTI_CARET_H_INCLUDED
@@ -0,0 +1,1666 @@
+#include "Regex.h"
+
+#define RE_MAX_REPEAT 1000      // max count of a counted repeat
+#define RE_MAX_PREFIX 64        // max length of the literal prefix
+#define RE_INFINITY (-1)        // max of an unbounded repeat
+
+// kinds of bytes for assertions
+#define RE_KIND_EDGE 0          // start or end of the text
+#define RE_KIND_NEWLINE 1
+#define RE_KIND_WORD 2
+#define RE_KIND_OTHER 3
+
+#define RE_STATE_KIND_MASK 3    // kind of the previous byte
+#define RE_STATE_MATCHED 4      // a match is found, new threads aren't started (leftmost-first)
+#define RE_STATE_START 8        // only the threads of a new match (unanchored DFA)
+
+// transition: (row of the target state << RE_TRANS_SHIFT) | flags
+#define RE_TRANS_MATCH 1        // a match ends before the byte
+#define RE_TRANS_DEAD 2         // the target state has no threads
+#define RE_TRANS_START 4        // the target state has RE_STATE_START
+#define RE_TRANS_SHIFT 3
+
+#define RE_UNKNOWN (-1)         // transition isn't computed yet
+#define RE_FAILED (-2)          // transition can't be computed (no memory)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+struct RegexState_tag {
+    int* threads;       // threads in priority order: pcs of RE_OP_CLASS, RE_OP_ASSERT and RE_OP_MATCH
+    size_t threadsLen;
+    int flags;          // kind of the previous byte | RE_STATE_MATCHED | RE_STATE_START
+    uint32_t hash;
+};
+
+
+// Parsing
+typedef enum {
+    RE_NODE_EMPTY,
+    RE_NODE_CLASS,      // value - class index
+    RE_NODE_CONCAT,     // left, right
+    RE_NODE_ALT,        // left, right
+    RE_NODE_REPEAT,     // left - child, min, max, isGreedy
+    RE_NODE_GROUP,      // left - child, value - capture index (-1 - non-capturing)
+    RE_NODE_ASSERT,     // value - RegexAssert
+    RE_NODE_BACKREF,    // value - group
+    RE_NODE_LOOK        // left - child, value - is negative
+} RegexNodeType;
+
+typedef struct {
+    RegexNodeType type;
+    int left;
+    int right;
+    int value;
+    int min;
+    int max;
+    int isGreedy;
+} RegexNode;
+
+typedef struct {
+    const char* pattern;
+    size_t len;
+    size_t pos;
+    Regex* regex;
+    RegexNode* nodes;
+    size_t nodesLen;
+    size_t nodesSize;
+    int isError;
+} RegexParser;
+
+static int IsWordChar(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static int GetKind(unsigned char c) {
+    if (c == '\n') { return RE_KIND_NEWLINE; }
+    return IsWordChar(c) ? RE_KIND_WORD : RE_KIND_OTHER;
+}
+
+static unsigned char FoldChar(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int IsInClass(const RegexClass* cls, unsigned char c) {
+    return (cls->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void AddToClass(RegexClass* cls, unsigned char c) {
+    cls->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static void AddRangeToClass(RegexClass* cls, unsigned char first, unsigned char last) {
+    for (unsigned c = first; c <= last; ++c) { AddToClass(cls, (unsigned char)c); }
+}
+
+// \d \w \s and their negations
+static int AddEscapeClass(RegexClass* cls, char c) {
+    RegexClass tmp = { { 0 } };
+
+    switch (c) {
+    case 'd': case 'D':
+        AddRangeToClass(&tmp, '0', '9');
+        break;
+    case 'w': case 'W':
+        for (unsigned i = 0; i < 256; ++i) { if (IsWordChar((unsigned char)i)) { AddToClass(&tmp, (unsigned char)i); } }
+        break;
+    case 's': case 'S':
+        AddToClass(&tmp, ' ');
+        AddRangeToClass(&tmp, '\t', '\r');
+        break;
+    default:
+        return 0;
+    }
+
+    int isNegative = (c == 'D' || c == 'W' || c == 'S');
+    for (size_t i = 0; i < 8; ++i) { cls->bits[i] |= isNegative ? ~tmp.bits[i] : tmp.bits[i]; }
+    return 1;
+}
+
+// char of escapes like \n, \t and escaped specials
+static unsigned char GetEscapeChar(char c) {
+    switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case '0': return '\0';
+    default: return (unsigned char)c;
+    }
+}
+
+static void SetParseError(RegexParser* p) {
+    p->isError = 1;
+}
+
+static int AddNode(RegexParser* p, RegexNodeType type, int left, int right, int value) {
+    if (p->isError) { return -1; }
+
+    if (p->nodesLen == p->nodesSize) {
+        size_t size = p->nodesSize ? 2 * p->nodesSize : 32;
+        RegexNode* nodes = realloc(p->nodes, size * sizeof(RegexNode));
+
+        if (!nodes) {
+            SetParseError(p);
+            return -1;
+        }
+        p->nodes = nodes;
+        p->nodesSize = size;
+    }
+
+    RegexNode* node = &p->nodes[p->nodesLen];
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    node->value = value;
+    node->min = 0;
+    node->max = 0;
+    node->isGreedy = 1;
+
+    return (int)p->nodesLen++;
+}
+
+// adds both cases of the letters of a class with REGEX_IGNORE_CASE (before a negation: [^a] has neither 'a' nor 'A')
+static void FoldClass(const Regex* regex, RegexClass* cls) {
+    if (!(regex->flags & REGEX_IGNORE_CASE)) { return; }
+
+    for (unsigned c = 'a'; c <= 'z'; ++c) {
+        if (IsInClass(cls, (unsigned char)c) || IsInClass(cls, (unsigned char)(c - 'a' + 'A'))) {
+            AddToClass(cls, (unsigned char)c);
+            AddToClass(cls, (unsigned char)(c - 'a' + 'A'));
+        }
+    }
+}
+
+// the class is added as it is, it's folded by the caller
+static int AddClassNode(RegexParser* p, const RegexClass* cls) {
+    Regex* regex = p->regex;
+
+    if (regex->classesLen == regex->classesSize) {
+        size_t size = regex->classesSize ? 2 * regex->classesSize : 16;
+        RegexClass* classes = realloc(regex->classes, size * sizeof(RegexClass));
+
+        if (!classes) {
+            SetParseError(p);
+            return -1;
+        }
+        regex->classes = classes;
+        regex->classesSize = size;
+    }
+    regex->classes[regex->classesLen] = *cls;
+
+    return AddNode(p, RE_NODE_CLASS, -1, -1, (int)regex->classesLen++);
+}
+
+static int AddCharNode(RegexParser* p, unsigned char c) {
+    RegexClass cls = { { 0 } };
+
+    AddToClass(&cls, c);
+    FoldClass(p->regex, &cls);
+    return AddClassNode(p, &cls);
+}
+
+static int IsEnd(const RegexParser* p) {
+    return p->pos >= p->len;
+}
+
+static char PeekChar(const RegexParser* p) {
+    return IsEnd(p) ? '\0' : p->pattern[p->pos];
+}
+
+static int ParseAlt(RegexParser* p);
+
+// [...] after '['
+static int ParseClass(RegexParser* p) {
+    RegexClass cls = { { 0 } };
+    int isNegative = 0;
+    int isFirst = 1;
+
+    if (PeekChar(p) == '^' && !IsEnd(p)) {
+        isNegative = 1;
+        ++p->pos;
+    }
+
+    while (!IsEnd(p) && (PeekChar(p) != ']' || isFirst)) {
+        unsigned char first = (unsigned char)p->pattern[p->pos++];
+        isFirst = 0;
+
+        if (first == '\\') {
+            if (IsEnd(p)) { break; }
+
+            char escape = p->pattern[p->pos++];
+            if (AddEscapeClass(&cls, escape)) { continue; }
+            first = GetEscapeChar(escape);
+        }
+
+        // range
+        if (p->pos + 1 < p->len && p->pattern[p->pos] == '-' && p->pattern[p->pos + 1] != ']') {
+            unsigned char last = (unsigned char)p->pattern[p->pos + 1];
+            p->pos += 2;
+
+            if (last == '\\') {
+                if (IsEnd(p)) { break; }
+                last = GetEscapeChar(p->pattern[p->pos++]);
+            }
+            if (last < first) {
+                SetParseError(p);
+                return -1;
+            }
+            AddRangeToClass(&cls, first, last);
+        } else {
+            AddToClass(&cls, first);
+        }
+    }
+
+    if (IsEnd(p)) {
+        // unterminated class
+        SetParseError(p);
+        return -1;
+    }
+    ++p->pos;
+
+    FoldClass(p->regex, &cls);
+    if (isNegative) {
+        for (size_t i = 0; i < 8; ++i) { cls.bits[i] = ~cls.bits[i]; }
+    }
+    return AddClassNode(p, &cls);
+}
+
+static int ParseEscape(RegexParser* p) {
+    if (IsEnd(p)) {
+        SetParseError(p);
+        return -1;
+    }
+
+    char c = p->pattern[p->pos++];
+    RegexClass cls = { { 0 } };
+
+    if (AddEscapeClass(&cls, c)) {
+        FoldClass(p->regex, &cls);
+        return AddClassNode(p, &cls);
+    }
+
+    switch (c) {
+    case 'b':
+        return AddNode(p, RE_NODE_ASSERT, -1, -1, RE_ASSERT_WORD);
+    case 'B':
+        return AddNode(p, RE_NODE_ASSERT, -1, -1, RE_ASSERT_NOT_WORD);
+    default:
+        break;
+    }
+
+    if (c >= '1' && c <= '9') {
+        p->regex->isBacktracking = 1;
+        return AddNode(p, RE_NODE_BACKREF, -1, -1, c - '0');
+    }
+    return AddCharNode(p, GetEscapeChar(c));
+}
+
+static int ParseAtom(RegexParser* p) {
+    char c = p->pattern[p->pos++];
+
+    switch (c) {
+    case '(': {
+        int node;
+
+        if (PeekChar(p) == '?' && p->pos + 1 < p->len) {
+            char type = p->pattern[p->pos + 1];
+            p->pos += 2;
+
+            switch (type) {
+            case ':':
+                node = AddNode(p, RE_NODE_GROUP, ParseAlt(p), -1, -1);
+                break;
+            case '=':
+            case '!':
+                p->regex->isBacktracking = 1;
+                node = AddNode(p, RE_NODE_LOOK, ParseAlt(p), -1, type == '!');
+                break;
+            default:
+                SetParseError(p);
+                return -1;
+            }
+        } else {
+            if (p->regex->groups >= REGEX_MAX_GROUPS) {
+                SetParseError(p);
+                return -1;
+            }
+            int group = (int)p->regex->groups++;
+            node = AddNode(p, RE_NODE_GROUP, ParseAlt(p), -1, group);
+        }
+
+        if (PeekChar(p) != ')' || IsEnd(p)) {
+            SetParseError(p);
+            return -1;
+        }
+        ++p->pos;
+        return node;
+    }
+
+    case '[':
+        return ParseClass(p);
+
+    case '.': {
+        RegexClass cls = { { 0 } };
+
+        for (size_t i = 0; i < 8; ++i) { cls.bits[i] = ~0u; }
+        cls.bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+        return AddClassNode(p, &cls);
+    }
+
+    case '^':
+        return AddNode(p, RE_NODE_ASSERT, -1, -1, RE_ASSERT_BOL);
+
+    case '$':
+        return AddNode(p, RE_NODE_ASSERT, -1, -1, RE_ASSERT_EOL);
+
+    case '\\':
+        return ParseEscape(p);
+
+    case '*':
+    case '+':
+    case '?':
+        // nothing to repeat
+        SetParseError(p);
+        return -1;
+
+    default:
+        return AddCharNode(p, (unsigned char)c);
+    }
+}
+
+static int ParseNumber(RegexParser* p, int* value) {
+    size_t start = p->pos;
+
+    *value = 0;
+    while (!IsEnd(p) && PeekChar(p) >= '0' && PeekChar(p) <= '9') {
+        *value = *value * 10 + (PeekChar(p) - '0');
+        if (*value > RE_MAX_REPEAT) { *value = RE_MAX_REPEAT + 1; }
+        ++p->pos;
+    }
+    return p->pos > start;
+}
+
+// {m}, {m,}, {m,n} after '{'. It isn't a quantifier if the syntax doesn't match
+static int ParseCounts(RegexParser* p, int* min, int* max) {
+    size_t start = p->pos;
+
+    if (!ParseNumber(p, min)) {
+        p->pos = start;
+        return 0;
+    }
+
+    *max = *min;
+    if (PeekChar(p) == ',' && !IsEnd(p)) {
+        ++p->pos;
+        if (!ParseNumber(p, max)) { *max = RE_INFINITY; }
+    }
+
+    if (PeekChar(p) != '}' || IsEnd(p)) {
+        p->pos = start;
+        return 0;
+    }
+    ++p->pos;
+
+    if (*min > RE_MAX_REPEAT || *max > RE_MAX_REPEAT || (*max != RE_INFINITY && *max < *min)) {
+        SetParseError(p);
+    }
+    return 1;
+}
+
+static int ParseRepeat(RegexParser* p) {
+    int node = ParseAtom(p);
+
+    while (!p->isError && !IsEnd(p)) {
+        int min, max;
+        char c = PeekChar(p);
+
+        if (c == '*') {
+            min = 0;
+            max = RE_INFINITY;
+            ++p->pos;
+        } else if (c == '+') {
+            min = 1;
+            max = RE_INFINITY;
+            ++p->pos;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+            ++p->pos;
+        } else if (c == '{') {
+            ++p->pos;
+            if (!ParseCounts(p, &min, &max)) {
+                // literal '{'
+                --p->pos;
+                break;
+            }
+        } else {
+            break;
+        }
+
+        node = AddNode(p, RE_NODE_REPEAT, node, -1, 0);
+        if (node < 0) { return -1; }
+
+        p->nodes[node].min = min;
+        p->nodes[node].max = max;
+        if (PeekChar(p) == '?' && !IsEnd(p)) {
+            p->nodes[node].isGreedy = 0;
+            ++p->pos;
+        }
+    }
+
+    return node;
+}
+
+static int ParseConcat(RegexParser* p) {
+    int node = AddNode(p, RE_NODE_EMPTY, -1, -1, 0);
+
+    while (!p->isError && !IsEnd(p) && PeekChar(p) != '|' && PeekChar(p) != ')') {
+        node = AddNode(p, RE_NODE_CONCAT, node, ParseRepeat(p), 0);
+    }
+
+    return node;
+}
+
+static int ParseAlt(RegexParser* p) {
+    int node = ParseConcat(p);
+
+    while (!p->isError && PeekChar(p) == '|' && !IsEnd(p)) {
+        ++p->pos;
+        node = AddNode(p, RE_NODE_ALT, node, ParseConcat(p), 0);
+    }
+
+    return node;
+}
+
+
+// Compilation
+static int Emit(RegexProgram* program, RegexOp op, int x, int y) {
+    if (program->len >= REGEX_MAX_PROGRAM) { return -1; }
+
+    if (program->len == program->size) {
+        size_t size = program->size ? 2 * program->size : 64;
+        RegexInst* insts = realloc(program->insts, size * sizeof(RegexInst));
+
+        if (!insts) { return -1; }
+        program->insts = insts;
+        program->size = size;
+    }
+
+    program->insts[program->len].op = op;
+    program->insts[program->len].x = x;
+    program->insts[program->len].y = y;
+
+    return (int)program->len++;
+}
+
+// emits the node (in reversed order for the backward program). Returns -1 on error
+static int Compile(const RegexParser* p, RegexProgram* program, int index, int isReversed) {
+    const RegexNode* node = &p->nodes[index];
+    int pc, jmp;
+
+    switch (node->type) {
+    case RE_NODE_EMPTY:
+        return 0;
+
+    case RE_NODE_CLASS:
+        return Emit(program, RE_OP_CLASS, node->value, 0) < 0 ? -1 : 0;
+
+    case RE_NODE_CONCAT:
+        if (Compile(p, program, isReversed ? node->right : node->left, isReversed)) { return -1; }
+        return Compile(p, program, isReversed ? node->left : node->right, isReversed);
+
+    case RE_NODE_ALT:
+        if ((pc = Emit(program, RE_OP_SPLIT, 0, 0)) < 0) { return -1; }
+        program->insts[pc].x = pc + 1;
+        if (Compile(p, program, node->left, isReversed)) { return -1; }
+        if ((jmp = Emit(program, RE_OP_JMP, 0, 0)) < 0) { return -1; }
+        program->insts[pc].y = (int)program->len;
+        if (Compile(p, program, node->right, isReversed)) { return -1; }
+        program->insts[jmp].x = (int)program->len;
+        return 0;
+
+    case RE_NODE_REPEAT: {
+        for (int i = 0; i < node->min; ++i) {
+            if (Compile(p, program, node->left, isReversed)) { return -1; }
+        }
+
+        if (node->max == RE_INFINITY) {
+            // L: split body, end; body; jmp L
+            if ((pc = Emit(program, RE_OP_SPLIT, 0, 0)) < 0) { return -1; }
+            if (Compile(p, program, node->left, isReversed)) { return -1; }
+            if (Emit(program, RE_OP_JMP, pc, 0) < 0) { return -1; }
+
+            program->insts[pc].x = node->isGreedy ? pc + 1 : (int)program->len;
+            program->insts[pc].y = node->isGreedy ? (int)program->len : pc + 1;
+            return 0;
+        }
+
+        // optional copies: split body, end; body; split body, end; ...
+        int count = node->max - node->min;
+        int* splits = malloc(count * sizeof(int) + 1);
+        if (!splits) { return -1; }
+
+        for (int i = 0; i < count; ++i) {
+            if ((splits[i] = Emit(program, RE_OP_SPLIT, 0, 0)) < 0 || Compile(p, program, node->left, isReversed)) {
+                free(splits);
+                return -1;
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            RegexInst* inst = &program->insts[splits[i]];
+
+            inst->x = node->isGreedy ? splits[i] + 1 : (int)program->len;
+            inst->y = node->isGreedy ? (int)program->len : splits[i] + 1;
+        }
+        free(splits);
+        return 0;
+    }
+
+    case RE_NODE_GROUP:
+        if (node->value < 0 || isReversed) { return Compile(p, program, node->left, isReversed); }
+
+        if (Emit(program, RE_OP_SAVE, 2 * node->value, 0) < 0) { return -1; }
+        if (Compile(p, program, node->left, isReversed)) { return -1; }
+        return Emit(program, RE_OP_SAVE, 2 * node->value + 1, 0) < 0 ? -1 : 0;
+
+    case RE_NODE_ASSERT: {
+        int kind = node->value;
+
+        if (isReversed && kind == RE_ASSERT_BOL) {
+            kind = RE_ASSERT_EOL;
+        } else if (isReversed && kind == RE_ASSERT_EOL) {
+            kind = RE_ASSERT_BOL;
+        }
+        return Emit(program, RE_OP_ASSERT, kind, 0) < 0 ? -1 : 0;
+    }
+
+    case RE_NODE_BACKREF:
+        return Emit(program, RE_OP_BACKREF, node->value, 0) < 0 ? -1 : 0;
+
+    case RE_NODE_LOOK:
+        if ((pc = Emit(program, RE_OP_LOOK, 0, node->value)) < 0) { return -1; }
+        if (Compile(p, program, node->left, 0)) { return -1; }
+        if (Emit(program, RE_OP_LOOK_END, 0, 0) < 0) { return -1; }
+        program->insts[pc].x = (int)program->len;
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+// splits bytes into classes: bytes of a class belong to the same byte sets
+static void BuildByteClasses(Regex* regex) {
+    RegexClass extra[2] = { { { 0 } }, { { 0 } } };
+
+    // assertions distinguish line ends and word chars
+    AddToClass(&extra[0], '\n');
+    AddEscapeClass(&extra[1], 'w');
+
+    memset(regex->byteClasses, 0, sizeof(regex->byteClasses));
+    regex->classesCount = 1;
+
+    for (size_t i = 0; i < regex->classesLen + 2; ++i) {
+        const RegexClass* cls = i < regex->classesLen ? &regex->classes[i] : &extra[i - regex->classesLen];
+        uint16_t total[256] = { 0 };
+        uint16_t inside[256] = { 0 };
+        int16_t splitted[256];
+
+        for (unsigned c = 0; c < 256; ++c) {
+            ++total[regex->byteClasses[c]];
+            if (IsInClass(cls, (unsigned char)c)) { ++inside[regex->byteClasses[c]]; }
+        }
+        for (size_t k = 0; k < 256; ++k) { splitted[k] = -1; }
+
+        // a class is split if the set covers it partially
+        for (unsigned c = 0; c < 256; ++c) {
+            uint8_t old = regex->byteClasses[c];
+
+            if (!IsInClass(cls, (unsigned char)c) || inside[old] == total[old]) { continue; }
+            if (splitted[old] < 0) { splitted[old] = (int16_t)regex->classesCount++; }
+            regex->byteClasses[c] = (uint8_t)splitted[old];
+        }
+    }
+}
+
+// single char of a class (both cases with REGEX_IGNORE_CASE)
+static int GetSingleChar(const Regex* regex, const RegexClass* cls, unsigned char* c) {
+    size_t count = 0;
+    unsigned char found = 0;
+
+    for (unsigned i = 0; i < 256; ++i) {
+        if (IsInClass(cls, (unsigned char)i)) {
+            ++count;
+            found = (unsigned char)i;
+        }
+    }
+
+    if (count == 1) {
+        *c = found;
+        return 1;
+    }
+    if (count == 2 && (regex->flags & REGEX_IGNORE_CASE) && found >= 'a' && found <= 'z'
+        && IsInClass(cls, (unsigned char)(found - 'a' + 'A'))) {
+        *c = found;
+        return 1;
+    }
+    return 0;
+}
+
+// collects chars which start every match. Returns 1 if the whole node is a literal
+static int ExtractPrefix(const RegexParser* p, int index, char* prefix, size_t* len) {
+    const RegexNode* node = &p->nodes[index];
+    unsigned char c;
+
+    switch (node->type) {
+    case RE_NODE_EMPTY:
+        return 1;
+
+    case RE_NODE_CLASS:
+        if (*len < RE_MAX_PREFIX && GetSingleChar(p->regex, &p->regex->classes[node->value], &c)) {
+            prefix[(*len)++] = (char)c;
+            return 1;
+        }
+        return 0;
+
+    case RE_NODE_CONCAT:
+        return ExtractPrefix(p, node->left, prefix, len) && ExtractPrefix(p, node->right, prefix, len);
+
+    case RE_NODE_GROUP:
+        return ExtractPrefix(p, node->left, prefix, len);
+
+    case RE_NODE_REPEAT:
+        if (node->min > 0) { ExtractPrefix(p, node->left, prefix, len); }
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+
+// DFA
+static uint32_t HashThreads(const int* threads, size_t len, int flags) {
+    uint32_t hash = 2166136261u ^ (uint32_t)flags;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint32_t)threads[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int InitDfa(RegexDfa* dfa, const Regex* regex, const RegexProgram* program, int isUnanchored, int isLongest) {
+    memset(dfa, 0, sizeof(RegexDfa));
+
+    dfa->program = program;
+    dfa->classes = regex->classes;
+    dfa->byteClasses = regex->byteClasses;
+    dfa->classesCount = regex->classesCount;
+    dfa->isUnanchored = isUnanchored;
+    dfa->isLongest = isLongest;
+
+    for (size_t i = 0; i < 4; ++i) { dfa->startStates[i] = RE_UNKNOWN; }
+
+    dfa->list = malloc(program->len * sizeof(int));
+    dfa->nextList = malloc(program->len * sizeof(int));
+    dfa->marks = calloc(program->len, sizeof(uint32_t));
+    dfa->stack = malloc((2 * program->len + 2) * sizeof(int));
+
+    return (dfa->list && dfa->nextList && dfa->marks && dfa->stack) ? ERR_SUCCESS : ERR_NOMEM;
+}
+
+static void ResetDfa(RegexDfa* dfa) {
+    for (size_t i = 0; i < dfa->statesLen; ++i) { free(dfa->states[i]); }
+    dfa->statesLen = 0;
+    dfa->memory = 0;
+
+    if (dfa->table) {
+        for (size_t i = 0; i < dfa->tableSize; ++i) { dfa->table[i] = RE_UNKNOWN; }
+    }
+    for (size_t i = 0; i < 4; ++i) { dfa->startStates[i] = RE_UNKNOWN; }
+}
+
+static void FreeDfa(RegexDfa* dfa) {
+    ResetDfa(dfa);
+    free(dfa->states);
+    free(dfa->trans);
+    free(dfa->table);
+    free(dfa->list);
+    free(dfa->nextList);
+    free(dfa->marks);
+    free(dfa->stack);
+    memset(dfa, 0, sizeof(RegexDfa));
+}
+
+static void NextMark(RegexDfa* dfa) {
+    if (++dfa->mark == 0) {
+        memset(dfa->marks, 0, dfa->program->len * sizeof(uint32_t));
+        dfa->mark = 1;
+    }
+}
+
+static int IsAssertTrue(int kind, int prevKind, int nextKind) {
+    switch (kind) {
+    case RE_ASSERT_BOL:
+        return prevKind == RE_KIND_EDGE || prevKind == RE_KIND_NEWLINE;
+    case RE_ASSERT_EOL:
+        return nextKind == RE_KIND_EDGE || nextKind == RE_KIND_NEWLINE;
+    case RE_ASSERT_WORD:
+        return (prevKind == RE_KIND_WORD) != (nextKind == RE_KIND_WORD);
+    case RE_ASSERT_NOT_WORD:
+        return (prevKind == RE_KIND_WORD) == (nextKind == RE_KIND_WORD);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Adds a thread and its epsilon closure to a list in priority order.
+ * Assertions are checked if the next byte is known (nextKind >= 0), otherwise they wait in the list.
+ */
+static void AddThread(RegexDfa* dfa, int startPc, int* list, size_t* len, int prevKind, int nextKind) {
+    const RegexInst* insts = dfa->program->insts;
+    size_t top = 0;
+
+    dfa->stack[top++] = startPc;
+    while (top > 0) {
+        int pc = dfa->stack[--top];
+
+        if (dfa->marks[pc] == dfa->mark) { continue; }
+        dfa->marks[pc] = dfa->mark;
+
+        switch (insts[pc].op) {
+        case RE_OP_JMP:
+            dfa->stack[top++] = insts[pc].x;
+            break;
+
+        case RE_OP_SPLIT:
+            // x is processed first
+            dfa->stack[top++] = insts[pc].y;
+            dfa->stack[top++] = insts[pc].x;
+            break;
+
+        case RE_OP_SAVE:
+            dfa->stack[top++] = pc + 1;
+            break;
+
+        case RE_OP_ASSERT:
+            if (nextKind < 0) {
+                list[(*len)++] = pc;
+            } else if (IsAssertTrue(insts[pc].x, prevKind, nextKind)) {
+                dfa->stack[top++] = pc + 1;
+            }
+            break;
+
+        default:
+            // RE_OP_CLASS, RE_OP_MATCH
+            list[(*len)++] = pc;
+            break;
+        }
+    }
+}
+
+static size_t GetStateSize(const RegexDfa* dfa, size_t threadsLen) {
+    return sizeof(RegexState) + threadsLen * sizeof(int) + dfa->classesCount * sizeof(int32_t)
+        + sizeof(RegexState*) + 2 * sizeof(int32_t);
+}
+
+static int GrowTable(RegexDfa* dfa) {
+    size_t size = dfa->tableSize ? 2 * dfa->tableSize : 256;
+    int32_t* table = malloc(size * sizeof(int32_t));
+
+    if (!table) { return ERR_NOMEM; }
+    for (size_t i = 0; i < size; ++i) { table[i] = RE_UNKNOWN; }
+
+    for (size_t i = 0; i < dfa->statesLen; ++i) {
+        size_t slot = dfa->states[i]->hash & (size - 1);
+
+        while (table[slot] >= 0) { slot = (slot + 1) & (size - 1); }
+        table[slot] = (int32_t)i;
+    }
+
+    free(dfa->table);
+    dfa->table = table;
+    dfa->tableSize = size;
+    return ERR_SUCCESS;
+}
+
+static int GrowStates(RegexDfa* dfa) {
+    size_t size = dfa->statesSize ? 2 * dfa->statesSize : 64;
+
+    COUNTER_ADD(COUNTER_REALLOCATIONS, 2);
+    RegexState** states = realloc(dfa->states, size * sizeof(RegexState*));
+    if (!states) { return ERR_NOMEM; }
+    dfa->states = states;
+
+    int32_t* trans = realloc(dfa->trans, size * dfa->classesCount * sizeof(int32_t));
+    if (!trans) { return ERR_NOMEM; }
+    dfa->trans = trans;
+
+    dfa->statesSize = size;
+    return ERR_SUCCESS;
+}
+
+/**
+ * Finds a state or adds it to the cache. The cache is flushed if it's full
+ * (the flush is visible by dfa->resets). Returns RE_FAILED if there is no memory.
+ */
+static int32_t GetState(RegexDfa* dfa, const int* threads, size_t len, int flags) {
+    uint32_t hash = HashThreads(threads, len, flags);
+
+    if (dfa->tableSize) {
+        for (size_t slot = hash & (dfa->tableSize - 1); dfa->table[slot] >= 0; slot = (slot + 1) & (dfa->tableSize - 1)) {
+            const RegexState* state = dfa->states[dfa->table[slot]];
+
+            if (state->hash == hash && state->flags == flags && state->threadsLen == len
+                && !memcmp(state->threads, threads, len * sizeof(int))) {
+                return dfa->table[slot];
+            }
+        }
+    }
+
+    size_t size = GetStateSize(dfa, len);
+    if (dfa->statesLen > 0 && dfa->memory + size > REGEX_DFA_MEMORY) {
+        ResetDfa(dfa);
+        ++dfa->resets;
+    }
+
+    if (2 * (dfa->statesLen + 1) > dfa->tableSize && GrowTable(dfa)) { return RE_FAILED; }
+    if (dfa->statesLen == dfa->statesSize && GrowStates(dfa)) { return RE_FAILED; }
+
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
+    RegexState* state = malloc(sizeof(RegexState) + len * sizeof(int));
+    if (!state) { return RE_FAILED; }
+
+    state->threads = (int*)(state + 1);
+    state->threadsLen = len;
+    state->flags = flags;
+    state->hash = hash;
+    memcpy(state->threads, threads, len * sizeof(int));
+
+    int32_t* row = dfa->trans + dfa->statesLen * dfa->classesCount;
+    for (size_t i = 0; i < dfa->classesCount; ++i) { row[i] = RE_UNKNOWN; }
+
+    size_t slot = hash & (dfa->tableSize - 1);
+    while (dfa->table[slot] >= 0) { slot = (slot + 1) & (dfa->tableSize - 1); }
+    dfa->table[slot] = (int32_t)dfa->statesLen;
+
+    dfa->states[dfa->statesLen] = state;
+    dfa->memory += size;
+
+    return (int32_t)dfa->statesLen++;
+}
+
+// transition to a state: its row in the table and flags
+static int32_t EncodeTransition(const RegexDfa* dfa, int32_t index, int isMatch) {
+    const RegexState* state = dfa->states[index];
+    int32_t flags = isMatch ? RE_TRANS_MATCH : 0;
+
+    if (state->threadsLen == 0) { flags |= RE_TRANS_DEAD; }
+    if (state->flags & RE_STATE_START) { flags |= RE_TRANS_START; }
+
+    return ((int32_t)(index * dfa->classesCount) << RE_TRANS_SHIFT) | flags;
+}
+
+static int32_t GetStateIndex(const RegexDfa* dfa, int32_t transition) {
+    return (transition >> RE_TRANS_SHIFT) / (int32_t)dfa->classesCount;
+}
+
+// returns the transition to the start state or RE_FAILED
+static int32_t GetStartState(RegexDfa* dfa, int prevKind) {
+    if (dfa->startStates[prevKind] < 0) {
+        size_t len = 0;
+
+        NextMark(dfa);
+        AddThread(dfa, 0, dfa->list, &len, prevKind, -1);
+
+        int32_t index = GetState(dfa, dfa->list, len, prevKind | (dfa->isUnanchored ? RE_STATE_START : 0));
+        if (index < 0) { return RE_FAILED; }
+        dfa->startStates[prevKind] = index;
+    }
+
+    return EncodeTransition(dfa, dfa->startStates[prevKind], 0);
+}
+
+// returns the transition from a state by the byte or RE_FAILED
+static int32_t ComputeNext(RegexDfa* dfa, int32_t index, unsigned char c) {
+    const RegexState* state = dfa->states[index];
+    const RegexInst* insts = dfa->program->insts;
+    int prevKind = state->flags & RE_STATE_KIND_MASK;
+    int nextKind = GetKind(c);
+    int isMatched = state->flags & RE_STATE_MATCHED;
+    int isMatch = 0;
+    size_t len = 0;
+    size_t nextLen = 0;
+
+    // threads between the previous byte and c
+    NextMark(dfa);
+    for (size_t i = 0; i < state->threadsLen; ++i) {
+        AddThread(dfa, state->threads[i], dfa->list, &len, prevKind, nextKind);
+    }
+
+    // threads of lower priority than a match are cut (leftmost-first), the longest match keeps them
+    for (size_t i = 0; i < len; ++i) {
+        if (insts[dfa->list[i]].op == RE_OP_MATCH) {
+            isMatch = 1;
+            if (!dfa->isLongest) {
+                len = i;
+                break;
+            }
+        }
+    }
+    if (isMatch && dfa->isUnanchored) { isMatched = RE_STATE_MATCHED; }
+
+    NextMark(dfa);
+    for (size_t i = 0; i < len; ++i) {
+        const RegexInst* inst = &insts[dfa->list[i]];
+
+        if (inst->op == RE_OP_CLASS && IsInClass(&dfa->classes[inst->x], c)) {
+            AddThread(dfa, dfa->list[i] + 1, dfa->nextList, &nextLen, nextKind, -1);
+        }
+    }
+
+    // a new match may start after c (with the lowest priority)
+    int flags = nextKind | isMatched;
+    if (dfa->isUnanchored && !isMatched) {
+        if (nextLen == 0) { flags |= RE_STATE_START; }
+        AddThread(dfa, 0, dfa->nextList, &nextLen, nextKind, -1);
+    }
+
+    size_t resets = dfa->resets;
+    int32_t next = GetState(dfa, dfa->nextList, nextLen, flags);
+    if (next < 0) { return RE_FAILED; }
+
+    int32_t transition = EncodeTransition(dfa, next, isMatch);
+    if (resets == dfa->resets) { dfa->trans[index * dfa->classesCount + dfa->byteClasses[c]] = transition; }
+
+    return transition;
+}
+
+// checks a match at the end of the scanned text
+static int IsFinalMatch(RegexDfa* dfa, int32_t index, int nextKind) {
+    const RegexState* state = dfa->states[index];
+    size_t len = 0;
+
+    NextMark(dfa);
+    for (size_t i = 0; i < state->threadsLen; ++i) {
+        AddThread(dfa, state->threads[i], dfa->list, &len, state->flags & RE_STATE_KIND_MASK, nextKind);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (dfa->program->insts[dfa->list[i]].op == RE_OP_MATCH) { return 1; }
+    }
+    return 0;
+}
+
+
+// Scanning
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+static ModelPos GetPosAt(const DocSpan* span, size_t i) {
+    ModelPos pos = span->pos;
+
+    pos.pos.x += i;
+    return pos;
+}
+
+static ModelPos GetPosAfter(const DocSpan* span, size_t i) {
+    ModelPos pos = span->pos;
+
+    if (span->isLineEnd) {
+        pos.block = pos.block->next;
+        ++pos.pos.y;
+        pos.pos.x = 0;
+    } else {
+        pos.pos.x += i + 1;
+    }
+    return pos;
+}
+
+static int GetKindBefore(const Document* doc, ModelPos pos) {
+    DocIterator it;
+    DocSpan span;
+
+    InitDocIterator(&it, doc, pos, DOC_ITER_LINE_ENDS | DOC_ITER_BACKWARD);
+    return DocNextSpan(&it, &span) ? GetKind((unsigned char)span.ptr[span.len - 1]) : RE_KIND_EDGE;
+}
+
+static int GetKindAfter(const Document* doc, ModelPos pos) {
+    DocIterator it;
+    DocSpan span;
+
+    InitDocIterator(&it, doc, pos, DOC_ITER_LINE_ENDS);
+    return DocNextSpan(&it, &span) ? GetKind((unsigned char)span.ptr[0]) : RE_KIND_EDGE;
+}
+
+static ModelPos GetDocEdge(const Document* doc, SearchDirection direction) {
+    ModelPos pos;
+
+    if (direction == SEARCH_FORWARD) {
+        pos.block = doc->blocks->last;
+        pos.pos.y = doc->blocks->len - 1;
+        pos.pos.x = pos.block->data.len;
+    } else {
+        pos.block = doc->blocks->nodes;
+        pos.pos.y = 0;
+        pos.pos.x = 0;
+    }
+    return pos;
+}
+
+// bytes [*begin, *end) of a span are before the limit (forward) or at/after it (backward)
+static int ClipSpan(const DocSpan* span, const ModelPos* limit, SearchDirection direction, size_t* begin, size_t* end) {
+    size_t x = span->pos.pos.x;
+
+    *begin = 0;
+    *end = span->len;
+    if (!limit) { return 0; }
+
+    if (direction == SEARCH_FORWARD) {
+        if (span->pos.pos.y < limit->pos.y) { return 0; }
+        *end = (span->pos.pos.y == limit->pos.y && limit->pos.x > x) ? MIN(limit->pos.x - x, span->len) : 0;
+        return *end < span->len;
+    }
+
+    if (span->pos.pos.y > limit->pos.y) { return 0; }
+    if (span->pos.pos.y < limit->pos.y) {
+        *begin = span->len;
+        return 1;
+    }
+    *begin = limit->pos.x > x ? MIN(limit->pos.x - x, span->len) : 0;
+    return *begin > 0;
+}
+
+/**
+ * Runs a DFA over the text from a position until the DFA dies, the limit or the edge of the text.
+ * IN:
+ * @param fromKind - kind of the byte before the start (in the scan order)
+ * @param limit - pointer to the last position of the scan (NULL - the edge of the text)
+ * @param limitKind - kind of the byte after the limit (in the scan order)
+ * @param prefix - literal which starts every match (only for forward unanchored scans) or NULL
+ * @param startLimit - pointer to the end of positions where a match may start
+ *                     (only for forward unanchored scans) or NULL
+ *
+ * OUT:
+ * @return isFound - 1 if a match is found (pos - the last end of a match in the scan order), 0 if not, -1 on error
+ */
+static int RunDfa(const Document* doc, RegexDfa* dfa, SearchDirection direction, ModelPos from, int fromKind,
+                    const ModelPos* limit, int limitKind, const Literal* prefix, const ModelPos* startLimit, ModelPos* pos) {
+    DocIterator it;
+    DocSpan span;
+    int isFound = 0;
+    int isLimited = 0;
+    int32_t transition = GetStartState(dfa, fromKind);
+
+    if (transition < 0) { return -1; }
+
+    InitDocIterator(&it, doc, from, DOC_ITER_LINE_ENDS | (direction == SEARCH_BACKWARD ? DOC_ITER_BACKWARD : DOC_ITER_FORWARD));
+
+    while (!isLimited && DocNextSpan(&it, &span)) {
+        const unsigned char* data = (const unsigned char*)span.ptr;
+        const uint8_t* byteClasses = dfa->byteClasses;
+        size_t begin, end;
+
+        isLimited = ClipSpan(&span, limit, direction, &begin, &end);
+
+        if (direction == SEARCH_BACKWARD) {
+            for (size_t i = end; i > begin; --i) {
+                int32_t next = dfa->trans[(transition >> RE_TRANS_SHIFT) + byteClasses[data[i - 1]]];
+
+                if (next < 0 && (next = ComputeNext(dfa, GetStateIndex(dfa, transition), data[i - 1])) < 0) { return -1; }
+                transition = next;
+
+                if (transition & (RE_TRANS_MATCH | RE_TRANS_DEAD)) {
+                    if (transition & RE_TRANS_MATCH) {
+                        isFound = 1;
+                        *pos = GetPosAfter(&span, i - 1);
+                    }
+                    if (transition & RE_TRANS_DEAD) { return isFound; }
+                }
+            }
+            continue;
+        }
+
+        size_t startsEnd = end;     // bytes where a match may start
+        if (startLimit) {
+            size_t startsBegin;
+
+            ClipSpan(&span, startLimit, SEARCH_FORWARD, &startsBegin, &startsEnd);
+            startsEnd = MIN(startsEnd, end);
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            // the DFA is waiting for a match start
+            if ((transition & RE_TRANS_START) && (i >= startsEnd || prefix)) {
+                // no more matches may start
+                if (i >= startsEnd) { return isFound; }
+
+                // skip to the next occurrence of the prefix
+                size_t searchEnd = MIN(end, startsEnd + prefix->len - 1);
+                const char* occurrence = FindLiteralInSpan(prefix, span.ptr + i, searchEnd - i);
+                size_t skipped = occurrence ? (size_t)(occurrence - span.ptr)
+                                            : MAX(i, searchEnd - MIN(searchEnd, prefix->len - 1));
+
+                if (skipped > i) {
+                    if ((transition = GetStartState(dfa, GetKind(data[skipped - 1]))) < 0) { return -1; }
+                    i = skipped;
+                    if (i == end) { break; }
+                    if (i >= startsEnd) { return isFound; }
+                }
+            }
+
+            int32_t next = dfa->trans[(transition >> RE_TRANS_SHIFT) + byteClasses[data[i]]];
+
+            if (next < 0 && (next = ComputeNext(dfa, GetStateIndex(dfa, transition), data[i])) < 0) { return -1; }
+            transition = next;
+
+            if (transition & (RE_TRANS_MATCH | RE_TRANS_DEAD)) {
+                if (transition & RE_TRANS_MATCH) {
+                    isFound = 1;
+                    *pos = GetPosAt(&span, i);
+                }
+                if (transition & RE_TRANS_DEAD) { return isFound; }
+            }
+        }
+    }
+
+    // the edge of the scanned text
+    if (IsFinalMatch(dfa, GetStateIndex(dfa, transition), isLimited ? limitKind : RE_KIND_EDGE)) {
+        isFound = 1;
+        *pos = isLimited ? *limit : GetDocEdge(doc, direction);
+    }
+
+    return isFound;
+}
+
+
+// Backtracking (patterns with backreferences and lookaheads), a block at a time
+#define RE_LOOP_SLOT (2 * REGEX_MAX_GROUPS)   // slots from it restore loops[slot - RE_LOOP_SLOT]
+
+typedef struct {
+    int pc;
+    size_t pos;
+    int slot;           // >= 0: the job restores the slot
+    size_t value;
+} BacktrackJob;
+
+typedef struct {
+    const Regex* regex;
+    const char* text;
+    size_t len;
+    int beforeKind;     // kind of the byte before the text
+    int afterKind;      // kind of the byte after the text
+    size_t* loops;      // position of the last iteration of a loop by pc of its back jump (SIZE_MAX - none)
+    BacktrackJob* jobs;
+    size_t jobsSize;
+    size_t steps;
+} Backtracker;
+
+static int PushJob(Backtracker* bt, size_t* top, int pc, size_t pos, int slot, size_t value) {
+    if (*top == bt->jobsSize) {
+        size_t size = bt->jobsSize ? 2 * bt->jobsSize : 256;
+        BacktrackJob* jobs = realloc(bt->jobs, size * sizeof(BacktrackJob));
+
+        if (!jobs) { return ERR_NOMEM; }
+        bt->jobs = jobs;
+        bt->jobsSize = size;
+    }
+
+    bt->jobs[*top].pc = pc;
+    bt->jobs[*top].pos = pos;
+    bt->jobs[*top].slot = slot;
+    bt->jobs[*top].value = value;
+    ++*top;
+    return ERR_SUCCESS;
+}
+
+static void RestoreSlot(Backtracker* bt, size_t* caps, const BacktrackJob* job) {
+    if (job->slot >= RE_LOOP_SLOT) {
+        bt->loops[job->slot - RE_LOOP_SLOT] = job->value;
+    } else {
+        caps[job->slot] = job->value;
+    }
+}
+
+static int GetKindAt(const Backtracker* bt, size_t pos, int isBefore) {
+    if (isBefore) { return pos == 0 ? bt->beforeKind : GetKind((unsigned char)bt->text[pos - 1]); }
+    return pos == bt->len ? bt->afterKind : GetKind((unsigned char)bt->text[pos]);
+}
+
+static int IsBackrefMatch(const Backtracker* bt, const size_t* caps, int group, size_t pos, size_t* len) {
+    size_t start = caps[2 * group];
+    size_t end = caps[2 * group + 1];
+
+    if (start == SIZE_MAX || end == SIZE_MAX || end < start) { return 0; }
+
+    *len = end - start;
+    if (pos + *len > bt->len) { return 0; }
+
+    for (size_t i = 0; i < *len; ++i) {
+        unsigned char a = (unsigned char)bt->text[start + i];
+        unsigned char b = (unsigned char)bt->text[pos + i];
+
+        if ((bt->regex->flags & REGEX_IGNORE_CASE) ? FoldChar(a) != FoldChar(b) : a != b) { return 0; }
+    }
+    return 1;
+}
+
+/**
+ * Runs the program from pc at pos. Jobs of outer calls (lookaheads) stay under the base.
+ * Returns 1 on a match (caps are filled), 0 if there is no match, -1 on error or the step limit.
+ */
+static int Backtrack(Backtracker* bt, int startPc, size_t start, size_t* caps, size_t base) {
+    const RegexInst* insts = bt->regex->forward.insts;
+    size_t top = base;
+    int result = 0;
+
+    if (PushJob(bt, &top, startPc, start, -1, 0)) { return -1; }
+
+    while (top > base && result == 0) {
+        BacktrackJob job = bt->jobs[--top];
+
+        if (job.slot >= 0) {
+            RestoreSlot(bt, caps, &job);
+            continue;
+        }
+
+        int pc = job.pc;
+        size_t pos = job.pos;
+
+        while (result == 0) {
+            const RegexInst* inst = &insts[pc];
+            size_t len;
+
+            if (++bt->steps > REGEX_BACKTRACK_LIMIT) { return -1; }
+
+            if (inst->op == RE_OP_CLASS) {
+                if (pos >= bt->len || !IsInClass(&bt->regex->classes[inst->x], (unsigned char)bt->text[pos])) { break; }
+                ++pc;
+                ++pos;
+            } else if (inst->op == RE_OP_SPLIT) {
+                if (PushJob(bt, &top, inst->y, pos, -1, 0)) { return -1; }
+                pc = inst->x;
+            } else if (inst->op == RE_OP_JMP) {
+                if (inst->x < pc) {
+                    // an iteration of a loop which consumes nothing ends the loop
+                    if (bt->loops[pc] == pos) { break; }
+                    if (PushJob(bt, &top, 0, 0, RE_LOOP_SLOT + pc, bt->loops[pc])) { return -1; }
+                    bt->loops[pc] = pos;
+                }
+                pc = inst->x;
+            } else if (inst->op == RE_OP_SAVE) {
+                if (PushJob(bt, &top, 0, 0, inst->x, caps[inst->x])) { return -1; }
+                caps[inst->x] = pos;
+                ++pc;
+            } else if (inst->op == RE_OP_ASSERT) {
+                if (!IsAssertTrue(inst->x, GetKindAt(bt, pos, 1), GetKindAt(bt, pos, 0))) { break; }
+                ++pc;
+            } else if (inst->op == RE_OP_BACKREF) {
+                if (!IsBackrefMatch(bt, caps, inst->x, pos, &len)) { break; }
+                pos += len;
+                ++pc;
+            } else if (inst->op == RE_OP_LOOK) {
+                size_t lookCaps[2 * REGEX_MAX_GROUPS];
+
+                memcpy(lookCaps, caps, sizeof(lookCaps));
+                int isLookMatch = Backtrack(bt, pc + 1, pos, lookCaps, top);
+
+                if (isLookMatch < 0) { return -1; }
+                if (isLookMatch == inst->y) { break; }
+                pc = inst->x;
+            } else {
+                // RE_OP_LOOK_END, RE_OP_MATCH
+                result = 1;
+            }
+        }
+    }
+
+    // loops are restored for the next run, captures are kept
+    while (top > base) {
+        --top;
+        if (bt->jobs[top].slot >= RE_LOOP_SLOT) { RestoreSlot(bt, caps, &bt->jobs[top]); }
+    }
+    return result;
+}
+
+// copies chars of a block to the buffer
+static int CopyBlock(const Document* doc, const Block* block, char** buffer, size_t* bufferSize) {
+    if (block->data.len > *bufferSize) {
+        COUNTER_ADD(COUNTER_REALLOCATIONS, 1);
+        char* tmp = realloc(*buffer, block->data.len);
+
+        if (!tmp) { return ERR_NOMEM; }
+        *buffer = tmp;
+        *bufferSize = block->data.len;
+    }
+
+    size_t len = 0;
+    for (const Fragment* fragment = block->data.fragments->nodes; fragment; fragment = fragment->next) {
+        COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, 1);
+        if (!fragment->data.len) { continue; }
+
+        memcpy(*buffer + len, doc->text->data + fragment->data.pos, fragment->data.len);
+        len += fragment->data.len;
+    }
+    return ERR_SUCCESS;
+}
+
+// runs the program at starts of a block: forward - from the start up to startsEnd, backward - from the end down
+static int BacktrackBlock(Backtracker* bt, size_t from, size_t startsEnd, SearchDirection direction, size_t* caps) {
+    const Literal* prefix = bt->regex->prefix;
+    size_t start = from;
+
+    for (;;) {
+        if (direction == SEARCH_FORWARD && start >= startsEnd) { return 0; }
+
+        if (direction == SEARCH_FORWARD && prefix) {
+            const char* occurrence = FindLiteralInSpan(prefix, bt->text + start, bt->len - start);
+
+            if (!occurrence) { return 0; }
+            start = occurrence - bt->text;
+
+            // the prefix may be found after the starts
+            if (start >= startsEnd) { return 0; }
+        }
+
+        for (size_t i = 0; i < 2 * REGEX_MAX_GROUPS; ++i) { caps[i] = SIZE_MAX; }
+
+        int result = Backtrack(bt, 0, start, caps, 0);
+        if (result != 0) { return result; }
+
+        if (direction == SEARCH_FORWARD) {
+            if (start == bt->len) { return 0; }
+            ++start;
+        } else {
+            if (start == 0) { return 0; }
+            --start;
+        }
+    }
+}
+
+static int FindBacktracking(const Document* doc, const Regex* regex, ModelPos from, const ModelPos* to,
+                            SearchDirection direction, RegexMatch* match) {
+    Backtracker bt = { regex, NULL, 0, RE_KIND_EDGE, RE_KIND_EDGE, NULL, NULL, 0, 0 };
+    char* buffer = NULL;
+    size_t bufferSize = 0;
+    size_t caps[2 * REGEX_MAX_GROUPS];
+    ModelPos pos = from;
+    int isFound = 0;
+
+    bt.loops = malloc(regex->forward.len * sizeof(size_t));
+    if (!bt.loops) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return 0;
+    }
+
+    while (pos.block && (!to || pos.pos.y <= to->pos.y)) {
+        Block* block = pos.block;
+        size_t startsEnd = (to && pos.pos.y == to->pos.y) ? to->pos.x : block->data.len + 1;
+
+        if (CopyBlock(doc, block, &buffer, &bufferSize)) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            break;
+        }
+
+        bt.text = buffer;
+        bt.len = block->data.len;
+        bt.beforeKind = block->prev ? RE_KIND_NEWLINE : RE_KIND_EDGE;
+        bt.afterKind = block->next ? RE_KIND_NEWLINE : RE_KIND_EDGE;
+        bt.steps = 0;
+
+        // a backward match ends at or before the position
+        if (direction == SEARCH_BACKWARD && pos.pos.x < bt.len) {
+            bt.afterKind = GetKind((unsigned char)buffer[pos.pos.x]);
+            bt.len = pos.pos.x;
+        }
+
+        for (size_t i = 0; i < regex->forward.len; ++i) { bt.loops[i] = SIZE_MAX; }
+
+        // the step limit skips the rest of the block
+        if (BacktrackBlock(&bt, pos.pos.x, startsEnd, direction, caps) > 0) {
+            isFound = 1;
+            match->start = pos;
+            match->start.pos.x = caps[0];
+            match->end = pos;
+            match->end.pos.x = caps[1];
+            break;
+        }
+
+        if (direction == SEARCH_FORWARD) {
+            pos.block = block->next;
+            ++pos.pos.y;
+            pos.pos.x = 0;
+        } else {
+            pos.block = block->prev;
+            if (pos.block) {
+                --pos.pos.y;
+                pos.pos.x = pos.block->data.len;
+            }
+        }
+    }
+
+    free(buffer);
+    free(bt.loops);
+    free(bt.jobs);
+    return isFound;
+}
+
+
+Regex* CreateRegex(const char* pattern, size_t len, int flags) {
+    assert(pattern);
+    TRACE_SCOPE("CreateRegex");
+
+    Regex* regex = calloc(1, sizeof(Regex));
+    if (!regex) { return NULL; }
+
+    regex->flags = flags;
+    regex->groups = 1;
+
+    RegexParser p = { pattern, len, 0, regex, NULL, 0, 0, 0 };
+    int root = ParseAlt(&p);
+
+    // a ')' without '('
+    if (!IsEnd(&p)) { SetParseError(&p); }
+
+    if (p.isError || root < 0) {
+        PrintError(NULL, ERR_PARAM, __FILE__, __LINE__);
+        free(p.nodes);
+        DestroyRegex(&regex);
+        return NULL;
+    }
+
+    int isError = 0;
+
+    // forward: save 0, pattern, save 1, match
+    isError |= Emit(&regex->forward, RE_OP_SAVE, 0, 0) < 0;
+    isError |= Compile(&p, &regex->forward, root, 0);
+    isError |= Emit(&regex->forward, RE_OP_SAVE, 1, 0) < 0;
+    isError |= Emit(&regex->forward, RE_OP_MATCH, 0, 0) < 0;
+
+    if (!regex->isBacktracking) {
+        isError |= Compile(&p, &regex->backward, root, 1);
+        isError |= Emit(&regex->backward, RE_OP_MATCH, 0, 0) < 0;
+    }
+
+    char prefix[RE_MAX_PREFIX];
+    size_t prefixLen = 0;
+
+    ExtractPrefix(&p, root, prefix, &prefixLen);
+    if (!isError && prefixLen > 0) {
+        regex->prefix = CreateLiteral(prefix, prefixLen, (flags & REGEX_IGNORE_CASE) ? SEARCH_IGNORE_CASE : SEARCH_MATCH_CASE);
+        isError |= !regex->prefix;
+    }
+    free(p.nodes);
+
+    if (!isError && !regex->isBacktracking) {
+        BuildByteClasses(regex);
+
+        isError |= InitDfa(&regex->forwardDfa, regex, &regex->forward, 1, 0) != ERR_SUCCESS;
+        isError |= InitDfa(&regex->startDfa, regex, &regex->backward, 0, 1) != ERR_SUCCESS;
+        isError |= InitDfa(&regex->backwardDfa, regex, &regex->backward, 1, 0) != ERR_SUCCESS;
+        isError |= InitDfa(&regex->endDfa, regex, &regex->forward, 0, 0) != ERR_SUCCESS;
+    }
+
+    if (isError) {
+        // too large program or no memory
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        DestroyRegex(&regex);
+        return NULL;
+    }
+
+    return regex;
+}
+
+void DestroyRegex(Regex** ppRegex) {
+    assert(ppRegex);
+
+    Regex* regex = *ppRegex;
+    if (!regex) { return; }
+
+    FreeDfa(&regex->forwardDfa);
+    FreeDfa(&regex->startDfa);
+    FreeDfa(&regex->backwardDfa);
+    FreeDfa(&regex->endDfa);
+    DestroyLiteral(&regex->prefix);
+    free(regex->forward.insts);
+    free(regex->backward.insts);
+    free(regex->classes);
+    free(regex);
+
+    *ppRegex = NULL;
+}
+
+// searches from a position; forward matches must start before the limit (NULL - no limit)
+static int Find(const Document* doc, Regex* regex, ModelPos from, const ModelPos* to, SearchDirection direction, RegexMatch* match) {
+    if (regex->isBacktracking) { return FindBacktracking(doc, regex, from, to, direction, match); }
+
+    int result;
+
+    if (direction == SEARCH_FORWARD) {
+        int fromKind = GetKindBefore(doc, from);
+
+        result = RunDfa(doc, &regex->forwardDfa, SEARCH_FORWARD, from, fromKind, NULL, 0, regex->prefix, to, &match->end);
+        if (result > 0) {
+            result = RunDfa(doc, &regex->startDfa, SEARCH_BACKWARD, match->end, GetKindAfter(doc, match->end),
+                            &from, fromKind, NULL, NULL, &match->start);
+        }
+
+        // the leftmost match starts after the limit: no match starts before it
+        if (result > 0 && to && !IsBefore(&match->start, to)) { result = 0; }
+    } else {
+        int fromKind = GetKindAfter(doc, from);
+
+        result = RunDfa(doc, &regex->backwardDfa, SEARCH_BACKWARD, from, fromKind, NULL, 0, NULL, NULL, &match->start);
+        if (result > 0) {
+            result = RunDfa(doc, &regex->endDfa, SEARCH_FORWARD, match->start, GetKindBefore(doc, match->start),
+                            &from, fromKind, NULL, NULL, &match->end);
+        }
+    }
+
+    if (result < 0) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return 0;
+    }
+    return result;
+}
+
+int FindRegex(const Document* doc, Regex* regex, ModelPos from, SearchDirection direction, RegexMatch* match) {
+    assert(doc && regex && match && from.block);
+
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("FindRegex");
+
+    return Find(doc, regex, from, NULL, direction, match);
+}
+
+int FindRegexInRange(const Document* doc, Regex* regex, ModelPos from, const ModelPos* to, RegexMatch* match) {
+    assert(doc && regex && match && from.block);
+
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("FindRegexInRange");
+
+    return Find(doc, regex, from, to, SEARCH_FORWARD, match);
+}
+
+// the position which is count chars after a position (a line end is a char)
+static ModelPos MovePos(ModelPos pos, size_t count) {
+    pos.pos.x += count;
+    while (pos.pos.x > pos.block->data.len) {
+        pos.pos.x -= pos.block->data.len + 1;
+        pos.block = pos.block->next;
+        ++pos.pos.y;
+    }
+    return pos;
+}
+
+int GetRegexGroups(const Document* doc, const Regex* regex, const RegexMatch* match, RegexMatch* groups) {
+    assert(doc && regex && match && groups);
+
+    Backtracker bt = { regex, NULL, 0, RE_KIND_EDGE, RE_KIND_EDGE, NULL, NULL, 0, 0 };
+    char* buffer = NULL;
+    size_t bufferSize = 0;
+    size_t len = 0;
+    size_t caps[2 * REGEX_MAX_GROUPS];
+    DocIterator it;
+    DocSpan span;
+    int result = -1;
+
+    // only the text of the match: a path of the backtracker which needs the text after it fails there,
+    // and the first path which ends at the end of the match is the one the search found
+    InitDocIterator(&it, doc, match->start, DOC_ITER_LINE_ENDS);
+    while (DocNextSpan(&it, &span) && IsBefore(&span.pos, &match->end)) {
+        size_t spanLen = span.len;
+
+        if (span.pos.pos.y == match->end.pos.y) { spanLen = MIN(spanLen, match->end.pos.x - span.pos.pos.x); }
+
+        if (len + spanLen > bufferSize) {
+            size_t size = MAX(2 * bufferSize, len + spanLen);
+            char* tmp = realloc(buffer, size);
+
+            if (!tmp) { goto cleanup; }
+            buffer = tmp;
+            bufferSize = size;
+        }
+
+        memcpy(buffer + len, span.ptr, spanLen);
+        len += spanLen;
+    }
+
+    bt.loops = malloc(regex->forward.len * sizeof(size_t));
+    if (!bt.loops) { goto cleanup; }
+
+    bt.text = buffer;
+    bt.len = len;
+    bt.beforeKind = GetKindBefore(doc, match->start);
+    bt.afterKind = GetKindAfter(doc, match->end);
+
+    for (size_t i = 0; i < regex->forward.len; ++i) { bt.loops[i] = SIZE_MAX; }
+    for (size_t i = 0; i < 2 * REGEX_MAX_GROUPS; ++i) { caps[i] = SIZE_MAX; }
+
+    // the priorities of the backtracker are the ones of the DFA, so it takes the same path
+    result = Backtrack(&bt, 0, 0, caps, 0);
+    if (result > 0 && caps[1] != len) { result = 0; }
+
+    for (size_t i = 0; result > 0 && i < regex->groups; ++i) {
+        if (caps[2 * i] == SIZE_MAX || caps[2 * i + 1] == SIZE_MAX) {
+            groups[i].start.block = NULL;
+            groups[i].end.block = NULL;
+            continue;
+        }
+        groups[i].start = MovePos(match->start, caps[2 * i]);
+        groups[i].end = MovePos(match->start, caps[2 * i + 1]);
+    }
+
+cleanup:
+    if (result < 0 && bt.steps <= REGEX_BACKTRACK_LIMIT) { PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__); }
+
+    free(buffer);
+    free(bt.loops);
+    free(bt.jobs);
+    return result > 0;
+}
@@ -0,0 +1,187 @@
+#pragma once
+#ifndef REGEX_H_INCLUDED
+#define REGEX_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Search.h"
+
+#define REGEX_MAX_GROUPS 10             // \0 (whole match) .. \9
+#define REGEX_MAX_PROGRAM 20000         // max count of instructions (counted repeats are expanded)
+#define REGEX_DFA_MEMORY (2 << 20)      // memory of cached DFA states; the cache is flushed when it's full
+#define REGEX_BACKTRACK_LIMIT (1 << 24) // max steps of the backtracking matcher per block
+
+typedef enum {
+    REGEX_MATCH_CASE    = 0,
+    REGEX_IGNORE_CASE   = 1 << 0    // ASCII letters only
+} RegexFlags;
+
+typedef enum {
+    RE_OP_CLASS,        // consumes a byte of the class x
+    RE_OP_SPLIT,        // continues at x (preferred) and y
+    RE_OP_JMP,          // continues at x
+    RE_OP_SAVE,         // saves the position to the slot x (captures)
+    RE_OP_ASSERT,       // checks the assertion x (RegexAssert) between the previous and the next bytes
+    RE_OP_BACKREF,      // matches the text of the group x (backtracking only)
+    RE_OP_LOOK,         // lookahead of the program at pc + 1, continues at x, y - is negative (backtracking only)
+    RE_OP_LOOK_END,     // end of a lookahead program
+    RE_OP_MATCH         // the pattern is matched
+} RegexOp;
+
+typedef enum {
+    RE_ASSERT_BOL,          // ^
+    RE_ASSERT_EOL,          // $
+    RE_ASSERT_WORD,         // \b
+    RE_ASSERT_NOT_WORD      // \B
+} RegexAssert;
+
+typedef struct {
+    RegexOp op;
+    int x;
+    int y;
+} RegexInst;
+
+typedef struct {
+    uint32_t bits[8];   // set of bytes
+} RegexClass;
+
+typedef struct {
+    RegexInst* insts;       // instructions
+    size_t len;             // count of instructions
+    size_t size;            // size of the array
+} RegexProgram;
+
+typedef struct RegexState_tag RegexState;
+
+typedef struct {
+    const RegexProgram* program;    // pointer to a program
+    const RegexClass* classes;      // byte sets of RE_OP_CLASS
+    const uint8_t* byteClasses;     // byte -> byte class
+    size_t classesCount;            // count of byte classes (columns of transitions)
+    int isUnanchored;               // a match may start at any position, otherwise only at the start
+    int isLongest;                  // the longest match, otherwise the first one (leftmost-first priorities)
+
+    RegexState** states;            // cached states
+    int32_t* trans;                 // transitions: row of a state by byte class (-1 - not computed)
+    size_t statesLen;
+    size_t statesSize;
+    int32_t* table;                 // hash table of indexes of states (-1 - empty)
+    size_t tableSize;
+    int32_t startStates[4];         // start state by the kind of the previous byte (-1 - not built)
+    size_t memory;                  // memory of cached states
+    size_t resets;                  // count of cache flushes
+
+    int* list;                      // work lists of threads
+    int* nextList;
+    uint32_t* marks;                // marks of threads in a work list
+    uint32_t mark;                  // current mark
+    int* stack;                     // stack of the closure
+} RegexDfa;
+
+typedef struct {
+    RegexProgram forward;       // program of the pattern
+    RegexProgram backward;      // program of the reversed pattern (DFA only)
+    RegexClass* classes;        // byte sets of RE_OP_CLASS
+    size_t classesLen;
+    size_t classesSize;
+    uint8_t byteClasses[256];   // byte -> byte class (bytes of a class are equal for all RE_OP_CLASS)
+    size_t classesCount;        // count of byte classes
+
+    // forward search: the end of the leftmost match, then its start from the end
+    RegexDfa forwardDfa;        // unanchored, first match of the pattern
+    RegexDfa startDfa;          // anchored, longest match of the reversed pattern
+    // backward search: the start of the nearest match, then its end from the start
+    RegexDfa backwardDfa;       // unanchored, first match of the reversed pattern
+    RegexDfa endDfa;            // anchored, first match of the pattern
+    Literal* prefix;            // literal prefix of every match (NULL - no prefix)
+    size_t groups;              // count of capture groups (with the whole match)
+    int flags;                  // RegexFlags
+    int isBacktracking;         // the pattern has backreferences or lookaheads, the DFA can't run it
+} Regex;
+
+typedef struct {
+    ModelPos start;     // position of the first char
+    ModelPos end;       // position after the last char
+} RegexMatch;
+
+/**
+ * Compiles a regular expression. Syntax: literals, ., [] classes with ranges and negation,
+ * \d \D \w \W \s \S, \n \t and escaped specials, groups (...) and (?:...), alternation |,
+ * quantifiers * + ? {m} {m,} {m,n} (greedy or lazy with ?), assertions ^ $ \b \B.
+ * Backreferences \1..\9 and lookaheads (?=...) (?!...) switch the pattern to the backtracking
+ * matcher, which searches each block separately.
+ * IN:
+ * @param pattern - pointer to chars of the pattern
+ * @param len - length of the pattern
+ * @param flags - RegexFlags
+ *
+ * OUT:
+ * @return regex - pointer to a compiled expression, NULL on error (syntax error or no memory)
+ */
+Regex* CreateRegex(const char* pattern, size_t len, int flags);
+
+/**
+ * Destroys a compiled expression.
+ * IN:
+ * @param ppRegex - pointer to pointer to a compiled expression
+ *
+ * OUT:
+ * *ppRegex - filled with NULL value
+ */
+void DestroyRegex(Regex** ppRegex);
+
+/**
+ * Finds a match of a regular expression in a document. The text is fed to the DFA span by span,
+ * so matches may cross fragments and blocks (a line end is '\n'). The DFA cache belongs to
+ * the expression: an expression may be used by one thread at a time.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param regex - pointer to a compiled expression
+ * @param from - start position
+ * @param direction - SEARCH_FORWARD: the leftmost match starting at or after the position,
+ *                    SEARCH_BACKWARD: the nearest match to the left of the position (it ends at or before it)
+ * @param match - pointer to a match to be filled
+ *
+ * OUT:
+ * @return isFound - 1 if a match is found, 0 otherwise
+ */
+int FindRegex(const Document* doc, Regex* regex, ModelPos from, SearchDirection direction, RegexMatch* match);
+
+/**
+ * Finds the leftmost match which starts in a range of a document. The match may end after the range.
+ * The DFA reads the text after the range only while a match started in the range may be alive.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param regex - pointer to a compiled expression
+ * @param from - start of the range
+ * @param to - pointer to the end of the range (NULL - the end of the document)
+ * @param match - pointer to a match to be filled
+ *
+ * OUT:
+ * @return isFound - 1 if a match is found, 0 otherwise
+ */
+int FindRegexInRange(const Document* doc, Regex* regex, ModelPos from, const ModelPos* to, RegexMatch* match);
+
+/**
+ * Gets capture groups of a match found by FindRegex(): the backtracking matcher runs on the text of the match.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param regex - pointer to a compiled expression
+ * @param match - pointer to a match of the expression
+ * @param groups - pointer to an array of regex->groups ranges to be filled
+ *                 (the range 0 is the whole match, a group which didn't participate has NULL blocks)
+ *
+ * OUT:
+ * @return isFilled - 1 if groups are filled, 0 otherwise (the step limit or no memory)
+ */
+int GetRegexGroups(const Document* doc, const Regex* regex, const RegexMatch* match, RegexMatch* groups);
+
+#endif // REGEX_H_INCLUDED
@@ -0,0 +1,464 @@
+#include "Replace.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef enum {
+    PART_TEXT,      // chars of the replacement
+    PART_GROUP,     // chars of a capture group
+    PART_BREAK      // a line end
+} PartType;
+
+typedef struct {
+    PartType type;
+    size_t pos;     // PART_TEXT: position of the chars (in the template, then in the text of the document)
+    size_t len;     // PART_TEXT: count of the chars
+    int group;      // PART_GROUP: index of the group
+} ReplacePart;
+
+typedef struct {
+    char* chars;            // chars of PART_TEXT parts
+    size_t charsLen;
+    ReplacePart* parts;
+    size_t len;
+    size_t size;
+    int maxGroup;           // the biggest group of PART_GROUP parts (-1 - no groups)
+} Template;
+
+// new chars of replaced blocks: pieces of the text split into lines
+typedef struct {
+    FragmentData_t* pieces;
+    size_t len;
+    size_t size;
+    size_t* lines;          // index of the first piece of every line after the first one
+    size_t linesLen;
+    size_t linesSize;
+    size_t y;               // index of the first replaced block
+    size_t lineChars;       // count of chars of the last line
+    HistoryChange* changes; // edits of blocks making the replacement of the blocks, one after another
+    size_t changesLen;
+    size_t changesSize;
+    int isReplacing;        // emitted chars are the replacement of a match: they are inserted by changes
+} Content;
+
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+// grows an array by doubling
+static int Reserve(void** data, size_t* size, size_t len, size_t itemSize) {
+    if (len < *size) { return ERR_SUCCESS; }
+
+    size_t newSize = *size ? 2 * *size : 64;
+    void* newData = realloc(*data, newSize * itemSize);
+
+    if (!newData) { return ERR_NOMEM; }
+    *data = newData;
+    *size = newSize;
+    return ERR_SUCCESS;
+}
+
+static int AddPart(Template* t, PartType type, int group) {
+    // chars of successive text parts are successive
+    if (type == PART_TEXT && t->len && t->parts[t->len - 1].type == PART_TEXT) {
+        ++t->parts[t->len - 1].len;
+        return ERR_SUCCESS;
+    }
+
+    if (Reserve((void**)&t->parts, &t->size, t->len, sizeof(ReplacePart))) { return ERR_NOMEM; }
+
+    ReplacePart part = { type, t->charsLen, type == PART_TEXT, group };
+    t->parts[t->len++] = part;
+    return ERR_SUCCESS;
+}
+
+static int AddTemplateChar(Template* t, char c) {
+    if (c == '\n') { return AddPart(t, PART_BREAK, 0); }
+
+    if (AddPart(t, PART_TEXT, 0)) { return ERR_NOMEM; }
+    t->chars[t->charsLen++] = c;
+    return ERR_SUCCESS;
+}
+
+// parses the replacement: escapes are processed only for regular expressions
+static int ParseTemplate(Template* t, const char* replacement, size_t len, int isRegex) {
+    t->chars = malloc(len + 1);
+    t->maxGroup = -1;
+    if (!t->chars) { return ERR_NOMEM; }
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = replacement[i];
+        int errValue;
+
+        if (!isRegex || c != '\\') {
+            errValue = AddTemplateChar(t, c);
+        } else if (++i == len) {
+            return ERR_PARAM;
+        } else if (replacement[i] >= '0' && replacement[i] <= '9') {
+            int group = replacement[i] - '0';
+
+            if (group > t->maxGroup) { t->maxGroup = group; }
+            errValue = AddPart(t, PART_GROUP, group);
+        } else if (replacement[i] == 'n') {
+            errValue = AddTemplateChar(t, '\n');
+        } else if (replacement[i] == 't') {
+            errValue = AddTemplateChar(t, '\t');
+        } else {
+            errValue = AddTemplateChar(t, replacement[i]);
+        }
+
+        if (errValue) { return errValue; }
+    }
+    return ERR_SUCCESS;
+}
+
+static void FreeTemplate(Template* t) {
+    free(t->chars);
+    free(t->parts);
+}
+
+// an edit at the end of the content: successive insertions are one edit, empty ones are skipped
+static int AddChange(Content* content, HistoryOp op, size_t len) {
+    size_t y = content->y + content->linesLen;
+    size_t x = content->lineChars;
+
+    if ((op == HISTORY_INSERT || op == HISTORY_DELETE) && !len) { return ERR_SUCCESS; }
+
+    if (op == HISTORY_INSERT && content->changesLen) {
+        HistoryChange* last = &content->changes[content->changesLen - 1];
+
+        if (last->op == HISTORY_INSERT && last->y == y && last->x + last->len == x) {
+            last->len += len;
+            return ERR_SUCCESS;
+        }
+    }
+
+    if (Reserve((void**)&content->changes, &content->changesSize, content->changesLen, sizeof(HistoryChange))) { return ERR_NOMEM; }
+
+    content->changes[content->changesLen++] = (HistoryChange){ op, y, x, len };
+    return ERR_SUCCESS;
+}
+
+// the chars of a match are deleted at the end of the content: the rest of every line and its line end
+static int DeleteMatch(Content* content, const RegexMatch* match) {
+    const Block* block = match->start.block;
+    size_t x = match->start.pos.x;
+
+    for (size_t y = match->start.pos.y; y < match->end.pos.y; ++y, block = block->next) {
+        if (AddChange(content, HISTORY_DELETE, block->data.len - x)) { return ERR_NOMEM; }
+        if (AddChange(content, HISTORY_MERGE, 0)) { return ERR_NOMEM; }
+        x = 0;
+    }
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, match->end.pos.y - match->start.pos.y);
+
+    return AddChange(content, HISTORY_DELETE, match->end.pos.x - x);
+}
+
+static int EmitText(Content* content, size_t pos, size_t len) {
+    if (!len) { return ERR_SUCCESS; }
+    if (content->isReplacing && AddChange(content, HISTORY_INSERT, len)) { return ERR_NOMEM; }
+
+    content->lineChars += len;
+
+    size_t lineStart = content->linesLen ? content->lines[content->linesLen - 1] : 0;
+    FragmentData_t* last = content->len > lineStart ? &content->pieces[content->len - 1] : NULL;
+
+    // successive chars of the text make one fragment
+    if (last && last->pos + last->len == pos) {
+        last->len += len;
+        return ERR_SUCCESS;
+    }
+
+    if (Reserve((void**)&content->pieces, &content->size, content->len, sizeof(FragmentData_t))) { return ERR_NOMEM; }
+
+    content->pieces[content->len].len = len;
+    content->pieces[content->len].pos = pos;
+    ++content->len;
+    return ERR_SUCCESS;
+}
+
+static int EmitBreak(Content* content) {
+    if (content->isReplacing && AddChange(content, HISTORY_SPLIT, 0)) { return ERR_NOMEM; }
+    if (Reserve((void**)&content->lines, &content->linesSize, content->linesLen, sizeof(size_t))) { return ERR_NOMEM; }
+
+    content->lines[content->linesLen++] = content->len;
+    content->lineChars = 0;
+    return ERR_SUCCESS;
+}
+
+// emits chars of the document in [from, to)
+static int EmitRange(const Document* doc, Content* content, ModelPos from, const ModelPos* to) {
+    DocIterator it;
+    DocSpan span;
+
+    if (!IsBefore(&from, to)) { return ERR_SUCCESS; }
+
+    InitDocIterator(&it, doc, from, DOC_ITER_LINE_ENDS);
+    while (DocNextSpan(&it, &span) && IsBefore(&span.pos, to)) {
+        int errValue;
+
+        if (span.isLineEnd) {
+            errValue = EmitBreak(content);
+        } else {
+            size_t len = span.pos.pos.y == to->pos.y ? MIN(span.len, to->pos.x - span.pos.pos.x) : span.len;
+            errValue = EmitText(content, (size_t)(span.ptr - doc->text->data), len);
+        }
+
+        if (errValue) { return errValue; }
+    }
+    return ERR_SUCCESS;
+}
+
+/**
+ * Emits the replacement of a match. Returns 1 if the match is replaced,
+ * 0 if its groups aren't found (the match is kept), -1 on error.
+ */
+static int EmitReplacement(const Document* doc, Content* content, const Template* t, const Regex* regex,
+                           const RegexMatch* match) {
+    RegexMatch groups[REGEX_MAX_GROUPS];
+    int isReplaced = 1;
+
+    groups[0] = *match;
+    if (t->maxGroup > 0 && !GetRegexGroups(doc, regex, match, groups)) { isReplaced = 0; }
+
+    for (size_t i = 0; isReplaced && i < t->len; ++i) {
+        const ReplacePart* part = &t->parts[i];
+        int errValue = ERR_SUCCESS;
+
+        if (part->type == PART_TEXT) {
+            errValue = EmitText(content, part->pos, part->len);
+        } else if (part->type == PART_BREAK) {
+            errValue = EmitBreak(content);
+        } else if (groups[part->group].start.block) {
+            errValue = EmitRange(doc, content, groups[part->group].start, &groups[part->group].end);
+        }
+
+        if (errValue) { return -1; }
+    }
+
+    if (!isReplaced && EmitRange(doc, content, match->start, &match->end)) { return -1; }
+    return isReplaced;
+}
+
+static ListFragment* CreateLine(const Document* doc, const FragmentData_t* pieces, size_t len, size_t* lineLen) {
+    ListFragment* fragments = CreateListFragment();
+    if (!fragments) { return NULL; }
+
+    *lineLen = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (AddFragmentData(fragments, &pieces[i])) {
+            DestroyListFragment(&fragments);
+            return NULL;
+        }
+        *lineLen += pieces[i].len;
+    }
+
+    // a block always has a fragment
+    if (!len) {
+        FragmentData_t empty = { 0, doc->text->len };
+
+        if (AddFragmentData(fragments, &empty)) {
+            DestroyListFragment(&fragments);
+            return NULL;
+        }
+    }
+    return fragments;
+}
+
+static void DestroyLines(Block* blocks) {
+    while (blocks) {
+        Block* next = blocks->next;
+
+        DestroyBlock(&blocks);
+        blocks = next;
+    }
+}
+
+// replaces the blocks first..last with the lines of the content; nothing is changed on error.
+// The old blocks are kept by the undo history, so every line gets a new block
+static int ApplyContent(Document* doc, const Content* content, Block* first, Block* last) {
+    size_t linesCount = content->linesLen + 1;
+    Block* newBlocks = NULL;
+    Block* newLast = NULL;
+
+    for (size_t i = 0; i < linesCount; ++i) {
+        size_t start = i ? content->lines[i - 1] : 0;
+        size_t end = i < content->linesLen ? content->lines[i] : content->len;
+        BlockData_t data = { 0, NULL, doc->version };
+        Block* block = NULL;
+
+        data.fragments = CreateLine(doc, content->pieces + start, end - start, &data.len);
+        if (data.fragments) {
+            block = CreateBlock(newLast, &data);
+            if (!block) { DestroyListFragment(&data.fragments); }
+        }
+
+        if (!block) {
+            DestroyLines(newBlocks);
+            return ERR_NOMEM;
+        }
+
+        if (newLast) {
+            newLast->next = block;
+        } else {
+            newBlocks = block;
+        }
+        newLast = block;
+    }
+
+    if (DocReplaceBlocks(doc, first, content->y, last, newBlocks, content->changes, content->changesLen)) {
+        DestroyLines(newBlocks);
+        return ERR_NOMEM;
+    }
+    return ERR_SUCCESS;
+}
+
+// finds all matches as Find next does from the start of the document
+static int CollectMatches(const Document* doc, const Literal* literal, Regex* regex, RegexMatch** matches, size_t* len) {
+    ModelPos from = { doc->blocks->nodes, { 0, 0 } };
+    size_t size = 0;
+    RegexMatch match;
+
+    for (;;) {
+        if (regex) {
+            if (!FindRegex(doc, regex, from, SEARCH_FORWARD, &match)) { break; }
+        } else {
+            if (!FindLiteral(doc, literal, from, SEARCH_FORWARD, &match.start)) { break; }
+
+            // the occurrence may cross line ends
+            match.end = match.start;
+            match.end.pos.x += literal->len;
+            while (match.end.pos.x > match.end.block->data.len) {
+                match.end.pos.x -= match.end.block->data.len + 1;
+                match.end.block = match.end.block->next;
+                ++match.end.pos.y;
+            }
+        }
+
+        if (Reserve((void**)matches, &size, *len, sizeof(RegexMatch))) { return ERR_NOMEM; }
+        (*matches)[(*len)++] = match;
+
+        from = match.end;
+        if (IsBefore(&match.start, &match.end)) { continue; }
+
+        // an empty match: the next one starts a char later
+        if (from.pos.x < from.block->data.len) {
+            ++from.pos.x;
+        } else if (from.block->next) {
+            from.block = from.block->next;
+            from.pos.x = 0;
+            ++from.pos.y;
+        } else {
+            break;
+        }
+    }
+    return ERR_SUCCESS;
+}
+
+int ReplaceAll(Document* doc, const char* pattern, size_t len, const char* replacement, size_t replacementLen,
+               int flags, size_t* count, DocChanged onChange, void* context) {
+    assert(doc && pattern && len && (replacement || !replacementLen));
+
+    COUNTERS_SCOPE(COUNTER_OP_REPLACE);
+    TRACE_SCOPE("ReplaceAll");
+
+    Literal* literal = NULL;
+    Regex* regex = NULL;
+    Template t = { 0 };
+    Content content = { 0 };
+    RegexMatch* matches = NULL;
+    size_t matchesLen = 0;
+    size_t replaced = 0;
+    int errValue;
+
+    if (count) { *count = 0; }
+
+    if (flags & REPLACE_REGEX) {
+        regex = CreateRegex(pattern, len, (flags & REPLACE_IGNORE_CASE) ? REGEX_IGNORE_CASE : REGEX_MATCH_CASE);
+        errValue = regex ? ERR_SUCCESS : ERR_PARAM;
+    } else {
+        literal = CreateLiteral(pattern, len, (flags & REPLACE_IGNORE_CASE) ? SEARCH_IGNORE_CASE : SEARCH_MATCH_CASE);
+        errValue = literal ? ERR_SUCCESS : ERR_NOMEM;
+    }
+
+    if (!errValue) { errValue = ParseTemplate(&t, replacement, replacementLen, regex != NULL); }
+    if (!errValue && regex && t.maxGroup >= (int)regex->groups) { errValue = ERR_PARAM; }
+    if (!errValue) { errValue = CollectMatches(doc, literal, regex, &matches, &matchesLen); }
+
+    // chars of the replacement are shared by all matches
+    if (!errValue && matchesLen && t.charsLen) {
+        size_t base = doc->text->len;
+
+        if (DocAddText(doc, t.chars, t.charsLen)) {
+            errValue = ERR_NOMEM;
+        } else {
+            for (size_t i = 0; i < t.len; ++i) { t.parts[i].pos += base; }
+        }
+    }
+
+    if (!errValue && matchesLen) { ++doc->version; }
+
+    // blocks touched by successive matches are rebuilt together; from the end, so positions
+    // of the matches which aren't replaced yet stay valid. All regions are undone as one unit
+    DocBeginUndoGroup(doc);
+    for (size_t last = matchesLen; !errValue && last > 0;) {
+        size_t first = last - 1;
+
+        while (first > 0 && matches[first - 1].end.pos.y >= matches[first].start.pos.y) { --first; }
+
+        Block* firstBlock = matches[first].start.block;
+        Block* lastBlock = matches[last - 1].end.block;
+        ModelPos from = { firstBlock, { 0, matches[first].start.pos.y } };
+        ModelPos end = { lastBlock, { lastBlock->data.len, matches[last - 1].end.pos.y } };
+        size_t regionReplaced = 0;
+
+        content.len = 0;
+        content.linesLen = 0;
+        content.y = from.pos.y;
+        content.lineChars = 0;
+        content.changesLen = 0;
+
+        for (size_t i = first; !errValue && i < last; ++i) {
+            size_t changesLen;
+            int result;
+
+            errValue = EmitRange(doc, &content, from, &matches[i].start);
+            if (errValue) { break; }
+
+            // the edits of a match see the matches before it replaced
+            changesLen = content.changesLen;
+            content.isReplacing = 1;
+            result = DeleteMatch(&content, &matches[i]) ? -1 : EmitReplacement(doc, &content, &t, regex, &matches[i]);
+            content.isReplacing = 0;
+            if (result < 0) {
+                errValue = ERR_NOMEM;
+                break;
+            }
+
+            // a kept match isn't edited
+            if (!result) { content.changesLen = changesLen; }
+            regionReplaced += result;
+            from = matches[i].end;
+        }
+
+        if (!errValue) { errValue = EmitRange(doc, &content, from, &end); }
+        if (!errValue) { errValue = ApplyContent(doc, &content, firstBlock, lastBlock); }
+        if (!errValue) { replaced += regionReplaced; }
+
+        for (size_t i = 0; !errValue && onChange && i < content.changesLen; ++i) { onChange(context, &content.changes[i]); }
+
+        last = first;
+    }
+    DocEndUndoGroup(doc);
+
+    if (errValue == ERR_NOMEM) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+    if (count) { *count = replaced; }
+
+    free(matches);
+    free(content.pieces);
+    free(content.lines);
+    free(content.changes);
+    FreeTemplate(&t);
+    DestroyRegex(&regex);
+    DestroyLiteral(&literal);
+    return errValue;
+}
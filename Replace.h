@@ -0,0 +1,49 @@
+#pragma once
+#ifndef REPLACE_H_INCLUDED
+#define REPLACE_H_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "String.h"
+#include "Document.h"
+#include "Search.h"
+#include "Regex.h"
+
+typedef enum {
+    REPLACE_LITERAL     = 0,
+    REPLACE_REGEX       = 1 << 0,
+    REPLACE_IGNORE_CASE = 1 << 1    // ASCII letters only
+} ReplaceFlags;
+
+/**
+ * Replaces all occurrences of a pattern. Occurrences are found as by Find next from the start
+ * of the document, then every block touched by them gets its fragments rebuilt once. The chars of
+ * the replacement are appended to the text once and shared by all occurrences; captured chars
+ * aren't copied, fragments point to them.
+ * With REPLACE_REGEX the replacement may contain \0 (the whole match) .. \9 (groups), \n, \t and \\.
+ * Changed blocks get one new version of the document.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param pattern - pointer to chars of the pattern
+ * @param len - length of the pattern (> 0)
+ * @param replacement - pointer to chars of the replacement ('\n' splits a block)
+ * @param replacementLen - length of the replacement
+ * @param flags - ReplaceFlags
+ * @param count - pointer to a count of replaced occurrences to be filled (NULL - not needed)
+ * @param onChange - callback getting the edits of blocks making the replacement, NULL - no reports
+ * @param context - context of onChange
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ *                    (ERR_PARAM - invalid expression or replacement, the document isn't changed)
+ */
+int ReplaceAll(Document* doc, const char* pattern, size_t len, const char* replacement, size_t replacementLen,
+               int flags, size_t* count, DocChanged onChange, void* context);
+
+#endif // REPLACE_H_INCLUDED
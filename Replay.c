@@ -0,0 +1,253 @@
+#include "Replay.h"
+
+#include <string.h>
+
+#include "Clock.h"
+
+#define REPLAY_MAGIC_LEN 4
+
+static ReplayStream recorder;
+
+static int IsCaretOp(ReplayOp op) {
+    return op <= REPLAY_OP_DELETE_BLOCK;
+}
+
+// LEB128: 7 bits per byte, the high bit marks continuation
+static void WriteVarint(FILE* file, uint64_t value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static int ReadVarint(FILE* file, uint64_t* value) {
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+
+        if (c == EOF) { return ERR_READ; }
+
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { return ERR_SUCCESS; }
+    }
+
+    return ERR_READ;
+}
+
+static int ReadSize(FILE* file, size_t* value) {
+    uint64_t tmp;
+
+    if (ReadVarint(file, &tmp)) { return ERR_READ; }
+
+    *value = (size_t)tmp;
+    return ERR_SUCCESS;
+}
+
+// zig-zag: small deltas of both signs take one byte
+static void WriteDelta(FILE* file, size_t value, size_t base) {
+    int64_t delta = (int64_t)(value - base);
+
+    WriteVarint(file, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+}
+
+static int ReadDelta(FILE* file, size_t base, size_t* value) {
+    uint64_t tmp;
+
+    if (ReadVarint(file, &tmp)) { return ERR_READ; }
+
+    *value = base + (size_t)(int64_t)((tmp >> 1) ^ -(tmp & 1));
+    return ERR_SUCCESS;
+}
+
+int ReplayStart(const char* filename, const ReplayHeader* header) {
+    assert(filename && header);
+
+    ReplayStop();
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return ERR_OPEN_FILE;
+    }
+
+    fwrite(REPLAY_MAGIC, 1, REPLAY_MAGIC_LEN, file);
+    fputc(REPLAY_VERSION, file);
+
+    WriteVarint(file, header->docLen);
+    WriteVarint(file, header->blocksCount);
+    WriteVarint(file, (uint64_t)header->mode);
+    WriteVarint(file, header->lines);
+    WriteVarint(file, header->chars);
+    WriteVarint(file, header->caretY);
+    WriteVarint(file, header->caretX);
+    WriteVarint(file, header->scrollY);
+    WriteVarint(file, header->scrollX);
+    WriteVarint(file, header->scrollPos);
+
+    recorder.file = file;
+    recorder.caretY = header->caretY;
+    recorder.caretX = header->caretX;
+    recorder.scrollY = header->scrollY;
+    recorder.time = GetMonotonicTime();
+
+    return ERR_SUCCESS;
+}
+
+void ReplayStop() {
+    if (!recorder.file) { return; }
+
+    if (fclose(recorder.file)) { PrintError(NULL, ERR_UNKNOWN, __FILE__, __LINE__); }
+    recorder.file = NULL;
+}
+
+int ReplayIsRecording() {
+    return recorder.file != NULL;
+}
+
+void ReplayWrite(ReplayOp op, size_t y, size_t x, int dir, size_t value, size_t extra) {
+    assert(op < REPLAY_OP_COUNT);
+
+    FILE* file = recorder.file;
+    if (!file) { return; }
+
+    uint64_t now = GetMonotonicTime();
+
+    fputc(op, file);
+    WriteVarint(file, (now - recorder.time) / NS_PER_US);
+    recorder.time = now;
+
+    if (IsCaretOp(op)) {
+        WriteDelta(file, y, recorder.caretY);
+        recorder.caretY = y;
+        recorder.caretX = x;
+    } else {
+        WriteDelta(file, y, recorder.scrollY);
+        recorder.scrollY = y;
+    }
+    WriteVarint(file, x);
+
+    switch (op) {
+    case REPLAY_OP_ADD_CHAR:
+    case REPLAY_OP_SWITCH_MODE:
+        WriteVarint(file, value);
+        break;
+
+    case REPLAY_OP_SCROLL:
+        fputc(dir, file);
+        WriteVarint(file, value);
+        WriteVarint(file, extra);
+        break;
+
+    case REPLAY_OP_RESIZE:
+        WriteVarint(file, value);
+        WriteVarint(file, extra);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void ReplayMove(size_t y, size_t x) {
+    if (!recorder.file || (y == recorder.caretY && x == recorder.caretX)) { return; }
+
+    ReplayWrite(REPLAY_OP_MOVE, y, x, 0, 0, 0);
+}
+
+int ReplayOpen(ReplayStream* stream, const char* filename, ReplayHeader* header) {
+    assert(stream && filename && header);
+
+    char magic[REPLAY_MAGIC_LEN];
+    uint64_t mode;
+
+    memset(stream, 0, sizeof(ReplayStream));
+
+    stream->file = fopen(filename, "rb");
+    if (!stream->file) {
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return ERR_OPEN_FILE;
+    }
+
+    if (fread(magic, 1, REPLAY_MAGIC_LEN, stream->file) != REPLAY_MAGIC_LEN
+        || memcmp(magic, REPLAY_MAGIC, REPLAY_MAGIC_LEN)
+        || fgetc(stream->file) != REPLAY_VERSION
+        || ReadSize(stream->file, &(header->docLen))
+        || ReadSize(stream->file, &(header->blocksCount))
+        || ReadVarint(stream->file, &mode)
+        || ReadSize(stream->file, &(header->lines))
+        || ReadSize(stream->file, &(header->chars))
+        || ReadSize(stream->file, &(header->caretY))
+        || ReadSize(stream->file, &(header->caretX))
+        || ReadSize(stream->file, &(header->scrollY))
+        || ReadSize(stream->file, &(header->scrollX))
+        || ReadSize(stream->file, &(header->scrollPos))) {
+
+        ReplayClose(stream);
+        PrintError(NULL, ERR_READ, __FILE__, __LINE__);
+        return ERR_READ;
+    }
+
+    header->mode = (int)mode;
+    stream->caretY = header->caretY;
+    stream->caretX = header->caretX;
+    stream->scrollY = header->scrollY;
+
+    return ERR_SUCCESS;
+}
+
+int ReplayRead(ReplayStream* stream, ReplayEvent* event) {
+    assert(stream && stream->file && event);
+
+    FILE* file = stream->file;
+    int c = fgetc(file);
+
+    if (c == EOF) { return ERR_EOF; }
+    if (c >= REPLAY_OP_COUNT) { return ERR_READ; }
+
+    memset(event, 0, sizeof(ReplayEvent));
+    event->op = (ReplayOp)c;
+
+    if (ReadVarint(file, &(event->delay))) { return ERR_READ; }
+
+    if (IsCaretOp(event->op)) {
+        if (ReadDelta(file, stream->caretY, &(event->y))) { return ERR_READ; }
+        stream->caretY = event->y;
+    } else {
+        if (ReadDelta(file, stream->scrollY, &(event->y))) { return ERR_READ; }
+        stream->scrollY = event->y;
+    }
+    if (ReadSize(file, &(event->x))) { return ERR_READ; }
+
+    switch (event->op) {
+    case REPLAY_OP_ADD_CHAR:
+    case REPLAY_OP_SWITCH_MODE:
+        if (ReadSize(file, &(event->value))) { return ERR_READ; }
+        break;
+
+    case REPLAY_OP_SCROLL:
+        if ((event->dir = fgetc(file)) == EOF
+            || ReadSize(file, &(event->value))
+            || ReadSize(file, &(event->extra))) {
+            return ERR_READ;
+        }
+        break;
+
+    case REPLAY_OP_RESIZE:
+        if (ReadSize(file, &(event->value)) || ReadSize(file, &(event->extra))) { return ERR_READ; }
+        break;
+
+    default:
+        break;
+    }
+
+    return ERR_SUCCESS;
+}
+
+void ReplayClose(ReplayStream* stream) {
+    assert(stream);
+
+    if (stream->file) { fclose(stream->file); }
+    stream->file = NULL;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+#define REPLAY_ON
+// #define REPLAY_OFF
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "Error.h"
+
+#define REPLAY_MAGIC "TERP"
+#define REPLAY_VERSION 1
+
+typedef enum {
+    REPLAY_OP_MOVE,             // caret moved to (y, x)
+    REPLAY_OP_ADD_CHAR,         // CaretAddChar at (y, x), value - char
+    REPLAY_OP_ADD_BLOCK,        // CaretAddBlock at (y, x)
+    REPLAY_OP_DELETE_CHAR,      // CaretDeleteChar at (y, x)
+    REPLAY_OP_DELETE_BLOCK,     // CaretDeleteBlock at (y, x)
+    REPLAY_OP_SCROLL,           // Scroll, value - count, dir - Direction, extra - horizontal pos
+    REPLAY_OP_RESIZE,           // UpdateDisplayedModel, value - lines, extra - chars
+    REPLAY_OP_SWITCH_MODE,      // SwitchMode, value - FormatMode
+    REPLAY_OP_COUNT
+} ReplayOp;
+
+typedef struct {
+    ReplayOp op;        // operation
+    uint64_t delay;     // time since the previous event (us)
+    size_t y;           // block index: caret (MOVE, edits) or top of the client area (others)
+    size_t x;           // caret position in the block (MOVE, edits) or wrapped line of the top block (others)
+    int dir;            // direction of a scroll
+    size_t value;       // operation value (see ReplayOp)
+    size_t extra;       // additional operation value (see ReplayOp)
+} ReplayEvent;
+
+typedef struct {
+    size_t docLen;          // sum of lengths of all blocks
+    size_t blocksCount;     // count of blocks
+    int mode;               // FormatMode
+    size_t lines;           // lines of the client area
+    size_t chars;           // chars of the client area
+    size_t caretY;          // caret block index
+    size_t caretX;          // caret position in the block
+    size_t scrollY;         // block index of the top of the client area
+    size_t scrollX;         // wrapped line of the top block
+    size_t scrollPos;       // horizontal scroll pos
+} ReplayHeader;
+
+typedef struct {
+    FILE* file;             // pointer to a trace file
+    size_t caretY;          // last caret block index (y of caret events is delta-coded)
+    size_t caretX;          // last caret position in the block
+    size_t scrollY;         // last top block index (y of other events is delta-coded)
+    uint64_t time;          // time of the last event (recording only)
+} ReplayStream;
+
+
+// Recording. The recorder belongs to the UI thread.
+/**
+ * Starts recording of model operations. Stops the current recording if it's active.
+ * IN:
+ * @param filename - pointer to a name of the trace file
+ * @param header - pointer to a state of the model at the start
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int ReplayStart(const char* filename, const ReplayHeader* header);
+
+/**
+ * Stops recording and closes the trace file.
+ */
+void ReplayStop();
+
+/**
+ * Checks recording.
+ * OUT:
+ * @return isRecording - flag of active recording
+ */
+int ReplayIsRecording();
+
+/**
+ * Writes an event to the trace file (if recording is active).
+ * IN:
+ * @param op - operation
+ * @param y - block index (see ReplayEvent)
+ * @param x - position in the block (see ReplayEvent)
+ * @param dir - direction of a scroll
+ * @param value - operation value (see ReplayOp)
+ * @param extra - additional operation value (see ReplayOp)
+ */
+void ReplayWrite(ReplayOp op, size_t y, size_t x, int dir, size_t value, size_t extra);
+
+/**
+ * Writes a caret move (if the caret position differs from the last recorded one).
+ * IN:
+ * @param y - caret block index
+ * @param x - caret position in the block
+ */
+void ReplayMove(size_t y, size_t x);
+
+
+// Reading
+/**
+ * Opens a trace file and reads its header.
+ * IN:
+ * @param stream - pointer to a stream
+ * @param filename - pointer to a name of the trace file
+ * @param header - pointer to a header to be filled
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int ReplayOpen(ReplayStream* stream, const char* filename, ReplayHeader* header);
+
+/**
+ * Reads the next event.
+ * IN:
+ * @param stream - pointer to an opened stream
+ * @param event - pointer to an event to be filled
+ *
+ * OUT:
+ * @return errValue - ERR_SUCCESS, ERR_EOF (no more events) or ERR_READ (broken file)
+ */
+int ReplayRead(ReplayStream* stream, ReplayEvent* event);
+
+/**
+ * Closes a stream.
+ * IN:
+ * @param stream - pointer to an opened stream
+ */
+void ReplayClose(ReplayStream* stream);
+
+#ifdef REPLAY_ON
+    #define REPLAY_WRITE(op, y, x, dir, value, extra)   ReplayWrite(op, y, x, dir, value, extra)
+    #define REPLAY_MOVE(y, x)                           ReplayMove(y, x)
+#else
+    #define REPLAY_WRITE(op, y, x, dir, value, extra)   ((void)0)
+    #define REPLAY_MOVE(y, x)                           ((void)0)
+#endif
+
+#endif // REPLAY_H_INCLUDED
@@ -15,6 +15,17 @@ void InitScrollBar(ScrollBar* pSB) {
     pSB->maxPos = 0;
 }
 
+// value * numerator / denominator rounded to the nearest, the product is exact
+static size_t Scale(size_t value, size_t numerator, size_t denominator) {
+    assert(denominator);
+
+    #ifdef __SIZEOF_INT128__
+        return (size_t) (((unsigned __int128) value * numerator + denominator / 2) / denominator);
+    #else
+        return (size_t) roundl((long double) value * numerator / denominator);
+    #endif
+}
+
 static ScrollBar GetRelativeSB(ScrollBar* pSB) {
     assert(pSB && pSB->pos <= pSB->maxPos);
 
@@ -22,7 +33,7 @@ static ScrollBar GetRelativeSB(ScrollBar* pSB) {
 
     if (pSB->maxPos > MAX_POS) {
         relativeSB.maxPos = MAX_POS;
-        relativeSB.pos = (size_t) roundl(((long double)pSB->pos / pSB->maxPos) * relativeSB.maxPos);
+        relativeSB.pos = Scale(pSB->pos, relativeSB.maxPos, pSB->maxPos);
     } else {
         relativeSB.maxPos = pSB->maxPos;
         relativeSB.pos = pSB->pos;
@@ -71,12 +82,25 @@ size_t GetAbsolutePos(size_t relativePos, size_t absoluteMaxPos) {
     size_t absolutePos = relativePos;
 
     if (absoluteMaxPos > MAX_POS) {
-        absolutePos = (size_t) roundl(((long double) relativePos / MAX_POS) * absoluteMaxPos);
+        absolutePos = Scale(relativePos, absoluteMaxPos, MAX_POS);
     }
 
     return absolutePos;
 }
 
+size_t GetAbsoluteTrackPos(HWND hwnd, const ScrollBar* pSB, int SB_TYPE) {
+    assert(pSB);
+    assert(SB_TYPE == SB_VERT || SB_TYPE == SB_HORZ);
+
+    SCROLLINFO info;
+
+    info.cbSize = sizeof(SCROLLINFO);
+    info.fMask = SIF_TRACKPOS;
+    if (!GetScrollInfo(hwnd, SB_TYPE, &info) || info.nTrackPos < 0) { return pSB->pos; }
+
+    return min(GetAbsolutePos((size_t) info.nTrackPos, pSB->maxPos), pSB->maxPos);
+}
+
 // for debugging
 void PrintScrollBar(const ScrollBar* pSB) {
     printf("Absolute: pos = %i of [0; %i]\n", pSB->pos, pSB->maxPos);
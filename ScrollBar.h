@@ -8,8 +8,8 @@
 #include <math.h>
 #include <stdio.h>
 
-// relative upper limit of the scroll range
-#define MAX_POS SHRT_MAX
+// relative upper limit of the scroll range (positions of SCROLLINFO are 32-bit)
+#define MAX_POS INT_MAX
 
 typedef struct {
     size_t pos;     // absolute position
@@ -48,6 +48,19 @@ size_t GetAbsoluteMaxPos(size_t modelAreaParam, size_t clientAreaParam);
  */
 size_t GetAbsolutePos(size_t relativePos, size_t absoluteMaxPos);
 
+/**
+ * Gets absolute position of the thumb dragged by the user. The 32-bit track position is read,
+ * because the position of the SB_THUMBTRACK message has 16 bits only.
+ * IN:
+ * @param hwnd - a handle to a window
+ * @param pSB - pointer to ScrollBar object
+ * @param SB_TYPE - a scroll bar type (SB_HORZ, SB_VERT)
+ *
+ * OUT:
+ * @return absolute position
+ */
+size_t GetAbsoluteTrackPos(HWND hwnd, const ScrollBar* pSB, int SB_TYPE);
+
 /**
  * Sets relative position
  * IN:
@@ -0,0 +1,371 @@
+#include "Search.h"
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+    #include <emmintrin.h>
+    #define SEARCH_SSE2
+#endif
+
+#define SIMD_WIDTH 16
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static char LowerChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static char UpperChar(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+static int IsMatch(const Literal* literal, const char* data) {
+    if (!(literal->flags & SEARCH_IGNORE_CASE)) {
+        return !memcmp(data, literal->pattern, literal->len);
+    }
+
+    for (size_t i = 0; i < literal->len; ++i) {
+        if (LowerChar(data[i]) != literal->pattern[i]) { return 0; }
+    }
+    return 1;
+}
+
+// the cheap filter: the first and the last chars of the pattern
+static int IsCandidate(const Literal* literal, const char* data) {
+    if (!(literal->flags & SEARCH_IGNORE_CASE)) {
+        return data[0] == literal->pattern[0] && data[literal->len - 1] == literal->pattern[literal->len - 1];
+    }
+    return LowerChar(data[0]) == literal->pattern[0]
+        && LowerChar(data[literal->len - 1]) == literal->pattern[literal->len - 1];
+}
+
+#ifdef SEARCH_SSE2
+typedef struct {
+    __m128i firstLower;
+    __m128i firstUpper;
+    __m128i lastLower;
+    __m128i lastUpper;
+} SimdFilter;
+
+static void InitSimdFilter(SimdFilter* filter, const Literal* literal) {
+    char first = literal->pattern[0];
+    char last = literal->pattern[literal->len - 1];
+    int isIgnoreCase = literal->flags & SEARCH_IGNORE_CASE;
+
+    filter->firstLower = _mm_set1_epi8(first);
+    filter->firstUpper = _mm_set1_epi8(isIgnoreCase ? UpperChar(first) : first);
+    filter->lastLower = _mm_set1_epi8(last);
+    filter->lastUpper = _mm_set1_epi8(isIgnoreCase ? UpperChar(last) : last);
+}
+
+// bit i is set if a match may start at data[i] (i < SIMD_WIDTH). data[0..len + SIMD_WIDTH - 2] must be readable
+static unsigned GetCandidates(const SimdFilter* filter, const char* data, size_t len) {
+    __m128i first = _mm_loadu_si128((const __m128i*)data);
+    __m128i last = _mm_loadu_si128((const __m128i*)(data + len - 1));
+
+    __m128i isFirst = _mm_or_si128(_mm_cmpeq_epi8(first, filter->firstLower), _mm_cmpeq_epi8(first, filter->firstUpper));
+    __m128i isLast = _mm_or_si128(_mm_cmpeq_epi8(last, filter->lastLower), _mm_cmpeq_epi8(last, filter->lastUpper));
+
+    return (unsigned)_mm_movemask_epi8(_mm_and_si128(isFirst, isLast));
+}
+#endif
+
+Literal* CreateLiteral(const char* pattern, size_t len, int flags) {
+    assert(pattern);
+
+    if (len == 0) {
+        PrintError(NULL, ERR_PARAM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    Literal* literal = calloc(1, sizeof(Literal));
+    if (!literal) { return NULL; }
+
+    literal->pattern = malloc(len * sizeof(char));
+    if (!literal->pattern) {
+        free(literal);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        literal->pattern[i] = (flags & SEARCH_IGNORE_CASE) ? LowerChar(pattern[i]) : pattern[i];
+    }
+    literal->len = len;
+    literal->flags = flags;
+
+    return literal;
+}
+
+void DestroyLiteral(Literal** ppLiteral) {
+    assert(ppLiteral);
+
+    if (!*ppLiteral) { return; }
+
+    free((*ppLiteral)->pattern);
+    free(*ppLiteral);
+    *ppLiteral = NULL;
+}
+
+const char* FindLiteralInSpan(const Literal* literal, const char* data, size_t len) {
+    assert(literal && (data || len == 0));
+
+    if (literal->len > len) { return NULL; }
+
+    size_t count = len - literal->len + 1;      // count of possible starts
+    size_t i = 0;
+
+#ifdef SEARCH_SSE2
+    SimdFilter filter;
+    InitSimdFilter(&filter, literal);
+
+    for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+        unsigned candidates = GetCandidates(&filter, data + i, literal->len);
+
+        while (candidates) {
+            const char* start = data + i + __builtin_ctz(candidates);
+            if (IsMatch(literal, start)) { return start; }
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    if (!(literal->flags & SEARCH_IGNORE_CASE)) {
+        // memchr is vectorized by the C library
+        while (i < count) {
+            const char* start = memchr(data + i, literal->pattern[0], count - i);
+            if (!start) { return NULL; }
+            if (IsMatch(literal, start)) { return start; }
+            i = start - data + 1;
+        }
+        return NULL;
+    }
+
+    for (; i < count; ++i) {
+        if (IsCandidate(literal, data + i) && IsMatch(literal, data + i)) { return data + i; }
+    }
+    return NULL;
+}
+
+const char* FindLastLiteralInSpan(const Literal* literal, const char* data, size_t len) {
+    assert(literal && (data || len == 0));
+
+    if (literal->len > len) { return NULL; }
+
+    size_t i = len - literal->len + 1;          // end of possible starts
+
+#ifdef SEARCH_SSE2
+    SimdFilter filter;
+    InitSimdFilter(&filter, literal);
+
+    for (; i >= SIMD_WIDTH; i -= SIMD_WIDTH) {
+        size_t base = i - SIMD_WIDTH;
+        unsigned candidates = GetCandidates(&filter, data + base, literal->len);
+
+        while (candidates) {
+            unsigned bit = 31 - __builtin_clz(candidates);
+            if (IsMatch(literal, data + base + bit)) { return data + base + bit; }
+            candidates &= ~(1u << bit);
+        }
+    }
+#endif
+
+    while (i > 0) {
+        --i;
+        if (IsCandidate(literal, data + i) && IsMatch(literal, data + i)) { return data + i; }
+    }
+    return NULL;
+}
+
+// chars near the borders of spans with their positions
+typedef struct {
+    char* chars;
+    ModelPos* pos;
+    size_t len;
+} Joint;
+
+static void AppendToJoint(Joint* joint, const DocSpan* span, size_t offset, size_t count) {
+    memcpy(joint->chars + joint->len, span->ptr + offset, count);
+    for (size_t i = 0; i < count; ++i) {
+        joint->pos[joint->len + i] = span->pos;
+        joint->pos[joint->len + i].pos.x += offset + i;
+    }
+    joint->len += count;
+}
+
+static void FreeJoint(Joint* joint) {
+    free(joint->chars);
+    free(joint->pos);
+}
+
+// keeps the last (forward) or the first (backward) count chars of the joint
+static void CutJoint(Joint* joint, size_t count, SearchDirection direction) {
+    if (count >= joint->len) { return; }
+
+    if (direction == SEARCH_FORWARD) {
+        memmove(joint->chars, joint->chars + joint->len - count, count);
+        memmove(joint->pos, joint->pos + joint->len - count, count * sizeof(ModelPos));
+    }
+    joint->len = count;
+}
+
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+// count of chars of a span before a position (all chars if the position is NULL)
+static size_t GetCountBefore(const DocSpan* span, const ModelPos* to) {
+    if (!to || span->pos.pos.y < to->pos.y) { return span->len; }
+    if (span->pos.pos.y > to->pos.y || to->pos.x <= span->pos.pos.x) { return 0; }
+    return MIN(to->pos.x - span->pos.pos.x, span->len);
+}
+
+// searches from a position; forward matches must start before the limit (NULL - no limit)
+static int Find(const Document* doc, const Literal* literal, ModelPos from, const ModelPos* to,
+                SearchDirection direction, ModelPos* match) {
+    // a match crossing a border of spans has at most (len - 1) chars on each side of it
+    size_t keep = literal->len - 1;
+    Joint joint = { 0 };
+    Joint tmp = { 0 };
+    int isFound = 0;
+
+    if (keep > 0) {
+        joint.chars = malloc(2 * keep * sizeof(char));
+        joint.pos = malloc(2 * keep * sizeof(ModelPos));
+        tmp.chars = malloc(2 * keep * sizeof(char));
+        tmp.pos = malloc(2 * keep * sizeof(ModelPos));
+
+        if (!joint.chars || !joint.pos || !tmp.chars || !tmp.pos) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            FreeJoint(&joint);
+            FreeJoint(&tmp);
+            return 0;
+        }
+    }
+
+    DocIterator it;
+    DocSpan span;
+    int flags = DOC_ITER_LINE_ENDS | (direction == SEARCH_BACKWARD ? DOC_ITER_BACKWARD : DOC_ITER_FORWARD);
+    InitDocIterator(&it, doc, from, flags);
+
+    while (!isFound && DocNextSpan(&it, &span)) {
+        size_t border = MIN(keep, span.len);     // chars of the span which may be a part of a crossing match
+
+        if (direction == SEARCH_FORWARD) {
+            // matches starting in the previous spans come first
+            if (joint.len > 0) {
+                size_t prevLen = joint.len;
+                AppendToJoint(&joint, &span, 0, border);
+
+                const char* start = FindLiteralInSpan(literal, joint.chars, joint.len);
+                if (start && (size_t)(start - joint.chars) < prevLen) {
+                    *match = joint.pos[start - joint.chars];
+                    isFound = !to || IsBefore(match, to);
+                    break;
+                }
+            }
+
+            // the limit cuts starts of matches, the matches themselves may cross it
+            size_t starts = GetCountBefore(&span, to);
+            if (starts > 0) {
+                const char* start = FindLiteralInSpan(literal, span.ptr, MIN(span.len, starts + keep));
+                if (start) {
+                    *match = span.pos;
+                    match->pos.x += start - span.ptr;
+                    isFound = 1;
+                    break;
+                }
+            }
+
+            if (keep > 0) {
+                if (span.len >= keep) {
+                    joint.len = 0;
+                    AppendToJoint(&joint, &span, span.len - keep, keep);
+                } else {
+                    if (joint.len == 0) { AppendToJoint(&joint, &span, 0, span.len); }
+                    CutJoint(&joint, keep, SEARCH_FORWARD);
+                }
+            }
+
+            // the span reaches the limit and the joint has no starts before it
+            if (starts < span.len && (joint.len == 0 || !IsBefore(&joint.pos[0], to))) { break; }
+        } else {
+            // matches ending in the next spans come first
+            if (joint.len > 0) {
+                tmp.len = 0;
+                AppendToJoint(&tmp, &span, span.len - border, border);
+                memcpy(tmp.chars + tmp.len, joint.chars, joint.len);
+                memcpy(tmp.pos + tmp.len, joint.pos, joint.len * sizeof(ModelPos));
+                tmp.len += joint.len;
+
+                const char* start = FindLastLiteralInSpan(literal, tmp.chars, tmp.len);
+                if (start && (size_t)(start - tmp.chars) < border) {
+                    *match = tmp.pos[start - tmp.chars];
+                    isFound = 1;
+                    break;
+                }
+
+                Joint swap = joint;
+                joint = tmp;
+                tmp = swap;
+                CutJoint(&joint, keep, SEARCH_BACKWARD);
+            }
+
+            const char* start = FindLastLiteralInSpan(literal, span.ptr, span.len);
+            if (start) {
+                *match = span.pos;
+                match->pos.x += start - span.ptr;
+                isFound = 1;
+                break;
+            }
+
+            if (keep == 0) { continue; }
+            if (span.len >= keep) {
+                joint.len = 0;
+                AppendToJoint(&joint, &span, 0, keep);
+            } else if (joint.len == 0) {
+                AppendToJoint(&joint, &span, 0, span.len);
+            }
+        }
+    }
+
+    FreeJoint(&joint);
+    FreeJoint(&tmp);
+
+    return isFound;
+}
+
+int FindLiteral(const Document* doc, const Literal* literal, ModelPos from, SearchDirection direction, ModelPos* match) {
+    assert(doc && literal && match);
+
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("FindLiteral");
+
+    return Find(doc, literal, from, NULL, direction, match);
+}
+
+int FindLiteralInRange(const Document* doc, const Literal* literal, ModelPos from, const ModelPos* to, ModelPos* match) {
+    assert(doc && literal && match);
+
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("FindLiteralInRange");
+
+    return Find(doc, literal, from, to, SEARCH_FORWARD, match);
+}
+
+int IsLiteralAt(const Document* doc, const Literal* literal, ModelPos pos) {
+    assert(doc && literal && pos.block);
+
+    DocIterator it;
+    DocSpan span;
+    size_t i = 0;
+
+    InitDocIterator(&it, doc, pos, DOC_ITER_LINE_ENDS);
+    while (i < literal->len && DocNextSpan(&it, &span)) {
+        size_t len = MIN(span.len, literal->len - i);
+
+        for (size_t j = 0; j < len; ++j) {
+            char c = (literal->flags & SEARCH_IGNORE_CASE) ? LowerChar(span.ptr[j]) : span.ptr[j];
+            if (c != literal->pattern[i + j]) { return 0; }
+        }
+        i += len;
+    }
+
+    return i == literal->len;
+}
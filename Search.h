@@ -0,0 +1,119 @@
+#pragma once
+#ifndef SEARCH_H_INCLUDED
+#define SEARCH_H_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+
+typedef enum {
+    SEARCH_MATCH_CASE   = 0,
+    SEARCH_IGNORE_CASE  = 1 << 0    // ASCII letters only
+} SearchFlags;
+
+typedef enum {
+    SEARCH_FORWARD,
+    SEARCH_BACKWARD
+} SearchDirection;
+
+typedef struct {
+    char* pattern;      // pointer to a pattern (folded to lower case with SEARCH_IGNORE_CASE)
+    size_t len;         // length of the pattern
+    int flags;          // SearchFlags
+} Literal;
+
+/**
+ * Creates a literal pattern.
+ * IN:
+ * @param pattern - pointer to chars of the pattern ('\n' matches a line end)
+ * @param len - length of the pattern (> 0)
+ * @param flags - SearchFlags
+ *
+ * OUT:
+ * @return literal - pointer to a literal pattern, NULL on error
+ */
+Literal* CreateLiteral(const char* pattern, size_t len, int flags);
+
+/**
+ * Destroys a literal pattern.
+ * IN:
+ * @param ppLiteral - pointer to pointer to a literal pattern
+ *
+ * OUT:
+ * *ppLiteral - filled with NULL value
+ */
+void DestroyLiteral(Literal** ppLiteral);
+
+/**
+ * Finds the first occurrence of a literal in contiguous chars.
+ * IN:
+ * @param literal - pointer to a literal pattern
+ * @param data - pointer to chars
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return match - pointer to the first char of the occurrence, NULL if there is no one
+ */
+const char* FindLiteralInSpan(const Literal* literal, const char* data, size_t len);
+
+/**
+ * Finds the last occurrence of a literal in contiguous chars.
+ * IN:
+ * @param literal - pointer to a literal pattern
+ * @param data - pointer to chars
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return match - pointer to the first char of the occurrence, NULL if there is no one
+ */
+const char* FindLastLiteralInSpan(const Literal* literal, const char* data, size_t len);
+
+/**
+ * Finds a literal in a document. Occurrences may cross fragments and blocks (a line end is '\n').
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param literal - pointer to a literal pattern
+ * @param from - start position
+ * @param direction - SEARCH_FORWARD: the first occurrence starting at or after the position,
+ *                    SEARCH_BACKWARD: the last occurrence ending at or before the position
+ * @param match - pointer to a position to be filled with the first char of the occurrence
+ *
+ * OUT:
+ * @return isFound - 1 if the occurrence is found, 0 otherwise
+ */
+int FindLiteral(const Document* doc, const Literal* literal, ModelPos from, SearchDirection direction, ModelPos* match);
+
+/**
+ * Finds the first occurrence of a literal which starts in a range of a document.
+ * The occurrence may end after the range. The text after the range isn't read beyond that.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param literal - pointer to a literal pattern
+ * @param from - start of the range
+ * @param to - pointer to the end of the range (NULL - the end of the document)
+ * @param match - pointer to a position to be filled with the first char of the occurrence
+ *
+ * OUT:
+ * @return isFound - 1 if the occurrence is found, 0 otherwise
+ */
+int FindLiteralInRange(const Document* doc, const Literal* literal, ModelPos from, const ModelPos* to, ModelPos* match);
+
+/**
+ * Checks that a literal occurs at a position of a document.
+ * IN:
+ * @param doc - pointer to a Document object
+ * @param literal - pointer to a literal pattern
+ * @param pos - position of the first char of the occurrence
+ *
+ * OUT:
+ * @return isMatch - 1 if the literal occurs at the position, 0 otherwise
+ */
+int IsLiteralAt(const Document* doc, const Literal* literal, ModelPos pos);
+
+#endif // SEARCH_H_INCLUDED
@@ -0,0 +1,322 @@
+#include "Snapshot.h"
+
+static const char lineEnd[] = "\n";
+
+static int Reserve(void** data, size_t* size, size_t len, size_t itemSize) {
+    if (len < *size) { return ERR_SUCCESS; }
+
+    size_t newSize = *size ? 2 * *size : SNAPSHOT_MIN_ITEMS;
+    void* newData = realloc(*data, newSize * itemSize);
+
+    if (!newData) { return ERR_NOMEM; }
+    *data = newData;
+    *size = newSize;
+    return ERR_SUCCESS;
+}
+
+int AddSnapshot(SnapshotSet* set, Snapshot* snapshot) {
+    assert(set && snapshot);
+
+    if (Reserve((void**)&set->items, &set->size, set->len, sizeof(Snapshot*))) { return ERR_NOMEM; }
+
+    set->items[set->len++] = snapshot;
+    set->newest = snapshot->version;
+    return ERR_SUCCESS;
+}
+
+static void FreeStates(BlockState* state) {
+    while (state) {
+        BlockState* older = state->older;
+
+        DestroyListFragment(&state->fragments);
+        free(state);
+        state = older;
+    }
+}
+
+// drops past states which were replaced before every live snapshot, returns 1 if the block keeps some
+static int TrimStates(Block* block, size_t minVersion) {
+    BlockState* state = atomic_load_explicit(&block->data.past, memory_order_relaxed);
+
+    // a reader of a live snapshot stops at a state which is kept and doesn't read its older pointer
+    if (state->validTo <= minVersion) {
+        atomic_store_explicit(&block->data.past, NULL, memory_order_release);
+        FreeStates(state);
+        return 0;
+    }
+
+    while (state->older && state->older->validTo > minVersion) { state = state->older; }
+
+    FreeStates(state->older);
+    state->older = NULL;
+    return 1;
+}
+
+static void FreeRetired(Retired* retired) {
+    switch (retired->type) {
+    case RETIRED_TEXT:
+        free(retired->ptr);
+        break;
+
+    case RETIRED_STRING: {
+        String* text = retired->ptr;
+        DestroyString(&text);
+        break;
+    }
+
+    case RETIRED_BLOCK: {
+        Block* block = retired->ptr;
+        DestroyBlock(&block);
+        break;
+    }
+
+    case RETIRED_BLOCKS: {
+        ListBlock* blocks = retired->ptr;
+        DestroyListBlock(&blocks);
+        break;
+    }
+    }
+}
+
+// frees what snapshots older than the version may read
+static void FreeBefore(SnapshotSet* set, size_t minVersion) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < set->pastLen; ++i) {
+        if (TrimStates(set->pastBlocks[i], minVersion)) { set->pastBlocks[kept++] = set->pastBlocks[i]; }
+    }
+    set->pastLen = kept;
+
+    // past states of retired blocks are older than them, so they are freed above
+    kept = 0;
+    for (size_t i = 0; i < set->retiredLen; ++i) {
+        if (set->retired[i].version <= minVersion) {
+            FreeRetired(&set->retired[i]);
+        } else {
+            set->retired[kept++] = set->retired[i];
+        }
+    }
+    set->retiredLen = kept;
+}
+
+void CollectSnapshots(SnapshotSet* set) {
+    assert(set);
+
+    size_t kept = 0;
+    size_t minVersion = SIZE_MAX;
+
+    for (size_t i = 0; i < set->len; ++i) {
+        Snapshot* snapshot = set->items[i];
+
+        if (atomic_load_explicit(&snapshot->isReleased, memory_order_acquire)) {
+            free(snapshot);
+            continue;
+        }
+
+        if (minVersion > snapshot->version) { minVersion = snapshot->version; }
+        set->items[kept++] = snapshot;
+    }
+
+    if (kept == set->len) { return; }
+
+    TRACE_SCOPE("CollectSnapshots");
+
+    set->len = kept;
+    FreeBefore(set, minVersion);
+}
+
+void FreeSnapshots(SnapshotSet* set) {
+    assert(set);
+
+    for (size_t i = 0; i < set->len; ++i) {
+        assert(atomic_load(&set->items[i]->isReleased));
+        free(set->items[i]);
+    }
+    FreeBefore(set, SIZE_MAX);
+
+    free(set->items);
+    free(set->pastBlocks);
+    free(set->retired);
+    memset(set, 0, sizeof(SnapshotSet));
+}
+
+static ListFragment* CopyFragments(const ListFragment* fragments) {
+    ListFragment* copy = CreateListFragment();
+    if (!copy) { return NULL; }
+
+    for (Fragment* fragment = fragments->nodes; fragment; fragment = fragment->next) {
+        if (AddFragmentData(copy, &fragment->data)) {
+            DestroyListFragment(&copy);
+            return NULL;
+        }
+    }
+    COUNTER_ADD(COUNTER_FRAGMENTS_VISITED, fragments->len);
+
+    return copy;
+}
+
+int PreserveBlock(SnapshotSet* set, Block* block, size_t version) {
+    assert(set && block);
+
+    CollectSnapshots(set);
+
+    size_t stateVersion = atomic_load_explicit(&block->data.stateVersion, memory_order_relaxed);
+    BlockState* past = atomic_load_explicit(&block->data.past, memory_order_relaxed);
+
+    if (!set->len || stateVersion > set->newest) { return ERR_SUCCESS; }
+
+    if (!past && Reserve((void**)&set->pastBlocks, &set->pastSize, set->pastLen, sizeof(Block*))) { return ERR_NOMEM; }
+
+    BlockState* state = malloc(sizeof(BlockState));
+    ListFragment* copy = CopyFragments(block->data.fragments);
+
+    if (!state || !copy) {
+        free(state);
+        if (copy) { DestroyListFragment(&copy); }
+        return ERR_NOMEM;
+    }
+
+    state->validFrom = stateVersion;
+    state->validTo = version;
+    state->len = block->data.len;
+    state->fragments = block->data.fragments;
+    state->next = block->next;
+    state->older = past;
+
+    if (!past) { set->pastBlocks[set->pastLen++] = block; }
+
+    // the state is published before the block is changed: a reader seeing a new stateVersion finds it
+    atomic_store_explicit(&block->data.past, state, memory_order_release);
+    atomic_store_explicit(&block->data.stateVersion, version, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+
+    block->data.fragments = copy;
+    return ERR_SUCCESS;
+}
+
+void RetireMemory(SnapshotSet* set, RetiredType type, void* ptr, size_t version) {
+    assert(set && ptr);
+
+    // freed memory might be read, so it's rather lost
+    if (Reserve((void**)&set->retired, &set->retiredSize, set->retiredLen, sizeof(Retired))) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return;
+    }
+
+    Retired retired = { type, version, ptr };
+    set->retired[set->retiredLen++] = retired;
+}
+
+void ReleaseSnapshot(Snapshot* snapshot) {
+    assert(snapshot);
+
+    atomic_store_explicit(&snapshot->isReleased, 1, memory_order_release);
+}
+
+// the current state is read as a seqlock: it is valid if the stateVersion of the block isn't changed while it's read
+void GetBlockState(Block* block, size_t version, BlockState* state) {
+    assert(block && state);
+
+    for (;;) {
+        size_t stateVersion = atomic_load_explicit(&block->data.stateVersion, memory_order_acquire);
+
+        if (stateVersion > version) {
+            BlockState* past = atomic_load_explicit(&block->data.past, memory_order_acquire);
+
+            while (past->validFrom > version) { past = past->older; }
+            *state = *past;
+            return;
+        }
+
+        state->len = block->data.len;
+        state->fragments = block->data.fragments;
+        state->next = block->next;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&block->data.stateVersion, memory_order_relaxed) == stateVersion) { return; }
+    }
+}
+
+void InitSnapshotIterator(SnapshotIterator* it, const Snapshot* snapshot) {
+    assert(it && snapshot && snapshot->blocks);
+
+    it->snapshot = snapshot;
+    GetBlockState(snapshot->blocks, snapshot->version, &it->state);
+    it->fragment = it->state.fragments->nodes;
+    it->y = 0;
+    it->x = 0;
+    it->isLineEndDone = 0;
+}
+
+static void SetSpan(SnapshotSpan* span, const char* ptr, size_t len, size_t y, size_t x, int isLineEnd) {
+    span->ptr = ptr;
+    span->len = len;
+    span->y = y;
+    span->x = x;
+    span->isLineEnd = isLineEnd;
+}
+
+int SnapshotNextSpan(SnapshotIterator* it, SnapshotSpan* span) {
+    assert(it && span);
+
+    const Snapshot* snapshot = it->snapshot;
+
+    for (;;) {
+        Fragment* fragment = it->fragment;
+
+        if (fragment) {
+            it->fragment = fragment->next;
+            it->x += fragment->data.len;
+
+            if (fragment->data.len) {
+                assert(fragment->data.pos + fragment->data.len <= snapshot->textLen);
+
+                SetSpan(span, snapshot->text + fragment->data.pos, fragment->data.len,
+                        it->y, it->x - fragment->data.len, 0);
+                return 1;
+            }
+            continue;
+        }
+
+        // the block is passed
+        if (it->y + 1 >= snapshot->blocksLen) { return 0; }
+
+        if (!it->isLineEndDone) {
+            it->isLineEndDone = 1;
+            SetSpan(span, lineEnd, 1, it->y, it->state.len, 1);
+            return 1;
+        }
+
+        GetBlockState(it->state.next, snapshot->version, &it->state);
+        it->fragment = it->state.fragments->nodes;
+        ++it->y;
+        it->x = 0;
+        it->isLineEndDone = 0;
+    }
+}
+
+int SaveSnapshot(const Snapshot* snapshot, const char* filename) {
+    assert(snapshot && filename);
+    TRACE_SCOPE("SaveSnapshot");
+
+    FILE* file = fopen(filename, "w");
+
+    if (!file) {
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return ERR_OPEN_FILE;
+    }
+
+    SnapshotIterator it;
+    SnapshotSpan span;
+    int errValue = ERR_SUCCESS;
+
+    InitSnapshotIterator(&it, snapshot);
+    while (!errValue && SnapshotNextSpan(&it, &span)) {
+        if (fwrite(span.ptr, sizeof(char), span.len, file) != span.len) { errValue = ERR_WRITE; }
+    }
+
+    if (fclose(file) && !errValue) { errValue = ERR_WRITE; }
+    if (errValue) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+
+    return errValue;
+}
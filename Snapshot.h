@@ -0,0 +1,187 @@
+#pragma once
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "String.h"
+#include "Fragment.h"
+#include "Block.h"
+
+#define SNAPSHOT_MIN_ITEMS 8    // initial capacity of the arrays of a snapshot set
+
+/**
+ * A read-only view of a document at a version. It is taken in O(1) by the thread editing
+ * the document and read by any thread without locks: it refers to the blocks of the document,
+ * and a block seen by a live snapshot keeps its state for it (copy-on-write of its fragments)
+ * before it's changed. The text is append-only, so the snapshot reads chars of its length only.
+ * The reader releases the snapshot when it's done.
+ */
+typedef struct {
+    size_t version;         // version of the document
+    const char* text;       // chars of the text (the buffer is kept while the snapshot lives)
+    size_t textLen;
+    Block* blocks;          // the first block at the version
+    size_t blocksLen;       // count of blocks at the version
+    atomic_int isReleased;  // set by the reader
+} Snapshot;
+
+typedef enum {
+    RETIRED_TEXT,       // a buffer of chars of the text
+    RETIRED_STRING,     // a String of the text
+    RETIRED_BLOCK,      // a block out of the document
+    RETIRED_BLOCKS      // a list of blocks of a replaced file
+} RetiredType;
+
+// memory which snapshots older than the version may read: it is freed after them
+typedef struct {
+    RetiredType type;
+    size_t version;
+    void* ptr;
+} Retired;
+
+/**
+ * Snapshots of a document and memory kept for them. Only the thread editing the document
+ * changes it; readers only set isReleased of their snapshots.
+ */
+typedef struct {
+    Snapshot** items;       // live snapshots and released ones which aren't collected yet
+    size_t len;
+    size_t size;
+    size_t newest;          // version of the newest snapshot
+    Block** pastBlocks;     // blocks having past states
+    size_t pastLen;
+    size_t pastSize;
+    Retired* retired;
+    size_t retiredLen;
+    size_t retiredSize;
+} SnapshotSet;
+
+typedef struct {
+    const char* ptr;    // pointer to the first char of the span
+    size_t len;         // length of the span
+    size_t y;           // index of the block
+    size_t x;           // position of the first char in the block (a line end is at the block length)
+    int isLineEnd;      // flag of a line end span
+} SnapshotSpan;
+
+typedef struct {
+    const Snapshot* snapshot;
+    BlockState state;       // state of the current block at the version of the snapshot
+    Fragment* fragment;     // current fragment (NULL - the block is passed)
+    size_t y;               // index of the current block
+    size_t x;               // position of the current fragment in the block
+    int isLineEndDone;      // the line end of the current block is yielded
+} SnapshotIterator;
+
+
+// the editing thread
+/**
+ * Adds a snapshot to a set, it becomes the newest one.
+ * IN:
+ * @param set - pointer to a snapshot set
+ * @param snapshot - pointer to a snapshot
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int AddSnapshot(SnapshotSet* set, Snapshot* snapshot);
+
+/**
+ * Frees released snapshots, past states of blocks and retired memory which no live snapshot reads.
+ * IN:
+ * @param set - pointer to a snapshot set
+ */
+void CollectSnapshots(SnapshotSet* set);
+
+/**
+ * Frees a snapshot set with all it keeps. Its snapshots must be released.
+ * IN:
+ * @param set - pointer to a snapshot set
+ */
+void FreeSnapshots(SnapshotSet* set);
+
+/**
+ * Keeps the state of a block for the live snapshots before the block is changed: the state
+ * becomes a past state and the block gets a copy of its fragments. A block changed since
+ * the newest snapshot is changed in place.
+ * IN:
+ * @param set - pointer to a snapshot set
+ * @param block - pointer to a block
+ * @param version - version of the document after the change
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation (the block is unchanged on error)
+ */
+int PreserveBlock(SnapshotSet* set, Block* block, size_t version);
+
+/**
+ * Hands memory which live snapshots may read to a set instead of freeing it.
+ * On error the memory stays allocated.
+ * IN:
+ * @param set - pointer to a snapshot set
+ * @param type - type of the memory
+ * @param ptr - pointer to the memory
+ * @param version - version of the document after the memory is dropped
+ */
+void RetireMemory(SnapshotSet* set, RetiredType type, void* ptr, size_t version);
+
+
+// readers
+/**
+ * Releases a snapshot, it must not be read after. Any thread may release it.
+ * IN:
+ * @param snapshot - pointer to a snapshot
+ */
+void ReleaseSnapshot(Snapshot* snapshot);
+
+/**
+ * Gets the state of a block at the version of a live snapshot: its length, its fragments
+ * and the next block. The fragments aren't changed while the snapshot lives.
+ * IN:
+ * @param block - pointer to a block of the snapshot
+ * @param version - version of the snapshot
+ * @param state - pointer to a state to be filled (older isn't used)
+ */
+void GetBlockState(Block* block, size_t version, BlockState* state);
+
+/**
+ * Inits an iterator over contiguous spans of the text of a snapshot.
+ * IN:
+ * @param it - pointer to an iterator
+ * @param snapshot - pointer to a snapshot
+ */
+void InitSnapshotIterator(SnapshotIterator* it, const Snapshot* snapshot);
+
+/**
+ * Gets the next span, line ends between blocks are spans too. Empty fragments are skipped.
+ * IN:
+ * @param it - pointer to an iterator
+ * @param span - pointer to a span to be filled
+ *
+ * OUT:
+ * @return isSpan - 1 if the span is filled, 0 at the end of the snapshot
+ */
+int SnapshotNextSpan(SnapshotIterator* it, SnapshotSpan* span);
+
+/**
+ * Writes the text of a snapshot to a file.
+ * IN:
+ * @param snapshot - pointer to a snapshot
+ * @param filename - pointer to a file name
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int SaveSnapshot(const Snapshot* snapshot, const char* filename);
+
+#endif // SNAPSHOT_H_INCLUDED
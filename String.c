@@ -5,13 +5,19 @@ static int ResizeString(String* str) {
 
     char* tmpData = NULL;
 
-    str->size = DIV_WITH_ROUND_UP(str->len, BASE_STRING_SIZE);
-    str->size *= BASE_STRING_SIZE;
+    // keep a room for the terminating null character; the size grows by half,
+    // so appending n chars costs O(n) copies instead of O(n^2 / BASE_STRING_SIZE)
+    size_t size = str->size + str->size / 2;
+    if (size < str->len + 1) { size = str->len + 1; }
+    size = DIV_WITH_ROUND_UP(size, BASE_STRING_SIZE) * BASE_STRING_SIZE;
 
-    tmpData = realloc(str->data, str->size * sizeof(char));
+    COUNTER_ADD(COUNTER_REALLOCATIONS, 1);
+    COUNTER_ADD(COUNTER_BYTES_REALLOCATED, str->len);
+    tmpData = realloc(str->data, size * sizeof(char));
 
     if (tmpData) {
         str->data = tmpData;
+        str->size = size;
         return 0;
     }
     return -1;
@@ -23,6 +29,7 @@ int ReserveSize(String* str, size_t size) {
     str->size = DIV_WITH_ROUND_UP(size, BASE_STRING_SIZE);
     str->size *= BASE_STRING_SIZE;
 
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     str->data = malloc(sizeof(char) * str->size);
     if (!str->data) { return -1; }
 
@@ -37,15 +44,18 @@ static int SetString(String* str, const char* src) {
         str->size = DIV_WITH_ROUND_UP(str->len, BASE_STRING_SIZE);
         str->size *= BASE_STRING_SIZE;
 
+        COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
         str->data = malloc(str->size * sizeof(char));
         if (!str->data) { return -1; }
 
+        COUNTER_ADD(COUNTER_BYTES_COPIED, str->len);
         strncpy(str->data, src, str->len);
     }
     return 0;
 }
 
 String* CreateString(const char* src) {
+    COUNTER_ADD(COUNTER_ALLOCATIONS, 1);
     String* str = calloc(1, sizeof(String));
     if (str && src) { 
         if (SetString(str, src)) {
@@ -76,6 +86,7 @@ int AddString(String* str, const char* src) {
         if (oldLen < str->len) {
             if (str->len > str->size && ResizeString(str)) { return -1; }
 
+            COUNTER_ADD(COUNTER_BYTES_COPIED, str->len - oldLen);
             strncpy(str->data + oldLen, src, str->len - oldLen);
         }
         return str->len - oldLen;
@@ -89,8 +100,9 @@ int AddChar(String* str, char c) {
 
     if (str->data) {
         ++str->len;
-        if (str->len > str->size && ResizeString(str)) { return -1; }
+        if (str->len >= str->size && ResizeString(str)) { return -1; }
 
+        COUNTER_ADD(COUNTER_BYTES_COPIED, 1);
         str->data[str->len - 1] = c;
         str->data[str->len] = '\0';    
         return str->len;
@@ -104,6 +116,23 @@ int AddChar(String* str, char c) {
     return SetString(str, tmp);
 }
 
+int AddChars(String* str, const char* src, size_t len) {
+    assert(str && str->data && (src || !len));
+
+    size_t oldLen = str->len;
+
+    str->len += len;
+    if (str->len >= str->size && ResizeString(str)) {
+        str->len = oldLen;
+        return -1;
+    }
+
+    COUNTER_ADD(COUNTER_BYTES_COPIED, len);
+    memcpy(str->data + oldLen, src, len);
+    str->data[str->len] = '\0';
+    return 0;
+}
+
 size_t PrintString(FILE* output, const String* str) {
     assert(str && str->data);
 
@@ -11,6 +11,7 @@
 #include <assert.h>
 
 #include "Error.h"
+#include "Counters.h"
 
 typedef struct String_tag {
     size_t size;    // reserved size
@@ -71,6 +72,18 @@ int AddString(String* str, const char* src);
  */
 int AddChar(String* str, char c);
 
+/**
+ * Adds chars to a String object. The chars may contain '\0'.
+ * IN:
+ * @param str - pointer to a String object with reserved data
+ * @param src - pointer to chars that should be added
+ * @param len - count of chars
+ *
+ * OUT:
+ * @return err - error value
+ */
+int AddChars(String* str, const char* src, size_t len);
+
 /**
  * Prints string.
  * IN:
@@ -0,0 +1,318 @@
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE Cond;
+    typedef HANDLE Thread;
+
+    static void InitMutex(Mutex* mutex) { InitializeCriticalSection(mutex); }
+    static void FreeMutex(Mutex* mutex) { DeleteCriticalSection(mutex); }
+    static void LockMutex(Mutex* mutex) { EnterCriticalSection(mutex); }
+    static void UnlockMutex(Mutex* mutex) { LeaveCriticalSection(mutex); }
+
+    static void InitCond(Cond* cond) { InitializeConditionVariable(cond); }
+    static void FreeCond(Cond* cond) { (void)cond; }
+    static void WaitCond(Cond* cond, Mutex* mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+    static void BroadcastCond(Cond* cond) { WakeAllConditionVariable(cond); }
+
+    static size_t GetProcessorsCount() {
+        SYSTEM_INFO info;
+
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors;
+    }
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t Cond;
+    typedef pthread_t Thread;
+
+    static void InitMutex(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+    static void FreeMutex(Mutex* mutex) { pthread_mutex_destroy(mutex); }
+    static void LockMutex(Mutex* mutex) { pthread_mutex_lock(mutex); }
+    static void UnlockMutex(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+
+    static void InitCond(Cond* cond) { pthread_cond_init(cond, NULL); }
+    static void FreeCond(Cond* cond) { pthread_cond_destroy(cond); }
+    static void WaitCond(Cond* cond, Mutex* mutex) { pthread_cond_wait(cond, mutex); }
+    static void BroadcastCond(Cond* cond) { pthread_cond_broadcast(cond); }
+
+    static size_t GetProcessorsCount() {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (size_t)count : 1;
+    }
+#endif
+
+typedef struct {
+    ThreadTask task;
+    void* arg;
+    TaskGroup* group;
+} Task;
+
+// ring buffer of tasks
+typedef struct {
+    Mutex mutex;
+    Task* tasks;
+    size_t head;        // index of the front task
+    size_t len;
+    size_t size;
+} TaskDeque;
+
+typedef struct {
+    ThreadPool* pool;
+    size_t index;
+    Thread thread;
+    TaskDeque deque;
+} Worker;
+
+struct ThreadPool_tag {
+    Worker* workers;
+    size_t workersCount;
+    atomic_size_t next;         // worker for the next submitted task
+    atomic_size_t queued;       // count of tasks in deques
+
+    Mutex mutex;                // guards sleeping and waiting
+    Cond workCond;              // a task is queued or the pool is stopped
+    Cond doneCond;              // a group has no pending tasks
+    int isStopped;
+};
+
+static int PushBack(TaskDeque* deque, const Task* task) {
+    if (deque->len == deque->size) {
+        size_t size = deque->size ? 2 * deque->size : 64;
+        Task* tasks = malloc(size * sizeof(Task));
+
+        if (!tasks) { return ERR_NOMEM; }
+
+        for (size_t i = 0; i < deque->len; ++i) { tasks[i] = deque->tasks[(deque->head + i) % deque->size]; }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->size = size;
+    }
+
+    deque->tasks[(deque->head + deque->len) % deque->size] = *task;
+    ++deque->len;
+    return ERR_SUCCESS;
+}
+
+static int PopFront(TaskDeque* deque, Task* task) {
+    if (!deque->len) { return 0; }
+
+    *task = deque->tasks[deque->head];
+    deque->head = (deque->head + 1) % deque->size;
+    --deque->len;
+    return 1;
+}
+
+static int PopBack(TaskDeque* deque, Task* task) {
+    if (!deque->len) { return 0; }
+
+    --deque->len;
+    *task = deque->tasks[(deque->head + deque->len) % deque->size];
+    return 1;
+}
+
+// takes an own task or steals one from the back of another worker
+static int TakeTask(ThreadPool* pool, size_t index, Task* task) {
+    TaskDeque* own = &pool->workers[index].deque;
+    int isTaken;
+
+    LockMutex(&own->mutex);
+    isTaken = PopFront(own, task);
+    UnlockMutex(&own->mutex);
+
+    for (size_t i = 1; !isTaken && i < pool->workersCount; ++i) {
+        TaskDeque* victim = &pool->workers[(index + i) % pool->workersCount].deque;
+
+        LockMutex(&victim->mutex);
+        isTaken = PopBack(victim, task);
+        UnlockMutex(&victim->mutex);
+    }
+
+    if (isTaken) { atomic_fetch_sub(&pool->queued, 1); }
+    return isTaken;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI RunWorker(LPVOID param) {
+#else
+static void* RunWorker(void* param) {
+#endif
+    Worker* worker = param;
+    ThreadPool* pool = worker->pool;
+    char name[32];
+
+    snprintf(name, sizeof(name), "Worker %zu", worker->index);
+    TraceSetThreadName(name);
+
+    for (;;) {
+        Task task;
+
+        if (TakeTask(pool, worker->index, &task)) {
+            task.task(task.arg, worker->index);
+
+            if (atomic_fetch_sub(&task.group->pending, 1) == 1) {
+                LockMutex(&pool->mutex);
+                BroadcastCond(&pool->doneCond);
+                UnlockMutex(&pool->mutex);
+            }
+            continue;
+        }
+
+        LockMutex(&pool->mutex);
+        while (!pool->isStopped && !atomic_load(&pool->queued)) { WaitCond(&pool->workCond, &pool->mutex); }
+
+        int isStopped = pool->isStopped && !atomic_load(&pool->queued);
+        UnlockMutex(&pool->mutex);
+
+        if (isStopped) { break; }
+    }
+
+    return 0;
+}
+
+static int StartThread(Worker* worker) {
+#ifdef _WIN32
+    worker->thread = CreateThread(NULL, 0, RunWorker, worker, 0, NULL);
+    return worker->thread ? ERR_SUCCESS : ERR_UNKNOWN;
+#else
+    return pthread_create(&worker->thread, NULL, RunWorker, worker) ? ERR_UNKNOWN : ERR_SUCCESS;
+#endif
+}
+
+static void JoinThread(Worker* worker) {
+#ifdef _WIN32
+    WaitForSingleObject(worker->thread, INFINITE);
+    CloseHandle(worker->thread);
+#else
+    pthread_join(worker->thread, NULL);
+#endif
+}
+
+// stops and frees the first count workers
+static void StopWorkers(ThreadPool* pool, size_t count) {
+    LockMutex(&pool->mutex);
+    pool->isStopped = 1;
+    BroadcastCond(&pool->workCond);
+    UnlockMutex(&pool->mutex);
+
+    for (size_t i = 0; i < count; ++i) { JoinThread(&pool->workers[i]); }
+
+    for (size_t i = 0; i < pool->workersCount; ++i) {
+        FreeMutex(&pool->workers[i].deque.mutex);
+        free(pool->workers[i].deque.tasks);
+    }
+}
+
+ThreadPool* CreateThreadPool(size_t threadsCount) {
+    if (!threadsCount) { threadsCount = GetProcessorsCount(); }
+    if (threadsCount > THREADPOOL_MAX_THREADS) { threadsCount = THREADPOOL_MAX_THREADS; }
+
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) { return NULL; }
+
+    pool->workers = calloc(threadsCount, sizeof(Worker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->workersCount = threadsCount;
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->queued, 0);
+    InitMutex(&pool->mutex);
+    InitCond(&pool->workCond);
+    InitCond(&pool->doneCond);
+
+    for (size_t i = 0; i < threadsCount; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        InitMutex(&pool->workers[i].deque.mutex);
+    }
+
+    for (size_t i = 0; i < threadsCount; ++i) {
+        if (StartThread(&pool->workers[i])) {
+            PrintError(NULL, ERR_UNKNOWN, __FILE__, __LINE__);
+            StopWorkers(pool, i);
+            FreeCond(&pool->workCond);
+            FreeCond(&pool->doneCond);
+            FreeMutex(&pool->mutex);
+            free(pool->workers);
+            free(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void DestroyThreadPool(ThreadPool** ppPool) {
+    assert(ppPool);
+
+    ThreadPool* pool = *ppPool;
+    if (!pool) { return; }
+
+    StopWorkers(pool, pool->workersCount);
+    FreeCond(&pool->workCond);
+    FreeCond(&pool->doneCond);
+    FreeMutex(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+
+    *ppPool = NULL;
+}
+
+size_t ThreadPoolSize(const ThreadPool* pool) {
+    assert(pool);
+    return pool->workersCount;
+}
+
+void InitTaskGroup(TaskGroup* group) {
+    assert(group);
+    atomic_init(&group->pending, 0);
+}
+
+int ThreadPoolSubmit(ThreadPool* pool, TaskGroup* group, ThreadTask task, void* arg) {
+    assert(pool && group && task);
+
+    Task item = { task, arg, group };
+    TaskDeque* deque = &pool->workers[atomic_fetch_add(&pool->next, 1) % pool->workersCount].deque;
+
+    atomic_fetch_add(&group->pending, 1);
+
+    // a task is counted before it's visible, so a worker never sees a task which isn't counted
+    LockMutex(&pool->mutex);
+    atomic_fetch_add(&pool->queued, 1);
+    UnlockMutex(&pool->mutex);
+
+    LockMutex(&deque->mutex);
+    int errValue = PushBack(deque, &item);
+    UnlockMutex(&deque->mutex);
+
+    LockMutex(&pool->mutex);
+    if (errValue) {
+        atomic_fetch_sub(&pool->queued, 1);
+    } else {
+        BroadcastCond(&pool->workCond);
+    }
+    UnlockMutex(&pool->mutex);
+
+    if (errValue) {
+        atomic_fetch_sub(&group->pending, 1);
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+    }
+    return errValue;
+}
+
+void ThreadPoolWait(ThreadPool* pool, TaskGroup* group) {
+    assert(pool && group);
+
+    LockMutex(&pool->mutex);
+    while (atomic_load(&group->pending)) { WaitCond(&pool->doneCond, &pool->mutex); }
+    UnlockMutex(&pool->mutex);
+}
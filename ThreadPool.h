@@ -0,0 +1,91 @@
+#pragma once
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Trace.h"
+
+// upper limit of worker threads (counters and traces are kept per thread)
+#define THREADPOOL_MAX_THREADS 32
+
+/**
+ * Task of a pool.
+ * IN:
+ * @param arg - argument given on submission
+ * @param worker - index of the worker running the task (0 .. ThreadPoolSize() - 1)
+ */
+typedef void (*ThreadTask)(void* arg, size_t worker);
+
+typedef struct {
+    atomic_size_t pending;      // count of submitted and not finished tasks
+} TaskGroup;
+
+typedef struct ThreadPool_tag ThreadPool;
+
+/**
+ * Starts worker threads. Every worker has a deque of tasks: it takes its own tasks
+ * from the front (in the order of submission) and steals tasks of other workers from the back.
+ * IN:
+ * @param threadsCount - count of workers (0 - count of processors)
+ *
+ * OUT:
+ * @return pool - pointer to a pool, NULL on error
+ */
+ThreadPool* CreateThreadPool(size_t threadsCount);
+
+/**
+ * Stops workers after they finish submitted tasks and frees the pool.
+ * IN:
+ * @param ppPool - pointer to pointer to a pool
+ *
+ * OUT:
+ * *ppPool - filled with NULL value
+ */
+void DestroyThreadPool(ThreadPool** ppPool);
+
+/**
+ * Gets count of workers.
+ * IN:
+ * @param pool - pointer to a pool
+ *
+ * OUT:
+ * @return count - count of workers
+ */
+size_t ThreadPoolSize(const ThreadPool* pool);
+
+/**
+ * Initializes a group of tasks.
+ * IN:
+ * @param group - pointer to a group
+ */
+void InitTaskGroup(TaskGroup* group);
+
+/**
+ * Queues a task. Tasks are spread over workers round-robin.
+ * IN:
+ * @param pool - pointer to a pool
+ * @param group - pointer to a group of the task
+ * @param task - function of the task
+ * @param arg - argument of the task
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int ThreadPoolSubmit(ThreadPool* pool, TaskGroup* group, ThreadTask task, void* arg);
+
+/**
+ * Blocks the calling thread until all tasks of a group are finished.
+ * It must not be called by workers of the pool.
+ * IN:
+ * @param pool - pointer to a pool
+ * @param group - pointer to a group
+ */
+void ThreadPoolWait(ThreadPool* pool, TaskGroup* group);
+
+#endif // THREADPOOL_H_INCLUDED
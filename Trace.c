@@ -0,0 +1,150 @@
+#include "Trace.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "Clock.h"
+
+#define RING_MASK (TRACE_RING_SIZE - 1)
+
+typedef struct TraceEvent_tag {
+    const char* name;   // name of an event
+    uint64_t start;     // start time, ns
+    uint64_t duration;  // duration, ns
+} TraceEvent;
+
+typedef struct TraceThread_tag {
+    size_t tid;                     // index of a thread in trace
+    const char* name;               // name of a thread (NULL if it's not set)
+    atomic_size_t head;             // count of recorded events (written by owner)
+    atomic_size_t tail;             // count of flushed events (written by flush)
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceThread;
+
+static _Atomic(TraceThread*) threads[TRACE_MAX_THREADS];
+static atomic_size_t threadsCount;
+static _Thread_local TraceThread* localThread;
+
+static TraceThread* GetLocalThread() {
+    if (localThread) { return localThread; }
+
+    size_t index = atomic_fetch_add(&threadsCount, 1);
+    if (index >= TRACE_MAX_THREADS) {
+        atomic_fetch_sub(&threadsCount, 1);
+        return NULL;
+    }
+
+    TraceThread* thread = calloc(1, sizeof(TraceThread));
+    if (!thread) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+    thread->tid = index;
+
+    atomic_store_explicit(&threads[index], thread, memory_order_release);
+    localThread = thread;
+    return thread;
+}
+
+TraceScope TraceBegin(const char* name) {
+    TraceScope scope = { name, GetMonotonicTime() };
+    return scope;
+}
+
+void TraceEnd(const TraceScope* scope) {
+    assert(scope);
+
+    uint64_t end = GetMonotonicTime();
+    TraceThread* thread = GetLocalThread();
+
+    if (!thread) { return; }
+
+    size_t head = atomic_load_explicit(&(thread->head), memory_order_relaxed);
+    TraceEvent* event = &(thread->events[head & RING_MASK]);
+
+    event->name = scope->name;
+    event->start = scope->start;
+    event->duration = end - scope->start;
+
+    // publish the event
+    atomic_store_explicit(&(thread->head), head + 1, memory_order_release);
+}
+
+void TraceSetThreadName(const char* name) {
+    TraceThread* thread = GetLocalThread();
+    if (thread) { thread->name = name; }
+}
+
+static void PrintEvent(FILE* output, const TraceEvent* event, size_t tid, int* pIsFirst) {
+    fprintf(output, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%zu}",
+        *pIsFirst ? "" : ",", event->name,
+        (double)event->start / NS_PER_US, (double)event->duration / NS_PER_US, tid);
+    *pIsFirst = 0;
+}
+
+static void FlushThread(FILE* output, TraceThread* thread, TraceEvent* buffer, int* pIsFirst) {
+    size_t head = atomic_load_explicit(&(thread->head), memory_order_acquire);
+    size_t tail = atomic_load_explicit(&(thread->tail), memory_order_relaxed);
+
+    if (head - tail > TRACE_RING_SIZE) { tail = head - TRACE_RING_SIZE; }
+
+    size_t first = tail;
+    for (size_t i = tail; i < head; ++i) {
+        buffer[i - first] = thread->events[i & RING_MASK];
+    }
+
+    // the owner could overwrite the oldest copied events (and be writing the next one) while copying
+    size_t newHead = atomic_load_explicit(&(thread->head), memory_order_acquire);
+    if (newHead + 1 > tail + TRACE_RING_SIZE) {
+        tail = newHead + 1 - TRACE_RING_SIZE;
+        if (tail > head) { tail = head; }
+    }
+
+    if (thread->name) {
+        fprintf(output, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+            *pIsFirst ? "" : ",", thread->tid, thread->name);
+        *pIsFirst = 0;
+    }
+
+    for (size_t i = tail; i < head; ++i) {
+        PrintEvent(output, &buffer[i - first], thread->tid, pIsFirst);
+    }
+
+    atomic_store_explicit(&(thread->tail), head, memory_order_relaxed);
+}
+
+int TraceFlush(FILE* output) {
+    assert(output);
+
+    int isFirst = 1;
+    TraceEvent* buffer = malloc(TRACE_RING_SIZE * sizeof(TraceEvent));
+
+    if (!buffer) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    size_t count = atomic_load(&threadsCount);
+    if (count > TRACE_MAX_THREADS) { count = TRACE_MAX_THREADS; }
+
+    fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (size_t i = 0; i < count; ++i) {
+        TraceThread* thread = atomic_load_explicit(&threads[i], memory_order_acquire);
+        if (thread) { FlushThread(output, thread, buffer, &isFirst); }
+    }
+    fprintf(output, "\n]}\n");
+
+    free(buffer);
+    return ERR_SUCCESS;
+}
+
+void TraceShutdown() {
+    size_t count = atomic_exchange(&threadsCount, 0);
+    if (count > TRACE_MAX_THREADS) { count = TRACE_MAX_THREADS; }
+
+    for (size_t i = 0; i < count; ++i) {
+        TraceThread* thread = atomic_exchange(&threads[i], NULL);
+        if (thread) { free(thread); }
+    }
+    localThread = NULL;
+}
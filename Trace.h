@@ -0,0 +1,78 @@
+#pragma once
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#define TRACE_ON
+// #define TRACE_OFF
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "Error.h"
+
+// events in a ring buffer of a thread (power of two); the oldest events are overwritten
+#define TRACE_RING_SIZE (1 << 16)
+// upper limit of threads that can record events
+#define TRACE_MAX_THREADS 64
+
+typedef struct TraceScope_tag {
+    const char* name;   // name of an event (string literal)
+    uint64_t start;     // start time, ns
+} TraceScope;
+
+/**
+ * Starts a scoped event.
+ * IN:
+ * @param name - name of an event. It must live until the end of program (string literal)
+ *
+ * OUT:
+ * @return scope - started scope
+ */
+TraceScope TraceBegin(const char* name);
+
+/**
+ * Ends a scoped event and records it to the ring buffer of the calling thread.
+ * IN:
+ * @param scope - pointer to a started scope
+ */
+void TraceEnd(const TraceScope* scope);
+
+/**
+ * Sets a name of the calling thread that is shown by trace viewers.
+ * IN:
+ * @param name - name of a thread. It must live until the end of program (string literal)
+ */
+void TraceSetThreadName(const char* name);
+
+/**
+ * Writes events of all threads recorded since the last flush in Chrome trace JSON format.
+ * IN:
+ * @param output - pointer to a stream
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+int TraceFlush(FILE* output);
+
+/**
+ * Frees ring buffers of all threads. No thread may record events after it.
+ */
+void TraceShutdown();
+
+#ifdef TRACE_ON
+    #define TRACE_CONCAT_(a, b) a##b
+    #define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+    #ifdef __GNUC__
+        // the event lasts until the end of an enclosing scope
+        #define TRACE_SCOPE(name) \
+            TraceScope TRACE_CONCAT(traceScope, __LINE__) __attribute__((cleanup(TraceEnd))) = TraceBegin(name)
+    #else
+        #define TRACE_SCOPE(name) ((void)0)
+    #endif
+#else
+    #define TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif // TRACE_H_INCLUDED
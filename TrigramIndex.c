@@ -0,0 +1,763 @@
+#include "TrigramIndex.h"
+
+#define TRIGRAM_MAGIC_LEN 4
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    uint32_t key;       // chars of the trigram + 1 (0 - free entry)
+    size_t count;       // count of blocks containing the trigram
+    size_t lastId;      // ID of the last added block
+    uint8_t* data;      // varints: the first ID, then deltas to the previous one
+    size_t len;
+    size_t size;
+} Posting;
+
+typedef struct {
+    const uint8_t* data;    // the next varint
+    size_t id;              // the last decoded ID
+    size_t done;            // count of decoded IDs
+    size_t count;
+} PostingReader;
+
+struct TrigramIndex_tag {
+    ThreadPool* pool;
+    const Document* doc;
+    Snapshot* snapshot;         // the indexed version of the document (NULL - released when the work is done)
+    char* filename;             // name of the stored index (NULL - not stored)
+    TaskGroup group;
+    atomic_int isCancelled;
+    atomic_int isReady;
+
+    size_t version;             // version of the document when it's indexed
+    Block** blocks;             // blocks of the version by IDs
+    size_t blocksCount;
+    Posting* table;             // open addressing by keys
+    size_t tableSize;           // power of 2
+    size_t tableLen;
+
+    // candidates of the last query: blocks where its occurrences may start
+    char* query;
+    size_t queryLen;
+    int queryFlags;
+    size_t queryVersion;        // version of the document
+    ModelPos* candidates;       // sorted by y
+    size_t candidatesLen;
+};
+
+static int IsBefore(const ModelPos* a, const ModelPos* b) {
+    return a->pos.y < b->pos.y || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+static unsigned char Fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static size_t Hash(uint32_t key, size_t tableSize) {
+    return (size_t)(key * 2654435761U) & (tableSize - 1);
+}
+
+static int IsCancelled(TrigramIndex* index) {
+    return atomic_load_explicit(&index->isCancelled, memory_order_relaxed);
+}
+
+// varints ==============================================================================
+
+static int PutVarint(Posting* posting, size_t value) {
+    // a size_t takes 10 bytes at most
+    if (posting->len + 10 > posting->size) {
+        size_t size = posting->size ? 2 * posting->size : 16;
+        uint8_t* data = realloc(posting->data, size);
+
+        if (!data) { return ERR_NOMEM; }
+        posting->data = data;
+        posting->size = size;
+    }
+
+    while (value >= 0x80) {
+        posting->data[posting->len++] = (uint8_t)(value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    posting->data[posting->len++] = (uint8_t)value;
+    return ERR_SUCCESS;
+}
+
+static void InitReader(PostingReader* reader, const Posting* posting) {
+    reader->data = posting->data;
+    reader->id = 0;
+    reader->done = 0;
+    reader->count = posting->count;
+}
+
+static int NextId(PostingReader* reader, size_t* id) {
+    size_t value = 0;
+
+    if (reader->done == reader->count) { return 0; }
+
+    for (unsigned shift = 0;; shift += 7) {
+        uint8_t c = *reader->data++;
+
+        value |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { break; }
+    }
+
+    // the first value is an ID, the next ones are deltas
+    reader->id = reader->done++ ? reader->id + value : value;
+    *id = reader->id;
+    return 1;
+}
+
+static void WriteVarint(FILE* file, uint64_t value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static int ReadSize(FILE* file, size_t* value) {
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+
+        if (c == EOF) { return ERR_READ; }
+
+        *value |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { return ERR_SUCCESS; }
+    }
+
+    return ERR_READ;
+}
+
+// table of postings ====================================================================
+
+static Posting* FindPosting(const TrigramIndex* index, uint32_t key) {
+    if (!index->tableSize) { return NULL; }
+
+    for (size_t i = Hash(key, index->tableSize);; i = (i + 1) & (index->tableSize - 1)) {
+        Posting* posting = &index->table[i];
+
+        if (posting->key == key + 1) { return posting; }
+        if (!posting->key) { return NULL; }
+    }
+}
+
+// the posting of a key, a new one if there is no one
+static Posting* AddPosting(TrigramIndex* index, uint32_t key) {
+    // the table is at most half full
+    if (2 * (index->tableLen + 1) > index->tableSize) {
+        size_t size = index->tableSize ? 2 * index->tableSize : 4096;
+        Posting* table = calloc(size, sizeof(Posting));
+
+        if (!table) { return NULL; }
+
+        for (size_t i = 0; i < index->tableSize; ++i) {
+            if (!index->table[i].key) { continue; }
+
+            size_t j = Hash(index->table[i].key - 1, size);
+            while (table[j].key) { j = (j + 1) & (size - 1); }
+            table[j] = index->table[i];
+        }
+
+        free(index->table);
+        index->table = table;
+        index->tableSize = size;
+    }
+
+    size_t i = Hash(key, index->tableSize);
+    while (index->table[i].key && index->table[i].key != key + 1) { i = (i + 1) & (index->tableSize - 1); }
+
+    if (!index->table[i].key) {
+        index->table[i].key = key + 1;
+        ++index->tableLen;
+    }
+    return &index->table[i];
+}
+
+static void ClearTable(TrigramIndex* index) {
+    for (size_t i = 0; i < index->tableSize; ++i) { free(index->table[i].data); }
+    free(index->table);
+    free(index->blocks);
+
+    index->table = NULL;
+    index->tableSize = 0;
+    index->tableLen = 0;
+    index->blocks = NULL;
+    index->blocksCount = 0;
+}
+
+// hash of the whole text and the count of its lines: the stored index belongs to the same text
+// (an edit in the middle of the file changes it), the chars are hashed by 8 at a time
+static uint64_t GetFingerprint(const Snapshot* snapshot) {
+    const unsigned char* data = (const unsigned char*)snapshot->text;
+    size_t len = snapshot->textLen;
+    size_t i = 0;
+    uint64_t hash = FNV_OFFSET;
+
+    TRACE_SCOPE("TrigramFingerprint");
+
+    hash = (hash ^ len) * FNV_PRIME;
+    hash = (hash ^ snapshot->blocksLen) * FNV_PRIME;
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; ++i) { hash = (hash ^ data[i]) * FNV_PRIME; }
+    return hash;
+}
+
+static int FillBlocks(TrigramIndex* index) {
+    const Snapshot* snapshot = index->snapshot;
+    Block* block = snapshot->blocks;
+
+    index->blocks = malloc(snapshot->blocksLen * sizeof(Block*));
+    if (!index->blocks) { return ERR_NOMEM; }
+
+    for (size_t id = 0; id < snapshot->blocksLen; ++id) {
+        BlockState state;
+
+        GetBlockState(block, snapshot->version, &state);
+        index->blocks[id] = block;
+        block = state.next;
+    }
+    index->blocksCount = snapshot->blocksLen;
+    return ERR_SUCCESS;
+}
+
+// building =============================================================================
+
+static int AddTrigram(TrigramIndex* index, uint32_t key, size_t id) {
+    Posting* posting = AddPosting(index, key);
+    if (!posting) { return ERR_NOMEM; }
+
+    // a trigram repeated in the block
+    if (posting->count && posting->lastId == id) { return ERR_SUCCESS; }
+
+    if (PutVarint(posting, posting->count ? id - posting->lastId : id)) { return ERR_NOMEM; }
+    posting->lastId = id;
+    ++posting->count;
+    return ERR_SUCCESS;
+}
+
+static int BuildIndex(TrigramIndex* index) {
+    TRACE_SCOPE("BuildTrigramIndex");
+
+    const char* text = index->snapshot->text;
+    int errValue = FillBlocks(index);
+
+    for (size_t id = 0; !errValue && id < index->blocksCount; ++id) {
+        BlockState state;
+        uint32_t key = 0;
+        size_t chars = 0;
+
+        if (IsCancelled(index)) { return ERR_UNKNOWN; }
+
+        // trigrams don't cross line ends: a block ID is where an occurrence of the line is
+        GetBlockState(index->blocks[id], index->version, &state);
+        for (Fragment* fragment = state.fragments->nodes; fragment && !errValue; fragment = fragment->next) {
+            const char* data = text + fragment->data.pos;
+
+            for (size_t i = 0; i < fragment->data.len && !errValue; ++i) {
+                key = ((key << 8) | Fold((unsigned char)data[i])) & 0xFFFFFF;
+                if (++chars >= 3) { errValue = AddTrigram(index, key, id); }
+            }
+        }
+    }
+    return errValue;
+}
+
+// storing ==============================================================================
+
+static int SaveIndex(const TrigramIndex* index) {
+    FILE* file = fopen(index->filename, "wb");
+    if (!file) { return ERR_OPEN_FILE; }
+
+    fwrite(TRIGRAM_INDEX_MAGIC, 1, TRIGRAM_MAGIC_LEN, file);
+    fputc(TRIGRAM_INDEX_VERSION, file);
+
+    WriteVarint(file, index->snapshot->textLen);
+    WriteVarint(file, index->blocksCount);
+    WriteVarint(file, GetFingerprint(index->snapshot));
+    WriteVarint(file, index->tableLen);
+
+    for (size_t i = 0; i < index->tableSize; ++i) {
+        const Posting* posting = &index->table[i];
+
+        if (!posting->key) { continue; }
+
+        WriteVarint(file, posting->key - 1);
+        WriteVarint(file, posting->count);
+        WriteVarint(file, posting->len);
+        fwrite(posting->data, 1, posting->len, file);
+    }
+
+    // a partial index isn't left
+    if (ferror(file) | fclose(file)) {
+        remove(index->filename);
+        return ERR_UNKNOWN;
+    }
+    return ERR_SUCCESS;
+}
+
+// checks that the IDs of a loaded posting are increasing blocks of the document
+static int IsPostingValid(const Posting* posting, size_t blocksCount) {
+    const uint8_t* data = posting->data;
+    const uint8_t* end = data + posting->len;
+    size_t id = 0;
+
+    for (size_t i = 0; i < posting->count; ++i) {
+        size_t value = 0;
+        unsigned shift = 0;
+
+        do {
+            if (data == end || shift >= 64) { return 0; }
+            value |= (size_t)(*data & 0x7F) << shift;
+            shift += 7;
+        } while (*data++ & 0x80);
+
+        if (i && !value) { return 0; }
+        id = i ? id + value : value;
+        if (id >= blocksCount) { return 0; }
+    }
+    return data == end;
+}
+
+static int LoadIndex(TrigramIndex* index) {
+    const Snapshot* snapshot = index->snapshot;
+    FILE* file = fopen(index->filename, "rb");
+    char magic[TRIGRAM_MAGIC_LEN];
+    size_t textLen, blocksCount, fingerprint, count;
+
+    if (!file) { return ERR_OPEN_FILE; }
+
+    if (fread(magic, 1, TRIGRAM_MAGIC_LEN, file) != TRIGRAM_MAGIC_LEN
+        || memcmp(magic, TRIGRAM_INDEX_MAGIC, TRIGRAM_MAGIC_LEN)
+        || fgetc(file) != TRIGRAM_INDEX_VERSION
+        || ReadSize(file, &textLen) || textLen != snapshot->textLen
+        || ReadSize(file, &blocksCount) || blocksCount != snapshot->blocksLen
+        || ReadSize(file, &fingerprint) || fingerprint != (size_t)GetFingerprint(snapshot)
+        || ReadSize(file, &count)) {
+        fclose(file);
+        return ERR_READ;
+    }
+
+    int errValue = FillBlocks(index);
+
+    for (size_t i = 0; !errValue && i < count; ++i) {
+        size_t key, postingCount, len;
+
+        if (IsCancelled(index)) {
+            errValue = ERR_UNKNOWN;
+        } else if (ReadSize(file, &key) || key > 0xFFFFFF || ReadSize(file, &postingCount) || ReadSize(file, &len)) {
+            errValue = ERR_READ;
+        } else {
+            Posting* posting = AddPosting(index, (uint32_t)key);
+
+            if (!posting || posting->count || !(posting->data = malloc(len ? len : 1))) {
+                errValue = posting && posting->count ? ERR_READ : ERR_NOMEM;
+            } else {
+                posting->count = postingCount;
+                posting->len = len;
+                posting->size = len;
+
+                if (fread(posting->data, 1, len, file) != len || !IsPostingValid(posting, blocksCount)) {
+                    errValue = ERR_READ;
+                }
+            }
+        }
+    }
+
+    fclose(file);
+    return errValue;
+}
+
+static void IndexDocument(void* arg, size_t worker) {
+    TrigramIndex* index = arg;
+    (void)worker;
+
+    TRACE_SCOPE("IndexDocument");
+
+    // the snapshot is read, the document may be edited meanwhile
+    int errValue = index->filename ? LoadIndex(index) : ERR_OPEN_FILE;
+
+    if (errValue && errValue != ERR_UNKNOWN) {
+        ClearTable(index);
+        errValue = BuildIndex(index);
+
+        // the index works without the file
+        if (!errValue && index->filename && SaveIndex(index)) { PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__); }
+    }
+
+    if (errValue == ERR_NOMEM) { PrintError(NULL, errValue, __FILE__, __LINE__); }
+
+    // the blocks changed after the version are searched as edited ones
+    ReleaseSnapshot(index->snapshot);
+    index->snapshot = NULL;
+    if (!errValue) { atomic_store_explicit(&index->isReady, 1, memory_order_release); }
+}
+
+TrigramIndex* StartTrigramIndex(ThreadPool* pool, Document* doc, const char* filename) {
+    assert(pool && doc);
+
+    TrigramIndex* index = calloc(1, sizeof(TrigramIndex));
+    if (!index) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    index->pool = pool;
+    index->doc = doc;
+    InitTaskGroup(&index->group);
+    atomic_init(&index->isCancelled, 0);
+    atomic_init(&index->isReady, 0);
+
+    if (filename) {
+        index->filename = malloc(strlen(filename) + sizeof(TRIGRAM_INDEX_EXT));
+        if (!index->filename) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            free(index);
+            return NULL;
+        }
+        strcpy(index->filename, filename);
+        strcat(index->filename, TRIGRAM_INDEX_EXT);
+    }
+
+    index->snapshot = DocTakeSnapshot(doc);
+    if (!index->snapshot) {
+        DestroyTrigramIndex(&index);
+        return NULL;
+    }
+    index->version = index->snapshot->version;
+
+    if (ThreadPoolSubmit(pool, &index->group, IndexDocument, index)) {
+        DestroyTrigramIndex(&index);
+        return NULL;
+    }
+    return index;
+}
+
+int IsTrigramIndexReady(const TrigramIndex* index) {
+    assert(index);
+    return atomic_load_explicit(&((TrigramIndex*)index)->isReady, memory_order_acquire);
+}
+
+void TrigramIndexWait(TrigramIndex* index) {
+    assert(index);
+    ThreadPoolWait(index->pool, &index->group);
+}
+
+void DestroyTrigramIndex(TrigramIndex** ppIndex) {
+    assert(ppIndex);
+
+    TrigramIndex* index = *ppIndex;
+    if (!index) { return; }
+
+    atomic_store(&index->isCancelled, 1);
+    TrigramIndexWait(index);
+
+    // the work isn't submitted
+    if (index->snapshot) { ReleaseSnapshot(index->snapshot); }
+    ClearTable(index);
+    free(index->filename);
+    free(index->query);
+    free(index->candidates);
+    free(index);
+
+    *ppIndex = NULL;
+}
+
+// search ===============================================================================
+
+static int CompareCounts(const void* a, const void* b) {
+    size_t x = (*(const Posting* const*)a)->count;
+    size_t y = (*(const Posting* const*)b)->count;
+    return (x > y) - (x < y);
+}
+
+static int CompareCandidates(const void* a, const void* b) {
+    size_t x = ((const ModelPos*)a)->pos.y;
+    size_t y = ((const ModelPos*)b)->pos.y;
+    return (x > y) - (x < y);
+}
+
+static int AddCandidate(TrigramIndex* index, size_t* size, Block* block, size_t y) {
+    if (index->candidatesLen == *size) {
+        size_t newSize = *size ? 2 * *size : 64;
+        ModelPos* candidates = realloc(index->candidates, newSize * sizeof(ModelPos));
+
+        if (!candidates) { return ERR_NOMEM; }
+        index->candidates = candidates;
+        *size = newSize;
+    }
+
+    index->candidates[index->candidatesLen++] = (ModelPos){ block, { 0, y } };
+    return ERR_SUCCESS;
+}
+
+// IDs of blocks containing all trigrams of chars
+static int IntersectPostings(const TrigramIndex* index, const char* chars, size_t len, size_t** ids, size_t* idsLen) {
+    size_t count = len - 2;
+    const Posting** postings = malloc(count * sizeof(Posting*));
+    uint32_t key = 0;
+
+    *ids = NULL;
+    *idsLen = 0;
+    if (!postings) { return ERR_NOMEM; }
+
+    for (size_t i = 0; i < len; ++i) {
+        key = ((key << 8) | Fold((unsigned char)chars[i])) & 0xFFFFFF;
+        if (i < 2) { continue; }
+
+        postings[i - 2] = FindPosting(index, key);
+
+        // a trigram which doesn't occur: no candidates
+        if (!postings[i - 2]) {
+            free(postings);
+            return ERR_SUCCESS;
+        }
+    }
+
+    // the shortest list is filtered by the others
+    qsort(postings, count, sizeof(Posting*), CompareCounts);
+
+    *ids = malloc((postings[0]->count ? postings[0]->count : 1) * sizeof(size_t));
+    if (!*ids) {
+        free(postings);
+        return ERR_NOMEM;
+    }
+
+    PostingReader reader;
+    size_t id;
+
+    InitReader(&reader, postings[0]);
+    while (NextId(&reader, &id)) { (*ids)[(*idsLen)++] = id; }
+
+    for (size_t i = 1; i < count && *idsLen; ++i) {
+        size_t kept = 0;
+        int isId;
+
+        InitReader(&reader, postings[i]);
+        isId = NextId(&reader, &id);
+
+        for (size_t j = 0; j < *idsLen && isId; ++j) {
+            while (isId && id < (*ids)[j]) { isId = NextId(&reader, &id); }
+            if (isId && id == (*ids)[j]) { (*ids)[kept++] = id; }
+        }
+        *idsLen = kept;
+    }
+
+    free(postings);
+    return ERR_SUCCESS;
+}
+
+/**
+ * Finds blocks where occurrences of a literal may start. The longest line of the literal is looked up:
+ * its trigrams are in the block of the line. Blocks changed after indexing are candidates as well.
+ */
+static int FindCandidates(TrigramIndex* index, const Literal* literal, size_t lineStart, size_t lineLen, size_t line) {
+    const Document* doc = index->doc;
+    size_t* ids;
+    size_t idsLen;
+    size_t size = 0;
+    size_t lines = 0;
+    int errValue = IntersectPostings(index, literal->pattern + lineStart, lineLen, &ids, &idsLen);
+
+    for (size_t i = 0; i < literal->len; ++i) { lines += literal->pattern[i] == '\n'; }
+
+    index->candidatesLen = 0;
+
+    // the blocks are the indexed ones
+    if (doc->version == index->version) {
+        for (size_t i = 0; !errValue && i < idsLen; ++i) {
+            if (ids[i] >= line) { errValue = AddCandidate(index, &size, index->blocks[ids[i] - line], ids[i] - line); }
+        }
+        free(ids);
+        return errValue;
+    }
+
+    size_t next = 0;    // the next candidate ID
+    size_t id = 0;      // ID of the last unchanged block
+    size_t y = 0;
+
+    for (Block* block = doc->blocks->nodes; block && !errValue; block = block->next, ++y) {
+        Block* start = block;
+        size_t count = 0;
+
+        if (block->data.version > index->version) {
+            // occurrences crossing the changed block start in it or in the lines before it
+            while (count < lines && start->prev) {
+                start = start->prev;
+                ++count;
+            }
+            for (size_t i = 0; i <= count && !errValue; ++i, start = start->next) {
+                errValue = AddCandidate(index, &size, start, y - count + i);
+            }
+            continue;
+        }
+
+        // unchanged blocks keep their order and their chars
+        while (index->blocks[id] != block) { ++id; }
+        while (next < idsLen && ids[next] < id) { ++next; }
+        if (next == idsLen || ids[next] != id || y < line) { continue; }
+
+        while (count < line) {
+            start = start->prev;
+            ++count;
+        }
+        errValue = AddCandidate(index, &size, start, y - line);
+    }
+
+    free(ids);
+    if (errValue) { return errValue; }
+
+    // changed blocks add starts out of order and repeated
+    qsort(index->candidates, index->candidatesLen, sizeof(ModelPos), CompareCandidates);
+
+    size_t len = 0;
+    for (size_t i = 0; i < index->candidatesLen; ++i) {
+        if (!len || index->candidates[len - 1].pos.y != index->candidates[i].pos.y) {
+            index->candidates[len++] = index->candidates[i];
+        }
+    }
+    index->candidatesLen = len;
+    return ERR_SUCCESS;
+}
+
+// candidates of the last query are kept until the query or the document is changed
+static int UpdateCandidates(TrigramIndex* index, const Literal* literal, size_t lineStart, size_t lineLen, size_t line) {
+    if (index->query && index->queryLen == literal->len && index->queryFlags == literal->flags
+        && index->queryVersion == index->doc->version && !memcmp(index->query, literal->pattern, literal->len)) {
+        return ERR_SUCCESS;
+    }
+
+    free(index->query);
+    index->query = malloc(literal->len);
+
+    int errValue = index->query ? FindCandidates(index, literal, lineStart, lineLen, line) : ERR_NOMEM;
+    if (errValue) {
+        free(index->query);
+        index->query = NULL;
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+        return errValue;
+    }
+
+    memcpy(index->query, literal->pattern, literal->len);
+    index->queryLen = literal->len;
+    index->queryFlags = literal->flags;
+    index->queryVersion = index->doc->version;
+    return ERR_SUCCESS;
+}
+
+static ModelPos GetEnd(ModelPos pos, size_t len) {
+    pos.pos.x += len;
+
+    while (pos.pos.x > pos.block->data.len) {
+        pos.pos.x -= pos.block->data.len + 1;
+        pos.block = pos.block->next;
+        ++pos.pos.y;
+    }
+    return pos;
+}
+
+// the first occurrence starting in a candidate block at or after the position
+static int FindForward(const TrigramIndex* index, const Literal* literal, ModelPos from, ModelPos* match) {
+    size_t left = 0;
+    size_t right = index->candidatesLen;
+
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+
+        if (index->candidates[middle].pos.y < from.pos.y) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+
+    for (size_t i = left; i < index->candidatesLen; ++i) {
+        const ModelPos* candidate = &index->candidates[i];
+        ModelPos start = candidate->pos.y == from.pos.y ? from : *candidate;
+        ModelPos to = { candidate->block->next, { 0, candidate->pos.y + 1 } };
+
+        if (FindLiteralInRange(index->doc, literal, start, to.block ? &to : NULL, match)) { return 1; }
+    }
+    return 0;
+}
+
+// the last occurrence starting in a candidate block and ending at or before the position
+static int FindBackward(const TrigramIndex* index, const Literal* literal, ModelPos from, ModelPos* match) {
+    size_t left = 0;
+    size_t right = index->candidatesLen;
+
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+
+        if (index->candidates[middle].pos.y <= from.pos.y) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+
+    for (size_t i = left; i-- > 0;) {
+        const ModelPos* candidate = &index->candidates[i];
+        ModelPos to = { candidate->block->next, { 0, candidate->pos.y + 1 } };
+        ModelPos start = *candidate;
+        ModelPos occurrence;
+        int isFound = 0;
+
+        while (FindLiteralInRange(index->doc, literal, start, to.block ? &to : NULL, &occurrence)) {
+            ModelPos end = GetEnd(occurrence, literal->len);
+
+            if (IsBefore(&from, &end)) { break; }
+
+            *match = occurrence;
+            isFound = 1;
+
+            // the next occurrence starts in the block too
+            if (occurrence.pos.x >= occurrence.block->data.len) { break; }
+            start = occurrence;
+            ++start.pos.x;
+        }
+
+        if (isFound) { return 1; }
+    }
+    return 0;
+}
+
+int FindLiteralIndexed(TrigramIndex* index, const Literal* literal, ModelPos from, SearchDirection direction,
+                       ModelPos* match) {
+    assert(index && literal && match);
+
+    COUNTERS_SCOPE(COUNTER_OP_SEARCH);
+    TRACE_SCOPE("FindLiteralIndexed");
+
+    // the longest line of the literal is looked up
+    size_t lineStart = 0;
+    size_t lineLen = 0;
+    size_t line = 0;
+
+    for (size_t i = 0, start = 0, y = 0; i <= literal->len; ++i) {
+        if (i < literal->len && literal->pattern[i] != '\n') { continue; }
+
+        if (i - start > lineLen) {
+            lineStart = start;
+            lineLen = i - start;
+            line = y;
+        }
+        start = i + 1;
+        ++y;
+    }
+
+    // short queries and queries before the index is ready scan the document
+    if (!IsTrigramIndexReady(index) || lineLen < 3 || UpdateCandidates(index, literal, lineStart, lineLen, line)) {
+        return FindLiteral(index->doc, literal, from, direction, match);
+    }
+
+    return direction == SEARCH_FORWARD ? FindForward(index, literal, from, match) : FindBackward(index, literal, from, match);
+}
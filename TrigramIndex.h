@@ -0,0 +1,92 @@
+#pragma once
+#ifndef TRIGRAMINDEX_H_INCLUDED
+#define TRIGRAMINDEX_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "Error.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#include "Document.h"
+#include "Search.h"
+#include "ThreadPool.h"
+
+#define TRIGRAM_INDEX_EXT ".tri"                        // the index is stored next to the file
+#define TRIGRAM_INDEX_MAGIC "TETI"
+#define TRIGRAM_INDEX_VERSION 2
+#define TRIGRAM_INDEX_MIN_SIZE (16 * 1024 * 1024)       // smaller documents are searched fast enough
+
+/**
+ * Index of a document: every trigram of its text (ASCII letters folded to lower case) maps to
+ * the list of blocks containing it. Lists are delta-encoded varints of block IDs, an ID is
+ * the index of the block when the index is built. Blocks changed after that (a newer version)
+ * are always searched, so the index stays valid while the document is edited.
+ */
+typedef struct TrigramIndex_tag TrigramIndex;
+
+/**
+ * Starts to index a document in the background. The index stored for the file is loaded if it
+ * belongs to the same text, otherwise the index is built and stored. The work reads a snapshot
+ * of the document, so the document may be edited meanwhile (DestroyTrigramIndex() cancels the work).
+ * IN:
+ * @param pool - pointer to a thread pool
+ * @param doc - pointer to a Document object
+ * @param filename - name of the file of the document (NULL - the index isn't stored)
+ *
+ * OUT:
+ * @return index - pointer to an index, NULL on error
+ */
+TrigramIndex* StartTrigramIndex(ThreadPool* pool, Document* doc, const char* filename);
+
+/**
+ * Checks that an index is ready.
+ * IN:
+ * @param index - pointer to an index
+ *
+ * OUT:
+ * @return isReady - 1 if the index is built or loaded, 0 while it's in progress or on error
+ */
+int IsTrigramIndexReady(const TrigramIndex* index);
+
+/**
+ * Waits for the background work of an index.
+ * IN:
+ * @param index - pointer to an index
+ */
+void TrigramIndexWait(TrigramIndex* index);
+
+/**
+ * Cancels the background work and destroys an index.
+ * IN:
+ * @param ppIndex - pointer to pointer to an index
+ *
+ * OUT:
+ * *ppIndex - filled with NULL value
+ */
+void DestroyTrigramIndex(TrigramIndex** ppIndex);
+
+/**
+ * Finds a literal as FindLiteral() does, searching only blocks which may contain it.
+ * Candidate blocks of the last query are kept until the query or the document is changed,
+ * so repeated searches only scan them. Until the index is ready the whole document is searched.
+ * IN:
+ * @param index - pointer to an index of the document
+ * @param literal - pointer to a literal pattern
+ * @param from - start position
+ * @param direction - SEARCH_FORWARD: the first occurrence starting at or after the position,
+ *                    SEARCH_BACKWARD: the last occurrence ending at or before the position
+ * @param match - pointer to a position to be filled with the first char of the occurrence
+ *
+ * OUT:
+ * @return isFound - 1 if the occurrence is found, 0 otherwise
+ */
+int FindLiteralIndexed(TrigramIndex* index, const Literal* literal, ModelPos from, SearchDirection direction,
+                       ModelPos* match);
+
+#endif // TRIGRAMINDEX_H_INCLUDED
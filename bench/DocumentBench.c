@@ -0,0 +1,912 @@
+/**
+ * Benchmarks of the document core (no WinAPI).
+ *
+ * Generates synthetic corpora (short lines, huge lines, mixed lines), loads each of them
+ * and measures load throughput, traversal, literal and regex search (sequential, parallel and indexed), scroll-bar thumb jumps, inserts and deletes at the start,
+ * middle and end of the document, block split/merge, replace-all, typing under live snapshots, column edits of every line, marks of every line
+ * followed through edits, decorations of every line queried by viewports, highlighting of a scrolled viewport and teardown. Results are written as JSON.
+ *
+ * Usage: DocumentBench [--size BYTES] [--repeats N] [--edits N] [--corpus NAME]
+ *                      [--dir PATH] [--output FILE] [--keep]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "Error.h"
+#include "Clock.h"
+#include "Document.h"
+#include "Search.h"
+#include "Regex.h"
+#include "FindAll.h"
+#include "IncrementalSearch.h"
+#include "Replace.h"
+#include "TrigramIndex.h"
+#include "Highlight.h"
+#include "LineIndex.h"
+#include "ColumnSelection.h"
+#include "Marks.h"
+#include "Decorations.h"
+#include "Counters.h"
+#include "Trace.h"
+
+#define DEFAULT_CORPUS_SIZE (8 * 1024 * 1024)
+#define DEFAULT_REPEATS 5
+#define DEFAULT_EDITS 20000
+#define MAX_PATH_LEN 1024
+
+// absent in corpora: the first and the last chars are common, so the filter passes candidates
+#define SEARCH_PATTERN "the_end"
+// absent in corpora: the literal prefix skips the text, the DFA runs only at candidates
+#define REGEX_PREFIX_PATTERN "the_end[0-9]+"
+// absent in corpora: no prefix, the DFA reads every byte
+#define REGEX_DFA_PATTERN "[0-9]{4}-[0-9]{2}-[0-9]{2}"
+
+// share of split/merge pairs relative to the count of edits
+#define SPLIT_MERGE_DIVIDER 10
+
+// frequent pair of letters of the corpora: swapped by groups of a regex
+#define REPLACE_PATTERN "(e)(t)"
+#define REPLACE_TEMPLATE "\\2\\1"
+
+// chars typed between snapshots: the first char after a snapshot copies the fragments of the block
+#define SNAPSHOT_PERIOD 16
+
+// columns of every line filled, deleted and typed into by a column selection
+#define COLUMN_LEFT 10
+#define COLUMN_RIGHT 20
+#define COLUMN_CHARS "col"
+
+// frequent pair of letters of the corpora: highlighted in a viewport scrolled down by a line and back
+#define HIGHLIGHT_PATTERN "et"
+#define HIGHLIGHT_VIEW_LINES 50
+#define HIGHLIGHT_FRAMES 1000
+
+// random displayed lines found through the line index (wrapped at THUMB_WRAP_CHARS)
+#define THUMB_JUMPS 1000
+#define THUMB_WRAP_CHARS 80
+
+typedef enum {
+    CORPUS_SHORT_LINES,     // lines of 0..80 chars
+    CORPUS_HUGE_LINES,      // four lines covering the whole corpus
+    CORPUS_MIXED_LINES,     // short lines with a long line every thousand lines
+    CORPUS_COUNT
+} CorpusType;
+
+static const char* corpusNames[CORPUS_COUNT] = {
+    "short_lines",
+    "huge_lines",
+    "mixed_lines"
+};
+
+typedef enum {
+    BENCH_LOAD,
+    BENCH_TRAVERSE,
+    BENCH_SEARCH,
+    BENCH_SEARCH_IGNORE_CASE,
+    BENCH_REGEX_PREFIX,
+    BENCH_REGEX_DFA,
+    BENCH_FIND_ALL,
+    BENCH_SEARCH_AS_YOU_TYPE,
+    BENCH_INDEX_BUILD,
+    BENCH_SEARCH_INDEXED,
+    BENCH_THUMB_JUMP,
+    BENCH_INSERT_START,
+    BENCH_INSERT_MIDDLE,
+    BENCH_INSERT_END,
+    BENCH_SPLIT_MERGE,
+    BENCH_DELETE_START,
+    BENCH_DELETE_MIDDLE,
+    BENCH_DELETE_END,
+    BENCH_REPLACE_ALL,
+    BENCH_UNDO_REPLACE_ALL,
+    BENCH_REDO_REPLACE_ALL,
+    BENCH_SNAPSHOT_TYPING,
+    BENCH_COLUMN_FILL,
+    BENCH_COLUMN_DELETE,
+    BENCH_COLUMN_INSERT,
+    BENCH_MARKS_ADD,
+    BENCH_MARKS_EDIT,
+    BENCH_MARKS_WALK,
+    BENCH_DECORATIONS_ADD,
+    BENCH_DECORATIONS_EDIT,
+    BENCH_DECORATIONS_VIEW,
+    BENCH_HIGHLIGHT_SCROLL,
+    BENCH_TEARDOWN,
+    BENCH_COUNT
+} BenchType;
+
+static const char* benchNames[BENCH_COUNT] = {
+    "load",
+    "traverse",
+    "search",
+    "search_ignore_case",
+    "regex_prefix",
+    "regex_dfa",
+    "find_all",
+    "search_as_you_type",
+    "index_build",
+    "search_indexed",
+    "thumb_jump",
+    "insert_start",
+    "insert_middle",
+    "insert_end",
+    "split_merge",
+    "delete_start",
+    "delete_middle",
+    "delete_end",
+    "replace_all",
+    "undo_replace_all",
+    "redo_replace_all",
+    "snapshot_typing",
+    "column_fill",
+    "column_delete",
+    "column_insert",
+    "marks_add",
+    "marks_edit",
+    "marks_walk",
+    "decorations_add",
+    "decorations_edit",
+    "decorations_view",
+    "highlight_scroll",
+    "teardown"
+};
+
+typedef struct {
+    size_t iterations;      // count of measured repeats
+    size_t ops;             // operations per repeat
+    size_t bytes;           // bytes processed per repeat
+    uint64_t minNs;         // the fastest repeat
+    uint64_t maxNs;         // the slowest repeat
+    uint64_t totalNs;       // sum of all repeats
+} BenchResult;
+
+typedef struct {
+    size_t corpusSize;
+    size_t repeats;
+    size_t edits;
+    const char* corpus;     // name of the only corpus to run (NULL - all)
+    const char* dir;
+    const char* output;
+    int isKeep;             // keep generated corpora
+} BenchConfig;
+
+static volatile size_t benchSink;   // keeps results of traversal alive
+
+// xorshift64*: a generated corpus must be the same from run to run
+static uint64_t NextRandom(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static size_t RandomRange(uint64_t* state, size_t min, size_t max) {
+    return min + (size_t)(NextRandom(state) % (max - min + 1));
+}
+
+static void WriteLine(FILE* file, uint64_t* state, size_t len) {
+    static const char letters[] = "etaoinshrdlucmfwypvbgkjqxz";
+
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t r = NextRandom(state);
+
+        fputc((r % 6) ? letters[(r >> 8) % (sizeof(letters) - 1)] : ' ', file);
+    }
+    fputc('\n', file);
+}
+
+static int GenerateCorpus(const char* filename, CorpusType type, size_t size) {
+    FILE* file = fopen(filename, "w");
+    uint64_t state = 0x9E3779B97F4A7C15ULL + type;
+    size_t written = 0;
+    size_t line = 0;
+
+    if (!file) {
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return ERR_OPEN_FILE;
+    }
+
+    while (written < size) {
+        size_t len;
+
+        switch (type) {
+        case CORPUS_SHORT_LINES:
+            len = RandomRange(&state, 0, 80);
+            break;
+
+        case CORPUS_HUGE_LINES:
+            len = size / 4;
+            break;
+
+        case CORPUS_MIXED_LINES:
+            len = (line % 1000 == 999) ? RandomRange(&state, 64 * 1024, 256 * 1024) : RandomRange(&state, 0, 120);
+            break;
+
+        default:
+            len = 0;
+            break;
+        }
+
+        if (written + len + 1 > size) { len = size - written - 1; }
+
+        WriteLine(file, &state, len);
+        written += len + 1;
+        ++line;
+    }
+
+    if (fclose(file)) {
+        PrintError(NULL, ERR_UNKNOWN, __FILE__, __LINE__);
+        return ERR_UNKNOWN;
+    }
+
+    return ERR_SUCCESS;
+}
+
+static void AddResult(BenchResult* result, uint64_t ns, size_t ops, size_t bytes) {
+    if (!result->iterations || ns < result->minNs) { result->minNs = ns; }
+    if (!result->iterations || ns > result->maxNs) { result->maxNs = ns; }
+
+    result->totalNs += ns;
+    result->ops = ops;
+    result->bytes = bytes;
+    ++result->iterations;
+}
+
+static Block* GetMiddleBlock(const Document* doc) {
+    Block* block = doc->blocks->nodes;
+
+    for (size_t i = 0; i < doc->blocks->len / 2; ++i) { block = block->next; }
+
+    return block;
+}
+
+static size_t Traverse(const Document* doc) {
+    size_t checksum = 0;
+    DocIterator it;
+    DocSpan span;
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+
+    InitDocIterator(&it, doc, start, DOC_ITER_LINE_ENDS);
+    while (DocNextSpan(&it, &span)) {
+        const unsigned char* data = (const unsigned char*)span.ptr;
+
+        for (size_t i = 0; i < span.len; ++i) { checksum += data[i]; }
+    }
+
+    return checksum;
+}
+
+static int SearchAll(const Document* doc, int flags, uint64_t* ns) {
+    Literal* literal = CreateLiteral(SEARCH_PATTERN, strlen(SEARCH_PATTERN), flags);
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+    ModelPos match;
+
+    if (!literal) { return ERR_NOMEM; }
+
+    uint64_t begin = GetMonotonicTime();
+    benchSink = FindLiteral(doc, literal, start, SEARCH_FORWARD, &match);
+    *ns = GetMonotonicTime() - begin;
+
+    DestroyLiteral(&literal);
+    return ERR_SUCCESS;
+}
+
+static int SearchRegexAll(const Document* doc, const char* pattern, uint64_t* ns) {
+    Regex* regex = CreateRegex(pattern, strlen(pattern), REGEX_MATCH_CASE);
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+    RegexMatch match;
+
+    if (!regex) { return ERR_NOMEM; }
+
+    uint64_t begin = GetMonotonicTime();
+    benchSink = FindRegex(doc, regex, start, SEARCH_FORWARD, &match);
+    *ns = GetMonotonicTime() - begin;
+
+    DestroyRegex(&regex);
+    return ERR_SUCCESS;
+}
+
+// the pattern of regex_dfa on all processors
+static int FindAllRegex(Document* doc, const char* pattern, uint64_t* ns) {
+    ThreadPool* pool = CreateThreadPool(0);
+    RegexMatch matches[64];
+    size_t count = 0;
+    int isFinished = 0;
+
+    if (!pool) { return ERR_NOMEM; }
+
+    uint64_t begin = GetMonotonicTime();
+    FindAll* findAll = StartFindAll(pool, doc, pattern, strlen(pattern), FIND_ALL_REGEX, NULL, NULL);
+
+    if (!findAll) {
+        DestroyThreadPool(&pool);
+        return ERR_NOMEM;
+    }
+
+    FindAllWait(findAll);
+    while (!isFinished) { count += FindAllTake(findAll, matches, 64, &isFinished); }
+    *ns = GetMonotonicTime() - begin;
+    benchSink = count;
+
+    DestroyFindAll(&findAll);
+    DestroyThreadPool(&pool);
+    return ERR_SUCCESS;
+}
+
+// types the literal pattern char by char: the first char scans the document, the next ones are measured
+static int TypeQuery(const Document* doc, uint64_t* ns) {
+    IncrementalSearch* search = CreateIncrementalSearch(doc);
+    size_t len = strlen(SEARCH_PATTERN);
+
+    if (!search) { return ERR_NOMEM; }
+
+    if (UpdateIncrementalSearch(search, SEARCH_PATTERN, 1, SEARCH_MATCH_CASE)) {
+        DestroyIncrementalSearch(&search);
+        return ERR_NOMEM;
+    }
+
+    uint64_t begin = GetMonotonicTime();
+    for (size_t i = 2; i <= len; ++i) {
+        if (UpdateIncrementalSearch(search, SEARCH_PATTERN, i, SEARCH_MATCH_CASE)) {
+            DestroyIncrementalSearch(&search);
+            return ERR_NOMEM;
+        }
+    }
+    *ns = GetMonotonicTime() - begin;
+    benchSink = search->len;
+
+    DestroyIncrementalSearch(&search);
+    return ERR_SUCCESS;
+}
+
+// builds the trigram index (not stored), then searches the literal pattern through it
+static int SearchIndexed(Document* doc, uint64_t* buildNs, uint64_t* ns) {
+    ThreadPool* pool = CreateThreadPool(1);
+    Literal* literal = CreateLiteral(SEARCH_PATTERN, strlen(SEARCH_PATTERN), SEARCH_MATCH_CASE);
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+    ModelPos match;
+    int errValue = ERR_NOMEM;
+
+    if (pool && literal) {
+        uint64_t begin = GetMonotonicTime();
+        TrigramIndex* index = StartTrigramIndex(pool, doc, NULL);
+
+        if (index) {
+            TrigramIndexWait(index);
+            *buildNs = GetMonotonicTime() - begin;
+
+            begin = GetMonotonicTime();
+            benchSink = FindLiteralIndexed(index, literal, start, SEARCH_FORWARD, &match);
+            *ns = GetMonotonicTime() - begin;
+
+            errValue = IsTrigramIndexReady(index) ? ERR_SUCCESS : ERR_NOMEM;
+            DestroyTrigramIndex(&index);
+        }
+    }
+
+    DestroyLiteral(&literal);
+    DestroyThreadPool(&pool);
+    return errValue;
+}
+
+// the index is built by the first jump (not measured), the next ones only search it
+static int ThumbJumps(const Document* doc, uint64_t* ns) {
+    LineIndex index;
+    ModelPos pos;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    size_t checksum = 0;
+
+    InitLineIndex(&index);
+    if (FindDisplayedLine(&index, doc, THUMB_WRAP_CHARS, 0, &pos)) {
+        FreeLineIndex(&index);
+        return ERR_NOMEM;
+    }
+
+    uint64_t start = GetMonotonicTime();
+    for (size_t i = 0; i < THUMB_JUMPS; ++i) {
+        FindDisplayedLine(&index, doc, THUMB_WRAP_CHARS, RandomRange(&state, 0, index.lines - 1), &pos);
+        checksum += pos.pos.y;
+    }
+    *ns = GetMonotonicTime() - start;
+    benchSink = checksum;
+
+    FreeLineIndex(&index);
+    return ERR_SUCCESS;
+}
+
+static int ReplaceAllPairs(Document* doc, size_t* count, uint64_t* ns) {
+    uint64_t start = GetMonotonicTime();
+    int errValue = ReplaceAll(doc, REPLACE_PATTERN, strlen(REPLACE_PATTERN), REPLACE_TEMPLATE,
+                              strlen(REPLACE_TEMPLATE), REPLACE_REGEX, count, NULL, NULL);
+
+    *ns = GetMonotonicTime() - start;
+    return errValue;
+}
+
+// undoes or redoes the last unit of the history
+static int UndoRedo(Document* doc, int isRedo, uint64_t* ns) {
+    ModelPos pos;
+    uint64_t start = GetMonotonicTime();
+    int errValue = isRedo ? DocRedo(doc, &pos, NULL, NULL) : DocUndo(doc, &pos, NULL, NULL);
+
+    *ns = GetMonotonicTime() - start;
+    return errValue ? errValue : !pos.block;
+}
+
+// frames of a viewport: the first frame scans the shown blocks, then one new block per frame is scanned
+static int HighlightScroll(Document* doc, size_t* frames, uint64_t* ns) {
+    Highlight* highlight = CreateHighlight(doc, HIGHLIGHT_PATTERN, strlen(HIGHLIGHT_PATTERN), HIGHLIGHT_LITERAL);
+    Block* top = doc->blocks->nodes;
+    size_t y = 0;
+    size_t count = 0;
+
+    if (!highlight) { return ERR_NOMEM; }
+
+    uint64_t start = GetMonotonicTime();
+    for (size_t i = 0; i < 2 * HIGHLIGHT_FRAMES; ++i) {
+        const HighlightRange* ranges;
+        Block* block = top;
+
+        BeginHighlightFrame(highlight);
+        for (size_t j = 0; j < HIGHLIGHT_VIEW_LINES && block; ++j, block = block->next) {
+            count += GetBlockHighlight(highlight, block, y + j, &ranges);
+        }
+
+        // down, then back to the cached blocks
+        if (i < HIGHLIGHT_FRAMES && top->next) {
+            top = top->next;
+            ++y;
+        } else if (i >= HIGHLIGHT_FRAMES && top->prev) {
+            top = top->prev;
+            --y;
+        }
+    }
+    *ns = GetMonotonicTime() - start;
+    *frames = 2 * HIGHLIGHT_FRAMES;
+    benchSink = count;
+
+    DestroyHighlight(&highlight);
+    return ERR_SUCCESS;
+}
+
+static int InsertChars(Document* doc, Block* block, size_t y, size_t x, size_t count, uint64_t* ns) {
+    uint64_t start = GetMonotonicTime();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (DocInsertChar(doc, block, y, x + i, 'a' + (char)(i % 26))) { return ERR_NOMEM; }
+    }
+
+    *ns = GetMonotonicTime() - start;
+    return ERR_SUCCESS;
+}
+
+static int DeleteChars(Document* doc, Block* block, size_t y, size_t x, int isBackward, size_t count, uint64_t* ns) {
+    uint64_t start = GetMonotonicTime();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (DocDeleteChar(doc, block, y, isBackward ? x - i - 1 : x)) { return ERR_NOMEM; }
+    }
+
+    *ns = GetMonotonicTime() - start;
+    return ERR_SUCCESS;
+}
+
+// types chars while a reader keeps the last snapshot taken every SNAPSHOT_PERIOD chars
+static int TypeWithSnapshots(Document* doc, Block* block, size_t y, size_t x, size_t count, uint64_t* ns) {
+    Snapshot* snapshot = NULL;
+    int errValue = ERR_SUCCESS;
+    uint64_t start = GetMonotonicTime();
+
+    for (size_t i = 0; i < count && !errValue; ++i) {
+        if (!(i % SNAPSHOT_PERIOD)) {
+            if (snapshot) { ReleaseSnapshot(snapshot); }
+            snapshot = DocTakeSnapshot(doc);
+            if (!snapshot) { return ERR_NOMEM; }
+        }
+        errValue = DocInsertChar(doc, block, y, x + i, 'a' + (char)(i % 26));
+    }
+
+    *ns = GetMonotonicTime() - start;
+    ReleaseSnapshot(snapshot);
+    return errValue;
+}
+
+// columns of every line edited as one undo unit: fill, delete the filled columns, type chars into them
+static int EditColumns(Document* doc, BenchType type, uint64_t* ns) {
+    ColumnSelection selection;
+    ModelPos corner = { doc->blocks->nodes, { COLUMN_LEFT, 0 } };
+    int errValue;
+
+    InitColumnSelection(&selection, NULL, NULL);
+    BeginColumnSelection(&selection, corner);
+    selection.active.block = doc->blocks->last;
+    selection.active.pos.y = doc->blocks->len - 1;
+    selection.active.pos.x = type == BENCH_COLUMN_FILL ? COLUMN_RIGHT : COLUMN_LEFT;
+
+    uint64_t start = GetMonotonicTime();
+
+    DocBeginUndoGroup(doc);
+    switch (type) {
+    case BENCH_COLUMN_FILL:
+        errValue = FillColumns(doc, &selection, '#');
+        break;
+
+    case BENCH_COLUMN_DELETE:
+        // the column caret deletes the filled columns after it
+        errValue = DeleteColumns(doc, &selection, COLUMN_RIGHT - COLUMN_LEFT, 0);
+        break;
+
+    default:
+        errValue = InsertColumns(doc, &selection, COLUMN_CHARS, strlen(COLUMN_CHARS), 1);
+        break;
+    }
+    DocEndUndoGroup(doc);
+
+    *ns = GetMonotonicTime() - start;
+    return errValue;
+}
+
+/*
+ * A mark in the middle of every block: the marks are added, followed through typing and
+ * split/merge pairs at the middle block (every edit shifts the marks after it), then walked in order.
+ */
+static int FollowMarks(const Document* doc, size_t edits, uint64_t* addNs, uint64_t* editNs, uint64_t* walkNs) {
+    MarkSet marks;
+    size_t y = 0;
+    uint64_t start = GetMonotonicTime();
+
+    InitMarkSet(&marks, MARK_MOVE);
+    for (Block* block = doc->blocks->nodes; block; block = block->next, ++y) {
+        if (AddMark(&marks, (position_t) { block->data.len / 2, y }, NULL)) {
+            FreeMarkSet(&marks);
+            return ERR_NOMEM;
+        }
+    }
+    *addNs = GetMonotonicTime() - start;
+
+    position_t pos = { 0, y / 2 };
+
+    start = GetMonotonicTime();
+    for (size_t i = 0; i < edits; ++i) {
+        MarksInsertChars(&marks, pos, 1);
+        if (!(i % SPLIT_MERGE_DIVIDER)) {
+            MarksSplitBlock(&marks, pos);
+            MarksMergeBlocks(&marks, pos.y, pos.x);
+        }
+    }
+    *editNs = GetMonotonicTime() - start;
+
+    start = GetMonotonicTime();
+    for (size_t id = FindNextMark(&marks, (position_t) { 0, 0 }, &pos); id != MARKS_NONE;
+        id = FindNextMark(&marks, (position_t) { pos.x + 1, pos.y }, &pos)) {
+        ++benchSink;
+    }
+    *walkNs = GetMonotonicTime() - start;
+
+    FreeMarkSet(&marks);
+    return ERR_SUCCESS;
+}
+
+/*
+ * Overlapping ranges of two layers in every block: the ranges are added, followed through typing
+ * and split/merge pairs in the ranges of the middle block, then the styled runs of viewports
+ * spread over the document are got.
+ */
+static int FollowDecorations(const Document* doc, size_t edits, uint64_t* addNs, uint64_t* editNs, uint64_t* viewNs) {
+    Decorations decorations;
+    size_t y = 0;
+    uint64_t start = GetMonotonicTime();
+
+    InitDecorations(&decorations);
+    for (Block* block = doc->blocks->nodes; block; block = block->next, ++y) {
+        size_t len = block->data.len;
+        int errValue = AddDecoration(&decorations, DECORATION_RESULTS, (ModelPos) { block, { len / 4, y } },
+                                     (ModelPos) { block, { 3 * len / 4, y } }, y % DECORATION_STYLES);
+
+        if (!errValue) {
+            errValue = AddDecoration(&decorations, DECORATION_MARKED, (ModelPos) { block, { 0, y } },
+                                     (ModelPos) { block, { len / 2, y } }, 0);
+        }
+        if (errValue) {
+            FreeDecorations(&decorations);
+            return errValue;
+        }
+    }
+    *addNs = GetMonotonicTime() - start;
+
+    size_t blocks = y;
+    position_t pos = { 0, blocks / 2 };
+
+    start = GetMonotonicTime();
+    for (size_t i = 0; i < edits; ++i) {
+        DecorationsInsertChars(&decorations, pos, 1);
+        if (!(i % SPLIT_MERGE_DIVIDER)) {
+            position_t split = { i % (pos.x + 1), pos.y };
+
+            DecorationsSplitBlock(&decorations, split);
+            DecorationsMergeBlocks(&decorations, split.y, split.x);
+        }
+        ++pos.x;
+    }
+    *editNs = GetMonotonicTime() - start;
+
+    start = GetMonotonicTime();
+    for (size_t i = 0; i < HIGHLIGHT_FRAMES; ++i) {
+        size_t first = blocks * i / HIGHLIGHT_FRAMES;
+
+        for (DecorationLayerId layer = 0; layer < DECORATION_LAYERS; ++layer) {
+            size_t len;
+            DecorationRun* runs = GetDecorationRuns(&decorations, layer, first, first + HIGHLIGHT_VIEW_LINES, &len);
+
+            benchSink += len;
+            free(runs);
+        }
+    }
+    *viewNs = GetMonotonicTime() - start;
+
+    FreeDecorations(&decorations);
+    return ERR_SUCCESS;
+}
+
+static int SplitMergeBlock(Document* doc, Block* block, size_t y, size_t count, uint64_t* ns) {
+    size_t x = block->data.len / 2;
+    uint64_t start = GetMonotonicTime();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (DocSplitBlock(doc, block, y, x)) { return ERR_NOMEM; }
+        if (DocMergeBlocks(doc, block, y)) { return ERR_NOMEM; }
+    }
+
+    *ns = GetMonotonicTime() - start;
+    return ERR_SUCCESS;
+}
+
+/**
+ * Runs all benchmarks on one corpus once.
+ * IN:
+ * @param filename - name of the corpus file
+ * @param config - benchmark configuration
+ * @param results - results of the corpus (one per BenchType)
+ *
+ * OUT:
+ * @return errValue - value indicating the success of the operation
+ */
+static int RunRepeat(const char* filename, const BenchConfig* config, BenchResult* results) {
+    uint64_t start, ns;
+    size_t edits = config->edits;
+
+    start = GetMonotonicTime();
+    Document* doc = CreateDocument(filename);
+    ns = GetMonotonicTime() - start;
+
+    if (!doc) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    size_t bytes = doc->text->len + doc->blocks->len;
+    AddResult(&results[BENCH_LOAD], ns, 1, bytes);
+
+    start = GetMonotonicTime();
+    benchSink = Traverse(doc);
+    AddResult(&results[BENCH_TRAVERSE], GetMonotonicTime() - start, 1, bytes);
+
+    if (SearchAll(doc, SEARCH_MATCH_CASE, &ns)) { goto error; }
+    AddResult(&results[BENCH_SEARCH], ns, 1, bytes);
+
+    if (SearchAll(doc, SEARCH_IGNORE_CASE, &ns)) { goto error; }
+    AddResult(&results[BENCH_SEARCH_IGNORE_CASE], ns, 1, bytes);
+
+    if (SearchRegexAll(doc, REGEX_PREFIX_PATTERN, &ns)) { goto error; }
+    AddResult(&results[BENCH_REGEX_PREFIX], ns, 1, bytes);
+
+    if (SearchRegexAll(doc, REGEX_DFA_PATTERN, &ns)) { goto error; }
+    AddResult(&results[BENCH_REGEX_DFA], ns, 1, bytes);
+
+    if (FindAllRegex(doc, REGEX_DFA_PATTERN, &ns)) { goto error; }
+    AddResult(&results[BENCH_FIND_ALL], ns, 1, bytes);
+
+    if (TypeQuery(doc, &ns)) { goto error; }
+    AddResult(&results[BENCH_SEARCH_AS_YOU_TYPE], ns, strlen(SEARCH_PATTERN) - 1, 0);
+
+    uint64_t buildNs;
+    if (SearchIndexed(doc, &buildNs, &ns)) { goto error; }
+    AddResult(&results[BENCH_INDEX_BUILD], buildNs, 1, bytes);
+    AddResult(&results[BENCH_SEARCH_INDEXED], ns, 1, bytes);
+
+    if (ThumbJumps(doc, &ns)) { goto error; }
+    AddResult(&results[BENCH_THUMB_JUMP], ns, THUMB_JUMPS, 0);
+
+    Block* first = doc->blocks->nodes;
+    Block* middle = GetMiddleBlock(doc);
+    Block* last = doc->blocks->last;
+    size_t middleY = doc->blocks->len / 2;
+    size_t lastY = doc->blocks->len - 1;
+    size_t middleX;
+
+    // typing: every char goes right after the previous one
+    if (InsertChars(doc, first, 0, 0, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_INSERT_START], ns, edits, edits);
+
+    middleX = middle->data.len / 2;
+    if (InsertChars(doc, middle, middleY, middleX, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_INSERT_MIDDLE], ns, edits, edits);
+
+    if (InsertChars(doc, last, lastY, last->data.len, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_INSERT_END], ns, edits, edits);
+
+    if (SplitMergeBlock(doc, middle, middleY, edits / SPLIT_MERGE_DIVIDER, &ns)) { goto error; }
+    AddResult(&results[BENCH_SPLIT_MERGE], ns, edits / SPLIT_MERGE_DIVIDER, 0);
+
+    // removes the typed chars: delete at the start and in the middle, backspace at the end
+    if (DeleteChars(doc, first, 0, 0, 0, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_DELETE_START], ns, edits, edits);
+
+    if (DeleteChars(doc, middle, middleY, middleX, 0, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_DELETE_MIDDLE], ns, edits, edits);
+
+    if (DeleteChars(doc, last, lastY, last->data.len, 1, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_DELETE_END], ns, edits, edits);
+
+    // only the replacement is recorded, so the edits above are measured without the history
+    size_t replaced = 0;
+    if (SetHistory(doc, HISTORY_DEFAULT_CAP)) { goto error; }
+    if (ReplaceAllPairs(doc, &replaced, &ns)) { goto error; }
+    AddResult(&results[BENCH_REPLACE_ALL], ns, replaced, bytes);
+
+    if (UndoRedo(doc, 0, &ns)) { goto error; }
+    AddResult(&results[BENCH_UNDO_REPLACE_ALL], ns, 1, bytes);
+
+    if (UndoRedo(doc, 1, &ns)) { goto error; }
+    AddResult(&results[BENCH_REDO_REPLACE_ALL], ns, 1, bytes);
+
+    // the replacement may replace the blocks typed into above
+    Block* block = doc->blocks->nodes;
+    if (TypeWithSnapshots(doc, block, 0, block->data.len / 2, edits, &ns)) { goto error; }
+    AddResult(&results[BENCH_SNAPSHOT_TYPING], ns, edits, edits);
+
+    for (BenchType type = BENCH_COLUMN_FILL; type <= BENCH_COLUMN_INSERT; ++type) {
+        if (EditColumns(doc, type, &ns)) { goto error; }
+        AddResult(&results[type], ns, doc->blocks->len, 0);
+    }
+
+    uint64_t addNs, walkNs;
+    if (FollowMarks(doc, edits, &addNs, &ns, &walkNs)) { goto error; }
+    AddResult(&results[BENCH_MARKS_ADD], addNs, doc->blocks->len, 0);
+    AddResult(&results[BENCH_MARKS_EDIT], ns, edits, 0);
+    AddResult(&results[BENCH_MARKS_WALK], walkNs, doc->blocks->len, 0);
+
+    uint64_t viewNs;
+    if (FollowDecorations(doc, edits, &addNs, &ns, &viewNs)) { goto error; }
+    AddResult(&results[BENCH_DECORATIONS_ADD], addNs, doc->blocks->len, 0);
+    AddResult(&results[BENCH_DECORATIONS_EDIT], ns, edits, 0);
+    AddResult(&results[BENCH_DECORATIONS_VIEW], viewNs, HIGHLIGHT_FRAMES, 0);
+
+    size_t frames = 0;
+    if (HighlightScroll(doc, &frames, &ns)) { goto error; }
+    AddResult(&results[BENCH_HIGHLIGHT_SCROLL], ns, frames, 0);
+
+    start = GetMonotonicTime();
+    DestroyDocument(&doc);
+    AddResult(&results[BENCH_TEARDOWN], GetMonotonicTime() - start, 1, bytes);
+
+    return ERR_SUCCESS;
+
+error:
+    DestroyDocument(&doc);
+    PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+    return ERR_NOMEM;
+}
+
+static void PrintResult(FILE* output, const char* corpus, BenchType type, const BenchResult* result, int isFirst) {
+    double nsPerOp = result->ops ? (double)result->minNs / result->ops : 0.0;
+    double mbPerSec = result->minNs ? (double)result->bytes / (1024.0 * 1024.0) * NS_PER_SEC / result->minNs : 0.0;
+
+    fprintf(output, "%s\n    {\"corpus\": \"%s\", \"name\": \"%s\", \"iterations\": %zu, \"ops\": %zu, \"bytes\": %zu, "
+            "\"min_ns\": %llu, \"mean_ns\": %llu, \"max_ns\": %llu, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f}",
+            isFirst ? "" : ",", corpus, benchNames[type], result->iterations, result->ops, result->bytes,
+            (unsigned long long)result->minNs,
+            (unsigned long long)(result->iterations ? result->totalNs / result->iterations : 0),
+            (unsigned long long)result->maxNs, nsPerOp, mbPerSec);
+}
+
+static int ParseArgs(int argc, char* argv[], BenchConfig* config) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "--keep")) {
+            config->isKeep = 1;
+            continue;
+        }
+
+        if (!value) {
+            fprintf(stderr, "missing value of %s\n", arg);
+            return ERR_PARAM;
+        }
+
+        if (!strcmp(arg, "--size")) {
+            config->corpusSize = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--repeats")) {
+            config->repeats = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--edits")) {
+            config->edits = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--corpus")) {
+            config->corpus = value;
+        } else if (!strcmp(arg, "--dir")) {
+            config->dir = value;
+        } else if (!strcmp(arg, "--output")) {
+            config->output = value;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return ERR_PARAM;
+        }
+        ++i;
+    }
+
+    if (config->corpusSize < 1024 || !config->repeats || !config->edits) {
+        fprintf(stderr, "--size must be at least 1024, --repeats and --edits must be positive\n");
+        return ERR_PARAM;
+    }
+
+    return ERR_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config = { DEFAULT_CORPUS_SIZE, DEFAULT_REPEATS, DEFAULT_EDITS, NULL, ".", NULL, 0 };
+    FILE* output = stdout;
+    int isFirst = 1;
+    int errValue = ERR_SUCCESS;
+
+    if (ParseArgs(argc, argv, &config)) { return ERR_PARAM; }
+
+    if (config.output) {
+        output = fopen(config.output, "w");
+        if (!output) {
+            PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+            return ERR_OPEN_FILE;
+        }
+    }
+
+    fprintf(output, "{\n  \"suite\": \"DocumentBench\",\n  \"corpus_size\": %zu,\n  \"repeats\": %zu,\n  \"edits\": %zu,\n",
+            config.corpusSize, config.repeats, config.edits);
+    #ifdef COUNTERS_ON
+        fprintf(output, "  \"counters\": true,\n");
+    #else
+        fprintf(output, "  \"counters\": false,\n");
+    #endif
+    fprintf(output, "  \"results\": [");
+
+    for (int type = 0; type < CORPUS_COUNT && !errValue; ++type) {
+        char filename[MAX_PATH_LEN];
+        BenchResult results[BENCH_COUNT] = { 0 };
+
+        if (config.corpus && strcmp(config.corpus, corpusNames[type])) { continue; }
+
+        snprintf(filename, sizeof(filename), "%s/bench_%s.txt", config.dir, corpusNames[type]);
+        fprintf(stderr, "corpus %s: generating %zu bytes\n", corpusNames[type], config.corpusSize);
+
+        errValue = GenerateCorpus(filename, (CorpusType)type, config.corpusSize);
+
+        for (size_t i = 0; i < config.repeats && !errValue; ++i) {
+            errValue = RunRepeat(filename, &config, results);
+        }
+
+        if (!config.isKeep) { remove(filename); }
+
+        for (int bench = 0; bench < BENCH_COUNT && !errValue; ++bench) {
+            PrintResult(output, corpusNames[type], (BenchType)bench, &results[bench], isFirst);
+            isFirst = 0;
+        }
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+    if (output != stdout) { fclose(output); }
+
+    CountersShutdown();
+    TraceShutdown();
+
+    return errValue;
+}
@@ -0,0 +1,829 @@
+/**
+ * Checks of the document core (no WinAPI), run by CTest.
+ *
+ * Builds small documents through files of the check directory and compares the results of
+ * the document core with the expected ones: regular expressions (DFA forward and backward,
+ * the backtracker, case folding, ranges and groups), the undo history, replace-all, edits at
+ * multiple carets and in column selections, marks and decorations following the edits, snapshots and searches reading them while the document is edited. A failed check is printed, the exit code is not zero if any check fails.
+ *
+ * Usage: DocumentCheck [--dir PATH]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "Error.h"
+#include "Document.h"
+#include "Search.h"
+#include "Regex.h"
+#include "Replace.h"
+#include "Marks.h"
+#include "Decorations.h"
+#include "MultiCaret.h"
+#include "ColumnSelection.h"
+#include "FindAll.h"
+#include "TrigramIndex.h"
+
+#define MAX_PATH_LEN 1024
+
+static const char* checkDir = ".";     // directory of the files of the check documents
+static size_t failedChecks;
+
+// counts a failed check
+static int Check(int isTrue, const char* group, const char* what) {
+    if (!isTrue) {
+        fprintf(stderr, "check failed: %s: %s\n", group, what);
+        ++failedChecks;
+    }
+    return isTrue;
+}
+
+// creates a document of a text through a file of the check directory
+static Document* CreateCheckDocument(const char* text) {
+    char filename[MAX_PATH_LEN];
+    FILE* file;
+
+    snprintf(filename, sizeof(filename), "%s/check_document.txt", checkDir);
+    file = fopen(filename, "w");
+    if (!file) {
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return NULL;
+    }
+    fputs(text, file);
+    fclose(file);
+
+    Document* doc = CreateDocument(filename);
+
+    remove(filename);
+    if (!doc) { PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__); }
+    return doc;
+}
+
+// the position of a line of a document
+static ModelPos GetLinePos(const Document* doc, size_t y, size_t x) {
+    ModelPos pos = { doc->blocks->nodes, { x, y } };
+
+    for (size_t i = 0; i < y && pos.block; ++i) { pos.block = pos.block->next; }
+    return pos;
+}
+
+static int IsAt(ModelPos pos, size_t y, size_t x) {
+    return pos.pos.y == y && pos.pos.x == x;
+}
+
+// compares the text of a document (lines are joined by "\n") with a string
+static int IsText(const Document* doc, const char* text) {
+    ModelPos start = { doc->blocks->nodes, { 0, 0 } };
+    size_t len = strlen(text);
+    size_t offset = 0;
+    DocIterator it;
+    DocSpan span;
+
+    InitDocIterator(&it, doc, start, DOC_ITER_LINE_ENDS);
+    while (DocNextSpan(&it, &span)) {
+        if (offset + span.len > len || memcmp(text + offset, span.ptr, span.len)) { return 0; }
+        offset += span.len;
+    }
+    return offset == len;
+}
+
+// regular expressions ==================================================================
+
+typedef struct {
+    const char* pattern;
+    int flags;                  // RegexFlags
+    SearchDirection direction;
+    size_t fromY;               // start of the search
+    size_t fromX;
+    int isFound;
+    size_t startY;              // expected match
+    size_t startX;
+    size_t endY;
+    size_t endX;
+} RegexCheck;
+
+static int CheckRegexMatches(const char* text, const RegexCheck* checks, size_t len) {
+    Document* doc = CreateCheckDocument(text);
+
+    if (!doc) { return ERR_NOMEM; }
+
+    for (size_t i = 0; i < len; ++i) {
+        const RegexCheck* check = checks + i;
+        Regex* regex = CreateRegex(check->pattern, strlen(check->pattern), check->flags);
+        RegexMatch match;
+
+        if (!Check(regex != NULL, "regex", check->pattern)) { continue; }
+
+        int isFound = FindRegex(doc, regex, GetLinePos(doc, check->fromY, check->fromX), check->direction, &match);
+
+        Check(isFound == check->isFound && (!isFound || (IsAt(match.start, check->startY, check->startX)
+              && IsAt(match.end, check->endY, check->endX))), "regex", check->pattern);
+        DestroyRegex(&regex);
+    }
+
+    DestroyDocument(&doc);
+    return ERR_SUCCESS;
+}
+
+// anchors, alternation, repeats, backreferences, lookaheads and backward search
+static int CheckRegexSyntax() {
+    static const RegexCheck checks[] = {
+        { "^cat", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 0, 0, 3 },
+        { "^cat", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 1, 0, 0, 0, 0, 0 },
+        { "cat$", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 0, 0, 0, 0, 0 },
+        { "cat$", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 11, 0, 14 },
+        { "\\bcat\\b", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 1, 0, 0, 0, 0, 0 },
+        { "\\bcat\\b", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 1, 1, 0, 11, 0, 14 },
+        { "\\Bcat", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 7, 0, 10 },
+        { "baz|bar", REGEX_MATCH_CASE, SEARCH_FORWARD, 1, 0, 1, 1, 4, 1, 7 },
+        { "x(yz|zz)y", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 0, 0, 0, 0, 0 },
+        { "x(yz|y)z+y", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 2, 5, 2, 10 },
+        { "[0-9]{4}-[0-9]{2}", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 2, 11, 2, 18 },
+        { "Cat\\nfoo", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 11, 1, 3 },
+        { "(ab)\\1", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 2, 0, 2, 4 },
+        { "(z)\\1", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 2, 7, 2, 9 },
+        { "(CAT) con\\1", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 0, 0, 10 },
+        { "foo(?=bar)", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 1, 8, 1, 11 },
+        { "foo(?!bar)", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 1, 0, 1, 3 },
+        { "foo", REGEX_MATCH_CASE, SEARCH_BACKWARD, 1, 14, 1, 1, 8, 1, 11 },
+        { "foo", REGEX_MATCH_CASE, SEARCH_BACKWARD, 1, 10, 1, 1, 0, 1, 3 },
+        { "^cat", REGEX_MATCH_CASE, SEARCH_BACKWARD, 4, 0, 1, 0, 0, 0, 3 },
+        { "(ab)\\1", REGEX_MATCH_CASE, SEARCH_BACKWARD, 2, 21, 1, 2, 0, 2, 4 },
+        { "end", REGEX_MATCH_CASE, SEARCH_BACKWARD, 4, 2, 0, 0, 0, 0, 0 },
+    };
+
+    return CheckRegexMatches("cat concat Cat\nfoo bar foobar\nabab xyzzy 2024-01-31\n\nend", checks, sizeof(checks) / sizeof(checks[0]));
+}
+
+// ignore-case classes: a negated class has neither case of its letters
+static int CheckRegexClasses() {
+    static const RegexCheck checks[] = {
+        { "[^a-z\\n]+", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 3, 0, 7 },
+        { "[^a]+", REGEX_IGNORE_CASE, SEARCH_FORWARD, 1, 0, 1, 1, 0, 1, 1 },
+        { "[a-c]+", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 0, 0, 3 },
+        { "[a-c]+", REGEX_MATCH_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 1, 0, 2 },
+        { "[^A-Z\\n]+", REGEX_MATCH_CASE, SEARCH_FORWARD, 1, 0, 1, 1, 0, 1, 2 },
+        { "\\w+", REGEX_IGNORE_CASE, SEARCH_FORWARD, 0, 0, 1, 0, 0, 0, 3 },
+    };
+
+    return CheckRegexMatches("AbC 123\nxaAy\n", checks, sizeof(checks) / sizeof(checks[0]));
+}
+
+// a match found in a range starts in it (the DFA and the backtracker)
+static int CheckRegexRange() {
+    static const struct {
+        const char* pattern;
+        size_t to;          // end of the range on the line
+        int isFound;
+        size_t start;       // expected start of the match
+    } checks[] = {
+        { "aa", 5, 0, 0 },
+        { "aa", 6, 1, 5 },
+        { "(a)\\1", 5, 0, 0 },
+        { "(a)\\1", 6, 1, 5 },
+        { "a(?!b)", 5, 0, 0 },
+        { "a(?!b)", 6, 1, 5 },
+    };
+    Document* doc = CreateCheckDocument("xabx aa\n");
+
+    if (!doc) { return ERR_NOMEM; }
+
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+        Regex* regex = CreateRegex(checks[i].pattern, strlen(checks[i].pattern), REGEX_MATCH_CASE);
+        ModelPos to = GetLinePos(doc, 0, checks[i].to);
+        RegexMatch match;
+
+        if (!Check(regex != NULL, "regex range", checks[i].pattern)) { continue; }
+
+        int isFound = FindRegexInRange(doc, regex, GetLinePos(doc, 0, 0), &to, &match);
+
+        Check(isFound == checks[i].isFound && (!isFound || match.start.pos.x == checks[i].start), "regex range", checks[i].pattern);
+        DestroyRegex(&regex);
+    }
+
+    DestroyDocument(&doc);
+    return ERR_SUCCESS;
+}
+
+// capture groups of a match
+static int CheckRegexGroups() {
+    const char* pattern = "(foo)(bar)|(baz)";
+    Document* doc = CreateCheckDocument("foo bar foobar\n");
+    Regex* regex = CreateRegex(pattern, strlen(pattern), REGEX_MATCH_CASE);
+    RegexMatch match;
+    RegexMatch groups[4];
+
+    if (!doc || !regex) {
+        if (doc) { DestroyDocument(&doc); }
+        if (regex) { DestroyRegex(&regex); }
+        return ERR_NOMEM;
+    }
+
+    if (Check(FindRegex(doc, regex, GetLinePos(doc, 0, 0), SEARCH_FORWARD, &match), "regex groups", "match")
+        && Check(regex->groups == 4 && GetRegexGroups(doc, regex, &match, groups), "regex groups", "groups")) {
+        Check(IsAt(groups[0].start, 0, 8) && IsAt(groups[0].end, 0, 14), "regex groups", "\\0");
+        Check(IsAt(groups[1].start, 0, 8) && IsAt(groups[1].end, 0, 11), "regex groups", "\\1");
+        Check(IsAt(groups[2].start, 0, 11) && IsAt(groups[2].end, 0, 14), "regex groups", "\\2");
+        Check(!groups[3].start.block, "regex groups", "\\3 didn't participate");
+    }
+
+    DestroyRegex(&regex);
+    DestroyDocument(&doc);
+    return ERR_SUCCESS;
+}
+
+// undo history =========================================================================
+
+// edits undone and redone one by one: the text and the place of every edit are restored
+static int CheckHistory() {
+    static const struct {
+        const char* text;   // text after the edit
+        size_t undoY;       // place of the undone edit
+        size_t undoX;
+        size_t redoY;       // place after the redone edit
+        size_t redoX;
+    } steps[] = {
+        { "one\ntwo\nthree", 0, 0, 0, 0 },
+        { "one\ntwoXY\nthree", 1, 3, 1, 5 },
+        { "one\ntwoXY\nth\nree", 2, 2, 3, 0 },
+        { "onetwoXY\nth\nree", 0, 3, 0, 3 },
+        { "onetwoXY\nth\ne", 2, 0, 2, 0 },
+    };
+    size_t len = sizeof(steps) / sizeof(steps[0]);
+    Document* doc = CreateCheckDocument(steps[0].text);
+    ModelPos pos;
+
+    if (!doc) { return ERR_NOMEM; }
+    if (SetHistory(doc, HISTORY_DEFAULT_CAP)) {
+        DestroyDocument(&doc);
+        return ERR_NOMEM;
+    }
+
+    if (DocInsertChars(doc, GetLinePos(doc, 1, 0).block, 1, 3, "XY", 2)
+        || DocSplitBlock(doc, GetLinePos(doc, 2, 0).block, 2, 2)
+        || DocMergeBlocks(doc, doc->blocks->nodes, 0)
+        || DocDeleteChars(doc, GetLinePos(doc, 2, 0).block, 2, 0, 2)) {
+        DestroyDocument(&doc);
+        return ERR_NOMEM;
+    }
+    Check(IsText(doc, steps[len - 1].text), "history", "edits");
+
+    for (size_t i = len - 1; i > 0; --i) {
+        Check(!DocUndo(doc, &pos, NULL, NULL) && pos.block && IsAt(pos, steps[i].undoY, steps[i].undoX), "history", "undo place");
+        Check(pos.block == GetLinePos(doc, pos.pos.y, 0).block, "history", "undo block");
+        Check(IsText(doc, steps[i - 1].text), "history", "undo text");
+    }
+    Check(!DocUndo(doc, &pos, NULL, NULL) && !pos.block, "history", "nothing to undo");
+
+    for (size_t i = 1; i < len; ++i) {
+        Check(!DocRedo(doc, &pos, NULL, NULL) && pos.block && IsAt(pos, steps[i].redoY, steps[i].redoX), "history", "redo place");
+        Check(pos.block == GetLinePos(doc, pos.pos.y, 0).block, "history", "redo block");
+        Check(IsText(doc, steps[i].text), "history", "redo text");
+    }
+    Check(!DocRedo(doc, &pos, NULL, NULL) && !pos.block, "history", "nothing to redo");
+
+    DestroyDocument(&doc);
+    return ERR_SUCCESS;
+}
+
+// replace-all ==========================================================================
+
+// every replacement is one edit of the history: one undo restores the text, one redo replaces it again
+static int CheckReplace() {
+    static const struct {
+        const char* text;
+        const char* pattern;
+        const char* replacement;
+        int flags;              // ReplaceFlags
+        size_t count;           // replaced occurrences
+        const char* replaced;   // text after the replacement
+    } checks[] = {
+        { "cat a cat\nno\ncat", "cat", "dog", REPLACE_LITERAL, 3, "dog a dog\nno\ndog" },
+        { "ab Ab\naB", "AB", "x", REPLACE_IGNORE_CASE, 3, "x x\nx" },
+        { "a\nb\na\nb", "a\nb", "-", REPLACE_LITERAL, 2, "-\n-" },
+        { "axb\nx", "x", "1\n2", REPLACE_LITERAL, 2, "a1\n2b\n1\n2" },
+        { "me@home\nyou@work", "(\\w+)@(\\w+)", "\\2 at \\1", REPLACE_REGEX, 2, "home at me\nwork at you" },
+        { "one two\nthree", " |\n", "\\n\\n", REPLACE_REGEX, 2, "one\n\ntwo\n\nthree" },
+        { "abc", "x", "y", REPLACE_LITERAL, 0, "abc" },
+    };
+
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+        Document* doc = CreateCheckDocument(checks[i].text);
+        size_t count = 0;
+        ModelPos pos;
+        int errValue = doc ? SetHistory(doc, HISTORY_DEFAULT_CAP) : ERR_NOMEM;
+
+        if (!errValue) {
+            errValue = ReplaceAll(doc, checks[i].pattern, strlen(checks[i].pattern), checks[i].replacement,
+                                  strlen(checks[i].replacement), checks[i].flags, &count, NULL, NULL);
+        }
+        if (errValue) {
+            if (doc) { DestroyDocument(&doc); }
+            return errValue;
+        }
+
+        Check(count == checks[i].count && IsText(doc, checks[i].replaced), "replace-all", checks[i].pattern);
+        if (count) {
+            Check(!DocUndo(doc, &pos, NULL, NULL) && pos.block && IsText(doc, checks[i].text), "replace-all undo", checks[i].pattern);
+            Check(!DocUndo(doc, &pos, NULL, NULL) && !pos.block, "replace-all undo group", checks[i].pattern);
+            Check(!DocRedo(doc, &pos, NULL, NULL) && pos.block && IsText(doc, checks[i].replaced), "replace-all redo", checks[i].pattern);
+        }
+        DestroyDocument(&doc);
+    }
+
+    // an invalid expression leaves the document (the regex compiler prints the error)
+    Document* doc = CreateCheckDocument("a(b");
+    if (!doc) { return ERR_NOMEM; }
+
+    size_t version = doc->version;
+    Check(ReplaceAll(doc, "(", 1, "x", 1, REPLACE_REGEX, NULL, NULL, NULL) == ERR_PARAM
+          && IsText(doc, "a(b") && doc->version == version, "replace-all", "invalid expression");
+
+    DestroyDocument(&doc);
+    return ERR_SUCCESS;
+}
+
+// multiple carets ======================================================================
+
+static void CountChanges(void* context, const CaretsChange* change) {
+    (void)change;
+    ++*(size_t*)context;
+}
+
+// carets are at positions and their blocks are the blocks of the positions
+static int AreCaretsAt(const Document* doc, const CaretSet* set, const position_t* positions, size_t len) {
+    if (set->len != len) { return 0; }
+
+    for (size_t i = 0; i < len; ++i) {
+        const ModelPos* caret = &set->items[i];
+
+        if (!IsAt(*caret, positions[i].y, positions[i].x) || caret->block != GetLinePos(doc, caret->pos.y, 0).block) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// every pass edits all carets, the blocks of the carets follow splits and merges, the passes are one undo group
+static int CheckMultiCaret() {
+    static const position_t start[] = { { 1, 0 }, { 1, 1 }, { 3, 2 } };
+    static const position_t inserted[] = { { 2, 0 }, { 2, 1 }, { 4, 2 } };
+    static const position_t tabbed[] = { { 4, 0 }, { 4, 1 }, { 8, 2 } };
+    static const position_t split[] = { { 0, 1 }, { 0, 3 }, { 0, 5 } };
+    static const position_t met[] = { { 4, 0 } };
+    Document* doc = CreateCheckDocument("abc\ndef\nghi");
+    CaretSet set;
+    size_t changes = 0;
+    ModelPos pos;
+    int errValue = doc ? SetHistory(doc, HISTORY_DEFAULT_CAP) : ERR_NOMEM;
+
+    InitCaretSet(&set, NULL, CountChanges, &changes);
+    for (size_t i = 0; i < 3 && !errValue; ++i) { errValue = AddCaret(&set, GetLinePos(doc, start[i].y, start[i].x)); }
+    if (!errValue) {
+        DocBeginUndoGroup(doc);
+        errValue = InsertAtCarets(doc, &set, "X", 1, 4, 0);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "aXbc\ndXef\nghiX") && AreCaretsAt(doc, &set, inserted, 3) && changes == 3, "carets", "insert");
+        errValue = InsertAtCarets(doc, &set, "\t", 1, 4, 0);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "aX  bc\ndX  ef\nghiX    ") && AreCaretsAt(doc, &set, tabbed, 3), "carets", "tab");
+        errValue = SplitAtCarets(doc, &set);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "aX  \nbc\ndX  \nef\nghiX    \n") && AreCaretsAt(doc, &set, split, 3), "carets", "split");
+        errValue = BackspaceAtCarets(doc, &set, 1);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "aX  bc\ndX  ef\nghiX    ") && AreCaretsAt(doc, &set, tabbed, 3), "carets", "backspace");
+        errValue = DeleteAtCarets(doc, &set, 2);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "aX  \ndX  \nghiX    ") && AreCaretsAt(doc, &set, tabbed, 3), "carets", "delete");
+
+        // the first caret deletes a char and a line end, the second one stops at it
+        ClearCarets(&set);
+        errValue = AddCaret(&set, GetLinePos(doc, 1, 1));
+    }
+    if (!errValue) { errValue = AddCaret(&set, GetLinePos(doc, 1, 3)); }
+    if (!errValue) { errValue = BackspaceAtCarets(doc, &set, 2); }
+    if (!errValue) {
+        Check(IsText(doc, "aX   \nghiX    ") && AreCaretsAt(doc, &set, met, 1), "carets", "backspace to a caret");
+        DocEndUndoGroup(doc);
+
+        Check(!DocUndo(doc, &pos, NULL, NULL) && IsText(doc, "abc\ndef\nghi"), "carets", "undo");
+        Check(!DocUndo(doc, &pos, NULL, NULL) && !pos.block, "carets", "undo group");
+    }
+
+    FreeCaretSet(&set);
+    if (doc) { DestroyDocument(&doc); }
+    return errValue;
+}
+
+// column selection =====================================================================
+
+// a rectangle over blocks shorter than it: copied, filled, typed over and deleted as columns
+static int CheckColumnSelection() {
+    static const char* text = "abcdef\nab\nabcdef";
+    Document* doc = CreateCheckDocument(text);
+    ColumnSelection selection;
+    ColumnRect rect;
+    String* copy = CreateString(NULL);
+    ModelPos pos;
+    int errValue = doc && copy && !ReserveSize(copy, 1) ? SetHistory(doc, HISTORY_DEFAULT_CAP) : ERR_NOMEM;
+
+    InitColumnSelection(&selection, NULL, NULL);
+    if (!errValue) {
+        BeginColumnSelection(&selection, GetLinePos(doc, 0, 1));
+        selection.active = GetLinePos(doc, 2, 4);
+        GetColumnRect(&selection, &rect);
+        Check(rect.block == doc->blocks->nodes && rect.y == 0 && rect.lines == 3 && rect.left == 1 && rect.right == 4,
+              "columns", "rectangle");
+
+        errValue = CopyColumns(doc, &selection, "\n", copy);
+    }
+    if (!errValue) {
+        Check(copy->len == 9 && !memcmp(copy->data, "bcd\nb\nbcd", 9), "columns", "copy");
+
+        DocBeginUndoGroup(doc);
+        errValue = FillColumns(doc, &selection, '.');
+    }
+    if (!errValue) {
+        Check(IsText(doc, "a...ef\na...\na...ef"), "columns", "fill");
+        errValue = InsertColumns(doc, &selection, "XY", 2, 4);
+    }
+    if (!errValue) {
+        GetColumnRect(&selection, &rect);
+        Check(IsText(doc, "aXYef\naXY\naXYef") && rect.left == 3 && rect.right == 3 && rect.lines == 3, "columns", "insert");
+        errValue = DeleteColumns(doc, &selection, 1, 1);
+    }
+    if (!errValue) {
+        GetColumnRect(&selection, &rect);
+        Check(IsText(doc, "aXef\naX\naXef") && rect.left == 2 && rect.right == 2, "columns", "delete");
+        DocEndUndoGroup(doc);
+
+        Check(!DocUndo(doc, &pos, NULL, NULL) && IsText(doc, text), "columns", "undo");
+    }
+
+    if (copy) { DestroyString(&copy); }
+    if (doc) { DestroyDocument(&doc); }
+    return errValue;
+}
+
+// marks ================================================================================
+
+#define CHECK_MARKS 4
+
+static void FollowMarks(void* context, const HistoryChange* change) {
+    MarksFollowChange(context, change);
+}
+
+static int AreMarksAt(const MarkSet* set, const size_t* ids, const position_t* positions) {
+    for (size_t i = 0; i < CHECK_MARKS; ++i) {
+        position_t pos = GetMark(set, ids[i]);
+
+        if (pos.x != positions[i].x || pos.y != positions[i].y) { return 0; }
+    }
+    return 1;
+}
+
+// marks follow the edits of undo, redo and replace-all
+static int CheckMarks() {
+    static const position_t start[CHECK_MARKS] = { { 0, 1 }, { 2, 2 }, { 0, 3 }, { 1, 1 } };
+    static const position_t split[CHECK_MARKS] = { { 0, 2 }, { 2, 3 }, { 0, 4 }, { 1, 2 } };
+    static const position_t merged[CHECK_MARKS] = { { 0, 1 }, { 4, 1 }, { 0, 2 }, { 1, 1 } };
+    static const position_t broken[CHECK_MARKS] = { { 0, 1 }, { 2, 3 }, { 0, 4 }, { 0, 2 } };
+    Document* doc = CreateCheckDocument("ab\nfoo\nbar\nbaz");
+    MarkSet set;
+    size_t ids[CHECK_MARKS];
+    ModelPos pos;
+    int errValue = doc ? SetHistory(doc, HISTORY_DEFAULT_CAP) : ERR_NOMEM;
+
+    InitMarkSet(&set, MARK_MOVE);
+    for (size_t i = 0; i < CHECK_MARKS && !errValue; ++i) { errValue = AddMark(&set, start[i], &ids[i]); }
+
+    // a bookmark stays on its line when a split above it is undone
+    if (!errValue) { errValue = DocSplitBlock(doc, doc->blocks->nodes, 0, 1); }
+    if (!errValue) {
+        MarksSplitBlock(&set, (position_t) { 1, 0 });
+        Check(AreMarksAt(&set, ids, split), "marks", "split");
+
+        Check(!DocUndo(doc, &pos, FollowMarks, &set) && AreMarksAt(&set, ids, start), "marks", "undo split");
+        Check(!DocRedo(doc, &pos, FollowMarks, &set) && AreMarksAt(&set, ids, split), "marks", "redo split");
+        Check(!DocUndo(doc, &pos, FollowMarks, &set) && AreMarksAt(&set, ids, start), "marks", "undo split again");
+
+        // a match over a line end: deleted chars, a merge and inserted chars
+        errValue = ReplaceAll(doc, "o\nb", 3, "0", 1, REPLACE_LITERAL, NULL, FollowMarks, &set);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "ab\nfo0ar\nbaz") && AreMarksAt(&set, ids, merged), "marks", "replace-all merge");
+        Check(!DocUndo(doc, &pos, FollowMarks, &set) && AreMarksAt(&set, ids, start), "marks", "undo replace-all merge");
+        Check(!DocRedo(doc, &pos, FollowMarks, &set) && AreMarksAt(&set, ids, merged), "marks", "redo replace-all merge");
+        Check(!DocUndo(doc, &pos, FollowMarks, &set) && IsText(doc, "ab\nfoo\nbar\nbaz"), "marks", "undo text");
+
+        // a replacement with a line end: a split after the deleted chars
+        errValue = ReplaceAll(doc, "oo", 2, "\n", 1, REPLACE_LITERAL, NULL, FollowMarks, &set);
+    }
+    if (!errValue) {
+        Check(IsText(doc, "ab\nf\n\nbar\nbaz") && AreMarksAt(&set, ids, broken), "marks", "replace-all split");
+    }
+
+    FreeMarkSet(&set);
+    if (doc) { DestroyDocument(&doc); }
+    return errValue;
+}
+
+// decorations ==========================================================================
+
+static void FollowDecorations(void* context, const HistoryChange* change) {
+    DecorationsFollowChange(context, change);
+}
+
+// compares the runs of the marked layer with the expected ones
+static int AreRuns(const Decorations* decorations, const DecorationRun* expected, size_t len) {
+    size_t runsLen;
+    DecorationRun* runs = GetDecorationRuns(decorations, DECORATION_MARKED, 0, SIZE_MAX, &runsLen);
+    int isEqual = runsLen == len;
+
+    for (size_t i = 0; isEqual && i < len; ++i) {
+        isEqual = runs[i].y == expected[i].y && runs[i].start == expected[i].start
+                  && runs[i].end == expected[i].end && runs[i].style == expected[i].style;
+    }
+    free(runs);
+    return isEqual;
+}
+
+// ranges follow the edits of undo, redo and replace-all
+static int CheckDecorations() {
+    static const DecorationRun start[] = { { 1, 0, 3, 1 }, { 3, 0, 3, 2 } };
+    static const DecorationRun split[] = { { 2, 0, 3, 1 }, { 4, 0, 3, 2 } };
+    static const DecorationRun replaced[] = { { 1, 0, 2, 1 }, { 2, 0, 3, 2 } };
+    static const DecorationRun undone[] = { { 1, 0, 2, 1 }, { 3, 0, 3, 2 } };
+    Document* doc = CreateCheckDocument("ab\nfoo\nbar\nbaz");
+    Decorations decorations;
+    ModelPos pos;
+    int errValue = doc ? SetHistory(doc, HISTORY_DEFAULT_CAP) : ERR_NOMEM;
+
+    InitDecorations(&decorations);
+    if (!errValue) { errValue = AddDecoration(&decorations, DECORATION_MARKED, GetLinePos(doc, 1, 0), GetLinePos(doc, 1, 3), 1); }
+    if (!errValue) { errValue = AddDecoration(&decorations, DECORATION_MARKED, GetLinePos(doc, 3, 0), GetLinePos(doc, 3, 3), 2); }
+    if (!errValue) { errValue = DocSplitBlock(doc, doc->blocks->nodes, 0, 1); }
+    if (!errValue) {
+        DecorationsSplitBlock(&decorations, (position_t) { 1, 0 });
+        Check(AreRuns(&decorations, split, 2), "decorations", "split");
+
+        Check(!DocUndo(doc, &pos, FollowDecorations, &decorations) && AreRuns(&decorations, start, 2), "decorations", "undo split");
+        Check(!DocRedo(doc, &pos, FollowDecorations, &decorations) && AreRuns(&decorations, split, 2), "decorations", "redo split");
+        Check(!DocUndo(doc, &pos, FollowDecorations, &decorations) && AreRuns(&decorations, start, 2), "decorations", "undo split again");
+
+        // the end of the first range is deleted, the second range moves up
+        errValue = ReplaceAll(doc, "o\nb", 3, "0", 1, REPLACE_LITERAL, NULL, FollowDecorations, &decorations);
+    }
+    if (!errValue) {
+        Check(AreRuns(&decorations, replaced, 2), "decorations", "replace-all");
+        Check(!DocUndo(doc, &pos, FollowDecorations, &decorations) && AreRuns(&decorations, undone, 2), "decorations", "undo replace-all");
+    }
+
+    FreeDecorations(&decorations);
+    if (doc) { DestroyDocument(&doc); }
+    return errValue;
+}
+
+// snapshots ============================================================================
+
+// compares the text of a snapshot with a string
+static int IsSnapshotText(const Snapshot* snapshot, const char* text) {
+    size_t len = strlen(text);
+    size_t offset = 0;
+    SnapshotIterator it;
+    SnapshotSpan span;
+
+    InitSnapshotIterator(&it, snapshot);
+    while (SnapshotNextSpan(&it, &span)) {
+        if (offset + span.len > len || memcmp(text + offset, span.ptr, span.len)) { return 0; }
+        offset += span.len;
+    }
+    return offset == len;
+}
+
+// edits in, before and after the lines of snapshots don't change their text
+static int CheckSnapshots() {
+    static const char* text = "one\ntwo\nthree";
+    Document* doc = CreateCheckDocument(text);
+    Snapshot* first = NULL;
+    Snapshot* second = NULL;
+    Document* view = NULL;
+    Block* origins[3];
+    int errValue = doc ? ERR_SUCCESS : ERR_NOMEM;
+
+    if (!errValue && (!(first = DocTakeSnapshot(doc)) || !(view = CreateSnapshotView(first, origins)))) { errValue = ERR_NOMEM; }
+    if (!errValue) {
+        Check(origins[0] == doc->blocks->nodes && origins[2] == doc->blocks->last, "snapshots", "blocks of the view");
+        errValue = DocInsertChars(doc, GetLinePos(doc, 1, 0).block, 1, 3, "XY", 2);
+    }
+    if (!errValue) { errValue = DocSplitBlock(doc, GetLinePos(doc, 2, 0).block, 2, 2); }
+    if (!errValue && !(second = DocTakeSnapshot(doc))) { errValue = ERR_NOMEM; }
+    if (!errValue) { errValue = DocMergeBlocks(doc, doc->blocks->nodes, 0); }
+    if (!errValue) { errValue = DocDeleteChars(doc, GetLinePos(doc, 2, 0).block, 2, 0, 2); }
+    if (!errValue) { errValue = DocAddText(doc, "four", 4); }
+
+    if (!errValue) {
+        Check(IsText(doc, "onetwoXY\nth\ne"), "snapshots", "edited text");
+        Check(IsSnapshotText(first, text) && IsText(view, text), "snapshots", "text of the first snapshot");
+        Check(IsSnapshotText(second, "one\ntwoXY\nth\nree"), "snapshots", "text of the second snapshot");
+    }
+
+    // memory of the first snapshot is freed by the next edit, the second one still reads its text
+    DestroySnapshotView(&view);
+    if (first) { ReleaseSnapshot(first); }
+    if (!errValue) { errValue = DocInsertChars(doc, doc->blocks->nodes, 0, 0, "zero", 4); }
+    if (!errValue) { Check(IsSnapshotText(second, "one\ntwoXY\nth\nree"), "snapshots", "text after a release"); }
+
+    if (second) { ReleaseSnapshot(second); }
+    if (doc) { DestroyDocument(&doc); }
+    return errValue;
+}
+
+typedef struct {
+    TaskGroup group;
+    atomic_int isOpen;
+} Gate;
+
+// holds the only worker of a pool until the gate is opened
+static void WaitGate(void* arg, size_t worker) {
+    Gate* gate = arg;
+    (void)worker;
+
+    while (!atomic_load(&gate->isOpen)) { }
+}
+
+// tasks submitted after the gate is closed start when it's opened, so edits made meanwhile come before them
+static int CloseGate(ThreadPool* pool, Gate* gate) {
+    InitTaskGroup(&gate->group);
+    atomic_init(&gate->isOpen, 0);
+    return ThreadPoolSubmit(pool, &gate->group, WaitGate, gate);
+}
+
+static void OpenGate(ThreadPool* pool, Gate* gate) {
+    atomic_store(&gate->isOpen, 1);
+    ThreadPoolWait(pool, &gate->group);
+}
+
+// the next position of a search after a match start (a char forward)
+static int NextPos(ModelPos* pos) {
+    if (pos->pos.x < pos->block->data.len) {
+        ++pos->pos.x;
+        return 1;
+    }
+    if (!pos->block->next) { return 0; }
+
+    pos->block = pos->block->next;
+    pos->pos.x = 0;
+    ++pos->pos.y;
+    return 1;
+}
+
+// matches of find-all are the matches of the text when it's started
+static int CheckFindAll() {
+    ThreadPool* pool = CreateThreadPool(1);
+    Document* doc = CreateCheckDocument("cat\ndog cat\ncatcat\ndog");
+    FindAll* findAll = NULL;
+    RegexMatch matches[8];
+    Gate gate;
+    int isFinished = 0;
+    int errValue = pool && doc ? ERR_SUCCESS : ERR_NOMEM;
+
+    if (!errValue) { errValue = CloseGate(pool, &gate); }
+    if (!errValue && !(findAll = StartFindAll(pool, doc, "CAT", 3, FIND_ALL_IGNORE_CASE, NULL, NULL))) { errValue = ERR_NOMEM; }
+
+    // lines are added and removed before the search runs
+    if (!errValue) { errValue = DocSplitBlock(doc, doc->blocks->nodes, 0, 0); }
+    if (!errValue) { errValue = DocDeleteChars(doc, GetLinePos(doc, 3, 0).block, 3, 0, 3); }
+    if (pool && doc) { OpenGate(pool, &gate); }
+    if (!errValue) {
+        size_t len;
+
+        FindAllWait(findAll);
+        len = FindAllTake(findAll, matches, 8, &isFinished);
+
+        Check(FindAllVersion(findAll) != doc->version && isFinished && len == 4, "find-all", "matches of the snapshot");
+        Check(len == 4 && IsAt(matches[0].start, 0, 0) && IsAt(matches[1].start, 1, 4)
+              && IsAt(matches[2].start, 2, 0) && IsAt(matches[3].start, 2, 3) && IsAt(matches[3].end, 2, 6),
+              "find-all", "positions of the snapshot");
+    }
+
+    if (findAll) { DestroyFindAll(&findAll); }
+    if (doc) { DestroyDocument(&doc); }
+    if (pool) { DestroyThreadPool(&pool); }
+    return errValue;
+}
+
+// trigram index ========================================================================
+
+// indexed searches find the occurrences of a linear scan: forward from every match and backward from the end
+static void CheckIndexedQueries(const Document* doc, TrigramIndex* index, const char* what) {
+    static const char* queries[] = { "fox", "Jumps", "the lazy", "dog\nthe", "over the", "quick\nbrown\nf", "zzz" };
+
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+        Literal* literal = CreateLiteral(queries[i], strlen(queries[i]), SEARCH_IGNORE_CASE);
+        ModelPos from = { doc->blocks->nodes, { 0, 0 } };
+        ModelPos end = { doc->blocks->last, { doc->blocks->last->data.len, doc->blocks->len - 1 } };
+        ModelPos match;
+        ModelPos indexed;
+        int isFound;
+        int isEqual = 1;
+
+        if (!Check(literal != NULL, what, queries[i])) { continue; }
+
+        do {
+            isFound = FindLiteral(doc, literal, from, SEARCH_FORWARD, &match);
+            if (isFound != FindLiteralIndexed(index, literal, from, SEARCH_FORWARD, &indexed)
+                || (isFound && !IsAt(indexed, match.pos.y, match.pos.x))) {
+                isEqual = 0;
+            }
+            from = match;
+        } while (isEqual && isFound && NextPos(&from));
+
+        isFound = FindLiteral(doc, literal, end, SEARCH_BACKWARD, &match);
+        if (isFound != FindLiteralIndexed(index, literal, end, SEARCH_BACKWARD, &indexed)
+            || (isFound && !IsAt(indexed, match.pos.y, match.pos.x))) {
+            isEqual = 0;
+        }
+
+        Check(isEqual, what, queries[i]);
+        DestroyLiteral(&literal);
+    }
+}
+
+// the index is built from a snapshot while the document is edited, then it follows the edits
+static int CheckTrigramIndex() {
+    ThreadPool* pool = CreateThreadPool(1);
+    Document* doc = CreateCheckDocument("The quick\nbrown fox\njumps over the lazy dog\nthe end\nfox");
+    TrigramIndex* index = NULL;
+    Gate gate;
+    int errValue = pool && doc ? ERR_SUCCESS : ERR_NOMEM;
+
+    if (!errValue) { errValue = CloseGate(pool, &gate); }
+    if (!errValue && !(index = StartTrigramIndex(pool, doc, NULL))) { errValue = ERR_NOMEM; }
+
+    // edits made before the index is built
+    if (!errValue) { errValue = DocInsertChars(doc, GetLinePos(doc, 3, 0).block, 3, 0, "fox ", 4); }
+    if (!errValue) { errValue = DocSplitBlock(doc, GetLinePos(doc, 2, 0).block, 2, 6); }
+    if (pool && doc) { OpenGate(pool, &gate); }
+    if (!errValue) {
+        TrigramIndexWait(index);
+        Check(IsTrigramIndexReady(index), "trigram index", "built while edited");
+        Check(IsText(doc, "The quick\nbrown fox\njumps \nover the lazy dog\nfox the end\nfox"), "trigram index", "edited text");
+        CheckIndexedQueries(doc, index, "trigram index after edits during the build");
+
+        // edits of the ready index: a merge makes an occurrence over a former line end, the last line is deleted
+        errValue = DocMergeBlocks(doc, GetLinePos(doc, 2, 0).block, 2);
+    }
+    if (!errValue) { errValue = DocDeleteChars(doc, GetLinePos(doc, 4, 0).block, 4, 0, 3); }
+    if (!errValue) { errValue = DocInsertChars(doc, doc->blocks->nodes, 0, 0, "fOX ", 4); }
+    if (!errValue) { CheckIndexedQueries(doc, index, "trigram index after edits"); }
+
+    if (index) { DestroyTrigramIndex(&index); }
+    if (doc) { DestroyDocument(&doc); }
+    if (pool) { DestroyThreadPool(&pool); }
+    return errValue;
+}
+
+int main(int argc, char* argv[]) {
+    static int (*const checks[])() = {
+        CheckRegexSyntax,
+        CheckRegexClasses,
+        CheckRegexRange,
+        CheckRegexGroups,
+        CheckHistory,
+        CheckReplace,
+        CheckMultiCaret,
+        CheckColumnSelection,
+        CheckMarks,
+        CheckDecorations,
+        CheckSnapshots,
+        CheckFindAll,
+        CheckTrigramIndex,
+    };
+    int errValue = ERR_SUCCESS;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--dir")) { checkDir = argv[i + 1]; }
+    }
+
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]) && !errValue; ++i) { errValue = checks[i](); }
+
+    if (errValue) {
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+        return errValue;
+    }
+
+    if (failedChecks) {
+        fprintf(stderr, "%zu checks failed\n", failedChecks);
+        return ERR_PARAM;
+    }
+    return ERR_SUCCESS;
+}
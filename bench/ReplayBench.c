@@ -0,0 +1,457 @@
+/**
+ * Headless replay of recorded editing sessions (see Replay.h, Debug -> Record session).
+ *
+ * Applies the recorded model operations to the document through the document core and
+ * emulates the view: caret and scroll positions, derived metrics (max block length,
+ * wrapped lines) and painting of the client area after every operation. Reports the total
+ * time, latency distribution per operation and peak memory as JSON. Undo, redo and replace-all
+ * aren't recorded: the editor stops the recording at them.
+ *
+ * Usage: ReplayBench --doc FILE --trace FILE [--output FILE]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#include "Error.h"
+#include "Clock.h"
+#include "Histogram.h"
+#include "Document.h"
+#include "Replay.h"
+#include "Counters.h"
+#include "Trace.h"
+
+// values of FormatMode (DisplayedModel.h)
+typedef enum {
+    VIEW_MODE_DEFAULT,
+    VIEW_MODE_WRAP
+} ViewMode;
+
+typedef struct {
+    Block* block;       // pointer to a block
+    size_t y;           // index of the block
+} ViewPos;
+
+typedef struct {
+    Document* doc;      // pointer to a Document object
+    ViewMode mode;      // format mode
+    size_t lines;       // lines of the client area
+    size_t chars;       // chars of the client area
+    size_t maxLen;      // max length of a block (document area)
+    size_t wrapLines;   // lines of the wrap model
+
+    ViewPos caret;      // caret block
+    ViewPos scroll;     // top block of the client area
+    size_t scrollX;     // wrapped line of the top block
+    size_t scrollPos;   // horizontal scroll pos
+
+    char* line;         // buffer of a painted line
+} View;
+
+static const char* opNames[REPLAY_OP_COUNT] = {
+    "move",
+    "add_char",
+    "add_block",
+    "delete_char",
+    "delete_block",
+    "scroll",
+    "resize",
+    "switch_mode"
+};
+
+static volatile size_t paintSink;   // keeps painted chars alive
+
+static size_t GetPeakMemory() {
+    #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+        return counters.PeakWorkingSetSize;
+    #else
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage)) { return 0; }
+        #ifdef __APPLE__
+            return (size_t)usage.ru_maxrss;
+        #else
+            return (size_t)usage.ru_maxrss * 1024;
+        #endif
+    #endif
+}
+
+static size_t GetBlockLines(const View* view, const Block* block) {
+    return block->data.len ? DIV_WITH_ROUND_UP(block->data.len, view->chars) : 1;
+}
+
+static int MoveTo(const View* view, ViewPos* pos, size_t y) {
+    if (y >= view->doc->blocks->len) { return ERR_PARAM; }
+
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, pos->y > y ? pos->y - y : y - pos->y);
+    for (; pos->y < y; ++pos->y) { pos->block = pos->block->next; }
+    for (; pos->y > y; --pos->y) { pos->block = pos->block->prev; }
+
+    return ERR_SUCCESS;
+}
+
+// BuildWrapModel and UpdateVerticalSB_Wrap pass all blocks
+static void CountWrapLines(View* view) {
+    view->wrapLines = 0;
+
+    COUNTER_ADD(COUNTER_BLOCKS_VISITED, view->doc->blocks->len);
+    for (Block* block = view->doc->blocks->nodes; block; block = block->next) {
+        view->wrapLines += GetBlockLines(view, block);
+    }
+}
+
+static size_t CopyLine(const View* view, const Block* block, size_t from, size_t len) {
+    Fragment* fragment = block->data.fragments->nodes;
+    size_t copied = 0;
+
+    // find place
+    while (fragment && from >= fragment->data.len) {
+        from -= fragment->data.len;
+        fragment = fragment->next;
+    }
+
+    for (; fragment && copied < len; fragment = fragment->next, from = 0) {
+        size_t count = fragment->data.len - from;
+
+        if (count > len - copied) { count = len - copied; }
+
+        memcpy(view->line + copied, view->doc->text->data + fragment->data.pos + from, count);
+        copied += count;
+    }
+
+    return copied;
+}
+
+// DisplayModel: every line of the client area is built from fragments
+static void Paint(const View* view) {
+    Block* block = view->scroll.block;
+    size_t lineInBlock = view->scrollX;
+    size_t sum = 0;
+
+    for (size_t i = 0; i < view->lines && block; ++i) {
+        switch (view->mode) {
+        case VIEW_MODE_DEFAULT:
+            sum += CopyLine(view, block, view->scrollPos, view->chars);
+            block = block->next;
+            break;
+
+        case VIEW_MODE_WRAP:
+            sum += CopyLine(view, block, lineInBlock * view->chars, view->chars);
+
+            if (++lineInBlock >= GetBlockLines(view, block)) {
+                block = block->next;
+                lineInBlock = 0;
+            }
+            break;
+        }
+    }
+
+    paintSink = sum;
+}
+
+static int InitView(View* view, Document* doc, const ReplayHeader* header) {
+    memset(view, 0, sizeof(View));
+
+    view->doc = doc;
+    view->mode = header->mode == VIEW_MODE_WRAP ? VIEW_MODE_WRAP : VIEW_MODE_DEFAULT;
+    view->lines = header->lines;
+    view->chars = header->chars ? header->chars : 1;
+    view->maxLen = GetMaxBlockLen(doc->blocks);
+
+    view->caret.block = doc->blocks->nodes;
+    view->scroll.block = doc->blocks->nodes;
+    view->scrollX = header->scrollX;
+    view->scrollPos = header->scrollPos;
+
+    view->line = malloc(view->chars);
+    if (!view->line) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    if (view->mode == VIEW_MODE_WRAP) { CountWrapLines(view); }
+
+    if (MoveTo(view, &(view->caret), header->caretY) || MoveTo(view, &(view->scroll), header->scrollY)) {
+        return ERR_PARAM;
+    }
+
+    return ERR_SUCCESS;
+}
+
+static int Resize(View* view, size_t lines, size_t chars) {
+    char* line = realloc(view->line, chars ? chars : 1);
+
+    if (!line) {
+        PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+        return ERR_NOMEM;
+    }
+
+    view->line = line;
+    view->lines = lines;
+    view->chars = chars ? chars : 1;
+
+    if (view->mode == VIEW_MODE_WRAP) { CountWrapLines(view); }
+
+    return ERR_SUCCESS;
+}
+
+static int ApplyEdit(View* view, const ReplayEvent* event) {
+    Block* block;
+    size_t linesBlock;
+
+    if (MoveTo(view, &(view->caret), event->y)) { return ERR_PARAM; }
+
+    block = view->caret.block;
+    if (event->x > block->data.len) { return ERR_PARAM; }
+
+    linesBlock = GetBlockLines(view, block);
+
+    switch (event->op) {
+    case REPLAY_OP_ADD_CHAR:
+        if (DocInsertChar(view->doc, block, event->y, event->x, (char)event->value)) { return ERR_NOMEM; }
+
+        if (view->maxLen < block->data.len) { view->maxLen = block->data.len; }
+        if (view->mode == VIEW_MODE_WRAP && linesBlock < GetBlockLines(view, block)) { ++view->wrapLines; }
+        break;
+
+    case REPLAY_OP_ADD_BLOCK: {
+        int isChangeLen = block->data.len == view->maxLen;
+
+        if (DocSplitBlock(view->doc, block, event->y, event->x)) { return ERR_NOMEM; }
+
+        if (view->scroll.y > view->caret.y) { ++view->scroll.y; }
+        if (isChangeLen) { view->maxLen = GetMaxBlockLen(view->doc->blocks); }
+        if (view->mode == VIEW_MODE_WRAP) { CountWrapLines(view); }
+        break;
+    }
+
+    case REPLAY_OP_DELETE_CHAR:
+        if (event->x == block->data.len) { return ERR_PARAM; }
+        if (DocDeleteChar(view->doc, block, event->y, event->x)) { return ERR_NOMEM; }
+
+        if (view->maxLen == block->data.len + 1) { view->maxLen = GetMaxBlockLen(view->doc->blocks); }
+        if (view->mode == VIEW_MODE_WRAP && linesBlock > GetBlockLines(view, block)) { --view->wrapLines; }
+        break;
+
+    case REPLAY_OP_DELETE_BLOCK:
+        if (!block->next) { return ERR_PARAM; }
+
+        if (view->scroll.block == block->next) {
+            view->scroll.block = block;
+            --view->scroll.y;
+        } else if (view->scroll.y > view->caret.y) {
+            --view->scroll.y;
+        }
+
+        if (DocMergeBlocks(view->doc, block, event->y)) { return ERR_NOMEM; }
+
+        if (view->maxLen < block->data.len) { view->maxLen = block->data.len; }
+        if (view->mode == VIEW_MODE_WRAP) { CountWrapLines(view); }
+        break;
+
+    default:
+        return ERR_PARAM;
+    }
+
+    return ERR_SUCCESS;
+}
+
+static int Apply(View* view, const ReplayEvent* event) {
+    int errValue = ERR_SUCCESS;
+
+    switch (event->op) {
+    case REPLAY_OP_MOVE:
+        errValue = MoveTo(view, &(view->caret), event->y);
+        break;
+
+    case REPLAY_OP_ADD_CHAR:
+    case REPLAY_OP_ADD_BLOCK:
+    case REPLAY_OP_DELETE_CHAR:
+    case REPLAY_OP_DELETE_BLOCK:
+        errValue = ApplyEdit(view, event);
+        break;
+
+    case REPLAY_OP_SCROLL:
+        view->scrollPos = event->extra;
+        break;
+
+    case REPLAY_OP_RESIZE:
+        errValue = Resize(view, event->value, event->extra);
+        break;
+
+    case REPLAY_OP_SWITCH_MODE:
+        if (event->value == VIEW_MODE_WRAP) {
+            view->mode = VIEW_MODE_WRAP;
+            view->scrollPos = 0;
+            errValue = Resize(view, view->lines, view->chars - 1);
+        } else {
+            view->mode = VIEW_MODE_DEFAULT;
+            errValue = Resize(view, view->lines, view->chars + 1);
+        }
+        break;
+
+    default:
+        return ERR_PARAM;
+    }
+
+    if (errValue) { return errValue; }
+
+    // the top of the client area is recorded after every view operation
+    if (event->op >= REPLAY_OP_SCROLL) {
+        if (MoveTo(view, &(view->scroll), event->y)) { return ERR_PARAM; }
+        view->scrollX = event->x;
+    }
+
+    Paint(view);
+
+    return ERR_SUCCESS;
+}
+
+// a percentile is the upper bound of its bucket, so it may exceed the exact maximum
+static uint64_t GetPercentile(const Histogram* hist, double percentile, uint64_t max) {
+    uint64_t value = HistogramPercentile(hist, percentile);
+
+    return value < max ? value : max;
+}
+
+static void PrintResults(FILE* output, const char* docName, const char* traceName, size_t events,
+                        uint64_t recordedUs, uint64_t totalNs, size_t loadMemory,
+                        const Histogram* histograms, const uint64_t* totals, const uint64_t* maxs) {
+    fprintf(output, "{\n  \"suite\": \"ReplayBench\",\n  \"document\": \"%s\",\n  \"trace\": \"%s\",\n", docName, traceName);
+    fprintf(output, "  \"events\": %zu,\n  \"recorded_us\": %llu,\n  \"total_ns\": %llu,\n",
+            events, (unsigned long long)recordedUs, (unsigned long long)totalNs);
+    fprintf(output, "  \"peak_memory_after_load\": %zu,\n  \"peak_memory\": %zu,\n", loadMemory, GetPeakMemory());
+    fprintf(output, "  \"ops\": [");
+
+    for (int op = 0, isFirst = 1; op < REPLAY_OP_COUNT; ++op) {
+        const Histogram* hist = &histograms[op];
+
+        if (!HistogramCount(hist)) { continue; }
+
+        fprintf(output, "%s\n    {\"op\": \"%s\", \"count\": %zu, \"total_ns\": %llu, \"p50_ns\": %llu, "
+                "\"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                isFirst ? "" : ",", opNames[op], HistogramCount(hist), (unsigned long long)totals[op],
+                (unsigned long long)GetPercentile(hist, 50.0, maxs[op]),
+                (unsigned long long)GetPercentile(hist, 90.0, maxs[op]),
+                (unsigned long long)GetPercentile(hist, 99.0, maxs[op]),
+                (unsigned long long)GetPercentile(hist, 99.9, maxs[op]),
+                (unsigned long long)maxs[op]);
+        isFirst = 0;
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* docName = NULL;
+    const char* traceName = NULL;
+    const char* outputName = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--doc")) {
+            docName = argv[i + 1];
+        } else if (!strcmp(argv[i], "--trace")) {
+            traceName = argv[i + 1];
+        } else if (!strcmp(argv[i], "--output")) {
+            outputName = argv[i + 1];
+        }
+    }
+
+    if (!docName || !traceName) {
+        fprintf(stderr, "Usage: %s --doc FILE --trace FILE [--output FILE]\n", argv[0]);
+        return ERR_ARGC;
+    }
+
+    ReplayStream stream;
+    ReplayHeader header;
+    ReplayEvent event;
+    View view;
+
+    static Histogram histograms[REPLAY_OP_COUNT];
+    uint64_t totals[REPLAY_OP_COUNT] = { 0 };
+    uint64_t maxs[REPLAY_OP_COUNT] = { 0 };
+    uint64_t recordedUs = 0;
+    uint64_t totalNs = 0;
+    size_t events = 0;
+    int errValue;
+
+    for (int op = 0; op < REPLAY_OP_COUNT; ++op) { InitHistogram(&histograms[op]); }
+
+    if (ReplayOpen(&stream, traceName, &header)) { return ERR_READ; }
+
+    Document* doc = CreateDocument(docName);
+    if (!doc) {
+        ReplayClose(&stream);
+        PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        return ERR_OPEN_FILE;
+    }
+
+    size_t docLen = 0;
+    for (Block* block = doc->blocks->nodes; block; block = block->next) { docLen += block->data.len; }
+
+    if (docLen != header.docLen || doc->blocks->len != header.blocksCount) {
+        fprintf(stderr, "the trace was recorded on another document (%zu chars, %zu blocks)\n",
+                header.docLen, header.blocksCount);
+        ReplayClose(&stream);
+        DestroyDocument(&doc);
+        return ERR_PARAM;
+    }
+
+    errValue = InitView(&view, doc, &header);
+    size_t loadMemory = GetPeakMemory();
+
+    while (!errValue && !(errValue = ReplayRead(&stream, &event))) {
+        uint64_t start = GetMonotonicTime();
+
+        errValue = Apply(&view, &event);
+
+        uint64_t ns = GetMonotonicTime() - start;
+
+        HistogramRecord(&histograms[event.op], ns);
+        totals[event.op] += ns;
+        if (maxs[event.op] < ns) { maxs[event.op] = ns; }
+
+        totalNs += ns;
+        recordedUs += event.delay;
+        ++events;
+    }
+
+    if (errValue == ERR_EOF) {
+        errValue = ERR_SUCCESS;
+    } else if (errValue == ERR_PARAM) {
+        fprintf(stderr, "the document diverged from the trace at event %zu\n", events);
+    } else {
+        PrintError(NULL, errValue, __FILE__, __LINE__);
+    }
+
+    if (!errValue) {
+        FILE* output = outputName ? fopen(outputName, "w") : stdout;
+
+        if (output) {
+            PrintResults(output, docName, traceName, events, recordedUs, totalNs, loadMemory, histograms, totals, maxs);
+            if (output != stdout) { fclose(output); }
+        } else {
+            errValue = ERR_OPEN_FILE;
+            PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+        }
+    }
+
+    free(view.line);
+    ReplayClose(&stream);
+    DestroyDocument(&doc);
+    CountersShutdown();
+    TraceShutdown();
+
+    return errValue;
+}
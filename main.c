@@ -7,6 +7,7 @@
 #include <tchar.h>
 #include <windows.h>
 #include <commdlg.h>
+#include <dlgs.h>
 #include <stdio.h>
 
 #include "Error.h"
@@ -14,8 +15,21 @@
 #include "String.h"
 #include "Document.h"
 #include "ScrollBar.h"
+#include "Latency.h"
+#include "Counters.h"
+#include "Trace.h"
+#include "Replay.h"
+#include "Search.h"
+#include "Regex.h"
+#include "ThreadPool.h"
+#include "FindAll.h"
+#include "IncrementalSearch.h"
+#include "Replace.h"
+#include "TrigramIndex.h"
+#include "FindInFiles.h"
 
 #include "DisplayedModel.h"
+#include "Input.h"
 
 /*  Declare Windows procedure  */
 LRESULT CALLBACK WindowProcedure(HWND, UINT, WPARAM, LPARAM);
@@ -24,6 +38,21 @@ const TCHAR szClassName[]   = _T("TextEdit");
 const TCHAR szTitle[]       = _T("FileName - TextEdit");
 const char* example         = "example.txt";
 
+#define LATENCY_FILENAME "latency.txt"
+#define COUNTERS_FILENAME "counters.json"
+#define TRACE_FILENAME "trace.json"
+#define REPLAY_FILENAME "session.rpl"
+
+#define FIND_BUFFER_SIZE 256
+#define GO_TO_BUFFER_SIZE 32
+#define FIND_ALL_BATCH 256
+
+#define WM_FIND_ALL_PROGRESS (WM_APP + 1)   // a chunk of the find-all search is finished
+#define WM_SEARCH_QUERY (WM_APP + 2)        // the query of the Find dialog is changed
+#define WM_FIND_IN_FILES_PROGRESS (WM_APP + 3)  // a file of the search in files is searched
+
+static HWND hDlgFind = NULL;    // modeless Find or Replace dialog
+
 int WINAPI WinMain(HINSTANCE hThisInstance, HINSTANCE hPrevInstance,
                     LPSTR lpszArgument, int nCmdShow) {
     HWND        hwnd;       /* This is the handle for our window */
@@ -75,6 +104,8 @@ int WINAPI WinMain(HINSTANCE hThisInstance, HINSTANCE hPrevInstance,
 
     /* Run the message loop. It will run until GetMessage() returns 0 */
     while (GetMessage(&messages, NULL, 0, 0)) {
+        if (hDlgFind && IsDialogMessage(hDlgFind, &messages)) { continue; }
+
         TranslateMessage(&messages); /* Translate virtual-key messages into character messages */
         DispatchMessage(&messages);  /* Send message to WindowProcedure */
     }
@@ -140,6 +171,465 @@ static int SetWindowTitle(HWND hwnd, PSTR* oldTitle, const char* title) {
     return ERR_SUCCESS;
 }
 
+// stops the recorded session: the replay can't repeat the operation that follows
+static void StopReplay(HWND hwnd) {
+    if (!ReplayIsRecording()) { return; }
+
+    ReplayStop();
+    CheckMenuItem(GetMenu(hwnd), IDM_DEBUG_REPLAY, MF_UNCHECKED);
+}
+
+/**
+ * Makes a loaded document the document of the window. Searches over the previous document
+ * must be stopped by the caller.
+ */
+static int ShowDocument(HWND hwnd, DisplayedModel* dm, Document** doc, Document* newDoc, PSTR* title) {
+    // the recorded session belongs to the previous document
+    StopReplay(hwnd);
+
+    // occurrences of the search are cached by blocks of the previous document
+    DestroyHighlight(&dm->highlight);
+    #ifdef CARET_ON
+        // bookmarks and decorations are positions of the previous document
+        ClearMarks(&dm->bookmarks);
+        FreeDecorations(&dm->decorations);
+    #endif
+    DestroyDocument(doc);
+    *doc = newDoc;
+
+    // without the history the document is still editable
+    SetHistory(newDoc, HISTORY_DEFAULT_CAP);
+
+    if (SetWindowTitle(hwnd, title, newDoc->title)) { return ERR_NOMEM; }
+
+    #ifndef NDEBUG // ==============================================/
+        PrintDocumentParameters(NULL, newDoc);
+        // PrintDocument(NULL, newDoc);
+    #endif // =====================================================/
+    CoverDocument(hwnd, dm, newDoc);
+    return ERR_SUCCESS;
+}
+
+// the directory of a file ("." for a name without a directory)
+static void GetDirectory(const char* path, char* dir, size_t size) {
+    const char* slash = strrchr(path, '\\');
+    const char* other = strrchr(path, '/');
+    size_t len;
+
+    if (!slash || (other && other > slash)) { slash = other; }
+    if (!slash) {
+        snprintf(dir, size, ".");
+        return;
+    }
+
+    len = (size_t)(slash - path);
+    snprintf(dir, size, "%.*s", (int)len, path);
+}
+
+static void FillReplayHeader(ReplayHeader* header, const DisplayedModel* dm) {
+    assert(header && dm);
+
+    header->docLen = 0;
+    for (Block* block = dm->doc->blocks->nodes; block; block = block->next) {
+        header->docLen += block->data.len;
+    }
+
+    header->blocksCount = dm->doc->blocks->len;
+    header->mode = dm->mode;
+    header->lines = dm->clientArea.lines;
+    header->chars = dm->clientArea.chars;
+
+    #ifdef CARET_ON
+        header->caretY = dm->caret.modelPos.pos.y;
+        header->caretX = dm->caret.modelPos.pos.x;
+    #else
+        header->caretY = 0;
+        header->caretX = 0;
+    #endif
+
+    header->scrollY = dm->scrollBars.modelPos.pos.y;
+    header->scrollX = dm->scrollBars.modelPos.pos.x;
+    header->scrollPos = dm->scrollBars.horizontal.pos;
+}
+
+// the Find dialog reports every change of the query for the search as you type
+static UINT_PTR CALLBACK FindHookProc(HWND hdlg, UINT message, WPARAM wParam, LPARAM lParam) {
+    (void)lParam;
+
+    if (message == WM_INITDIALOG) { return TRUE; }
+    if (message == WM_COMMAND && LOWORD(wParam) == edt1 && HIWORD(wParam) == EN_CHANGE) {
+        PostMessage(GetParent(hdlg), WM_SEARCH_QUERY, 0, 0);
+    }
+    return 0;
+}
+
+typedef struct {
+    int isOffset;   // the value is a char offset (a line number otherwise)
+    size_t value;
+} GoToRequest;
+
+// the Go to dialog reads a line number (from 1) or a char offset of the document
+static INT_PTR CALLBACK GoToProc(HWND hdlg, UINT message, WPARAM wParam, LPARAM lParam) {
+    static GoToRequest* request;
+
+    switch (message) {
+    case WM_INITDIALOG:
+        request = (GoToRequest*) lParam;
+        CheckRadioButton(hdlg, IDC_GO_TO_LINE, IDC_GO_TO_OFFSET, request->isOffset ? IDC_GO_TO_OFFSET : IDC_GO_TO_LINE);
+        return TRUE;
+
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDOK: {
+            char text[GO_TO_BUFFER_SIZE];
+            char* end;
+
+            GetDlgItemText(hdlg, IDC_GO_TO_VALUE, text, GO_TO_BUFFER_SIZE);
+            request->isOffset = IsDlgButtonChecked(hdlg, IDC_GO_TO_OFFSET) == BST_CHECKED;
+            request->value = (size_t) strtoull(text, &end, 10);
+
+            // lines are numbered from 1
+            if (end == text || *end || (!request->isOffset && !request->value)) {
+                MessageBox(hdlg, "Invalid number", szClassName, MB_OK | MB_ICONWARNING);
+                return TRUE;
+            }
+            EndDialog(hdlg, IDOK);
+            return TRUE;
+        }
+
+        case IDCANCEL:
+            EndDialog(hdlg, IDCANCEL);
+            return TRUE;
+
+        default:
+            break;
+        }
+        break;
+
+    default:
+        break;
+    }
+    return FALSE;
+}
+
+void InitFindReplace(HWND hwnd, FINDREPLACE* fr, char* findWhat, char* replaceWith) {
+    fr->lStructSize         = sizeof(FINDREPLACE);
+    fr->hwndOwner           = hwnd;
+    fr->hInstance           = NULL;
+    fr->Flags               = FR_DOWN | FR_HIDEWHOLEWORD | FR_ENABLEHOOK;
+    fr->lpstrFindWhat       = findWhat;
+    fr->lpstrReplaceWith    = replaceWith;
+    fr->wFindWhatLen        = FIND_BUFFER_SIZE;
+    fr->wReplaceWithLen     = FIND_BUFFER_SIZE;
+    fr->lCustData           = 0L;
+    fr->lpfnHook            = FindHookProc;
+    fr->lpTemplateName      = NULL;
+}
+
+// big documents get a trigram index in the background: repeated searches scan only candidate blocks,
+// the index is built from a snapshot and follows later edits by versions of blocks
+static TrigramIndex* IndexDocument(ThreadPool* pool, Document* doc, const char* filename) {
+    if (!pool || doc->text->len < TRIGRAM_INDEX_MIN_SIZE) { return NULL; }
+    return StartTrigramIndex(pool, doc, filename);
+}
+
+/**
+ * Highlights the occurrences of a query in the displayed text (an empty query - no highlighting).
+ * The window is repainted if the highlighted query is changed.
+ */
+static void HighlightQuery(HWND hwnd, DisplayedModel* dm, const char* query, size_t len, int isRegex, int isMatchCase) {
+    assert(dm && dm->doc && query);
+
+    int flags = (isRegex ? HIGHLIGHT_REGEX : HIGHLIGHT_LITERAL) | (isMatchCase ? 0 : HIGHLIGHT_IGNORE_CASE);
+
+    if (dm->highlight && IsHighlightOf(dm->highlight, query, len, flags)) { return; }
+    if (!dm->highlight && !len) { return; }
+
+    DestroyHighlight(&dm->highlight);
+    if (len) { dm->highlight = CreateHighlight(dm->doc, query, len, flags); }
+    InvalidateView(hwnd, dm);
+}
+
+/**
+ * Searches the text of the Find dialog from the caret. The caret stays at the start of the occurrence.
+ * Returns 1 if the text is found, 0 if not, -1 if the regular expression is invalid.
+ */
+static int FindNext(HWND hwnd, DisplayedModel* dm, const FINDREPLACE* fr, int isRegex, TrigramIndex* index,
+                    SearchDirection direction, RECT* rectangle) {
+    assert(dm && fr && rectangle);
+
+    size_t len = strlen(fr->lpstrFindWhat);
+    if (!len) { return 0; }
+
+    Literal* literal = NULL;
+    Regex* regex = NULL;
+
+    if (isRegex) {
+        regex = CreateRegex(fr->lpstrFindWhat, len, (fr->Flags & FR_MATCHCASE) ? REGEX_MATCH_CASE : REGEX_IGNORE_CASE);
+        if (!regex) { return -1; }
+    } else {
+        literal = CreateLiteral(fr->lpstrFindWhat, len, (fr->Flags & FR_MATCHCASE) ? SEARCH_MATCH_CASE : SEARCH_IGNORE_CASE);
+        if (!literal) {
+            PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+            return 0;
+        }
+    }
+
+    ModelPos from = dm->caret.modelPos;
+    ModelPos match;
+
+    // the caret may be to the right of the end of the block
+    from.pos.x = min(from.pos.x, from.block->data.len);
+
+    // skip the occurrence under the caret
+    if (direction == SEARCH_FORWARD) {
+        if (from.pos.x < from.block->data.len) {
+            ++from.pos.x;
+        } else if (from.block->next) {
+            from.block = from.block->next;
+            ++from.pos.y;
+            from.pos.x = 0;
+        }
+    }
+
+    int isFound;
+
+    if (regex) {
+        RegexMatch regexMatch;
+
+        isFound = FindRegex(dm->doc, regex, from, direction, &regexMatch);
+        match = regexMatch.start;
+        DestroyRegex(&regex);
+    } else {
+        isFound = index ? FindLiteralIndexed(index, literal, from, direction, &match)
+                        : FindLiteral(dm->doc, literal, from, direction, &match);
+        DestroyLiteral(&literal);
+    }
+
+    if (isFound) { CaretGoTo(hwnd, dm, match, rectangle); }
+    return isFound;
+}
+
+// called by a worker of the find-all search
+static void PostFindAllProgress(void* context) {
+    PostMessage((HWND)context, WM_FIND_ALL_PROGRESS, 0, 0);
+}
+
+/**
+ * Starts the search of all occurrences of a query with FindAllFlags.
+ * Returns 1 if the search is started, 0 if not, -1 if the regular expression is invalid.
+ */
+static int FindAllStart(HWND hwnd, ThreadPool* pool, Document* doc, const char* what, int flags, FindAll** findAll) {
+    assert(pool && doc && what && findAll);
+
+    DestroyFindAll(findAll);
+
+    size_t len = strlen(what);
+    if (!len) { return 0; }
+
+    *findAll = StartFindAll(pool, doc, what, len, flags, PostFindAllProgress, hwnd);
+    if (!*findAll) { return (flags & FIND_ALL_REGEX) ? -1 : 0; }
+    return 1;
+}
+
+// the title shows the count of occurrences of the search
+static void ShowMatchesCount(HWND hwnd, const char* title, size_t count, int isFinished) {
+    char text[_MAX_FNAME + _MAX_EXT + 64];
+
+    snprintf(text, sizeof(text), "%s - %zu matches%s - %s", title, count, isFinished ? "" : "...", szClassName);
+    SetWindowText(hwnd, text);
+}
+
+/**
+ * Takes the found occurrences: they're underlined, the caret goes to the first one (if isGoTo is set), the title shows the count.
+ * Returns 1 if the search is finished.
+ */
+static int FindAllUpdate(HWND hwnd, DisplayedModel* dm, FindAll* findAll, size_t* count, int isGoTo, const char* title) {
+    assert(dm && findAll && count && title);
+
+    RegexMatch matches[FIND_ALL_BATCH];
+    size_t prevCount = *count;
+    int isFinished = 0;
+    size_t len;
+
+    while ((len = FindAllTake(findAll, matches, FIND_ALL_BATCH, &isFinished))) {
+        #ifdef CARET_ON
+            // the occurrences stay underlined while the text is edited
+            for (size_t i = 0; i < len; ++i) {
+                if (DecorationAdd(hwnd, dm, DECORATION_RESULTS, matches[i].start, matches[i].end, 0)) { break; }
+            }
+
+            if (!*count && isGoTo) {
+                RECT rectangle;
+
+                FindCaret(hwnd, dm, &rectangle);
+                CaretGoTo(hwnd, dm, matches[0].start, &rectangle);
+                UpdateView(hwnd, dm);
+            }
+        #endif
+        *count += len;
+    }
+
+    if (*count != prevCount || isFinished) { ShowMatchesCount(hwnd, title, *count, isFinished); }
+    return isFinished;
+}
+
+/**
+ * Replaces all occurrences of the text of the Replace dialog as one edit of the document (bookmarks and decorations follow it),
+ * then the displayed model covers the changed document once.
+ * Returns 1 if the text is replaced, 0 if not found, -1 if the regular expression or the replacement is invalid.
+ */
+static int ReplaceAllText(HWND hwnd, DisplayedModel* dm, Document* doc, const FINDREPLACE* fr, int isRegex) {
+    assert(dm && doc && fr);
+
+    size_t len = strlen(fr->lpstrFindWhat);
+    if (!len) { return 0; }
+
+    int flags = (isRegex ? REPLACE_REGEX : REPLACE_LITERAL) | ((fr->Flags & FR_MATCHCASE) ? 0 : REPLACE_IGNORE_CASE);
+    size_t count = 0;
+    int errValue = ReplaceAll(doc, fr->lpstrFindWhat, len, fr->lpstrReplaceWith, strlen(fr->lpstrReplaceWith), flags, &count,
+                              FollowDocChange, dm);
+
+    if (errValue == ERR_PARAM) { return -1; }
+    if (!count) { return 0; }
+
+    // the trace has no replace-all: the recording stops at it
+    StopReplay(hwnd);
+
+    CoverDocument(hwnd, dm, doc);
+    ShowMatchesCount(hwnd, doc->title, count, 1);
+    return 1;
+}
+
+/**
+ * Finds the query typed in the Find dialog, narrowing the occurrences of the previous query.
+ * The caret goes to the first occurrence at or after it.
+ */
+static void SearchAsYouType(HWND hwnd, DisplayedModel* dm, IncrementalSearch* search, const char* title) {
+    assert(dm && search && title);
+
+    char query[FIND_BUFFER_SIZE];
+    size_t len = GetDlgItemText(hDlgFind, edt1, query, FIND_BUFFER_SIZE);
+    int flags = IsDlgButtonChecked(hDlgFind, chx2) ? SEARCH_MATCH_CASE : SEARCH_IGNORE_CASE;
+
+    if (UpdateIncrementalSearch(search, query, len, flags)) { return; }
+    HighlightQuery(hwnd, dm, query, len, 0, flags == SEARCH_MATCH_CASE);
+
+    if (!len) {
+        char text[_MAX_FNAME + _MAX_EXT + 64];
+
+        snprintf(text, sizeof(text), "%s - %s", title, szClassName);
+        SetWindowText(hwnd, text);
+        return;
+    }
+    ShowMatchesCount(hwnd, title, search->len, 1);
+
+    #ifdef CARET_ON
+        // occurrences are sorted: the first one at or after the caret
+        size_t left = 0;
+        size_t right = search->len;
+        position_t caret = dm->caret.modelPos.pos;
+
+        while (left < right) {
+            size_t middle = left + (right - left) / 2;
+            position_t pos = search->hits[middle].pos;
+
+            if (pos.y < caret.y || (pos.y == caret.y && pos.x < caret.x)) {
+                left = middle + 1;
+            } else {
+                right = middle;
+            }
+        }
+
+        if (left < search->len) {
+            RECT rectangle;
+
+            FindCaret(hwnd, dm, &rectangle);
+            CaretGoTo(hwnd, dm, search->hits[left], &rectangle);
+            UpdateView(hwnd, dm);
+        }
+    #endif
+}
+
+#ifdef CARET_ON
+    // the chars of the column selection are put to the clipboard as text, its lines end with CR LF
+    static int CopyColumnsToClipboard(HWND hwnd, const DisplayedModel* dm) {
+        assert(dm);
+
+        String* str = CreateString(NULL);
+        if (!str || ReserveSize(str, 1)) {
+            if (str) { DestroyString(&str); }
+            return ERR_NOMEM;
+        }
+
+        int errValue = ColumnCopy(dm, "\r\n", str);
+        HGLOBAL hGlobal = errValue ? NULL : GlobalAlloc(GMEM_MOVEABLE, str->len + 1);
+
+        if (hGlobal) {
+            char* data = GlobalLock(hGlobal);
+
+            memcpy(data, str->data, str->len);
+            data[str->len] = '\0';
+            GlobalUnlock(hGlobal);
+
+            // the clipboard owns the memory it got only
+            if (!OpenClipboard(hwnd)) {
+                GlobalFree(hGlobal);
+            } else {
+                EmptyClipboard();
+                if (!SetClipboardData(CF_TEXT, hGlobal)) { GlobalFree(hGlobal); }
+                CloseClipboard();
+            }
+        } else if (!errValue) {
+            errValue = ERR_NOMEM;
+        }
+
+        DestroyString(&str);
+        return errValue;
+    }
+#endif
+
+// called by a worker of the search in files
+static void PostFindInFilesProgress(void* context) {
+    PostMessage((HWND)context, WM_FIND_IN_FILES_PROGRESS, 0, 0);
+}
+
+/**
+ * Takes the occurrences found in files, the title shows their count.
+ * Returns 1 if the search is finished.
+ */
+static int FindInFilesUpdate(HWND hwnd, FindInFiles* search, FileMatch** results, size_t* len, size_t* size,
+                             const char* title) {
+    assert(search && results && len && size && title);
+
+    int isFinished = 0;
+
+    for (;;) {
+        if (*len == *size) {
+            size_t newSize = *size ? 2 * *size : FIND_ALL_BATCH;
+            FileMatch* newResults = realloc(*results, newSize * sizeof(FileMatch));
+
+            if (!newResults) {
+                PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                break;
+            }
+            *results = newResults;
+            *size = newSize;
+        }
+
+        size_t count = FindInFilesTake(search, *results + *len, *size - *len, &isFinished);
+        if (!count) { break; }
+        *len += count;
+    }
+
+    char text[_MAX_FNAME + _MAX_EXT + 96];
+
+    snprintf(text, sizeof(text), "%s - %zu matches in %zu files%s - %s", title, *len, FindInFilesCount(search),
+             isFinished ? "" : "...", szClassName);
+    SetWindowText(hwnd, text);
+    return isFinished;
+}
+
 /*  This function is called by the Windows function DispatchMessage()  */
 LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
     static OPENFILENAME ofn;
@@ -149,6 +639,33 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
     static Document*        doc;
     static DisplayedModel   dm;
 
+    static UINT         findMessage;
+    static FINDREPLACE  fr;
+    static char         findWhat[FIND_BUFFER_SIZE];
+    static char         replaceWith[FIND_BUFFER_SIZE];
+    static int          isRegex;
+
+    static ThreadPool*  pool;
+    static FindAll*     findAll;            // running find-all search (NULL - no search)
+    static size_t       findAllCount;       // count of taken occurrences
+    static char         findAllWhat[FIND_BUFFER_SIZE];
+    static int          findAllFlags;       // FindAllFlags of the search
+    static int          isFindAllEdited;    // the text is edited during the search: the caret stays
+    static IncrementalSearch* typedSearch;  // search as you type in the Find dialog (NULL - not started)
+    static TrigramIndex* trigramIndex;      // index of a big document (NULL - not indexed)
+    static char         docPath[_MAX_PATH]; // file of the document
+
+    static FindInFiles* fileSearch;         // the last search in files (NULL - no search), it owns paths of results
+    static FileMatch*   fileResults;        // taken occurrences of the search in files
+    static size_t       fileResultsLen;
+    static size_t       fileResultsSize;
+    static size_t       fileResultNext;     // result opened by Next result
+
+    #ifdef CARET_ON
+        static InputBatch inputBatch;       // pending key events merged into one model operation
+        static size_t     markStyle;        // style of the next marked text
+    #endif
+
     HDC         hdc;
     PAINTSTRUCT ps;
     HMENU       hMenu;
@@ -162,6 +679,14 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
     /* handle the messages */
     switch (message) {
     case WM_CREATE:
+        TraceSetThreadName("UI");
+
+        findMessage = RegisterWindowMessage(FINDMSGSTRING);
+        InitFindReplace(hwnd, &fr, findWhat, replaceWith);
+
+        // the find-all search works without a pool
+        pool = CreateThreadPool(0);
+
         // device context initialization
         hdc = GetDC(hwnd);
         pstrTitle = NULL;
@@ -183,6 +708,7 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             PostMessage(hwnd, WM_CLOSE, 0, 0);
             break;
         }
+        SetHistory(doc, HISTORY_DEFAULT_CAP);
 
         #ifndef NDEBUG // ==============================================/
             PrintDocumentParameters(NULL, doc);
@@ -190,6 +716,8 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
         #endif // =====================================================/
 
         CoverDocument(hwnd, &dm, doc);
+        snprintf(docPath, sizeof(docPath), "%s", example);
+        trigramIndex = IndexDocument(pool, doc, docPath);
 
         hMenu = GetMenu(hwnd);
         CheckMenuItem(hMenu, IDM_FORMAT_WRAP, MF_UNCHECKED);
@@ -197,6 +725,8 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
     // WM_CREATE
 
     case WM_COMMAND:
+        LATENCY_INPUT(LATENCY_OP_COMMAND);
+
         switch (LOWORD(wParam)) {
         case IDM_FILE_OPEN:
             #ifndef NDEBUG // ==================/
@@ -216,21 +746,19 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
                 Document* newDoc = CreateDocument(ofn.lpstrFile);
 
                 if (newDoc) {
-                    DestroyDocument(&doc);
-                    doc = newDoc;
+                    DestroyFindAll(&findAll);
+                    DestroyIncrementalSearch(&typedSearch);
+                    DestroyTrigramIndex(&trigramIndex);
 
-                    if (SetWindowTitle(hwnd, &pstrTitle, doc->title)) {
+                    if (ShowDocument(hwnd, &dm, &doc, newDoc, &pstrTitle)) {
                         free(pstrFilename);
                         PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
                         PostMessage(hwnd, WM_CLOSE, 0, 0);
                         break;
                     }
 
-                    #ifndef NDEBUG // ==============================================/
-                        PrintDocumentParameters(NULL, doc);
-                        // PrintDocument(NULL, doc);
-                    #endif // =====================================================/
-                    CoverDocument(hwnd, &dm, doc);
+                    snprintf(docPath, sizeof(docPath), "%s", ofn.lpstrFile);
+                    trigramIndex = IndexDocument(pool, doc, docPath);
                 }
 
                 #ifndef NDEBUG // ==============================================/
@@ -239,10 +767,6 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
                 #endif // =====================================================/
             }
             free(pstrFilename);
-
-            #ifdef CARET_ON
-                CaretSetPos(&dm);
-            #endif
             break;
 
         case IDM_FILE_EXIT:
@@ -253,6 +777,292 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             PostMessage(hwnd, WM_CLOSE, 0, 0);
             break;
 
+        case IDM_DEBUG_LATENCY: {
+            FILE* output = fopen(LATENCY_FILENAME, "a");
+
+            if (!output) {
+                PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+                break;
+            }
+
+            LatencyDump(output);
+            fclose(output);
+
+            #ifndef NDEBUG // ==================/
+                LatencyDump(NULL);
+            #endif // =========================/
+            break;
+        }
+
+        case IDM_DEBUG_COUNTERS: {
+            FILE* output = fopen(COUNTERS_FILENAME, "w");
+
+            if (!output) {
+                PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+                break;
+            }
+
+            CountersExportJSON(output);
+            fclose(output);
+            break;
+        }
+
+        case IDM_DEBUG_TRACE: {
+            FILE* output = fopen(TRACE_FILENAME, "w");
+
+            if (!output) {
+                PrintError(NULL, ERR_OPEN_FILE, __FILE__, __LINE__);
+                break;
+            }
+
+            TraceFlush(output);
+            fclose(output);
+            break;
+        }
+
+        case IDM_DEBUG_REPLAY:
+            hMenu = GetMenu(hwnd);
+
+            if (ReplayIsRecording()) {
+                ReplayStop();
+                CheckMenuItem(hMenu, IDM_DEBUG_REPLAY, MF_UNCHECKED);
+            } else {
+                ReplayHeader header;
+
+                FillReplayHeader(&header, &dm);
+                if (!ReplayStart(REPLAY_FILENAME, &header)) {
+                    CheckMenuItem(hMenu, IDM_DEBUG_REPLAY, MF_CHECKED);
+                }
+            }
+            break;
+
+        case IDM_SEARCH_FIND:
+            if (hDlgFind) {
+                SetFocus(hDlgFind);
+            } else {
+                hDlgFind = FindText(&fr);
+            }
+            break;
+
+        case IDM_SEARCH_REPLACE:
+            if (hDlgFind) {
+                SetFocus(hDlgFind);
+            } else {
+                hDlgFind = ReplaceText(&fr);
+            }
+            break;
+
+        case IDM_SEARCH_NEXT:
+        case IDM_SEARCH_PREV:
+            if (!findWhat[0]) {
+                SendMessage(hwnd, WM_COMMAND, IDM_SEARCH_FIND, 0L);
+                break;
+            }
+
+            HighlightQuery(hwnd, &dm, findWhat, strlen(findWhat), isRegex, fr.Flags & FR_MATCHCASE);
+
+            #ifdef CARET_ON
+                FindCaret(hwnd, &dm, &rectangle);
+                switch (FindNext(hwnd, &dm, &fr, isRegex, trigramIndex, LOWORD(wParam) == IDM_SEARCH_NEXT ? SEARCH_FORWARD : SEARCH_BACKWARD, &rectangle)) {
+                case 0:
+                    MessageBox(hwnd, "Cannot find the text", szClassName, MB_OK | MB_ICONINFORMATION);
+                    break;
+                case -1:
+                    MessageBox(hwnd, "Invalid regular expression", szClassName, MB_OK | MB_ICONWARNING);
+                    break;
+                default:
+                    break;
+                }
+                REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+            #endif
+            break;
+
+        case IDM_SEARCH_FIND_ALL:
+            if (!findWhat[0]) {
+                SendMessage(hwnd, WM_COMMAND, IDM_SEARCH_FIND, 0L);
+                break;
+            }
+            if (!pool) { break; }
+
+            findAllCount = 0;
+            isFindAllEdited = 0;
+            strcpy(findAllWhat, findWhat);
+            findAllFlags = (isRegex ? FIND_ALL_REGEX : FIND_ALL_LITERAL) | ((fr.Flags & FR_MATCHCASE) ? 0 : FIND_ALL_IGNORE_CASE);
+            #ifdef CARET_ON
+                DecorationClear(hwnd, &dm, DECORATION_RESULTS);
+            #endif
+            HighlightQuery(hwnd, &dm, findWhat, strlen(findWhat), isRegex, fr.Flags & FR_MATCHCASE);
+
+            switch (FindAllStart(hwnd, pool, doc, findAllWhat, findAllFlags, &findAll)) {
+            case 0:
+                MessageBox(hwnd, "Cannot find the text", szClassName, MB_OK | MB_ICONINFORMATION);
+                break;
+            case -1:
+                MessageBox(hwnd, "Invalid regular expression", szClassName, MB_OK | MB_ICONWARNING);
+                break;
+            default:
+                break;
+            }
+            break;
+
+        case IDM_SEARCH_FIND_IN_FILES: {
+            char dir[_MAX_PATH];
+
+            if (!findWhat[0]) {
+                SendMessage(hwnd, WM_COMMAND, IDM_SEARCH_FIND, 0L);
+                break;
+            }
+            if (!pool) { break; }
+
+            DestroyFindInFiles(&fileSearch);
+            fileResultsLen = 0;
+            fileResultNext = 0;
+
+            // the query is literal: regular expressions need a document
+            GetDirectory(docPath, dir, sizeof(dir));
+            fileSearch = StartFindInFiles(pool, dir, findWhat, strlen(findWhat),
+                                          (fr.Flags & FR_MATCHCASE) ? SEARCH_MATCH_CASE : SEARCH_IGNORE_CASE, 0,
+                                          PostFindInFilesProgress, hwnd);
+            break;
+        }
+
+        case IDM_SEARCH_NEXT_RESULT: {
+            if (!fileResultsLen) { break; }
+
+            const FileMatch* result = &fileResults[fileResultNext];
+            fileResultNext = (fileResultNext + 1) % fileResultsLen;
+
+            // the lines of the occurrence are known: the document of its file is loaded only
+            if (strcmp(result->path, docPath)) {
+                Document* newDoc = CreateDocument(result->path);
+                if (!newDoc) { break; }
+
+                DestroyFindAll(&findAll);
+                DestroyIncrementalSearch(&typedSearch);
+                DestroyTrigramIndex(&trigramIndex);
+
+                if (ShowDocument(hwnd, &dm, &doc, newDoc, &pstrTitle)) {
+                    PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                    PostMessage(hwnd, WM_CLOSE, 0, 0);
+                    break;
+                }
+
+                snprintf(docPath, sizeof(docPath), "%s", result->path);
+                trigramIndex = IndexDocument(pool, doc, docPath);
+                InvalidateView(hwnd, &dm);
+            }
+            HighlightQuery(hwnd, &dm, findWhat, strlen(findWhat), 0, fr.Flags & FR_MATCHCASE);
+
+            #ifdef CARET_ON
+                FindCaret(hwnd, &dm, &rectangle);
+                // the file may be changed after the search
+                CaretGoToLine(hwnd, &dm, min(result->line, doc->blocks->len - 1), result->column, &rectangle);
+                REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+            #endif
+            break;
+        }
+
+        case IDM_SEARCH_GO_TO: {
+            static GoToRequest request;
+
+            if (DialogBoxParam(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_GO_TO), hwnd, GoToProc, (LPARAM) &request) != IDOK) {
+                break;
+            }
+
+            #ifdef CARET_ON
+                int errValue = request.isOffset ? CaretGoToOffset(hwnd, &dm, request.value, &rectangle)
+                                                : CaretGoToLine(hwnd, &dm, request.value - 1, 0, &rectangle);
+
+                if (errValue == ERR_PARAM) {
+                    MessageBox(hwnd, request.isOffset ? "The offset is past the end of the document" : "No such line",
+                                szClassName, MB_OK | MB_ICONINFORMATION);
+                } else if (errValue) {
+                    PrintError(NULL, errValue, __FILE__, __LINE__);
+                }
+                REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+            #endif
+            break;
+        }
+
+        #ifdef CARET_ON
+            case IDM_BOOKMARK_TOGGLE:
+                if (BookmarkToggle(hwnd, &dm)) { PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__); }
+                break;
+
+            case IDM_BOOKMARK_NEXT:
+            case IDM_BOOKMARK_PREV:
+                FindCaret(hwnd, &dm, &rectangle);
+                if (!BookmarkGoToNext(hwnd, &dm, LOWORD(wParam) == IDM_BOOKMARK_PREV, &rectangle)) {
+                    REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+                }
+                break;
+
+            case IDM_EDIT_MARK:
+                // every mark takes the next style
+                if (!DecorationMarkColumns(hwnd, &dm, markStyle)) { markStyle = (markStyle + 1) % DECORATION_STYLES; }
+                break;
+
+            case IDM_EDIT_CLEAR_MARKS:
+                DecorationClear(hwnd, &dm, DECORATION_MARKED);
+                break;
+        #endif
+
+        case IDM_EDIT_UNDO:
+        case IDM_EDIT_REDO: {
+            ModelPos pos;
+
+            // bookmarks and decorations follow the undone (redone) edits
+            if (LOWORD(wParam) == IDM_EDIT_UNDO) {
+                DocUndo(doc, &pos, FollowDocChange, &dm);
+            } else {
+                DocRedo(doc, &pos, FollowDocChange, &dm);
+            }
+            if (!pos.block) { break; }
+
+            // the trace has no history (its units are the edit groups of the session): the replay stops here
+            StopReplay(hwnd);
+
+            // blocks may be replaced: the view is covered again and the caret goes to the edit
+            CoverDocument(hwnd, &dm, doc);
+            #ifdef CARET_ON
+                CaretGoTo(hwnd, &dm, pos, &rectangle);
+            #endif
+            InvalidateView(hwnd, &dm);
+            break;
+        }
+
+        #ifdef CARET_ON
+            case IDM_EDIT_CUT:
+            case IDM_EDIT_COPY:
+                if (!dm.columns.isSelected) { break; }
+
+                FindCaret(hwnd, &dm, &rectangle);
+                if (CopyColumnsToClipboard(hwnd, &dm)) {
+                    PrintError(NULL, ERR_NOMEM, __FILE__, __LINE__);
+                    break;
+                }
+                if (LOWORD(wParam) == IDM_EDIT_COPY || dm.columns.anchor.pos.x == dm.columns.active.pos.x) { break; }
+
+                ColumnDeleteChars(hwnd, &dm, 1, 0, &rectangle);
+                REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+                UpdateView(hwnd, &dm);
+                break;
+
+            case IDM_EDIT_BLANK:
+                if (!dm.columns.isSelected) { break; }
+
+                FindCaret(hwnd, &dm, &rectangle);
+                ColumnFill(hwnd, &dm, ' ', &rectangle);
+                UpdateView(hwnd, &dm);
+                break;
+        #endif
+
+        case IDM_SEARCH_REGEX:
+            DestroyFindAll(&findAll);
+            isRegex = !isRegex;
+            CheckMenuItem(GetMenu(hwnd), IDM_SEARCH_REGEX, isRegex ? MF_CHECKED : MF_UNCHECKED);
+            break;
+
         case IDM_FORMAT_WRAP:
             hMenu = GetMenu(hwnd);
 
@@ -268,31 +1078,82 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
                 break;
 
             default:
+                LATENCY_INPUT_DONE(FALSE);
                 PrintError(NULL, ERR_UNKNOWN, __FILE__, __LINE__);
                 return ERR_UNKNOWN;
             }
             break;
 
         default:
+            LATENCY_INPUT_DONE(FALSE);
             PrintError(NULL, ERR_UNKNOWN, __FILE__, __LINE__);
             return ERR_UNKNOWN;
         }
 
+        LATENCY_MODEL_DONE();
+
         // common actions for listed commands
         if (LOWORD(wParam) == IDM_FILE_OPEN || LOWORD(wParam) == IDM_FORMAT_WRAP) {
             // force repaint
-            InvalidateRect(hwnd, NULL, TRUE);
-            UpdateWindow(hwnd);
+            InvalidateView(hwnd, &dm);
         }
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_COMMAND
 
+    case WM_FIND_ALL_PROGRESS:
+        // a notification may come after the search is cancelled
+        if (!findAll) { break; }
+
+        // the search reads a snapshot: matches of an edited version are stale, so the edited text is searched again
+        if (FindAllVersion(findAll) != doc->version) {
+            findAllCount = 0;
+            isFindAllEdited = 1;
+            #ifdef CARET_ON
+                DecorationClear(hwnd, &dm, DECORATION_RESULTS);
+            #endif
+            FindAllStart(hwnd, pool, doc, findAllWhat, findAllFlags, &findAll);
+            break;
+        }
+
+        if (FindAllUpdate(hwnd, &dm, findAll, &findAllCount, !isFindAllEdited, doc->title)) {
+            DestroyFindAll(&findAll);
+            if (!findAllCount) { MessageBox(hwnd, "Cannot find the text", szClassName, MB_OK | MB_ICONINFORMATION); }
+        }
+        break;
+    // WM_FIND_ALL_PROGRESS
+
+    case WM_FIND_IN_FILES_PROGRESS:
+        // a notification may come after the search is cancelled
+        if (!fileSearch) { break; }
+
+        if (FindInFilesUpdate(hwnd, fileSearch, &fileResults, &fileResultsLen, &fileResultsSize, doc->title)
+            && !fileResultsLen) {
+            DestroyFindInFiles(&fileSearch);
+            MessageBox(hwnd, "Cannot find the text in files", szClassName, MB_OK | MB_ICONINFORMATION);
+        }
+        break;
+    // WM_FIND_IN_FILES_PROGRESS
+
+    case WM_SEARCH_QUERY:
+        // regular expressions are searched by Find next
+        if (!hDlgFind || isRegex) { break; }
+        if (!typedSearch) { typedSearch = CreateIncrementalSearch(doc); }
+        if (typedSearch) { SearchAsYouType(hwnd, &dm, typedSearch, doc->title); }
+        break;
+    // WM_SEARCH_QUERY
+
     case WM_SIZE:
+        LATENCY_INPUT(LATENCY_OP_RESIZE);
+
         UpdateDisplayedModel(hwnd, &dm, lParam);
+        LATENCY_MODEL_DONE();
 
-        #ifdef CARET_ON
-            if(hwnd == GetFocus()) { CaretSetPos(&dm); }
-        #endif
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_SIZE
 
@@ -311,18 +1172,31 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 #endif
 
     case WM_PAINT:
+        // a pending shift of the contents is done first (its repaint is the nested WM_PAINT)
+        FlushView(hwnd, &dm);
+        if (!GetUpdateRect(hwnd, NULL, FALSE)) { break; }
+
         hdc = BeginPaint(hwnd, &ps);
         SelectObject(hdc, GetStockObject(SYSTEM_FIXED_FONT));
 
         DisplayModel(hdc, &dm);
 
         EndPaint(hwnd, &ps);
+        LATENCY_PAINT_DONE();
         break;
     // WM_PAINT
 
+    case WM_TIMER:
+        // changes of the view which no input flushed
+        if (wParam == VIEW_TIMER_ID) { FlushView(hwnd, &dm); }
+        break;
+    // WM_TIMER
+
     case WM_HSCROLL:
         if (dm.mode != FORMAT_MODE_DEFAULT) { break; }
 
+        LATENCY_INPUT(LATENCY_OP_SCROLL);
+
         switch (LOWORD(wParam)) {
         case SB_LINEUP:
             #ifdef CARET_ON
@@ -359,7 +1233,7 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             break;
 
         case SB_THUMBTRACK: {
-            size_t absolutePos = GetAbsolutePos(HIWORD(wParam), dm.scrollBars.horizontal.maxPos);
+            size_t absolutePos = GetAbsoluteTrackPos(hwnd, &dm.scrollBars.horizontal, SB_HORZ);
 
             if (dm.scrollBars.horizontal.pos > absolutePos) {
                 #ifdef CARET_ON
@@ -386,13 +1260,15 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             break;
         }
 
-        #ifdef CARET_ON
-            CaretSetPos(&dm);
-        #endif
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_HSCROLL
 
     case WM_VSCROLL:
+        LATENCY_INPUT(LATENCY_OP_SCROLL);
+
         #ifdef CARET_ON
             switch (dm.mode) {
             case FORMAT_MODE_DEFAULT:
@@ -444,7 +1320,7 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             break;
 
         case SB_THUMBTRACK: {
-            size_t absolutePos = GetAbsolutePos(HIWORD(wParam), dm.scrollBars.vertical.maxPos);
+            size_t absolutePos = GetAbsoluteTrackPos(hwnd, &dm.scrollBars.vertical, SB_VERT);
 
             if (dm.scrollBars.vertical.pos > absolutePos) {
                 #ifdef CARET_ON
@@ -472,13 +1348,15 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
             break;
         }
 
-        #ifdef CARET_ON
-            CaretSetPos(&dm);
-        #endif
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_VSCROLL
 
     case WM_KEYDOWN:
+        LATENCY_INPUT(LATENCY_OP_KEYDOWN);
+
         #ifdef CARET_ON
             FindCaret(hwnd, &dm, &rectangle);
         #endif
@@ -486,26 +1364,21 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
         switch (wParam) {
         case VK_UP:
             #ifdef CARET_ON
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    if (dm.caret.modelPos.pos.y > 0) {
-                        CaretMoveToTop_Default(hwnd, &dm, &rectangle);
-
-                        if (dm.caret.modelPos.pos.x > dm.caret.modelPos.block->data.len) {
-                            FindLeftEnd_Default(hwnd, &dm, &rectangle);
-                        }
-                    }
-                    break;
-
-                case FORMAT_MODE_WRAP:
-                    if (dm.caret.linePos > 0) {
-                        CaretMoveToTop_Wrap(hwnd, &dm, &rectangle);
-                    }
+                // Shift+arrow selects columns
+                if (GetKeyState(VK_SHIFT) < 0) {
+                    ColumnSelect(hwnd, &dm, UP, &rectangle);
                     break;
+                }
 
-                default:
+                // Ctrl+Alt+Up/Down adds a caret above/below the carets
+                if (GetKeyState(VK_CONTROL) < 0 && GetKeyState(VK_MENU) < 0) {
+                    MultiCaretAdd(hwnd, &dm, UP, &rectangle);
                     break;
                 }
+
+                AddInputKey(&inputBatch, wParam, LOWORD(lParam));
+                DrainInput(hwnd, &inputBatch);
+                ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
             #else
                 PostMessage(hwnd, WM_VSCROLL, SB_LINEUP, (LPARAM)0);
             #endif
@@ -513,26 +1386,21 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_DOWN:
             #ifdef CARET_ON
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    if (dm.caret.modelPos.pos.y < DECREMENT_OF(dm.documentArea.lines)) {
-                        CaretMoveToBottom_Default(hwnd, &dm, &rectangle);
-
-                        if (dm.caret.modelPos.pos.x > dm.caret.modelPos.block->data.len) {
-                            FindLeftEnd_Default(hwnd, &dm, &rectangle);
-                        }
-                    }
-                    break;
-
-                case FORMAT_MODE_WRAP:
-                    if (dm.caret.linePos < DECREMENT_OF(dm.wrapModel.lines)) {
-                        CaretMoveToBottom_Wrap(hwnd, &dm, &rectangle);
-                    }
+                // Shift+arrow selects columns
+                if (GetKeyState(VK_SHIFT) < 0) {
+                    ColumnSelect(hwnd, &dm, DOWN, &rectangle);
                     break;
+                }
 
-                default:
+                // Ctrl+Alt+Up/Down adds a caret above/below the carets
+                if (GetKeyState(VK_CONTROL) < 0 && GetKeyState(VK_MENU) < 0) {
+                    MultiCaretAdd(hwnd, &dm, DOWN, &rectangle);
                     break;
                 }
+
+                AddInputKey(&inputBatch, wParam, LOWORD(lParam));
+                DrainInput(hwnd, &inputBatch);
+                ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
             #else
                 PostMessage(hwnd, WM_VSCROLL, SB_LINEDOWN, (LPARAM)0);
             #endif
@@ -540,28 +1408,14 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_LEFT:
             #ifdef CARET_ON
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    if (dm.caret.modelPos.pos.x > 0) {
-                        CaretMoveToLeft_Default(hwnd, &dm, &rectangle);
-                    } else if (dm.caret.modelPos.pos.y > 0) {
-                        CaretMoveToTop_Default(hwnd, &dm, &rectangle);
-                        FindRightEnd_Default(hwnd, &dm, &rectangle);
-                    }
-                    break;
-
-                case FORMAT_MODE_WRAP:
-                    if (dm.caret.clientPos.x > 0) {
-                        CaretMoveToLeft_Wrap(&dm);
-                    } else if (dm.caret.linePos > 0) {
-                        CaretMoveToTop_Wrap(hwnd, &dm, &rectangle);
-                        FindRightEnd_Wrap(&dm);
-                    }
-                    break;
-
-                default:
+                if (GetKeyState(VK_SHIFT) < 0) {
+                    ColumnSelect(hwnd, &dm, LEFT, &rectangle);
                     break;
                 }
+
+                AddInputKey(&inputBatch, wParam, LOWORD(lParam));
+                DrainInput(hwnd, &inputBatch);
+                ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
             #else
                 PostMessage(hwnd, WM_HSCROLL, SB_LINEUP, (LPARAM)0);
             #endif
@@ -569,56 +1423,22 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_RIGHT:
             #ifdef CARET_ON
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    if (dm.caret.modelPos.pos.x < dm.caret.modelPos.block->data.len) {
-                        CaretMoveToRight_Default(hwnd, &dm, &rectangle);
-                    } else if (dm.caret.modelPos.pos.y < DECREMENT_OF(dm.documentArea.lines)) {
-                        CaretMoveToBottom_Default(hwnd, &dm, &rectangle);
-                        if (dm.caret.modelPos.pos.x) { FindHome_Default(hwnd, &dm, &rectangle); }
-                    }
-                    break;
-
-                case FORMAT_MODE_WRAP:
-                    if (dm.caret.modelPos.pos.x < dm.caret.modelPos.block->data.len
-                        && dm.caret.clientPos.x < dm.clientArea.chars) {
-                        CaretMoveToRight_Wrap(&dm);
-                    } else if (dm.caret.linePos < DECREMENT_OF(dm.wrapModel.lines)) {
-                        CaretMoveToBottom_Wrap(hwnd, &dm, &rectangle);
-                        if (dm.caret.clientPos.x) { FindHome_Wrap(&dm); }
-                    }
-                    break;
-
-                default:
+                if (GetKeyState(VK_SHIFT) < 0) {
+                    ColumnSelect(hwnd, &dm, RIGHT, &rectangle);
                     break;
                 }
+
+                AddInputKey(&inputBatch, wParam, LOWORD(lParam));
+                DrainInput(hwnd, &inputBatch);
+                ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
             #else
                 PostMessage(hwnd, WM_HSCROLL, SB_LINEDOWN, (LPARAM)0);
             #endif
-
             break;
 
         case VK_PRIOR:
             #ifdef CARET_ON
-                if (dm.mode != FORMAT_MODE_DEFAULT) { break; }
-
-                if (dm.scrollBars.vertical.pos > 0) {
-                    CaretPageUp(hwnd, &dm, &rectangle);
-
-                    switch (dm.mode) {
-                    case FORMAT_MODE_DEFAULT:
-                        if (dm.caret.modelPos.pos.x > dm.caret.modelPos.block->data.len) {
-                            FindLeftEnd_Default(hwnd, &dm, &rectangle);
-                        }
-                        break;
-
-                    case FORMAT_MODE_WRAP:
-                        FindLeftEnd_Wrap(&dm);
-                        break;
-                    default:
-                        break;
-                    }
-                }
+                CaretPageUp(hwnd, &dm, &rectangle);
             #else
                 PostMessage(hwnd, WM_VSCROLL, SB_PAGEUP, (LPARAM)0);
             #endif
@@ -626,25 +1446,7 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_NEXT:
             #ifdef CARET_ON
-                if (dm.mode != FORMAT_MODE_DEFAULT) { break; }
-
-                if (dm.scrollBars.vertical.maxPos - dm.scrollBars.vertical.pos > 0) {
-                    CaretPageDown(hwnd, &dm, &rectangle);
-
-                    switch (dm.mode) {
-                    case FORMAT_MODE_DEFAULT:
-                        if (dm.caret.modelPos.pos.x > dm.caret.modelPos.block->data.len) {
-                            FindLeftEnd_Default(hwnd, &dm, &rectangle);
-                        }
-                        break;
-
-                    case FORMAT_MODE_WRAP:
-                        FindLeftEnd_Wrap(&dm);
-                        break;
-                    default:
-                        break;
-                    }
-                }
+                CaretPageDown(hwnd, &dm, &rectangle);
             #else
                 PostMessage(hwnd, WM_VSCROLL, SB_PAGEDOWN, (LPARAM)0);
             #endif
@@ -652,6 +1454,17 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_HOME:
             #ifdef CARET_ON
+                ColumnClear(hwnd, &dm);
+                if (GetKeyState(VK_CONTROL) < 0) {
+                    CaretGoToStart(hwnd, &dm, &rectangle);
+                    break;
+                }
+
+                if (dm.carets.len > 1) {
+                    MultiCaretMove(hwnd, &dm, CARETS_HOME, 1, &rectangle);
+                    break;
+                }
+
                 switch (dm.mode) {
                 case FORMAT_MODE_DEFAULT:
                     if (dm.caret.modelPos.pos.x) { FindHome_Default(hwnd, &dm, &rectangle); }
@@ -670,6 +1483,17 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         case VK_END:
             #ifdef CARET_ON
+                ColumnClear(hwnd, &dm);
+                if (GetKeyState(VK_CONTROL) < 0) {
+                    CaretGoToEnd(hwnd, &dm, &rectangle);
+                    break;
+                }
+
+                if (dm.carets.len > 1) {
+                    MultiCaretMove(hwnd, &dm, CARETS_END, 1, &rectangle);
+                    break;
+                }
+
                 switch (dm.mode) {
                 case FORMAT_MODE_DEFAULT:
                     FindRightEnd_Default(hwnd, &dm, &rectangle);
@@ -689,167 +1513,209 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
         #ifdef CARET_ON
             case VK_DELETE:
-                    HideCaret(hwnd);
-
-                    if (dm.caret.modelPos.block->data.len && dm.caret.modelPos.pos.x < dm.caret.modelPos.block->data.len) {
-                        CaretDeleteChar(hwnd, &dm);
-                    } else if (dm.caret.modelPos.block->next) {
-                        CaretDeleteBlock(hwnd, &dm);
-                    }
-
-                    InvalidateRect(hwnd, NULL, TRUE);
-                    UpdateWindow(hwnd);
-
-                    ShowCaret(hwnd);
+                    AddInputKey(&inputBatch, wParam, LOWORD(lParam));
+                    DrainInput(hwnd, &inputBatch);
+                    ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
+                    LATENCY_MODEL_DONE();
 
                     #ifndef NDEBUG // ======================= /
                         PrintDocumentParameters(NULL, doc);
                     #endif // =============================== /
                 break;
             // VK_DELETE
+
+            case VK_ESCAPE:
+                MultiCaretClear(hwnd, &dm);
+                ColumnClear(hwnd, &dm);
+                break;
         #endif
 
+        case VK_F2:
+            if (GetKeyState(VK_CONTROL) < 0) {
+                PostMessage(hwnd, WM_COMMAND, IDM_BOOKMARK_TOGGLE, 0L);
+            } else {
+                PostMessage(hwnd, WM_COMMAND, GetKeyState(VK_SHIFT) < 0 ? IDM_BOOKMARK_PREV : IDM_BOOKMARK_NEXT, 0L);
+            }
+            break;
+
+        case VK_F3:
+            PostMessage(hwnd, WM_COMMAND, GetKeyState(VK_SHIFT) < 0 ? IDM_SEARCH_PREV : IDM_SEARCH_NEXT, 0L);
+            break;
+
+        case VK_F4:
+            PostMessage(hwnd, WM_COMMAND, IDM_SEARCH_NEXT_RESULT, 0L);
+            break;
+
+        case 'G':
+            if (GetKeyState(VK_CONTROL) < 0) { PostMessage(hwnd, WM_COMMAND, IDM_SEARCH_GO_TO, 0L); }
+            break;
+
+        case 'Z':
+            if (GetKeyState(VK_CONTROL) < 0) { PostMessage(hwnd, WM_COMMAND, IDM_EDIT_UNDO, 0L); }
+            break;
+
+        case 'Y':
+            if (GetKeyState(VK_CONTROL) < 0) { PostMessage(hwnd, WM_COMMAND, IDM_EDIT_REDO, 0L); }
+            break;
+
+        case 'C':
+            if (GetKeyState(VK_CONTROL) < 0) { PostMessage(hwnd, WM_COMMAND, IDM_EDIT_COPY, 0L); }
+            break;
+
+        case 'X':
+            if (GetKeyState(VK_CONTROL) < 0) { PostMessage(hwnd, WM_COMMAND, IDM_EDIT_CUT, 0L); }
+            break;
+
         default:
             break;
         }
 
+        LATENCY_MODEL_DONE();
+
         #ifdef CARET_ON
             // CaretPrintParams(&dm);
-            CaretSetPos(&dm);
+            REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
         #endif
+
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_KEYDOWN
 
     #ifdef CARET_ON
     case WM_CHAR:
-        FindCaret(hwnd, &dm, &rectangle);
+        LATENCY_INPUT(LATENCY_OP_CHAR);
 
-        for(int i = 0; i < (int) LOWORD(lParam); i++) {
-            switch(wParam) {
-            case '\b' : // backspace
-                if(dm.caret.modelPos.pos.y || dm.caret.modelPos.pos.x) {
-                    if (dm.caret.modelPos.pos.x && !dm.caret.clientPos.x) {
-                        SendMessage(hwnd, WM_KEYDOWN, VK_LEFT, 1L);
-                    }
-                    SendMessage(hwnd, WM_KEYDOWN, VK_LEFT, 1L);
-                    SendMessage(hwnd, WM_KEYDOWN, VK_DELETE, 1L);
-                }
-                break;
-
-            case '\t' : // tab
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    do {
-                        SendMessage(hwnd, WM_CHAR, ' ', 1L);
-                    } while(dm.caret.modelPos.pos.x % 8 != 0);
-                    break;
+        FindCaret(hwnd, &dm, &rectangle);
 
-                case FORMAT_MODE_WRAP:
-                    do {
-                        SendMessage(hwnd, WM_CHAR, ' ', 1L);
-                    } while(dm.caret.clientPos.x % 8 != 0 && dm.caret.clientPos.x < dm.clientArea.chars);
+        // typed chars, tabs and backspaces of the queue are one model operation and one repaint
+        if (AddInputChar(&inputBatch, (char) wParam, LOWORD(lParam))) {
+            DrainInput(hwnd, &inputBatch);
+            ApplyInputBatch(hwnd, &dm, &inputBatch, &rectangle);
+            LATENCY_MODEL_DONE();
+
+            #ifndef NDEBUG // ======================= /
+                PrintDocumentParameters(NULL, doc);
+            #endif // =============================== /
+        } else {
+            for(int i = 0; i < (int) LOWORD(lParam); i++) {
+                switch(wParam) {
+                case '\a' :   // Ctrl+G (Go to)
+                case '\x03' : // Ctrl+C (Copy)
+                case '\x18' : // Ctrl+X (Cut)
+                case '\x19' : // Ctrl+Y (Redo)
+                case '\x1a' : // Ctrl+Z (Undo)
                     break;
 
-                default:
+                case '\n' : // line feed
+                    printf("line feed\n");
                     break;
-                }
-                break;
 
-            case '\n' : // line feed
-                printf("line feed\n");
-                break;
+                case '\r' : { // carriage return
+                    int flag = 0;
 
-            case '\r' : { // carriage return
-                int flag = 0;
-                
-                HideCaret(hwnd);
-
-                CaretAddBlock(hwnd, &dm);
-
-                printf("%u\n", DIV_WITH_ROUND_UP(dm.caret.modelPos.pos.x, dm.clientArea.chars));
-
-                // TODO: fix this because it's not good
-                if (dm.mode == FORMAT_MODE_WRAP && dm.caret.modelPos.pos.x >= dm.clientArea.chars
-                    && (!dm.caret.clientPos.x || dm.caret.clientPos.x == dm.clientArea.chars)) {
-                    flag = 1;
-                }
-
-                PostMessage(hwnd, WM_KEYDOWN, VK_RIGHT, (LPARAM)0);
-
-                if (flag) {
-                    --dm.caret.clientPos.y;
-                }
-
-                InvalidateRect(hwnd, NULL, TRUE);
-                UpdateWindow(hwnd);
+                    ColumnClear(hwnd, &dm);
+                    if (dm.carets.len > 1) {
+                        MultiCaretAddBlock(hwnd, &dm, &rectangle);
+                        LATENCY_MODEL_DONE();
+                        break;
+                    }
 
-                ShowCaret(hwnd);
+                    CaretAddBlock(hwnd, &dm);
+                    LATENCY_MODEL_DONE();
 
-                #ifndef NDEBUG // ======================= /
-                    PrintDocumentParameters(NULL, doc);
-                #endif // =============================== /
-            }
-                break;
+                    printf("%u\n", DIV_WITH_ROUND_UP(dm.caret.modelPos.pos.x, dm.clientArea.chars));
 
-            default : // character codes
-                HideCaret(hwnd);
-                CaretAddChar(hwnd, &dm, (char) wParam);
+                    // TODO: fix this because it's not good
+                    if (dm.mode == FORMAT_MODE_WRAP && dm.caret.modelPos.pos.x >= dm.clientArea.chars
+                        && (!dm.caret.clientPos.x || dm.caret.clientPos.x == dm.clientArea.chars)) {
+                        flag = 1;
+                    }
 
-                // TODO: not fixed bugs of line translate in wrap model
-                // PostMessage(hwnd, WM_KEYDOWN, VK_RIGHT, (LPARAM)0);
+                    PostMessage(hwnd, WM_KEYDOWN, VK_RIGHT, (LPARAM)0);
 
-                switch (dm.mode) {
-                case FORMAT_MODE_DEFAULT:
-                    if (dm.caret.modelPos.pos.x < dm.caret.modelPos.block->data.len) {
-                        CaretMoveToRight_Default(hwnd, &dm, &rectangle);
-                    } else if (dm.caret.modelPos.pos.y < DECREMENT_OF(dm.documentArea.lines)) {
-                        CaretMoveToBottom_Default(hwnd, &dm, &rectangle);
-                        if (dm.caret.modelPos.pos.x) { FindHome_Default(hwnd, &dm, &rectangle); }
+                    if (flag) {
+                        --dm.caret.clientPos.y;
                     }
-                    break;
 
-                case FORMAT_MODE_WRAP:
-                    if (dm.caret.modelPos.pos.x < dm.caret.modelPos.block->data.len
-                        && dm.caret.clientPos.x < dm.clientArea.chars) {
-                        CaretMoveToRight_Wrap(&dm);
-                    } else if (dm.caret.linePos < DECREMENT_OF(dm.wrapModel.lines)) {
-                        CaretMoveToBottom_Wrap(hwnd, &dm, &rectangle);
-                        if (dm.caret.clientPos.x) { FindHome_Wrap(&dm); }
-                        CaretMoveToRight_Wrap(&dm);
-                    }
+                    #ifndef NDEBUG // ======================= /
+                        PrintDocumentParameters(NULL, doc);
+                    #endif // =============================== /
+                }
                     break;
 
                 default:
                     break;
                 }
-
-                InvalidateRect(hwnd, NULL, TRUE);
-                UpdateWindow(hwnd);
-
-                ShowCaret(hwnd);
-
-                #ifndef NDEBUG // ======================= /
-                    PrintDocumentParameters(NULL, doc);
-                #endif // =============================== /
-                break;
             }
         }
 
         // CaretPrintParams(&dm);
-        CaretSetPos(&dm);
+        REPLAY_MOVE(dm.caret.modelPos.pos.y, dm.caret.modelPos.pos.x);
+        UpdateView(hwnd, &dm);
+
+        LATENCY_INPUT_DONE(GetUpdateRect(hwnd, NULL, FALSE));
         break;
     // WM_CHAR
     #endif
 
     case WM_DESTROY:
+        DestroyFindAll(&findAll);
+        DestroyIncrementalSearch(&typedSearch);
+        DestroyTrigramIndex(&trigramIndex);
+        DestroyFindInFiles(&fileSearch);
+        free(fileResults);
+        DestroyHighlight(&dm.highlight);
+        FreeDisplayedModel(&dm);
+        DestroyThreadPool(&pool);
         if (doc) { DestroyDocument(&doc); }
         if (pstrTitle) { free(pstrTitle); }
+        LatencyShutdown();
+        CountersShutdown();
+        TraceShutdown();
+        ReplayStop();
 
         PostQuitMessage(0); /* send a WM_QUIT to the message queue */
         break;
     // WM_DESTROY
 
-    default: /* for messages that we don't deal with */
+    default:
+        // notification of the Find dialog
+        if (message == findMessage && findMessage) {
+            const FINDREPLACE* pfr = (const FINDREPLACE*) lParam;
+
+            if (pfr->Flags & FR_DIALOGTERM) {
+                hDlgFind = NULL;
+            } else if (pfr->Flags & FR_FINDNEXT) {
+                // the results of the search belong to the previous query
+                if (findAll && strcmp(findAllWhat, findWhat)) { DestroyFindAll(&findAll); }
+
+                SendMessage(hwnd, WM_COMMAND, (pfr->Flags & FR_DOWN) ? IDM_SEARCH_NEXT : IDM_SEARCH_PREV, 0L);
+            } else if (pfr->Flags & FR_REPLACE) {
+                // the occurrence is replaced by Replace all only, so Replace finds the next one
+                SendMessage(hwnd, WM_COMMAND, IDM_SEARCH_NEXT, 0L);
+            } else if (pfr->Flags & FR_REPLACEALL) {
+                // occurrences of the typed query are changed
+                DestroyIncrementalSearch(&typedSearch);
+
+                switch (ReplaceAllText(hwnd, &dm, doc, pfr, isRegex)) {
+                case 0:
+                    MessageBox(hwnd, "Cannot find the text", szClassName, MB_OK | MB_ICONINFORMATION);
+                    break;
+                case -1:
+                    MessageBox(hwnd, "Invalid regular expression or replacement", szClassName, MB_OK | MB_ICONWARNING);
+                    break;
+                default:
+                    InvalidateView(hwnd, &dm);
+                    UpdateView(hwnd, &dm);
+                    break;
+                }
+            }
+            break;
+        }
+
+        /* for messages that we don't deal with */
         return DefWindowProc(hwnd, message, wParam, lParam);
     }
 